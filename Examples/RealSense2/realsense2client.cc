@@ -139,6 +139,9 @@ void RunTracker(void * param) try
       threadParam->timesTrack.push_back(ttrack);
    }
 
+   // track the images still in the pipeline
+   threadParam->tracker->Flush();
+
    threadParam->returnCode = EXIT_SUCCESS;
    gOutTrak.Print("end RunTracker");
 }
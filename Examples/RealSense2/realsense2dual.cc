@@ -146,6 +146,9 @@ void RunTracker(int threadId) try
       gThreadParams[threadId].timesTrack.push_back(ttrack);
    }
 
+   // track the images still in the pipeline
+   gThreadParams[threadId].tracker->Flush();
+
    gThreadParams[threadId].returnCode = EXIT_SUCCESS;
    gOutTrak.Print("end RunTracker");
 }
@@ -264,7 +267,7 @@ int main(int paramc, char * paramv[]) try
    cv::FileStorage mapperSettings(gMapperFilename, cv::FileStorage::READ);
    VerifySettings(mapperSettings, gMapperFilename);
 
-   MapperServer mapperServer(vocab, false, 2);
+   MapperServer mapperServer(vocab, false, 2, (int)mapperSettings["Mapper.nThreads"]);
    vMapperClients.push_back(&mapperServer);
    MapDrawer mapDrawer(mapperSettings, mapperServer);
 
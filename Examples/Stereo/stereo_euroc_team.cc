@@ -236,6 +236,9 @@ void RunTracker(int threadId) try
    //SLAM.SaveTrajectoryTUM("CameraTrajectory.txt");
    //SLAM.SaveKeyFrameTrajectoryTUM("KeyFrameTrajectory.txt");   
 
+   // track the images still in the pipeline
+   pTracker->Flush();
+
    gThreadParams[threadId].returnCode = EXIT_SUCCESS;
    gOutTrak.Print("end RunTracker");
 }
@@ -350,7 +353,7 @@ int main(int paramc, char * paramv[]) try
    cv::FileStorage mapperSettings(gMapperFileName, cv::FileStorage::READ);
    VerifySettings(mapperSettings, gMapperFileName);
 
-   MapperServer mapperServer(vocab, false, gTrackerQuantity);
+   MapperServer mapperServer(vocab, false, gTrackerQuantity, (int)mapperSettings["Mapper.nThreads"]);
    vMapperClients.push_back(&mapperServer);
    MapDrawer mapDrawer(mapperSettings, mapperServer);
 
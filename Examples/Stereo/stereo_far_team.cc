@@ -259,6 +259,9 @@ void RunTracker(int threadId) try
          sleep(T/1e3 - ttrack*1e6);
    }
 
+   // track the images still in the pipeline
+   pTracker->Flush();
+
    gThreadParams[threadId].returnCode = EXIT_SUCCESS;
    gOutTrak.Print("end RunTracker");
 }
@@ -388,7 +391,7 @@ int main(int paramc, char * paramv[]) try
    cv::FileStorage mapperSettings(gMapperFileName, cv::FileStorage::READ);
    VerifySettings(mapperSettings, gMapperFileName);
 
-   MapperServer mapperServer(vocab, false, gTrackerQuantity);
+   MapperServer mapperServer(vocab, false, gTrackerQuantity, (int)mapperSettings["Mapper.nThreads"]);
    MapDrawer mapDrawer(mapperSettings, mapperServer);
 
    gThreadParams.resize(gTrackerQuantity);
@@ -67,8 +67,14 @@ void BaseBinaryEdge<D, E, VertexXiType, VertexXjType>::constructQuadraticForm()
 
   if (fromNotFixed || toNotFixed) {
 #ifdef G2O_OPENMP
-    from->lockQuadraticForm();
-    to->lockQuadraticForm();
+    // lock in the order of the vertex ids, so two edges between the same vertices cannot deadlock
+    if (from->id() < to->id()) {
+      from->lockQuadraticForm();
+      to->lockQuadraticForm();
+    } else {
+      to->lockQuadraticForm();
+      from->lockQuadraticForm();
+    }
 #endif
     const InformationType& omega = _information;
     Matrix<double, D, 1> omega_r = - omega * _error;
@@ -140,8 +146,13 @@ void BaseBinaryEdge<D, E, VertexXiType, VertexXjType>::linearizeOplus()
     return;
 
 #ifdef G2O_OPENMP
-  vi->lockQuadraticForm();
-  vj->lockQuadraticForm();
+  if (vi->id() < vj->id()) {
+    vi->lockQuadraticForm();
+    vj->lockQuadraticForm();
+  } else {
+    vj->lockQuadraticForm();
+    vi->lockQuadraticForm();
+  }
 #endif
 
   const double delta = 1e-9;
@@ -347,6 +347,8 @@ bool BlockSolver<Traits>::updateStructure(const std::vector<HyperGraph::Vertex*>
 
   }
 
+  // the Hessian has new blocks
+  _linearSolver->init();
   return true;
 }
 
@@ -376,7 +378,7 @@ bool BlockSolver<Traits>::solve(){
   //_DInvSchur->clear();
   memset (_coefficients, 0, _sizePoses*sizeof(double));
 # ifdef G2O_OPENMP
-# pragma omp parallel for default (shared) schedule(dynamic, 10)
+# pragma omp parallel for default (shared) schedule(dynamic, 10) num_threads(_optimizer->numThreads()) if (_optimizer->numThreads() > 1)
 # endif
   for (int landmarkIndex = 0; landmarkIndex < static_cast<int>(_Hll->blockCols().size()); ++landmarkIndex) {
     const typename SparseBlockMatrix<LandmarkMatrixType>::IntBlockMap& marginalizeColumn = _Hll->blockCols()[landmarkIndex];
@@ -503,7 +505,7 @@ bool BlockSolver<Traits>::buildSystem()
 {
   // clear b vector
 # ifdef G2O_OPENMP
-# pragma omp parallel for default (shared) if (_optimizer->indexMapping().size() > 1000)
+# pragma omp parallel for default (shared) num_threads(_optimizer->numThreads()) if (_optimizer->numThreads() > 1 && _optimizer->indexMapping().size() > 1000)
 # endif
   for (int i = 0; i < static_cast<int>(_optimizer->indexMapping().size()); ++i) {
     OptimizableGraph::Vertex* v=_optimizer->indexMapping()[i];
@@ -524,7 +526,7 @@ bool BlockSolver<Traits>::buildSystem()
 # else
   // if running with threads need to produce copies of the workspace for each thread
   JacobianWorkspace jacobianWorkspace = _optimizer->jacobianWorkspace();
-# pragma omp parallel for default (shared) firstprivate(jacobianWorkspace) if (_optimizer->activeEdges().size() > 100)
+# pragma omp parallel for default (shared) firstprivate(jacobianWorkspace) num_threads(_optimizer->numThreads()) if (_optimizer->numThreads() > 1 && _optimizer->activeEdges().size() > 100)
 # endif
   for (int k = 0; k < static_cast<int>(_optimizer->activeEdges().size()); ++k) {
     OptimizableGraph::Edge* e = _optimizer->activeEdges()[k];
@@ -546,7 +548,7 @@ bool BlockSolver<Traits>::buildSystem()
 
   // flush the current system in a sparse block matrix
 # ifdef G2O_OPENMP
-# pragma omp parallel for default (shared) if (_optimizer->indexMapping().size() > 1000)
+# pragma omp parallel for default (shared) num_threads(_optimizer->numThreads()) if (_optimizer->numThreads() > 1 && _optimizer->indexMapping().size() > 1000)
 # endif
   for (int i = 0; i < static_cast<int>(_optimizer->indexMapping().size()); ++i) {
     OptimizableGraph::Vertex* v=_optimizer->indexMapping()[i];
@@ -568,7 +570,7 @@ bool BlockSolver<Traits>::setLambda(double lambda, bool backup)
     _diagonalBackupLandmark.resize(_numLandmarks);
   }
 # ifdef G2O_OPENMP
-# pragma omp parallel for default (shared) if (_numPoses > 100)
+# pragma omp parallel for default (shared) num_threads(_optimizer->numThreads()) if (_optimizer->numThreads() > 1 && _numPoses > 100)
 # endif
   for (int i = 0; i < _numPoses; ++i) {
     PoseMatrixType *b=_Hpp->block(i,i);
@@ -577,7 +579,7 @@ bool BlockSolver<Traits>::setLambda(double lambda, bool backup)
     b->diagonal().array() += lambda;
   }
 # ifdef G2O_OPENMP
-# pragma omp parallel for default (shared) if (_numLandmarks > 100)
+# pragma omp parallel for default (shared) num_threads(_optimizer->numThreads()) if (_optimizer->numThreads() > 1 && _numLandmarks > 100)
 # endif
   for (int i = 0; i < _numLandmarks; ++i) {
     LandmarkMatrixType *b=_Hll->block(i,i);
@@ -614,8 +616,10 @@ bool BlockSolver<Traits>::init(SparseOptimizer* optimizer, bool online)
       _Hpl->clear();
     if (_Hll)
       _Hll->clear();
+    // an online pass solves the structure of the previous pass, or the one grown by updateStructure,
+    // so the symbolic factorization of the linear solver is only reset here
+    _linearSolver->init();
   }
-  _linearSolver->init();
   return true;
 }
 
@@ -66,9 +66,7 @@ namespace g2o {
 
   template <class MatrixType>
   void SparseBlockMatrix<MatrixType>::clear(bool dealloc) {
-#   ifdef G2O_OPENMP
-#   pragma omp parallel for default (shared) if (_blockCols.size() > 100)
-#   endif
+    // serial: the matrix does not know the thread count of the optimizer that owns it
     for (int i=0; i < static_cast<int>(_blockCols.size()); ++i) {
       for (typename SparseBlockMatrix<MatrixType>::IntBlockMap::const_iterator it=_blockCols[i].begin(); it!=_blockCols[i].end(); ++it){
         typename SparseBlockMatrix<MatrixType>::SparseMatrixBlock* b=it->second;
@@ -294,9 +292,7 @@ namespace g2o {
     Eigen::Map<VectorXd> destVec(dest, destSize);
     Eigen::Map<const VectorXd> srcVec(src, rows());
 
-#   ifdef G2O_OPENMP
-#   pragma omp parallel for default (shared) schedule(dynamic, 10)
-#   endif
+    // serial: the matrix does not know the thread count of the optimizer that owns it
     for (int i=0; i < static_cast<int>(_blockCols.size()); ++i){
       int destOffset = colBaseOfBlock(i);
       for (typename SparseBlockMatrix<MatrixType>::IntBlockMap::const_iterator it=_blockCols[i].begin(); 
@@ -48,7 +48,7 @@ namespace g2o{
 
 
   SparseOptimizer::SparseOptimizer() :
-    _forceStopFlag(0), _verbose(false), _algorithm(0), _computeBatchStatistics(false)
+    _forceStopFlag(0), _verbose(false), _algorithm(0), _computeBatchStatistics(false), _numThreads(1)
   {
     _graphActions.resize(AT_NUM_ELEMENTS);
   }
@@ -68,7 +68,7 @@ namespace g2o{
     }
 
 #   ifdef G2O_OPENMP
-#   pragma omp parallel for default (shared) if (_activeEdges.size() > 50)
+#   pragma omp parallel for default (shared) num_threads(_numThreads) if (_numThreads > 1 && _activeEdges.size() > 50)
 #   endif
     for (int k = 0; k < static_cast<int>(_activeEdges.size()); ++k) {
       OptimizableGraph::Edge* e = _activeEdges[k];
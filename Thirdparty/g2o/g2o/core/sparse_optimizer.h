@@ -278,6 +278,15 @@ namespace g2o {
     
     bool computeBatchStatistics() const { return _computeBatchStatistics;}
 
+    /**
+     * number of OpenMP threads that evaluate the errors and Jacobians of the edges and
+     * accumulate the Schur complement, 1 (the default) runs single-threaded.
+     * It has no effect unless g2o is built with G2O_OPENMP.
+     */
+    void setNumThreads(int numThreads) { _numThreads = numThreads < 1 ? 1 : numThreads;}
+
+    int numThreads() const { return _numThreads;}
+
     /**** callbacks ****/
     //! add an action to be executed before the error vectors are computed
     bool addComputeErrorAction(HyperGraphAction* action);
@@ -306,6 +315,7 @@ namespace g2o {
 
     BatchStatisticsContainer _batchStatistics;   ///< global statistics of the optimizer, e.g., timing, num-non-zeros
     bool _computeBatchStatistics;
+    int _numThreads;
   };
 } // end namespace
 
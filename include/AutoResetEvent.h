@@ -0,0 +1,66 @@
+/**
+* This file is part of ORB-SLAM2-TEAM.
+*
+* Copyright (C) 2018 Joe Bedard <mr dot joe dot bedard at gmail dot com>
+* For more information see <https://github.com/joebedard/ORB_SLAM2_TEAM>
+*
+* ORB-SLAM2-TEAM is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2-TEAM is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2-TEAM. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef AUTORESETEVENT_H
+#define AUTORESETEVENT_H
+
+#include <mutex>
+#include <condition_variable>
+
+namespace ORB_SLAM2_TEAM
+{
+
+   // Wakes up a waiting thread after another thread has changed some state the waiter checks.
+   // The event stays set until a Wait returns, so a Set between the waiter's check and its Wait is not lost.
+   class AutoResetEvent
+   {
+   public:
+
+      AutoResetEvent() : mbSet(false) {}
+
+      void Set()
+      {
+         {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mbSet = true;
+         }
+         mCond.notify_all();
+      }
+
+      // blocks until the event is set, then resets it
+      void Wait()
+      {
+         std::unique_lock<std::mutex> lock(mMutex);
+         mCond.wait(lock, [this] { return mbSet; });
+         mbSet = false;
+      }
+
+   private:
+
+      bool mbSet;
+
+      std::mutex mMutex;
+
+      std::condition_variable mCond;
+   };
+
+}
+
+#endif // AUTORESETEVENT_H
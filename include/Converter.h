@@ -35,6 +35,7 @@ namespace ORB_SLAM2_TEAM
       static std::vector<cv::Mat> toDescriptorVector(const cv::Mat &Descriptors);
 
       static g2o::SE3Quat toSE3Quat(const cv::Mat &cvT);
+      static g2o::SE3Quat toSE3Quat(const cv::Matx44f &T);
       static g2o::SE3Quat toSE3Quat(const g2o::Sim3 &gSim3);
 
       static cv::Mat toCvMat(const g2o::SE3Quat &SE3);
@@ -48,7 +49,9 @@ namespace ORB_SLAM2_TEAM
 
       static Eigen::Matrix<double, 3, 1> toVector3d(const cv::Mat &cvVector);
       static Eigen::Matrix<double, 3, 1> toVector3d(const cv::Point3f &cvPoint);
+      static Eigen::Matrix<double, 3, 1> toVector3d(const cv::Vec3f &v);
       static Eigen::Matrix<double, 3, 3> toMatrix3d(const cv::Mat &cvMat3);
+      static Eigen::Matrix<double, 3, 3> toMatrix3d(const cv::Matx33f &M);
 
       static std::vector<float> toQuaternion(const cv::Mat &M);
    };
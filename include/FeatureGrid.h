@@ -0,0 +1,134 @@
+/**
+* This file is part of ORB-SLAM2-TEAM.
+*
+* Copyright (C) 2018 Joe Bedard <mr dot joe dot bedard at gmail dot com>
+* For more information see <https://github.com/joebedard/ORB_SLAM2_TEAM>
+*
+* ORB-SLAM2-TEAM is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2-TEAM is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2-TEAM. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FEATUREGRID_H
+#define FEATUREGRID_H
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+#include "FeatureStore.h"
+#include "FrameCalibration.h"
+
+namespace ORB_SLAM2_TEAM
+{
+
+   using namespace std;
+
+   // Keypoint indices grouped by grid cell, in compressed-row form. The indices of all cells are stored in
+   // one array, and cell c = x * FRAME_GRID_ROWS + y holds mvIndices[mvCellStart[c]] .. mvIndices[mvCellStart[c + 1] - 1].
+   // The cells of one grid column are adjacent, so each column of an area query is one contiguous range.
+   class FeatureGrid
+   {
+   public:
+
+      static const int CELLS = FRAME_GRID_COLS * FRAME_GRID_ROWS;
+
+      FeatureGrid();
+
+      // builds the grid in a counting pass, keypoints that fall outside the image bounds are left out
+      void Assign(const FeatureStore & features, const FrameCalibration & fc);
+
+      // calls visit(idx) for each keypoint inside the square of half-size r centered on (x, y);
+      // if minLevel > 0 or maxLevel >= 0, only for keypoints with an octave in [minLevel, maxLevel]
+      template<typename Visitor>
+      void ForEachInArea(const FeatureStore & features, const float x, const float y, const float r,
+         const int minLevel, const int maxLevel, Visitor visit) const;
+
+      // clears vIndices and fills it as ForEachInArea, no memory is allocated once vIndices has grown
+      void GetFeaturesInArea(const FeatureStore & features, const float x, const float y, const float r,
+         const int minLevel, const int maxLevel, vector<size_t> & vIndices) const;
+
+   private:
+
+      float mMinX;
+
+      float mMinY;
+
+      float mCellWidthInv;
+
+      float mCellHeightInv;
+
+      // CELLS + 1 offsets into mvIndices
+      vector<uint32_t> mvCellStart;
+
+      // keypoint indices sorted by cell, ascending within each cell
+      vector<uint16_t> mvIndices;
+
+      // returns -1 if the position is outside the grid
+      int CellOf(const float x, const float y) const;
+   };
+
+   template<typename Visitor>
+   void FeatureGrid::ForEachInArea(const FeatureStore & features, const float x, const float y, const float r,
+      const int minLevel, const int maxLevel, Visitor visit) const
+   {
+      if (mvCellStart.empty())
+         return;
+
+      const int nMinCellX = max(0, (int)floor((x - mMinX - r) * mCellWidthInv));
+      if (nMinCellX >= FRAME_GRID_COLS)
+         return;
+
+      const int nMaxCellX = min((int)FRAME_GRID_COLS - 1, (int)ceil((x - mMinX + r) * mCellWidthInv));
+      if (nMaxCellX < 0)
+         return;
+
+      const int nMinCellY = max(0, (int)floor((y - mMinY - r) * mCellHeightInv));
+      if (nMinCellY >= FRAME_GRID_ROWS)
+         return;
+
+      const int nMaxCellY = min((int)FRAME_GRID_ROWS - 1, (int)ceil((y - mMinY + r) * mCellHeightInv));
+      if (nMaxCellY < 0)
+         return;
+
+      const bool bCheckLevels = (minLevel > 0) || (maxLevel >= 0);
+      const float * pX = features.XData();
+      const float * pY = features.YData();
+      const int * pOctave = features.OctaveData();
+
+      for (int ix = nMinCellX; ix <= nMaxCellX; ix++)
+      {
+         const uint16_t * it = mvIndices.data() + mvCellStart[ix * FRAME_GRID_ROWS + nMinCellY];
+         const uint16_t * end = mvIndices.data() + mvCellStart[ix * FRAME_GRID_ROWS + nMaxCellY + 1];
+         for (; it != end; ++it)
+         {
+            const size_t idx = *it;
+            if (bCheckLevels)
+            {
+               if (pOctave[idx] < minLevel)
+                  continue;
+               if (maxLevel >= 0)
+                  if (pOctave[idx] > maxLevel)
+                     continue;
+            }
+
+            if (fabs(pX[idx] - x) < r && fabs(pY[idx] - y) < r)
+               visit(idx);
+         }
+      }
+   }
+
+}
+
+#endif // FEATUREGRID_H
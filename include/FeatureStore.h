@@ -0,0 +1,154 @@
+/**
+* This file is part of ORB-SLAM2-TEAM.
+*
+* Copyright (C) 2018 Joe Bedard <mr dot joe dot bedard at gmail dot com>
+* For more information see <https://github.com/joebedard/ORB_SLAM2_TEAM>
+*
+* ORB-SLAM2-TEAM is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2-TEAM is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2-TEAM. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FEATURESTORE_H
+#define FEATURESTORE_H
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <opencv2/core/core.hpp>
+
+namespace ORB_SLAM2_TEAM
+{
+
+   using namespace std;
+
+   // std::allocator does not honor alignments above 16 bytes before C++17
+   template<typename T, size_t Alignment>
+   class AlignedAllocator
+   {
+   public:
+      typedef T value_type;
+
+      template<typename U>
+      struct rebind
+      {
+         typedef AlignedAllocator<U, Alignment> other;
+      };
+
+      AlignedAllocator() {}
+
+      template<typename U>
+      AlignedAllocator(const AlignedAllocator<U, Alignment> &) {}
+
+      T * allocate(size_t n)
+      {
+         // the original pointer is stored just before the aligned block
+         void * raw = ::operator new(n * sizeof(T) + Alignment + sizeof(void *));
+         uintptr_t aligned = ((uintptr_t)raw + sizeof(void *) + Alignment - 1) & ~(uintptr_t)(Alignment - 1);
+         ((void **)aligned)[-1] = raw;
+         return (T *)aligned;
+      }
+
+      void deallocate(T * p, size_t n)
+      {
+         ::operator delete(((void **)p)[-1]);
+      }
+
+      template<typename U>
+      bool operator==(const AlignedAllocator<U, Alignment> &) const { return true; }
+
+      template<typename U>
+      bool operator!=(const AlignedAllocator<U, Alignment> &) const { return false; }
+   };
+
+   // Compact structure-of-arrays copy of the undistorted keypoints and their descriptors.
+   // Matching and optimization only read the position, octave and angle of a keypoint, so these are
+   // stored in separate contiguous arrays, and every descriptor row starts on a 32-byte boundary.
+   class FeatureStore
+   {
+   public:
+
+      static const int DESCRIPTOR_SIZE = 32;
+
+      FeatureStore();
+
+      // copies the keypoints and descriptors (one 32-byte row per keypoint)
+      void Assign(const vector<cv::KeyPoint> & keys, const cv::Mat & descriptors);
+
+      size_t Size() const {
+         return mvX.size();
+      }
+
+      float X(size_t i) const {
+         return mvX[i];
+      }
+
+      float Y(size_t i) const {
+         return mvY[i];
+      }
+
+      int Octave(size_t i) const {
+         return mvOctave[i];
+      }
+
+      float Angle(size_t i) const {
+         return mvAngle[i];
+      }
+
+      const float * XData() const {
+         return mvX.data();
+      }
+
+      const float * YData() const {
+         return mvY.data();
+      }
+
+      const int * OctaveData() const {
+         return mvOctave.data();
+      }
+
+      const unsigned char * Descriptor(size_t i) const {
+         return &mDescriptors[i * DESCRIPTOR_SIZE];
+      }
+
+      // rebuilds the keypoints, their size and response are not stored
+      void GetKeyPoints(vector<cv::KeyPoint> & keys) const;
+
+      // header for one descriptor row, the data is not copied
+      cv::Mat DescriptorRow(size_t i) const;
+
+      // header for all descriptor rows, the data is not copied
+      cv::Mat Descriptors() const;
+
+      size_t GetBufferSize() const;
+
+      void * ReadBytes(void * const buffer);
+
+      void * WriteBytes(void * const buffer) const;
+
+   private:
+
+      vector<float> mvX;
+
+      vector<float> mvY;
+
+      vector<int> mvOctave;
+
+      vector<float> mvAngle;
+
+      vector<unsigned char, AlignedAllocator<unsigned char, 32> > mDescriptors;
+   };
+
+}
+
+#endif // FEATURESTORE_H
@@ -24,6 +24,7 @@
 #define FRAME_H
 
 #include <vector>
+#include <atomic>
 
 #include "MapPoint.h"
 #include "DBoW2/BowVector.h"
@@ -32,6 +33,8 @@
 #include "KeyFrame.h"
 #include "ORBextractor.h"
 #include "FrameCalibration.h"
+#include "FeatureStore.h"
+#include "FeatureGrid.h"
 
 #include <opencv2/opencv.hpp>
 
@@ -60,44 +63,85 @@ namespace ORB_SLAM2_TEAM
       Frame(const cv::Mat &imGray, const double &timeStamp, ORBextractor* extractor, FrameCalibration * FC);
 
       // Extract ORB on the image. 0 for left image and 1 for right image.
-      void ExtractORBLeft(const cv::Mat &im);
+      void ExtractORBLeft(const cv::Mat &im, cv::Mat &descriptors);
       void ExtractORBRight(const cv::Mat &im);
 
       // Compute Bag of Words representation.
       void ComputeBoW(ORBVocabulary & vocab);
 
-      // Set the camera pose.
-      void SetPose(cv::Mat Tcw);
+      // Set the camera pose, and compute its inverse and the camera center.
+      void SetPose(const cv::Mat &Tcw);
+      void SetPose(const cv::Matx44f &Tcw);
 
-      // Computes rotation, translation and camera center matrices from the camera pose.
-      void UpdatePoseMatrices();
+      // Returns true if a pose has been set.
+      inline bool HasPose() const {
+         return mbHasPose;
+      }
+
+      // The pose is stored in fixed-size matrices, the cv::Mat getters return copies.
+      inline cv::Mat GetPose() const {
+         return cv::Mat(mTcw);
+      }
+
+      inline cv::Mat GetPoseInverse() const {
+         return cv::Mat(mTwc);
+      }
 
       // Returns the camera center.
-      inline cv::Mat GetCameraCenter() {
-         return mOw.clone();
+      inline cv::Mat GetCameraCenter() const {
+         return cv::Mat(mOw);
+      }
+
+      inline cv::Mat GetRotation() const {
+         return cv::Mat(GetRotationMatx());
+      }
+
+      inline cv::Mat GetTranslation() const {
+         return cv::Mat(GetTranslationVec());
       }
 
       // Returns inverse of rotation
-      inline cv::Mat GetRotationInverse() {
-         return mRwc.clone();
+      inline cv::Mat GetRotationInverse() const {
+         return cv::Mat(GetRotationInverseMatx());
+      }
+
+      inline cv::Matx44f GetPoseMatx() const {
+         return mTcw;
+      }
+
+      inline cv::Matx44f GetPoseInverseMatx() const {
+         return mTwc;
+      }
+
+      inline cv::Vec3f GetCameraCenterVec() const {
+         return mOw;
+      }
+
+      inline cv::Matx33f GetRotationMatx() const {
+         return mTcw.get_minor<3, 3>(0, 0);
+      }
+
+      inline cv::Vec3f GetTranslationVec() const {
+         return cv::Vec3f(mTcw(0, 3), mTcw(1, 3), mTcw(2, 3));
+      }
+
+      inline cv::Matx33f GetRotationInverseMatx() const {
+         return mTwc.get_minor<3, 3>(0, 0);
       }
 
       // Check if a MapPoint is in the frustum of the camera
       // and fill variables of the MapPoint to be used by the tracking
       bool isInFrustum(MapPoint* pMP, float viewingCosLimit);
 
-      // Compute the cell of a keypoint (return false if outside the grid)
-      bool PosInGrid(const cv::KeyPoint &kp, int &posX, int &posY);
-
       vector<size_t> GetFeaturesInArea(const float &x, const float  &y, const float  &r, const int minLevel = -1, const int maxLevel = -1) const;
 
+      // Same as above, but fills a buffer owned by the caller so repeated queries do not allocate.
+      void GetFeaturesInArea(const float &x, const float  &y, const float  &r, const int minLevel, const int maxLevel, vector<size_t> & vIndices) const;
+
       // Search a match for each keypoint in the left image to a keypoint in the right image.
       // If there is a match, depth is computed and the right coordinate associated to the left keypoint is stored.
       void ComputeStereoMatches();
 
-      // Associate a "right" coordinate to a keypoint if there is valid depth in the depthmap.
-      void ComputeStereoFromRGBD(const cv::Mat &imDepth);
-
       // Backprojects a keypoint (if stereo/depth info available) into 3D world coordinates.
       cv::Mat UnprojectStereo(const int &i);
 
@@ -118,11 +162,6 @@ namespace ORB_SLAM2_TEAM
       // Vector of KeyPoints (features) based on original image(s). Used for visualization.
       std::vector<cv::KeyPoint> mvKeys, mvKeysRight;
 
-      // Vector of undistorted KeyPoints (features). Used by tracking and mapping.
-      // If it is a stereo frame, mvKeysUn is redundant because images are pre-rectified.
-      // If it is a RGB-D frame, the RGB images might be distorted.
-      std::vector<cv::KeyPoint> mvKeysUn;
-
       // Corresponding stereo coordinate for each KeyPoint.
       // If this frame is monocular, all elements are negative.
       std::vector<float> mvuRight;
@@ -135,24 +174,27 @@ namespace ORB_SLAM2_TEAM
       DBoW2::BowVector mBowVec;
       DBoW2::FeatureVector mFeatVec;
 
-      // ORB descriptor, each row associated to a keypoint.
-      cv::Mat mDescriptors, mDescriptorsRight;
+      // ORB descriptor of the right image, each row associated to a keypoint of mvKeysRight.
+      cv::Mat mDescriptorsRight;
+
+      // Undistorted KeyPoints (features) and their ORB descriptors. Used by tracking and mapping.
+      // If it is a stereo frame, the positions are those of mvKeys because images are pre-rectified.
+      // If it is a RGB-D frame, the RGB images might be distorted.
+      FeatureStore mFeatures;
 
       // MapPoints associated to KeyPoints (via the index), NULL pointer if no association.
-      // Each non-null element corresponds to an element in mvKeysUn.
+      // Each non-null element corresponds to a feature in mFeatures.
       std::vector<MapPoint*> mvpMapPoints;
 
       // Flag to identify outlier associations.
       std::vector<bool> mvbOutlier;
 
       // Keypoints are assigned to cells in a grid to reduce matching complexity when projecting MapPoints.
-      std::vector<std::size_t> mGrid[FRAME_GRID_COLS][FRAME_GRID_ROWS];
-
-      // Camera pose.
-      cv::Mat mTcw;
+      FeatureGrid mGrid;
 
       // Current and Next Frame id.
-      static long unsigned int nNextId;
+      // Frames are built on the tracking front-end threads, the Tracking reset writes it under its pipeline mutex.
+      static std::atomic<long unsigned int> nNextId;
       long unsigned int mnId;
 
       // Reference Keyframe.
@@ -172,17 +214,21 @@ namespace ORB_SLAM2_TEAM
 
       // Undistort keypoints given OpenCV distortion parameters.
       // Only for the RGB-D case. Stereo must be already rectified!
-      // (called in the constructor).
-      void UndistortKeyPoints();
+      // The undistorted keypoints are only kept in mFeatures (called in the constructor).
+      void UndistortKeyPoints(vector<cv::KeyPoint> &keysUn);
+
+      // Undistort keypoints and associate a "right" coordinate to each keypoint with valid depth in the depthmap,
+      // both in one pass over the keypoints (called in the RGB-D constructor).
+      void UndistortKeyPointsRGBD(const cv::Mat &imDepth, vector<cv::KeyPoint> &keysUn);
 
       // Assign keypoints to the grid for speed up feature matching (called in the constructor).
       void AssignFeaturesToGrid();
 
-      // Rotation, translation and camera center
-      cv::Mat mRcw;
-      cv::Mat mtcw;
-      cv::Mat mRwc;
-      cv::Mat mOw; //==mtwc
+      // Camera pose, its inverse and the camera center
+      cv::Matx44f mTcw;
+      cv::Matx44f mTwc;
+      cv::Vec3f mOw; //==mtwc
+      bool mbHasPose;
 
    };
 
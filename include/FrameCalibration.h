@@ -94,6 +94,29 @@ namespace ORB_SLAM2_TEAM
       void * ReadBytes(void * const buffer);
       void * WriteBytes(void * const buffer) const;
 
+      // true if keypoints must be undistorted with UndistortPoint
+      bool HasUndistortMap() const
+      {
+         return !mUndistortMap.empty();
+      }
+
+      // undistorts an image position by bilinear sampling of the undistortion map
+      void UndistortPoint(const float x, const float y, float & ux, float & uy) const
+      {
+         const float fx = std::min(std::max(x, 0.0f), (float)mWidth);
+         const float fy = std::min(std::max(y, 0.0f), (float)mHeight);
+         const int x0 = std::min((int)fx, mWidth - 1);
+         const int y0 = std::min((int)fy, mHeight - 1);
+         const float ax = fx - x0;
+         const float ay = fy - y0;
+
+         const cv::Vec2f * row0 = mUndistortMap.ptr<cv::Vec2f>(y0) + x0;
+         const cv::Vec2f * row1 = mUndistortMap.ptr<cv::Vec2f>(y0 + 1) + x0;
+         const float w00 = (1.0f - ax) * (1.0f - ay), w01 = ax * (1.0f - ay), w10 = (1.0f - ax) * ay, w11 = ax * ay;
+         ux = w00 * row0[0][0] + w01 * row0[1][0] + w10 * row1[0][0] + w11 * row1[1][0];
+         uy = w00 * row0[0][1] + w01 * row0[1][1] + w10 * row1[0][1] + w11 * row1[1][1];
+      }
+
 
    private:
       int mWidth;
@@ -116,6 +139,20 @@ namespace ORB_SLAM2_TEAM
       float mBl;
       float mThDepth;
 
+      // undistorted position of each integer pixel position in [0, width] x [0, height], empty if there is no distortion.
+      // Copies share the same map, it is only built by Initialize.
+      cv::Mat mUndistortMap;
+
+      void InitializeCamera(
+         const cv::Mat & K,
+         const cv::Mat & distCoef,
+         const int & width,
+         const int & height,
+         const float & bl,
+         const float & thDepth);
+
+      void InitializeUndistortMap();
+
       struct Header
       {
          int mWidth;
@@ -0,0 +1,147 @@
+/**
+* This file is part of ORB-SLAM2-TEAM.
+*
+* Copyright (C) 2018 Joe Bedard <mr dot joe dot bedard at gmail dot com>
+* For more information see <https://github.com/joebedard/ORB_SLAM2_TEAM>
+*
+* ORB-SLAM2-TEAM is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2-TEAM is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2-TEAM. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef GLOBALBUNDLEADJUSTER_H
+#define GLOBALBUNDLEADJUSTER_H
+
+#include "Map.h"
+#include "MapPoint.h"
+#include "KeyFrame.h"
+#include "SyncPrint.h"
+
+#include "g2o/core/sparse_optimizer.h"
+#include "g2o/types/types_six_dof_expmap.h"
+
+#include <unordered_map>
+#include <vector>
+#include <mutex>
+#include <limits>
+
+namespace ORB_SLAM2_TEAM
+{
+
+   // The global bundle adjustment of LoopClosing, with a graph that is kept between loops.
+   // Each run starts from the map, which holds the solution of the previous run (even an interrupted one)
+   // corrected by the loop, so only the KeyFrames, MapPoints and observations that changed are rebuilt.
+   // The records are indexed by id, so the graph holds no pointers to KeyFrames or MapPoints between runs.
+   class GlobalBundleAdjuster : protected SyncPrint
+   {
+   public:
+
+      // numThreads is the number of OpenMP threads of the g2o solver
+      GlobalBundleAdjuster(int numThreads = 1);
+
+      // optimizes all KeyFrames and MapPoints in rounds of a few iterations
+      // between rounds, the KeyFrames and MapPoints added to the map join the graph, starting from the solution
+      // returns false if *pbStopFlag was set, the solution so far can still be published
+      bool Optimize(Map & theMap, int nIterations, bool * pbStopFlag);
+
+      // writes the solution to the map, locking mutexMapUpdate for one chunk of KeyFrames or MapPoints at a time
+      // the KeyFrames and MapPoints that are not in the graph are corrected through the spanning tree
+      // LocalMapping must be paused, and the thread must be a reader of the map
+      void Publish(Map & theMap, id_type loopKeyFrameId);
+
+      // removes all vertices and edges
+      void Clear();
+
+   private:
+
+      // an edge between a MapPoint and the KeyFrame that observes it at the keypoint idx
+      struct EdgeRecord
+      {
+         id_type keyFrameId;
+         size_t idx;
+         bool stereo;
+         g2o::OptimizableGraph::Edge * pEdge;
+         unsigned long pass;
+      };
+
+      struct PointRecord
+      {
+         g2o::VertexSBAPointXYZ * pVertex;
+         vector<EdgeRecord> edges;
+         unsigned long pass;
+      };
+
+      struct KeyFrameRecord
+      {
+         g2o::VertexSE3Expmap * pVertex;
+         unsigned long pass;
+      };
+
+      g2o::SparseOptimizer mOptimizer;
+
+      unordered_map<id_type, KeyFrameRecord> mKeyFrames;
+
+      unordered_map<id_type, PointRecord> mMapPoints;
+
+      // incremented by each call of Sync, marks the records found in the map
+      unsigned long mPass;
+
+      // the KeyFrames added by the current Sync, the vector keeps its capacity between calls
+      vector<KeyFrame *> mNewKeyFrames;
+
+      // updates the graph to match the map, mutexMapUpdate must be locked
+      // bReadEstimates sets all vertices from the map, and removes the bad KeyFrames, MapPoints and observations,
+      // otherwise only KeyFrames, MapPoints and observations are added, starting from the solution
+      // returns true if the graph changed
+      bool Sync(Map & theMap, bool bReadEstimates);
+
+      // returns the record of the KeyFrame if it is in the graph and was found in the map by the last Sync, otherwise NULL
+      KeyFrameRecord * FindKeyFrame(KeyFrame * pKF);
+
+      void AddKeyFrameVertex(KeyFrame * pKF, const g2o::SE3Quat & Tcw);
+
+      // returns false if no KeyFrame in the graph observes the MapPoint
+      bool AddMapPointVertex(MapPoint * pMP, const Eigen::Vector3d & x3Dw);
+
+      // creates a new edge for the observation, or reuses the edge of the record if the keypoint is the same
+      void AddEdge(
+         g2o::VertexSBAPointXYZ * pPointVertex,
+         g2o::VertexSE3Expmap * pKeyFrameVertex,
+         KeyFrame * pKF,
+         size_t idx,
+         EdgeRecord & record);
+
+      // adds or updates the edges of the observations of the MapPoint, and removes the edges of the unlinked observations
+      void SyncEdges(MapPoint * pMP, PointRecord & record);
+
+      // g2o vertex ids are int, so 2 * id + 1 must not exceed the largest int
+      static int VertexId(id_type id, id_type offset)
+      {
+         if (id > (id_type)((numeric_limits<int>::max() - 1) / 2))
+            throw exception("GlobalBundleAdjuster::VertexId: maximum id exceeded");
+         return (int)(2 * id + offset);
+      }
+
+      static int VertexId(id_type keyFrameId)
+      {
+         return VertexId(keyFrameId, 0);
+      }
+
+      static int VertexId(MapPoint * pMP)
+      {
+         return VertexId(pMP->id, 1);
+      }
+   };
+
+}
+
+#endif // GLOBALBUNDLEADJUSTER_H
@@ -0,0 +1,62 @@
+/**
+* This file is part of ORB-SLAM2-TEAM.
+*
+* Copyright (C) 2018 Joe Bedard <mr dot joe dot bedard at gmail dot com>
+* For more information see <https://github.com/joebedard/ORB_SLAM2_TEAM>
+*
+* ORB-SLAM2-TEAM is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2-TEAM is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2-TEAM. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef HAMMINGDISTANCE_H
+#define HAMMINGDISTANCE_H
+
+#include <cstddef>
+
+#include "FeatureStore.h"
+
+namespace ORB_SLAM2_TEAM
+{
+
+   // Hamming distances between one ORB descriptor and many candidate descriptors.
+   // The kernel is selected once at runtime for the host CPU: AVX-512 VPOPCNTDQ, AVX2 (vpshufb popcount) or scalar.
+   class HammingDistance
+   {
+   public:
+
+      struct Result
+      {
+         int bestDist;
+
+         int secondDist;
+
+         // an element of the candidate indices, or -1 if there was no candidate
+         int bestIdx;
+      };
+
+      // distance between two 32-byte descriptors
+      static int Distance(const unsigned char * a, const unsigned char * b);
+
+      // distances[i] = distance between query and store.Descriptor(indices[i])
+      static void Compute(const unsigned char * query, const FeatureStore & store, const size_t * indices, size_t n, int * distances);
+
+      // best and second best distances between query and the candidates, both are 256 if not found
+      static Result FindBest(const unsigned char * query, const FeatureStore & store, const size_t * indices, size_t n);
+
+      // name of the kernel used on this CPU
+      static const char * InstructionSet();
+   };
+
+}
+
+#endif // HAMMINGDISTANCE_H
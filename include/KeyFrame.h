@@ -31,6 +31,8 @@
 #include "KeyFrameDatabase.h"
 #include "SyncPrint.h"
 #include "FrameCalibration.h"
+#include "FeatureStore.h"
+#include "FeatureGrid.h"
 
 #include <mutex>
 #include <atomic>
@@ -57,6 +59,10 @@ namespace ORB_SLAM2_TEAM
 
       KeyFrame(id_type id, Frame &F);
 
+      // KeyFrames are allocated from a SlabAllocator
+      static void * operator new(size_t size);
+      static void operator delete(void * p, size_t size);
+
       // Pose functions
       void SetPose(const cv::Mat &Tcw);
       cv::Mat GetPose();
@@ -65,6 +71,13 @@ namespace ORB_SLAM2_TEAM
       cv::Mat GetRotation();
       cv::Mat GetTranslation();
 
+      // fixed-size copies of the pose, without an allocation
+      cv::Matx44f GetPoseMatx();
+      cv::Matx44f GetPoseInverseMatx();
+      cv::Vec3f GetCameraCenterVec();
+      cv::Matx33f GetRotationMatx();
+      cv::Vec3f GetTranslationVec();
+
       // Bag of Words Representation
       void ComputeBoW(ORBVocabulary & vocab);
 
@@ -99,6 +112,9 @@ namespace ORB_SLAM2_TEAM
 
       // KeyPoint functions
       vector<size_t> GetFeaturesInArea(const float &x, const float  &y, const float  &r) const;
+
+      // Same as above, but fills a buffer owned by the caller so repeated queries do not allocate.
+      void GetFeaturesInArea(const float &x, const float  &y, const float  &r, vector<size_t> & vIndices) const;
       cv::Mat UnprojectStereo(int i);
 
       // Image
@@ -208,10 +224,10 @@ namespace ORB_SLAM2_TEAM
       // Number of KeyPoints (features).
       const int & N;
 
-      // Vector of undistorted KeyPoints (features). Used by tracking and mapping.
-      // If it is a stereo frame, mvKeysUn is redundant because images are pre-rectified.
+      // Undistorted KeyPoints (features) and their descriptors. Used by tracking and mapping.
+      // If it is a stereo frame, the undistorted KeyPoints are redundant because images are pre-rectified.
       // If it is a RGB-D frame, the RGB images might be distorted.
-      const vector<cv::KeyPoint> & keysUn;
+      const FeatureStore & features;
 
       // Corresponding stereo coordinate for each KeyPoint.
       // If this frame is monocular, all elements are negative.
@@ -221,9 +237,6 @@ namespace ORB_SLAM2_TEAM
       // If this frame is monocular, all elements are negative.
       const vector<float> & depth;
 
-      // Corresponding descriptor for each KeyPoint.
-      const cv::Mat & descriptors;
-
       //BoW
       DBoW2::BowVector mBowVec;
       DBoW2::FeatureVector mFeatVec;
@@ -244,17 +257,17 @@ namespace ORB_SLAM2_TEAM
    protected:
 
       // SE3 Pose and camera center
-      cv::Mat Tcw;
-      cv::Mat Twc;
-      cv::Mat Ow;
+      cv::Matx44f Tcw;
+      cv::Matx44f Twc;
+      cv::Vec3f Ow;
 
       // MapPoints associated to KeyPoints (via the index), NULL pointer if no association.
-      // Each non-null element corresponds to an element in mvKeysUn.
+      // Each non-null element corresponds to an element in mFeatures.
       vector<MapPoint*> mvpMapPoints;
 
       // Grid over the image to speed up feature matching
       // not serialized, rebuilt with AssignFeaturesToGrid()
-      vector<size_t> mGrid[FRAME_GRID_COLS][FRAME_GRID_ROWS];
+      FeatureGrid mGrid;
 
       map<KeyFrame *, int> mConnectedKeyFrameWeights;
       vector<KeyFrame *> mvpOrderedConnectedKeyFrames;
@@ -304,14 +317,12 @@ namespace ORB_SLAM2_TEAM
       // Vector of KeyPoints (features) based on original image(s). Used for visualization.
       vector<cv::KeyPoint> mvKeys;
 
-      vector<cv::KeyPoint> mvKeysUn;
+      FeatureStore mFeatures;
 
       vector<float> mvuRight;
 
       vector<float> mvDepth;
 
-      cv::Mat mDescriptors;
-
       cv::Mat mTcp;
 
       int mnScaleLevels;
@@ -321,12 +332,11 @@ namespace ORB_SLAM2_TEAM
       vector<float> mvLevelSigma2;
       vector<float> mvInvLevelSigma2;
 
-      // Grid (to speed up feature matching)
-      const int mnGridCols;
-      const int mnGridRows;
-
       atomic_bool mModified;
 
+      // the Map which records modifications to this KeyFrame, set by Map::AddKeyFrame
+      atomic<Map *> mpMap;
+
       static id_type PeekId(const void * data);
 
       static void * ReadMapPointIds(
@@ -361,8 +371,6 @@ namespace ORB_SLAM2_TEAM
 
       static void * WriteKeyFrameIds(void * const buffer, const set<KeyFrame *> & kfs);
 
-      bool PosInGrid(const cv::KeyPoint &kp, int &posX, int &posY);
-
       void AssignFeaturesToGrid();
 
       void PrintPrefix(ostream & out);
@@ -0,0 +1,148 @@
+/**
+* This file is part of ORB-SLAM2-TEAM.
+*
+* Copyright (C) 2018 Joe Bedard <mr dot joe dot bedard at gmail dot com>
+* For more information see <https://github.com/joebedard/ORB_SLAM2_TEAM>
+*
+* ORB-SLAM2-TEAM is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2-TEAM is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2-TEAM. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LOCALBUNDLEADJUSTER_H
+#define LOCALBUNDLEADJUSTER_H
+
+#include "Map.h"
+#include "MapPoint.h"
+#include "KeyFrame.h"
+#include "SyncPrint.h"
+
+#include "g2o/core/sparse_optimizer.h"
+#include "g2o/core/robust_kernel_impl.h"
+#include "g2o/types/types_six_dof_expmap.h"
+
+#include <unordered_map>
+#include <vector>
+#include <mutex>
+#include <limits>
+
+namespace ORB_SLAM2_TEAM
+{
+
+   // The local bundle adjustment of LocalMapping, with a graph that is kept between calls.
+   // Consecutive windows share most of their KeyFrames and MapPoints, so their vertices, edges
+   // and robust kernels are reused, and only the KeyFrames and MapPoints entering or leaving
+   // the window are added or removed. The estimates are read from the map on each call.
+   class LocalBundleAdjuster : protected SyncPrint
+   {
+   public:
+
+      // numThreads is the number of OpenMP threads of the g2o solver
+      LocalBundleAdjuster(int numThreads = 1);
+
+      // optimizes pKF, its covisible KeyFrames and the MapPoints they observe
+      // the other KeyFrames observing those MapPoints are fixed
+      void Adjust(KeyFrame * pKF, bool * pbStopFlag, Map & theMap);
+
+      // removes the vertices of bad MapPoints and KeyFrames, so the graph holds no pointers to them
+      // call it before the thread reports that it is quiescent (Map::Quiescent)
+      void ReleaseBad();
+
+      // removes all vertices and edges
+      void Clear();
+
+   private:
+
+      // an edge between a MapPoint and the KeyFrame that observes it at the keypoint idx
+      struct EdgeRecord
+      {
+         KeyFrame * pKF;
+         size_t idx;
+         bool stereo;
+         g2o::OptimizableGraph::Edge * pEdge;
+         g2o::RobustKernelHuber * pKernel;
+         unsigned long pass;
+      };
+
+      struct PointRecord
+      {
+         g2o::VertexSBAPointXYZ * pVertex;
+         vector<EdgeRecord> edges;
+         unsigned long pass;
+      };
+
+      struct KeyFrameRecord
+      {
+         g2o::VertexSE3Expmap * pVertex;
+         unsigned long pass;
+      };
+
+      g2o::SparseOptimizer mOptimizer;
+
+      unordered_map<KeyFrame *, KeyFrameRecord> mKeyFrames;
+
+      unordered_map<MapPoint *, PointRecord> mMapPoints;
+
+      // incremented by each call of Adjust, marks the records in the current window
+      unsigned long mPass;
+
+      // the window of the current call, the vectors keep their capacity between calls
+      vector<KeyFrame *> mLocalKeyFrames;
+      vector<KeyFrame *> mFixedKeyFrames;
+      vector<MapPoint *> mLocalMapPoints;
+
+      // the edges of the current window, and the MapPoint of each edge
+      vector<EdgeRecord *> mEdges;
+      vector<MapPoint *> mEdgeMapPoints;
+
+      // collects the window and updates the graph to match it, mutexMapUpdate must be locked
+      void BuildGraph(KeyFrame * pKF);
+
+      void AddKeyFrameVertex(KeyFrame * pKF, bool fixed);
+
+      void AddMapPointVertex(MapPoint * pMP);
+
+      // creates a new edge for the observation, or reuses the edge of the record if the keypoint is the same
+      void AddEdge(
+         g2o::VertexSBAPointXYZ * pPointVertex,
+         g2o::VertexSE3Expmap * pKeyFrameVertex,
+         KeyFrame * pKF,
+         size_t idx,
+         EdgeRecord & record);
+
+      // returns the quantity of edges moved to level 1 because they are outliers
+      size_t CheckEdges();
+
+      void Recover(Map & theMap);
+
+      // g2o vertex ids are int, so 2 * id + 1 must not exceed the largest int
+      static int VertexId(id_type id, id_type offset)
+      {
+         if (id > (id_type)((numeric_limits<int>::max() - 1) / 2))
+            throw exception("LocalBundleAdjuster::VertexId: maximum id exceeded");
+         return (int)(2 * id + offset);
+      }
+
+      static int VertexId(KeyFrame * pKF)
+      {
+         return VertexId(pKF->id, 0);
+      }
+
+      static int VertexId(MapPoint * pMP)
+      {
+         return VertexId(pMP->id, 1);
+      }
+   };
+
+}
+
+#endif // LOCALBUNDLEADJUSTER_H
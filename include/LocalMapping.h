@@ -29,11 +29,15 @@
 #include "MapSubject.h"
 #include "LoopClosing.h"
 #include "KeyFrameDatabase.h"
+#include "LocalBundleAdjuster.h"
 #include "MapperSubject.h"
 #include "SyncPrint.h"
 #include "Statistics.h"
+#include "AutoResetEvent.h"
+#include "WorkerPool.h"
 
 #include <mutex>
+#include <condition_variable>
 
 namespace ORB_SLAM2_TEAM
 {
@@ -53,7 +57,8 @@ namespace ORB_SLAM2_TEAM
          size_t quantityTrackers,
          unsigned int keyFrameIdSpan,
          unsigned long firstMapPointId,
-         unsigned int mapPointIdSpan
+         unsigned int mapPointIdSpan,
+         unsigned int quantityThreads
       );
 
       void SetLoopCloser(LoopClosing * pLoopCloser);
@@ -73,6 +78,7 @@ namespace ORB_SLAM2_TEAM
       bool Pause();
       void Resume();
       bool IsPaused();
+      void WaitUntilPaused();
       bool PauseRequested();
       bool GetIdle();
       void SetIdle(bool flag);
@@ -104,6 +110,9 @@ namespace ORB_SLAM2_TEAM
       // iterate through the new MapPoints (that were added by the new KeyFrame) and remove low-quality MapPoints
       void MapPointCulling();
 
+      // drops bad MapPoints from the recent lists and the local BA graph, then deletes the erased MapPoints that no thread can hold
+      void ReclaimMapPoints();
+
       void SearchInNeighbors();
 
       void KeyFrameCulling();
@@ -117,6 +126,7 @@ namespace ORB_SLAM2_TEAM
       void ResetIfRequested();
       bool mbResetRequested;
       mutex mMutexReset;
+      condition_variable mCondReset;
 
       bool CheckFinish();
       void SetFinish();
@@ -148,6 +158,9 @@ namespace ORB_SLAM2_TEAM
       // one list for each tracker, use trackerId for the vector index
       vector<list<MapPoint *>> mRecentAddedMapPoints;
 
+      // the recent lists are kept while waiting for a KeyFrame
+      Map::reader_id mMapReader;
+
       mutex & mMutexMapUpdate;
 
       unsigned long mNextMapPointId;
@@ -164,10 +177,22 @@ namespace ORB_SLAM2_TEAM
 
       mutex mMutexPause;
 
+      // signaled when mbPaused becomes true
+      condition_variable mCondPaused;
+
+      // set when Run has something to do: a new KeyFrame, or a pause, resume, reset or finish request
+      AutoResetEvent mWakeUp;
+
       bool mbIdle;
 
       mutex mMutexIdle;
 
+      // runs the parallel stages of SearchInNeighbors
+      WorkerPool mWorkerPool;
+
+      // keeps the local BA graph between KeyFrames
+      LocalBundleAdjuster mLocalBundleAdjuster;
+
       unsigned long NewMapPointId();
 
       // process new keyframe metrics
@@ -30,11 +30,15 @@
 #include "MapSubject.h"
 #include "ORBVocabulary.h"
 #include "KeyFrameDatabase.h"
+#include "GlobalBundleAdjuster.h"
 #include "SyncPrint.h"
 #include "Statistics.h"
+#include "AutoResetEvent.h"
+#include "WorkerPool.h"
 
 #include <thread>
 #include <mutex>
+#include <condition_variable>
 #include "g2o/types/types_seven_dof_expmap.h"
 
 namespace ORB_SLAM2_TEAM
@@ -42,6 +46,7 @@ namespace ORB_SLAM2_TEAM
 
    class LocalMapping;
    class KeyFrameDatabase;
+   class Sim3Solver;
 
 
    class LoopClosing : public MapSubject, protected SyncPrint
@@ -61,7 +66,8 @@ namespace ORB_SLAM2_TEAM
          Map & map,
          KeyFrameDatabase & kfDB, 
          ORBVocabulary & vocab,
-         const bool bFixScale
+         const bool bFixScale,
+         const unsigned int quantityThreads = 1
       );
 
       ~LoopClosing();
@@ -119,9 +125,20 @@ namespace ORB_SLAM2_TEAM
 
       void CorrectLoop();
 
+      // launches a Global BA thread that corrects the map from the loop KeyFrame loopKeyFrameId
+      void StartGBA(unsigned long loopKeyFrameId);
+
+      // stops the Global BA and waits for its thread, bPublish writes the solution so far to the map
+      // returns true if a Global BA was stopped before it converged
+      bool StopGBA(bool bPublish);
+
       void ResetIfRequested();
       bool mbResetRequested;
       std::mutex mMutexReset;
+      std::condition_variable mCondReset;
+
+      // set when Run has something to do: a new KeyFrame, or a reset or finish request
+      AutoResetEvent mWakeUp;
 
       bool CheckFinish();
       void SetFinish();
@@ -152,6 +169,9 @@ namespace ORB_SLAM2_TEAM
       std::vector<KeyFrame*> mvpCurrentConnectedKFs;
       std::vector<MapPoint*> mvpCurrentMatchedPoints;
       std::vector<MapPoint*> mvpLoopMapPoints;
+
+      // the MapPoint vectors are cleared before waiting for a KeyFrame, so the reader is idle while waiting
+      Map::reader_id mMapReader;
       cv::Mat mScw;
       g2o::Sim3 mg2oScw;
 
@@ -161,13 +181,26 @@ namespace ORB_SLAM2_TEAM
       bool mbRunningGBA;
       bool mbFinishedGBA;
       bool mbStopGBA;
+      bool mbPublishStoppedGBA;
+      bool mbInterruptedGBA;
+      unsigned long mGBALoopKeyFrameId;
       std::mutex mMutexGBA;
       std::thread* mpThreadGBA;
 
       // Fix scale in the stereo/RGB-D case
       bool mbFixScale;
 
-      bool mnFullBAIdx;
+      // OpenMP threads of the essential graph optimization and the global BA
+      int mQuantityThreads;
+
+      // keeps the Global BA graph between loops
+      GlobalBundleAdjuster mGlobalBundleAdjuster;
+
+      // evaluates the loop candidates of ComputeSim3 in parallel
+      WorkerPool mWorkerPool;
+
+      // one for each loop candidate, reused by each call of ComputeSim3
+      std::vector<Sim3Solver *> mvpSim3Solvers;
 
    private:
       
@@ -28,6 +28,9 @@
 #include "SyncPrint.h"
 #include <set>
 #include <unordered_map>
+#include <vector>
+#include <list>
+#include <memory>
 
 #include <mutex>
 
@@ -39,6 +42,10 @@ namespace ORB_SLAM2_TEAM
    class Map : SyncPrint
    {
    public:
+
+      // immutable, contiguous views of the KeyFrames and MapPoints in the map
+      typedef shared_ptr<const vector<KeyFrame *>> KeyFrameSnapshot;
+      typedef shared_ptr<const vector<MapPoint *>> MapPointSnapshot;
       
       mutex mutexMapUpdate;
 
@@ -62,15 +69,21 @@ namespace ORB_SLAM2_TEAM
 
       int GetLastBigChangeIdx();
 
-      vector<KeyFrame *> GetAllKeyFrames();
+      // returns the current KeyFrames without copying them or waiting for the map to be unlocked
+      // the snapshot does not change, later additions and erasures are published in a new snapshot
+      KeyFrameSnapshot GetKeyFrameSnapshot();
 
-      set<KeyFrame *> GetKeyFrameSet();
+      // returns a copy of the current snapshot
+      vector<KeyFrame *> GetAllKeyFrames();
 
       KeyFrame * GetKeyFrame(id_type keyFrameId) const;
 
-      vector<MapPoint *> GetAllMapPoints();
+      // returns the current MapPoints without copying them or waiting for the map to be unlocked
+      // the snapshot does not change, later additions and erasures are published in a new snapshot
+      MapPointSnapshot GetMapPointSnapshot();
 
-      set<MapPoint *> GetMapPointSet();
+      // returns a copy of the current snapshot
+      vector<MapPoint *> GetAllMapPoints();
 
       MapPoint * GetMapPoint(id_type mapPointId) const;
 
@@ -90,6 +103,48 @@ namespace ORB_SLAM2_TEAM
 
       void Replace(MapPoint & oldMP, MapPoint & newMP);
 
+      // records a modified KeyFrame or MapPoint, called by SetModified(true) once until the next TakeModified
+      void AddModified(KeyFrame * pKF);
+      void AddModified(MapPoint * pMP);
+
+      // moves the KeyFrames and MapPoints modified since the previous call into the vectors, and clears their modified flags
+      // the cost is proportional to the quantity of changes, not the size of the map
+      // a KeyFrame or MapPoint may appear more than once
+      // bad MapPoints are returned by id, because they may be deleted after their flag is cleared
+      void TakeModified(vector<KeyFrame *> & keyFrames, vector<MapPoint *> & mapPoints, vector<id_type> & badMapPoints);
+
+      // Erased MapPoints are deleted when no thread can still use them.
+      // A thread that keeps MapPoint pointers without locking the mapper's map update mutex registers as a reader.
+      // The reader reads the epoch, drops its pointers to bad MapPoints, then reports the epoch with Quiescent.
+      // A MapPoint erased before the lowest reported epoch is deleted by ReclaimMapPoints.
+      typedef size_t reader_id;
+
+      reader_id RegisterReader();
+
+      void UnregisterReader(reader_id reader);
+
+      unsigned long GetEpoch();
+
+      // the reader holds no pointers to MapPoints erased before the epoch
+      void Quiescent(reader_id reader, unsigned long epoch);
+
+      // the reader holds no MapPoint pointers until its next Quiescent
+      void Idle(reader_id reader);
+
+      // deletes the erased MapPoints that no reader can hold, the mapper's map update mutex must be locked
+      void ReclaimMapPoints();
+
+      // registers the calling thread as a reader for the lifetime of the object
+      class ReaderScope
+      {
+      public:
+         ReaderScope(Map & map) : mMap(map), mReader(map.RegisterReader()) {}
+         ~ReaderScope() { mMap.UnregisterReader(mReader); }
+      private:
+         Map & mMap;
+         reader_id mReader;
+      };
+
       // only for debugging
       void ValidateAllLinks();
 
@@ -104,20 +159,68 @@ namespace ORB_SLAM2_TEAM
       // Index related to a big change in the map (loop closure, global BA)
       int mnBigChangeIdx;
 
-      mutex mMutexMap;
+      mutable mutex mMutexMap;
 
    private:
       // This avoids that two points (with same id) are created simultaneously in separate threads (id conflict)
       mutex mMutexPointCreation;
 
-      unordered_map<id_type, MapPoint *> mMapPoints;
+      // indexed by id, NULL if the id is not in the map
+      // ids are assigned densely by the trackers and mappers, so the tables stay compact
+      vector<MapPoint *> mMapPoints;
 
-      unordered_map<id_type, KeyFrame *> mKeyFrames;
+      vector<KeyFrame *> mKeyFrames;
 
       // returns a MapPoint if it was replaced, otherwise returns NULL
       MapPoint * LinkWithoutLock(MapPoint & rMP, size_t idx, KeyFrame & rKF);
 
       KeyFrame * mFirstKeyFrame;
+
+      // the vectors of the latest snapshots, a writer modifies them in place unless a reader
+      // still holds the snapshot, then the writer publishes a modified copy
+      shared_ptr<vector<KeyFrame *>> mpKeyFrameSnapshot;
+
+      shared_ptr<vector<MapPoint *>> mpMapPointSnapshot;
+
+      // position of each KeyFrame and MapPoint in the snapshot vectors, indexed by id
+      vector<size_t> mKeyFrameSnapshotIndex;
+
+      vector<size_t> mMapPointSnapshotIndex;
+
+      // locked by readers only to copy a snapshot pointer
+      mutable mutex mMutexSnapshot;
+
+      // these update the tables and the snapshots together, mMutexMap must be locked
+      // Unpublish returns the KeyFrame or MapPoint that was removed, or NULL
+      void PublishKeyFrame(KeyFrame * pKF);
+      KeyFrame * UnpublishKeyFrame(id_type keyFrameId);
+      void PublishMapPoint(MapPoint * pMP);
+      MapPoint * UnpublishMapPoint(id_type mapPointId);
+
+      // queues an erased MapPoint for deletion, mMutexMap must not be locked
+      void RetireMapPoint(MapPoint * pMP);
+
+      mutex mMutexModified;
+
+      vector<KeyFrame *> mModifiedKeyFrames;
+
+      vector<MapPoint *> mModifiedMapPoints;
+
+      // quantity of TakeModified calls still reading the MapPoints they took, retired MapPoints are not reclaimed meanwhile
+      int mTakingModified;
+
+      mutex mMutexReclaim;
+
+      // incremented by each retired MapPoint
+      unsigned long mEpoch;
+
+      // the epoch reported by each reader, or READER_IDLE
+      vector<unsigned long> mReaderEpochs;
+
+      vector<bool> mReaderRegistered;
+
+      // erased MapPoints waiting for deletion, each paired with the epoch when it was erased
+      list<pair<unsigned long, MapPoint *>> mRetiredMapPoints;
    };
 
 } //namespace ORB_SLAM
@@ -76,7 +76,11 @@ namespace ORB_SLAM2_TEAM
 
       mutex mMutexReferenceMapPoints;
 
-      std::vector<MapPoint *> mvpReferenceMapPoints;
+      // ids instead of pointers, a reference MapPoint may be deleted between two drawings
+      std::vector<id_type> mReferenceMapPointIds;
+
+      // the viewer reads MapPoints only while drawing them
+      Map::reader_id mMapReader;
 
       float mViewpointX, mViewpointY, mViewpointZ, mViewpointF;
 
@@ -32,6 +32,8 @@
 #include "KeyFrame.h"
 #include "Frame.h"
 #include "Map.h"
+#include "ObservationMap.h"
+#include "SeqLock.h"
 
 namespace ORB_SLAM2_TEAM
 {
@@ -51,15 +53,45 @@ namespace ORB_SLAM2_TEAM
       // tracking or mapping constructor
       MapPoint(id_type id, const cv::Mat &Pos, KeyFrame* pRefKF);
 
+      // MapPoints are allocated from a SlabAllocator
+      static void * operator new(size_t size);
+      static void operator delete(void * p, size_t size);
+
+      // a consistent copy of the position data
+      struct Position
+      {
+         cv::Vec3f worldPos;
+
+         // mean viewing direction
+         cv::Vec3f normal;
+
+         // scale invariance distances
+         float minDistance;
+         float maxDistance;
+      };
+
+      // reads the position data without a lock or an allocation, for tracking
+      Position GetPosition();
+
       void SetWorldPos(const cv::Mat &Pos);
       cv::Mat GetWorldPos();
 
       cv::Mat GetNormal();
       KeyFrame* GetReferenceKeyFrame();
 
-      map<KeyFrame*, size_t> GetObservations();
+      // returns a copy, which does not allocate unless the MapPoint has many observations
+      ObservationMap GetObservations();
       size_t Observations();
 
+      // calls f(KeyFrame *, size_t) for each observation, without a copy, while mMutexFeatures is locked
+      // f must not lock a KeyFrame or a MapPoint
+      template<class F> void ForEachObservation(F f)
+      {
+         unique_lock<mutex> lock(mMutexFeatures);
+         for (const ObservationMap::value_type & obs : mObservations)
+            f(obs.first, obs.second);
+      }
+
       int GetIndexInKeyFrame(KeyFrame* pKF);
       bool IsObserving(KeyFrame* pKF);
 
@@ -157,14 +189,15 @@ namespace ORB_SLAM2_TEAM
       cv::Mat mPosGBA;
       unsigned long int mnBAGlobalForKF;
 
-      static mutex mGlobalMutex;
-
    private:
 
       id_type mnId;
 
       atomic_bool mModified;
 
+      // the Map which records modifications to this MapPoint, set by Map::AddMapPoint
+      atomic<Map *> mpMap;
+
       id_type mnFirstKFid;
 
       mutex mMutexFeatures;
@@ -175,8 +208,8 @@ namespace ORB_SLAM2_TEAM
       // quantity of KeyFrames linked to this MapPoint (double if stereo mode)
       size_t mnObs;
 
-      // Keyframes observing the point and associated index in keyframe
-      map<KeyFrame*, size_t> mObservations;
+      // Keyframes observing the point and associated index in keyframe, sorted by KeyFrame id
+      ObservationMap mObservations;
 
       // Best descriptor to fast matching
       cv::Mat mDescriptor;
@@ -191,17 +224,20 @@ namespace ORB_SLAM2_TEAM
       // the MapPoint that replaced this MapPoint
       MapPoint * mpReplaced;
 
+      // serializes the writers of the position data, readers use mPosSeqLock
       mutex mMutexPos;
 
+      SeqLock mPosSeqLock;
+
       // Position in absolute coordinates
-      cv::Mat mWorldPos;
+      atomic<float> mWorldPos[3];
 
       // Mean viewing direction
-      cv::Mat mNormalVector;
+      atomic<float> mNormalVector[3];
 
-      // Scale invariance distances
-      float mfMinDistance;
-      float mfMaxDistance;
+      // Scale invariance distances, each is also read alone without mPosSeqLock
+      atomic<float> mfMinDistance;
+      atomic<float> mfMaxDistance;
 
    private:
 
@@ -231,9 +267,9 @@ namespace ORB_SLAM2_TEAM
          void * const buffer,
          const Map & rMap,
          unordered_map<id_type, KeyFrame *> & newKeyFrames,
-         map<KeyFrame *, size_t> & observations);
+         ObservationMap & observations);
 
-      static void * WriteObservations(void * const buffer, map<KeyFrame *, size_t> & observations);
+      static void * WriteObservations(void * const buffer, const ObservationMap & observations);
 
       // called from Map::Link when all linking is complete
       // pre: the thread has locked this->mMutexFeatures and rKF.mMutexFeatures
@@ -44,7 +44,10 @@ namespace ORB_SLAM2_TEAM
    public:
 
       // Pre: vocab is loaded
-      MapperServer(ORBVocabulary & vocab, const bool bMonocular, const unsigned int maxTrackers);
+      // quantityThreads is the number of threads (including the LocalMapping thread) of the parallel mapping stages
+      // and the g2o solvers of the local BA, the essential graph optimization and the global BA,
+      // 0 or less uses one thread per hardware thread
+      MapperServer(ORBVocabulary & vocab, const bool bMonocular, const unsigned int maxTrackers, const int quantityThreads = 0);
 
       ~MapperServer();
 
@@ -83,48 +83,25 @@ namespace ORB_SLAM2_TEAM
       {
          MapChangeEvent mapChanges;
 
-         set<KeyFrame *> setKFs = theMap.GetKeyFrameSet();
-         for (KeyFrame * pKF : setKFs)
-         {
-            if (pKF->GetModified())
-            {
-               if (pKF->IsBad())
-                  mapChanges.deletedKeyFrames.insert(pKF->id);
-               else
-                  mapChanges.updatedKeyFrames.insert(pKF);
-            }
-         }
+         vector<KeyFrame *> modifiedKFs;
+         vector<MapPoint *> modifiedMPs;
+         vector<id_type> badMPs;
+         theMap.TakeModified(modifiedKFs, modifiedMPs, badMPs);
 
-         set<MapPoint *> setMPs = theMap.GetMapPointSet();
-         for (MapPoint * pMP : setMPs)
+         for (KeyFrame * pKF : modifiedKFs)
          {
-            if (pMP->GetModified())
-            {
-               if (pMP->IsBad())
-                  mapChanges.deletedMapPoints.insert(pMP->id);
-               else
-                  mapChanges.updatedMapPoints.insert(pMP);
-            }
+            if (pKF->IsBad())
+               mapChanges.deletedKeyFrames.insert(pKF->id);
+            else
+               mapChanges.updatedKeyFrames.insert(pKF);
          }
 
-         NotifyMapChanged(mapChanges);
+         for (MapPoint * pMP : modifiedMPs)
+            mapChanges.updatedMapPoints.insert(pMP);
 
-         for (KeyFrame * pKF : setKFs)
-         {
-            if (pKF->GetModified())
-            {
-               pKF->SetModified(false);
-            }
-         }
-
-         for (MapPoint * pMP : setMPs)
-         {
-            if (pMP->GetModified())
-            {
-               pMP->SetModified(false);
-            }
-         }
+         mapChanges.deletedMapPoints.insert(badMPs.begin(), badMPs.end());
 
+         NotifyMapChanged(mapChanges);
       }
 
       void NotifyPauseRequested(bool b)
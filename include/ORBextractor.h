@@ -24,6 +24,7 @@
 #include <vector>
 #include <list>
 #include <opencv/cv.h>
+#include "WorkerPool.h"
 
 
 namespace ORB_SLAM2_TEAM
@@ -48,8 +49,9 @@ namespace ORB_SLAM2_TEAM
 
       enum { HARRIS_SCORE = 0, FAST_SCORE = 1 };
 
+      // nThreads is the number of threads (including the caller) that extract the pyramid levels in parallel
       ORBextractor(int nfeatures, float scaleFactor, int nlevels,
-         int iniThFAST, int minThFAST);
+         int iniThFAST, int minThFAST, int nThreads = 1);
 
       ~ORBextractor() {}
 
@@ -84,18 +86,32 @@ namespace ORB_SLAM2_TEAM
          return mvInvLevelSigma2;
       }
 
+      // long-lived threads used by Extract, they may also be used to extract several images at the same time
+      WorkerPool & GetWorkerPool() {
+         return mWorkerPool;
+      }
+
       std::vector<cv::Mat> mvImagePyramid;
 
    protected:
 
       void ComputePyramid(cv::Mat image);
       void ComputeKeyPointsOctTree(std::vector<std::vector<cv::KeyPoint> >& allKeypoints);
+      void ComputeKeyPointsOctTree(int level, std::vector<cv::KeyPoint> & keypoints);
       std::vector<cv::KeyPoint> DistributeOctTree(const std::vector<cv::KeyPoint>& vToDistributeKeys, const int &minX,
          const int &maxX, const int &minY, const int &maxY, const int &nFeatures, const int &level);
 
       void ComputeKeyPointsOld(std::vector<std::vector<cv::KeyPoint> >& allKeypoints);
       std::vector<cv::Point> pattern;
 
+      // pattern rotated to each of the 30 angle bins, 512 points per bin
+      std::vector<cv::Point> mvRotatedPattern;
+
+      // mvRotatedPattern as memory offsets for the row step of each level's image
+      const std::vector<int> & GetPatternOffsets(int level, int step);
+      std::vector<std::vector<int> > mvPatternOffsets;
+      std::vector<int> mvPatternStep;
+
       int nfeatures;
       double scaleFactor;
       int nlevels;
@@ -104,12 +120,24 @@ namespace ORB_SLAM2_TEAM
 
       std::vector<int> mnFeaturesPerLevel;
 
+      // FAST score of every pixel in each pyramid level, reused between frames
+      std::vector<cv::Mat> mvFastScore;
+
+      // each level of mvImagePyramid is the interior of a buffer padded by EDGE_THRESHOLD pixels,
+      // the buffers are allocated once per image size
+      std::vector<cv::Mat> mvPyramidBuffer;
+
+      // blurred pyramid levels used to compute the descriptors, reused between frames
+      std::vector<cv::Mat> mvBlurBuffer;
+
       std::vector<int> umax;
 
       std::vector<float> mvScaleFactor;
       std::vector<float> mvInvScaleFactor;
       std::vector<float> mvLevelSigma2;
       std::vector<float> mvInvLevelSigma2;
+
+      WorkerPool mWorkerPool;
    };
 
 } //namespace ORB_SLAM
@@ -33,6 +33,7 @@
 #include "Frame.h"
 #include "MapChangeEvent.h"
 #include "SyncPrint.h"
+#include "WorkerPool.h"
 
 namespace ORB_SLAM2_TEAM
 {
@@ -46,10 +47,17 @@ namespace ORB_SLAM2_TEAM
       // Computes the Hamming distance between two ORB descriptors
       static int DescriptorDistance(const cv::Mat &a, const cv::Mat &b);
 
+      // Same as above, for descriptors stored as raw 32-byte rows (FeatureStore)
+      static int DescriptorDistance(const unsigned char * a, const unsigned char * b);
+
       // Search matches between Frame keypoints and projected MapPoints. Returns number of matches
       // Used to track the local map (Tracking)
       int SearchByProjection(Frame &F, const std::vector<MapPoint*> &vpMapPoints, const float th = 3);
 
+      // Same as above, but the candidates of the MapPoints are searched by the threads of the pool.
+      // The keypoints are then claimed in the order of vpMapPoints, so the matches equal the serial search.
+      int SearchByProjection(Frame &F, const std::vector<MapPoint*> &vpMapPoints, WorkerPool &pool, const float th = 3);
+
       // Project MapPoints tracked in last frame into the current frame and search matches.
       // Used to track from previous frame (Tracking)
       int SearchByProjection(Frame &CurrentFrame, const Frame &LastFrame, const float th, const bool bMono);
@@ -82,6 +90,25 @@ namespace ORB_SLAM2_TEAM
       // Project MapPoints into KeyFrame and search for duplicated MapPoints.
       int Fuse(Map & rMap, KeyFrame & rKF, const vector<MapPoint *> & vpMapPoints, const float th = 3.0);
 
+      // a keypoint of a KeyFrame found by the search of Fuse, for a MapPoint that does not observe the KeyFrame
+      struct FuseMatch
+      {
+         MapPoint * pMP;
+         KeyFrame * pKF;
+         size_t idx;
+      };
+
+      // The search of Fuse, it appends the matches and does not modify the map.
+      // Searches of different KeyFrames (or of parts of vpMapPoints) may run in parallel.
+      void FindFuseMatches(KeyFrame & rKF, const vector<MapPoint *> & vpMapPoints, vector<FuseMatch> & matches, const float th = 3.0);
+
+      // The commit of Fuse, it links or replaces the matched MapPoints in order.
+      // The matches were searched before any of them was applied, so they can differ from a serial Fuse:
+      // a MapPoint replaced by a previous match is fused through its final replacement, with the keypoint
+      // found for the replaced MapPoint, and the searches do not see descriptors updated by previous fusions.
+      // Returns the quantity of MapPoints fused.
+      int ApplyFuseMatches(Map & rMap, const vector<FuseMatch> & matches);
+
       // Project MapPoints into KeyFrame using a given Sim3 and search for duplicated MapPoints.
       int Fuse(Map & rMap, KeyFrame & rKF, cv::Mat Scw, const std::vector<MapPoint*> & vpPoints, float th, vector<MapPoint *> & vpReplacePoint);
 
@@ -94,10 +121,17 @@ namespace ORB_SLAM2_TEAM
 
    protected:
 
-      bool CheckDistEpipolarLine(const cv::KeyPoint &kp1, const cv::KeyPoint &kp2, const cv::Mat &F12, const KeyFrame *pKF);
+      bool CheckDistEpipolarLine(const float x1, const float y1, const float x2, const float y2, const int octave2, const cv::Mat &F12, const KeyFrame *pKF);
 
       float RadiusByViewingCos(const float &viewCos);
 
+      // appends the keypoints near a projected MapPoint of the local map and their descriptor distances,
+      // keypoints claimed by other MapPoints are not excluded yet
+      void LocalMapCandidates(const Frame &F, MapPoint * pMP, const float th, std::vector<size_t> &vCandidates, std::vector<int> &vDistances);
+
+      // matches pMP with its best unclaimed candidate, returns true if a keypoint was claimed
+      bool ClaimLocalMapMatch(Frame &F, MapPoint * pMP, const size_t * pCandidates, const int * pDistances, size_t n);
+
       void ComputeThreeMaxima(std::vector<int>* histo, const int L, int &ind1, int &ind2, int &ind3);
 
       float mfNNratio;
@@ -0,0 +1,109 @@
+/**
+* This file is part of ORB-SLAM2-TEAM.
+*
+* Copyright (C) 2018 Joe Bedard <mr dot joe dot bedard at gmail dot com>
+* For more information see <https://github.com/joebedard/ORB_SLAM2_TEAM>
+*
+* ORB-SLAM2-TEAM is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2-TEAM is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2-TEAM. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef OBSERVATIONMAP_H
+#define OBSERVATIONMAP_H
+
+#include <cstddef>
+#include <utility>
+
+namespace ORB_SLAM2_TEAM
+{
+   class KeyFrame;
+
+   // The KeyFrames observing a MapPoint, each with the index of its keypoint, sorted by KeyFrame id.
+   // Most MapPoints have few observations, so they are stored in a small sorted array inside the object,
+   // which is copied without an allocation. The array moves to the heap only when it outgrows INLINE_CAPACITY.
+   class ObservationMap
+   {
+   public:
+
+      typedef std::pair<KeyFrame *, size_t> value_type;
+
+      typedef const value_type * const_iterator;
+
+      static const size_t INLINE_CAPACITY = 8;
+
+      ObservationMap();
+
+      ObservationMap(const ObservationMap & other);
+
+      ~ObservationMap();
+
+      ObservationMap & operator=(const ObservationMap & other);
+
+      size_t size() const
+      {
+         return mSize;
+      }
+
+      bool empty() const
+      {
+         return mSize == 0;
+      }
+
+      const_iterator begin() const
+      {
+         return mpData;
+      }
+
+      const_iterator end() const
+      {
+         return mpData + mSize;
+      }
+
+      // returns end() if pKF is not in the map
+      const_iterator find(KeyFrame * pKF) const;
+
+      size_t count(KeyFrame * pKF) const
+      {
+         return find(pKF) == end() ? 0 : 1;
+      }
+
+      // returns the keypoint index of pKF, throws if pKF is not in the map
+      size_t at(KeyFrame * pKF) const;
+
+      // inserts pKF, or replaces its keypoint index
+      void set(KeyFrame * pKF, size_t idx);
+
+      void erase(KeyFrame * pKF);
+
+      void clear();
+
+   private:
+
+      // points to mInline, or to a heap array when mCapacity > INLINE_CAPACITY
+      value_type * mpData;
+
+      size_t mSize;
+
+      size_t mCapacity;
+
+      value_type mInline[INLINE_CAPACITY];
+
+      // returns the first element whose KeyFrame id is not less than the id of pKF
+      value_type * LowerBound(KeyFrame * pKF) const;
+
+      void Reserve(size_t capacity);
+   };
+
+}
+
+#endif // OBSERVATIONMAP_H
@@ -46,12 +46,8 @@ namespace ORB_SLAM2_TEAM
          int nIterations = 5,
          bool * pbStopFlag = NULL,
          const id_type loopKeyFrameId = 0,
-         const bool bRobust = true);
-
-      static void LocalBundleAdjustment(
-         KeyFrame * pKF,
-         bool * pbStopFlag,
-         Map & theMap);
+         const bool bRobust = true,
+         const int nThreads = 1);
 
       static int PoseOptimization(Frame* pFrame);
 
@@ -63,7 +59,8 @@ namespace ORB_SLAM2_TEAM
          const LoopClosing::KeyFrameAndPose & NonCorrectedSim3,
          const LoopClosing::KeyFrameAndPose & CorrectedSim3,
          const std::map<KeyFrame *, set<KeyFrame *> > & LoopConnections,
-         const bool & bFixScale);
+         const bool & bFixScale,
+         const int nThreads = 1);
 
       // if bFixScale is true, optimize SE3 (stereo,rgbd), Sim3 otherwise (mono)
       static int OptimizeSim3(
@@ -78,40 +75,6 @@ namespace ORB_SLAM2_TEAM
 
       static void Print(const char * message);
 
-      static void CreateGraphLocalBundleAdjustment(
-         std::mutex & mutexMapUpdate,
-         KeyFrame * pKF,
-         g2o::SparseOptimizer & optimizer,
-         id_type & maxKFid,
-         list<KeyFrame*> & lLocalKeyFrames,
-         list<MapPoint*> & lLocalMapPoints,
-         vector<g2o::EdgeSE3ProjectXYZ*> & vpEdgesMono,
-         vector<KeyFrame*> & vpEdgeKFMono,
-         vector<MapPoint*> & vpMapPointEdgeMono,
-         vector<g2o::EdgeStereoSE3ProjectXYZ*> & vpEdgesStereo,
-         vector<KeyFrame*> & vpEdgeKFStereo,
-         vector<MapPoint*> & vpMapPointEdgeStereo);
-
-      static void CheckGraphLocalBundleAdjustment(
-         std::mutex & mutexMapUpdate,
-         vector<g2o::EdgeSE3ProjectXYZ*> & vpEdgesMono,
-         vector<MapPoint*> & vpMapPointEdgeMono,
-         vector<g2o::EdgeStereoSE3ProjectXYZ*> & vpEdgesStereo,
-         vector<MapPoint*> & vpMapPointEdgeStereo);
-
-      static void RecoverGraphLocalBundleAdjustment(
-         Map & theMap,
-         g2o::SparseOptimizer & optimizer,
-         id_type & maxKFid,
-         list<KeyFrame*> & lLocalKeyFrames,
-         list<MapPoint*> & lLocalMapPoints,
-         vector<g2o::EdgeSE3ProjectXYZ*> & vpEdgesMono,
-         vector<KeyFrame*> & vpEdgeKFMono,
-         vector<MapPoint*> & vpMapPointEdgeMono,
-         vector<g2o::EdgeStereoSE3ProjectXYZ*> & vpEdgesStereo,
-         vector<KeyFrame*> & vpEdgeKFStereo,
-         vector<MapPoint*> & vpMapPointEdgeStereo);
-
       static void CreateGraphOptimize(
          KeyFrame * pCurKF,
          KeyFrame * pLoopKF, 
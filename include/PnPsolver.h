@@ -52,6 +52,7 @@
 #define PNPSOLVER_H
 
 #include <opencv2/core/core.hpp>
+#include <random>
 #include "MapPoint.h"
 #include "Frame.h"
 
@@ -60,10 +61,19 @@ namespace ORB_SLAM2_TEAM
 
    class PnPsolver {
    public:
+      PnPsolver();
+
       PnPsolver(const Frame &F, const vector<MapPoint*> &vpMapPointMatches);
 
       ~PnPsolver();
 
+      // Set up a new problem and restart RANSAC. The buffers of a previous problem are reused,
+      // so one solver can serve many relocalization attempts.
+      void Initialize(const Frame &F, const vector<MapPoint*> &vpMapPointMatches);
+
+      // each solver draws its minimal sets from its own generator, so solvers can run on different threads
+      void SetSeed(unsigned int seed);
+
       void SetRansacParameters(double probability = 0.99, int minInliers = 8, int maxIterations = 300, int minSet = 4, float epsilon = 0.4,
          float th2 = 5.991);
 
@@ -191,6 +201,12 @@ namespace ORB_SLAM2_TEAM
       // Max square error associated with scale level. Max error = th*th*sigma(level)*sigma(level)
       vector<float> mvMaxError;
 
+      // Random generator for the minimal sets
+      std::mt19937 mRandom;
+
+      // Indices still available while drawing a minimal set
+      vector<size_t> mvAvailableIndices;
+
    };
 
 } //namespace ORB_SLAM
@@ -0,0 +1,130 @@
+/**
+* This file is part of ORB-SLAM2-TEAM.
+*
+* Copyright (C) 2018 Joe Bedard <mr dot joe dot bedard at gmail dot com>
+* For more information see <https://github.com/joebedard/ORB_SLAM2_TEAM>
+*
+* ORB-SLAM2-TEAM is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2-TEAM is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2-TEAM. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef POSESOLVER_H
+#define POSESOLVER_H
+
+#include <vector>
+#include <cstddef>
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+namespace ORB_SLAM2_TEAM
+{
+
+   using namespace std;
+
+   // Levenberg-Marquardt optimization of one camera pose (Tcw) against fixed world points, used by Optimizer::PoseOptimization.
+   // It takes the same steps as g2o::OptimizationAlgorithmLevenberg on a VertexSE3Expmap with EdgeSE3ProjectXYZOnlyPose
+   // and EdgeStereoSE3ProjectXYZOnlyPose edges and Huber kernels, but the observations are kept in plain arrays
+   // and the 6x6 normal equations are accumulated directly, so nothing is allocated per observation.
+   class PoseSolver
+   {
+   public:
+
+      typedef Eigen::Matrix<double, 6, 6> Matrix6d;
+
+      typedef Eigen::Matrix<double, 6, 1> Vector6d;
+
+      PoseSolver(const double fx, const double fy, const double cx, const double cy, const double bf,
+         const double deltaMono, const double deltaStereo);
+
+      void Reserve(size_t n);
+
+      // returns the index of the monocular observation
+      size_t AddMono(const float * Xw, const double u, const double v, const double invSigma2);
+
+      // returns the index of the stereo observation
+      size_t AddStereo(const float * Xw, const double u, const double v, const double ur, const double invSigma2);
+
+      size_t QuantityMono() const
+      {
+         return mMono.u.size();
+      }
+
+      size_t QuantityStereo() const
+      {
+         return mStereo.u.size();
+      }
+
+      // inactive observations are left out of Optimize, as g2o edges with level 1
+      void SetActiveMono(size_t i, bool active)
+      {
+         mMono.active[i] = active;
+      }
+
+      void SetActiveStereo(size_t i, bool active)
+      {
+         mStereo.active[i] = active;
+      }
+
+      // Huber kernels are applied to all observations while true (the default)
+      void SetRobust(bool robust)
+      {
+         mbRobust = robust;
+      }
+
+      void SetPose(const Eigen::Matrix3d & Rcw, const Eigen::Vector3d & tcw);
+
+      Eigen::Matrix3d GetRotation() const;
+
+      Eigen::Vector3d GetTranslation() const;
+
+      // runs at most nIterations iterations over the active observations
+      void Optimize(int nIterations);
+
+      // error weighted by the information, without the kernel, of every observation at the current pose
+      void ComputeChi2(vector<double> & vChi2Mono, vector<double> & vChi2Stereo) const;
+
+   private:
+
+      struct Observations
+      {
+         vector<double> X, Y, Z;
+         vector<double> u, v, ur;
+         vector<double> invSigma2;
+         vector<char> active;
+      };
+
+      const double mfx, mfy, mcx, mcy, mbf;
+
+      const double mDeltaMono, mDeltaStereo;
+
+      bool mbRobust;
+
+      Observations mMono;
+
+      Observations mStereo;
+
+      Eigen::Quaterniond mRotation;
+
+      Eigen::Vector3d mTranslation;
+
+      // robust chi2 of the active observations, and their normal equations if H and b are not NULL
+      double Accumulate(Matrix6d * H, Vector6d * b) const;
+
+      // Tcw = exp(update) * Tcw, the update is (rotation, translation) as in g2o::SE3Quat::exp
+      void ApplyUpdate(const Vector6d & update);
+   };
+
+}
+
+#endif // POSESOLVER_H
@@ -0,0 +1,78 @@
+/**
+* This file is part of ORB-SLAM2-TEAM.
+*
+* Copyright (C) 2018 Joe Bedard <mr dot joe dot bedard at gmail dot com>
+* For more information see <https://github.com/joebedard/ORB_SLAM2_TEAM>
+*
+* ORB-SLAM2-TEAM is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2-TEAM is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2-TEAM. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <atomic>
+#include <thread>
+
+namespace ORB_SLAM2_TEAM
+{
+
+   // A sequence lock, for small data that is read much more often than it is written.
+   // A reader does not block and does not write shared memory, it copies the data and retries if a writer was active.
+   // Writers must be serialized by the caller.
+   // The data must be stored in relaxed atomics, so a reader racing with a writer is well defined and its copy is discarded.
+   class SeqLock
+   {
+   public:
+
+      SeqLock() : mSequence(0) {}
+
+      // returns the sequence to pass to ReadRetry
+      unsigned int ReadBegin() const
+      {
+         unsigned int seq = mSequence.load(std::memory_order_acquire);
+         while (seq & 1)
+         {
+            std::this_thread::yield();
+            seq = mSequence.load(std::memory_order_acquire);
+         }
+         return seq;
+      }
+
+      // returns true if the data was written since ReadBegin, and the copy must be read again
+      bool ReadRetry(unsigned int seq) const
+      {
+         std::atomic_thread_fence(std::memory_order_acquire);
+         return mSequence.load(std::memory_order_relaxed) != seq;
+      }
+
+      void WriteBegin()
+      {
+         mSequence.store(mSequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+         std::atomic_thread_fence(std::memory_order_release);
+      }
+
+      void WriteEnd()
+      {
+         mSequence.store(mSequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+      }
+
+   private:
+
+      // odd while a writer is active
+      std::atomic<unsigned int> mSequence;
+   };
+
+}
+
+#endif // SEQLOCK_H
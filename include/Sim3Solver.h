@@ -24,6 +24,7 @@
 
 #include <opencv2/core/core.hpp>
 #include <vector>
+#include <random>
 
 #include "KeyFrame.h"
 
@@ -36,8 +37,17 @@ namespace ORB_SLAM2_TEAM
    {
    public:
 
+      Sim3Solver();
+
       Sim3Solver(KeyFrame* pKF1, KeyFrame* pKF2, const std::vector<MapPoint*> &vpMatched12, const bool bFixScale = true);
 
+      // Set up a new problem and restart RANSAC. The vectors of a previous problem keep their capacity,
+      // so one solver can serve the loop candidates of many KeyFrames.
+      void Initialize(KeyFrame* pKF1, KeyFrame* pKF2, const std::vector<MapPoint*> &vpMatched12, const bool bFixScale = true);
+
+      // each solver draws its minimal sets from its own generator, so solvers can run on different threads
+      void SetSeed(unsigned int seed);
+
       void SetRansacParameters(double probability = 0.99, int minInliers = 6, int maxIterations = 300);
 
       cv::Mat find(std::vector<bool> &vbInliers12, int &nInliers);
@@ -105,10 +115,20 @@ namespace ORB_SLAM2_TEAM
       // Indices for random selection
       std::vector<size_t> mvAllIndices;
 
+      // Random generator for the minimal sets
+      std::mt19937 mRandom;
+
+      // Indices still available while drawing a minimal set
+      std::vector<size_t> mvAvailableIndices;
+
       // Projections
       std::vector<cv::Mat> mvP1im1;
       std::vector<cv::Mat> mvP2im2;
 
+      // Projections of the current hypothesis, overwritten by each iteration
+      std::vector<cv::Mat> mvP1im2;
+      std::vector<cv::Mat> mvP2im1;
+
       // RANSAC probability
       double mRansacProb;
 
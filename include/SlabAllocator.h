@@ -0,0 +1,98 @@
+/**
+* This file is part of ORB-SLAM2-TEAM.
+*
+* Copyright (C) 2018 Joe Bedard <mr dot joe dot bedard at gmail dot com>
+* For more information see <https://github.com/joebedard/ORB_SLAM2_TEAM>
+*
+* ORB-SLAM2-TEAM is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2-TEAM is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2-TEAM. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SLABALLOCATOR_H
+#define SLABALLOCATOR_H
+
+#include <cstddef>
+#include <new>
+#include <mutex>
+#include <vector>
+#include <type_traits>
+
+namespace ORB_SLAM2_TEAM
+{
+
+   // Allocates objects of one type from large blocks instead of the general heap.
+   // Freed slots are kept in a free list and reused, so objects created and destroyed together
+   // stay close in memory, and a new object does not pay for a heap allocation.
+   // Blocks are never returned to the heap.
+   template<class T, std::size_t SlotsPerBlock = 1024>
+   class SlabAllocator
+   {
+   public:
+
+      SlabAllocator() : mpFree(NULL), mNextSlot(SlotsPerBlock) {}
+
+      ~SlabAllocator()
+      {
+         for (Slot * pBlock : mBlocks)
+            delete[] pBlock;
+      }
+
+      // returns uninitialized memory for one T
+      void * Allocate()
+      {
+         std::unique_lock<std::mutex> lock(mMutex);
+         if (mpFree)
+         {
+            Slot * pSlot = mpFree;
+            mpFree = pSlot->pNext;
+            return pSlot;
+         }
+         if (mNextSlot == SlotsPerBlock)
+         {
+            mBlocks.push_back(new Slot[SlotsPerBlock]);
+            mNextSlot = 0;
+         }
+         return &mBlocks.back()[mNextSlot++];
+      }
+
+      // returns memory from Allocate to the free list, the object must already be destroyed
+      void Deallocate(void * p)
+      {
+         if (!p) return;
+         std::unique_lock<std::mutex> lock(mMutex);
+         Slot * pSlot = static_cast<Slot *>(p);
+         pSlot->pNext = mpFree;
+         mpFree = pSlot;
+      }
+
+   private:
+
+      union Slot
+      {
+         Slot * pNext;
+         typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+      };
+
+      std::mutex mMutex;
+
+      std::vector<Slot *> mBlocks;
+
+      Slot * mpFree;
+
+      // the next unused slot in the last block
+      std::size_t mNextSlot;
+   };
+
+}
+
+#endif // SLABALLOCATOR_H
@@ -52,18 +52,18 @@ namespace ORB_SLAM2_TEAM
 
       // Proccess the given stereo frame. Images must be synchronized and rectified.
       // Input images: RGB (CV_8UC3) or grayscale (CV_8U). RGB is converted to grayscale.
-      // Returns the camera pose (empty if tracking fails).
+      // Returns the camera pose (empty if tracking fails, or if the image is still in the tracking pipeline).
       cv::Mat TrackStereo(const cv::Mat &imLeft, const cv::Mat &imRight, const double &timestamp);
 
       // Process the given rgbd frame. Depthmap must be registered to the RGB frame.
       // Input image: RGB (CV_8UC3) or grayscale (CV_8U). RGB is converted to grayscale.
       // Input depthmap: Float (CV_32F).
-      // Returns the camera pose (empty if tracking fails).
+      // Returns the camera pose (empty if tracking fails, or if the image is still in the tracking pipeline).
       cv::Mat TrackRGBD(const cv::Mat &im, const cv::Mat &depthmap, const double &timestamp);
 
       // Proccess the given monocular frame
       // Input images: RGB (CV_8UC3) or grayscale (CV_8U). RGB is converted to grayscale.
-      // Returns the camera pose (empty if tracking fails).
+      // Returns the camera pose (empty if tracking fails, or if the image is still in the tracking pipeline).
       cv::Mat TrackMonocular(const cv::Mat &im, const double &timestamp);
 
       // Returns true if there have been a big map change (loop closure, global BA)
@@ -40,8 +40,14 @@
 #include "Enums.h"
 #include "SyncPrint.h"
 #include "FrameCalibration.h"
+#include "PnPsolver.h"
+#include "Duration.h"
 
 #include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <list>
+#include <exception>
 
 namespace ORB_SLAM2_TEAM
 {
@@ -68,9 +74,15 @@ namespace ORB_SLAM2_TEAM
       cv::Mat GetBaseline();
 
       // Preprocess the input and call Track(). Extract features and performs stereo matching.
-      Frame & GrabImageStereo(const cv::Mat &imRectLeft, const cv::Mat &imRectRight, const double &timestamp);
-      Frame & GrabImageRGBD(const cv::Mat &imRGB, const cv::Mat &imD, const double &timestamp);
-      Frame & GrabImageMonocular(const cv::Mat &im, const double &timestamp);
+      // Returns the tracked Frame, or NULL if no Frame was tracked by this call.
+      // In pipeline mode the Frame is built on the front-end thread and the returned Frame is the
+      // most recently tracked one, which is usually one image behind (see its mTimeStamp).
+      Frame * GrabImageStereo(const cv::Mat &imRectLeft, const cv::Mat &imRectRight, const double &timestamp);
+      Frame * GrabImageRGBD(const cv::Mat &imRGB, const cv::Mat &imD, const double &timestamp);
+      Frame * GrabImageMonocular(const cv::Mat &im, const double &timestamp);
+
+      // In pipeline mode, tracks the images still in the pipeline. Call after the last image.
+      void Flush();
 
       void SetViewer(Viewer* pViewer);
 
@@ -166,6 +178,9 @@ namespace ORB_SLAM2_TEAM
       // used to hold MapPoints from nearby KeyFrames. different for each Frame.
       std::vector<MapPoint*> mvpLocalMapPoints;
 
+      // this tracker reads MapPoints of the map between frames
+      Map::reader_id mMapReader;
+
       //Drawers
       Viewer* mpViewer;
       FrameDrawer* mpFrameDrawer;
@@ -227,8 +242,89 @@ namespace ORB_SLAM2_TEAM
       // used for stereo image rectification
       cv::Mat mRectMapLeft1, mRectMapLeft2, mRectMapRight1, mRectMapRight2;
 
+      // one PnP solver per relocalization candidate, kept between relocalizations to reuse their buffers
+      vector<PnPsolver *> mvpPnPsolvers;
+
+      // an image waiting to be made into a Frame
+      struct FrameRequest
+      {
+         cv::Mat imLeft;
+
+         // right image (stereo) or depth map (RGB-D)
+         cv::Mat imRight;
+
+         double timestamp;
+      };
+
+      // a Frame ready to be tracked
+      struct BuiltFrame
+      {
+         // rebuilt by the tracking thread if the Frame was built with the wrong extractor
+         FrameRequest request;
+
+         Frame frame;
+
+         // used by the FrameDrawer
+         cv::Mat imGray;
+
+         // the pipeline generation when the Frame was built, Frames from before a map reset are discarded
+         unsigned int generation;
+
+         // rethrown by the tracking thread
+         exception_ptr error;
+      };
+
+      // if true, the Frame for the next image is built on mFrontEndThread while the current Frame is tracked
+      bool mbPipeline;
+
+      // if true, the oldest images and Frames are dropped when the pipeline falls behind
+      // if false, Frames are tracked in order and the caller waits for the front-end
+      bool mbPipelineDropFrames;
+
+      // maximum quantity of waiting images and of built Frames when dropping frames
+      size_t mPipelineQueueSize;
+
+      thread mFrontEndThread;
+
+      mutex mMutexPipeline;
+
+      condition_variable mCondPipeline;
+
+      list<FrameRequest> mPipelineRequests;
+
+      list<BuiltFrame> mBuiltFrames;
+
+      unsigned int mPipelineGeneration;
+
+      bool mbFrontEndBusy;
+
+      bool mbFinishFrontEnd;
+
+      unsigned int mQuantityFramesDropped;
+
       void LoadCameraParameters(cv::FileStorage & settings, SensorType sensor);
 
+      // converts a color image to grayscale, according to mbRGB
+      void ConvertToGray(cv::Mat & im);
+
+      // preprocesses the images of the request and extracts the features of a new Frame
+      void BuildFrame(const FrameRequest & request, Frame & frame, cv::Mat & imGray);
+
+      Frame * GrabImage(FrameRequest & request);
+
+      // calls Track() and records its metrics
+      void TrackCurrentFrame(cv::Mat & imGray, const time_type startTrack);
+
+      // queues the request for the front-end and takes the next Frame to be tracked
+      // returns false if no Frame is ready
+      bool NextPipelinedFrame(FrameRequest & request, Frame & frame, cv::Mat & imGray);
+
+      // moves a Frame taken from mBuiltFrames into frame, rethrows its error
+      void TakeBuiltFrame(BuiltFrame & built, Frame & frame, cv::Mat & imGray);
+
+      // main function of mFrontEndThread
+      void RunFrontEnd();
+
       void CheckModeChange();
 
       void CheckReset();
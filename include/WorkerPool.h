@@ -0,0 +1,89 @@
+/**
+* This file is part of ORB-SLAM2-TEAM.
+*
+* Copyright (C) 2018 Joe Bedard <mr dot joe dot bedard at gmail dot com>
+* For more information see <https://github.com/joebedard/ORB_SLAM2_TEAM>
+*
+* ORB-SLAM2-TEAM is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2-TEAM is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2-TEAM. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <vector>
+#include <list>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+
+namespace ORB_SLAM2_TEAM
+{
+
+   using namespace std;
+
+   // A fixed set of long-lived threads that run the iterations of a parallel loop.
+   // The thread that calls ParallelFor also runs iterations, so calls may be nested
+   // (an iteration may call ParallelFor on the same pool) without deadlocking.
+   class WorkerPool
+   {
+   public:
+
+      // quantityThreads includes the calling thread, so a pool of 1 runs everything serially
+      WorkerPool(unsigned int quantityThreads);
+
+      ~WorkerPool();
+
+      unsigned int QuantityThreads()
+      {
+         return (unsigned int)mWorkers.size() + 1;
+      }
+
+      // runs task(i) for each i in [0, n) and returns when all of them are done
+      // the first exception thrown by a task is rethrown here
+      void ParallelFor(size_t n, const function<void(size_t)> & task);
+
+   private:
+
+      struct Job
+      {
+         const function<void(size_t)> * task;
+         size_t n;
+         size_t next;
+         unsigned int active;
+         exception_ptr error;
+      };
+
+      vector<thread> mWorkers;
+
+      list<Job *> mJobs;
+
+      bool mbFinish;
+
+      mutex mMutexJobs;
+
+      condition_variable mCondJobs;
+
+      condition_variable mCondDone;
+
+      void RunWorker();
+
+      // runs iterations of the job until none are left, mMutexJobs must be locked
+      void RunJob(Job & job, unique_lock<mutex> & lock);
+   };
+
+}
+
+#endif // WORKERPOOL_H
@@ -46,6 +46,18 @@ namespace ORB_SLAM2_TEAM
       return g2o::SE3Quat(R, t);
    }
 
+   g2o::SE3Quat Converter::toSE3Quat(const cv::Matx44f &T)
+   {
+      Eigen::Matrix<double, 3, 3> R;
+      R << T(0, 0), T(0, 1), T(0, 2),
+         T(1, 0), T(1, 1), T(1, 2),
+         T(2, 0), T(2, 1), T(2, 2);
+
+      Eigen::Matrix<double, 3, 1> t(T(0, 3), T(1, 3), T(2, 3));
+
+      return g2o::SE3Quat(R, t);
+   }
+
    cv::Mat Converter::toCvMat(const g2o::SE3Quat &SE3)
    {
       Eigen::Matrix<double, 4, 4> eigMat = SE3.to_homogeneous_matrix();
@@ -134,6 +146,11 @@ namespace ORB_SLAM2_TEAM
       return v;
    }
 
+   Eigen::Matrix<double, 3, 1> Converter::toVector3d(const cv::Vec3f &v)
+   {
+      return Eigen::Matrix<double, 3, 1>(v[0], v[1], v[2]);
+   }
+
    Eigen::Matrix<double, 3, 3> Converter::toMatrix3d(const cv::Mat &cvMat3)
    {
       Eigen::Matrix<double, 3, 3> M;
@@ -145,6 +162,17 @@ namespace ORB_SLAM2_TEAM
       return M;
    }
 
+   Eigen::Matrix<double, 3, 3> Converter::toMatrix3d(const cv::Matx33f &M)
+   {
+      Eigen::Matrix<double, 3, 3> E;
+
+      E << M(0, 0), M(0, 1), M(0, 2),
+         M(1, 0), M(1, 1), M(1, 2),
+         M(2, 0), M(2, 1), M(2, 2);
+
+      return E;
+   }
+
    std::vector<float> Converter::toQuaternion(const cv::Mat &M)
    {
       Eigen::Matrix<double, 3, 3> eigMat = toMatrix3d(M);
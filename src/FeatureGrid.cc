@@ -0,0 +1,95 @@
+/**
+* This file is part of ORB-SLAM2-TEAM.
+*
+* Copyright (C) 2018 Joe Bedard <mr dot joe dot bedard at gmail dot com>
+* For more information see <https://github.com/joebedard/ORB_SLAM2_TEAM>
+*
+* ORB-SLAM2-TEAM is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2-TEAM is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2-TEAM. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "FeatureGrid.h"
+
+namespace ORB_SLAM2_TEAM
+{
+
+   FeatureGrid::FeatureGrid()
+      : mMinX(0.0f)
+      , mMinY(0.0f)
+      , mCellWidthInv(0.0f)
+      , mCellHeightInv(0.0f)
+   {
+   }
+
+   void FeatureGrid::Assign(const FeatureStore & features, const FrameCalibration & fc)
+   {
+      const size_t n = features.Size();
+      if (n > 0xFFFF)
+         throw exception("FeatureGrid::Assign too many keypoints for 16-bit indices");
+
+      mMinX = fc.minX;
+      mMinY = fc.minY;
+      mCellWidthInv = fc.gridElementWidthInv;
+      mCellHeightInv = fc.gridElementHeightInv;
+
+      // count the keypoints of each cell, then turn the counts into the end offset of each cell
+      mvCellStart.assign(CELLS + 1, 0);
+      for (size_t i = 0; i < n; i++)
+      {
+         const int cell = CellOf(features.X(i), features.Y(i));
+         if (cell >= 0)
+            mvCellStart[cell]++;
+      }
+
+      uint32_t total = 0;
+      for (int c = 0; c < CELLS; c++)
+      {
+         total += mvCellStart[c];
+         mvCellStart[c] = total;
+      }
+      mvCellStart[CELLS] = total;
+
+      // fill backwards, so each end offset moves down to the start of its cell
+      // and the indices of a cell stay in ascending order
+      mvIndices.resize(total);
+      for (size_t i = n; i-- > 0; )
+      {
+         const int cell = CellOf(features.X(i), features.Y(i));
+         if (cell >= 0)
+            mvIndices[--mvCellStart[cell]] = (uint16_t)i;
+      }
+   }
+
+   void FeatureGrid::GetFeaturesInArea(const FeatureStore & features, const float x, const float y, const float r,
+      const int minLevel, const int maxLevel, vector<size_t> & vIndices) const
+   {
+      vIndices.clear();
+      ForEachInArea(features, x, y, r, minLevel, maxLevel, [&vIndices](size_t idx)
+      {
+         vIndices.push_back(idx);
+      });
+   }
+
+   int FeatureGrid::CellOf(const float x, const float y) const
+   {
+      const int posX = (int)round((x - mMinX) * mCellWidthInv);
+      const int posY = (int)round((y - mMinY) * mCellHeightInv);
+
+      //Keypoint's coordinates are undistorted, which could cause to go out of the image
+      if (posX < 0 || posX >= FRAME_GRID_COLS || posY < 0 || posY >= FRAME_GRID_ROWS)
+         return -1;
+
+      return posX * FRAME_GRID_ROWS + posY;
+   }
+
+}
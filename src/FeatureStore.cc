@@ -0,0 +1,115 @@
+/**
+* This file is part of ORB-SLAM2-TEAM.
+*
+* Copyright (C) 2018 Joe Bedard <mr dot joe dot bedard at gmail dot com>
+* For more information see <https://github.com/joebedard/ORB_SLAM2_TEAM>
+*
+* ORB-SLAM2-TEAM is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2-TEAM is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2-TEAM. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "FeatureStore.h"
+#include "Serializer.h"
+#include <cstring>
+
+namespace ORB_SLAM2_TEAM
+{
+
+   FeatureStore::FeatureStore()
+   {
+   }
+
+   void FeatureStore::Assign(const vector<cv::KeyPoint> & keys, const cv::Mat & descriptors)
+   {
+      const size_t n = keys.size();
+      if (descriptors.rows != (int)n || (n > 0 && descriptors.cols != DESCRIPTOR_SIZE))
+         throw exception("FeatureStore::Assign quantity of keypoints and descriptors do not match");
+
+      mvX.resize(n);
+      mvY.resize(n);
+      mvOctave.resize(n);
+      mvAngle.resize(n);
+      mDescriptors.resize(n * DESCRIPTOR_SIZE);
+
+      for (size_t i = 0; i < n; i++)
+      {
+         const cv::KeyPoint & kp = keys[i];
+         mvX[i] = kp.pt.x;
+         mvY[i] = kp.pt.y;
+         mvOctave[i] = kp.octave;
+         mvAngle[i] = kp.angle;
+         memcpy(&mDescriptors[i * DESCRIPTOR_SIZE], descriptors.ptr((int)i), DESCRIPTOR_SIZE);
+      }
+   }
+
+   void FeatureStore::GetKeyPoints(vector<cv::KeyPoint> & keys) const
+   {
+      keys.resize(mvX.size());
+      for (size_t i = 0; i < mvX.size(); i++)
+      {
+         cv::KeyPoint & kp = keys[i];
+         kp.pt.x = mvX[i];
+         kp.pt.y = mvY[i];
+         kp.octave = mvOctave[i];
+         kp.angle = mvAngle[i];
+      }
+   }
+
+   cv::Mat FeatureStore::DescriptorRow(size_t i) const
+   {
+      return cv::Mat(1, DESCRIPTOR_SIZE, CV_8U, (void *)Descriptor(i));
+   }
+
+   cv::Mat FeatureStore::Descriptors() const
+   {
+      if (mvX.empty())
+         return cv::Mat();
+      return cv::Mat((int)mvX.size(), DESCRIPTOR_SIZE, CV_8U, (void *)mDescriptors.data());
+   }
+
+   size_t FeatureStore::GetBufferSize() const
+   {
+      size_t size = Serializer::GetVectorBufferSize<float>(mvX.size());
+      size += Serializer::GetVectorBufferSize<float>(mvY.size());
+      size += Serializer::GetVectorBufferSize<int>(mvOctave.size());
+      size += Serializer::GetVectorBufferSize<float>(mvAngle.size());
+      size += mDescriptors.size();
+      return size;
+   }
+
+   void * FeatureStore::ReadBytes(void * const buffer)
+   {
+      void * pData = buffer;
+      pData = Serializer::ReadVector<float>(pData, mvX);
+      pData = Serializer::ReadVector<float>(pData, mvY);
+      pData = Serializer::ReadVector<int>(pData, mvOctave);
+      pData = Serializer::ReadVector<float>(pData, mvAngle);
+
+      // descriptors follow the keypoints, one row for each
+      mDescriptors.resize(mvX.size() * DESCRIPTOR_SIZE);
+      memcpy(mDescriptors.data(), pData, mDescriptors.size());
+      return (char *)pData + mDescriptors.size();
+   }
+
+   void * FeatureStore::WriteBytes(void * const buffer) const
+   {
+      void * pData = buffer;
+      pData = Serializer::WriteVector<float>(pData, mvX);
+      pData = Serializer::WriteVector<float>(pData, mvY);
+      pData = Serializer::WriteVector<int>(pData, mvOctave);
+      pData = Serializer::WriteVector<float>(pData, mvAngle);
+      memcpy(pData, mDescriptors.data(), mDescriptors.size());
+      return (char *)pData + mDescriptors.size();
+   }
+
+}
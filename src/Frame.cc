@@ -23,14 +23,83 @@
 #include "Frame.h"
 #include "Converter.h"
 #include "ORBmatcher.h"
-#include <thread>
+#include "HammingDistance.h"
+
+#include <cfloat>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
 
 namespace ORB_SLAM2_TEAM
 {
 
-   long unsigned int Frame::nNextId = 0;
+   // half size of the SAD window used for the subpixel stereo refinement
+   const int STEREO_SAD_WINDOW = 5;
+
+   // the SAD window is slid STEREO_SAD_RANGE pixels to each side of the descriptor match
+   const int STEREO_SAD_RANGE = 5;
+
+   // SAD between the 11x11 patch centered on pL and the patches centered on pR + incR, for incR in
+   // [-STEREO_SAD_RANGE, STEREO_SAD_RANGE]. Each patch is offset by its center pixel before the difference.
+   // The sums are exact integers, so the result is the same as the L1 norm of the float patches.
+   static void StereoSAD(const uchar * pL, size_t stepL, const uchar * pR, size_t stepR, float * vDists)
+   {
+      const int w = STEREO_SAD_WINDOW;
+      const int L = STEREO_SAD_RANGE;
+      const int W = 2 * w + 1;
+
+      // left patch minus its center, and the band of the right image covered by all the windows,
+      // both widened with zeros to whole vectors
+      short patchL[W][16];
+      short bandR[W][32];
+
+      const int centerL = pL[0];
+      for (int y = 0; y < W; y++)
+      {
+         const uchar * rowL = pL + (y - w) * (ptrdiff_t)stepL - w;
+         const uchar * rowR = pR + (y - w) * (ptrdiff_t)stepR - w - L;
+         for (int x = 0; x < 16; x++)
+            patchL[y][x] = x < W ? (short)(rowL[x] - centerL) : 0;
+         for (int x = 0; x < 32; x++)
+            bandR[y][x] = x < W + 2 * L ? (short)rowR[x] : 0;
+      }
+
+      for (int s = 0; s <= 2 * L; s++)
+      {
+         const short centerR = bandR[w][s + w];
+
+#if defined(__SSE2__) || defined(_M_X64)
+         // a row of the window fits in 16 lanes of 16 bits, the sum of 11 rows does not overflow
+         const __m128i c = _mm_set1_epi16(centerR);
+         const __m128i mask = _mm_setr_epi16(-1, -1, -1, 0, 0, 0, 0, 0);
+         __m128i acc0 = _mm_setzero_si128(), acc1 = acc0;
+         for (int y = 0; y < W; y++)
+         {
+            __m128i d0 = _mm_add_epi16(_mm_sub_epi16(_mm_loadu_si128((const __m128i *)&patchL[y][0]), _mm_loadu_si128((const __m128i *)&bandR[y][s])), c);
+            __m128i d1 = _mm_add_epi16(_mm_sub_epi16(_mm_loadu_si128((const __m128i *)&patchL[y][8]), _mm_loadu_si128((const __m128i *)&bandR[y][s + 8])), c);
+            acc0 = _mm_add_epi16(acc0, _mm_max_epi16(d0, _mm_sub_epi16(_mm_setzero_si128(), d0)));
+            acc1 = _mm_add_epi16(acc1, _mm_max_epi16(d1, _mm_sub_epi16(_mm_setzero_si128(), d1)));
+         }
+         __m128i sum = _mm_madd_epi16(_mm_add_epi16(acc0, _mm_and_si128(acc1, mask)), _mm_set1_epi16(1));
+         sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+         sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+         vDists[s] = (float)_mm_cvtsi128_si32(sum);
+#else
+         int sum = 0;
+         for (int y = 0; y < W; y++)
+            for (int x = 0; x < W; x++)
+               sum += abs(patchL[y][x] - bandR[y][s + x] + centerR);
+         vDists[s] = (float)sum;
+#endif
+      }
+   }
+
+   atomic<long unsigned int> Frame::nNextId(0);
 
-   Frame::Frame() {}
+   Frame::Frame()
+      : mbHasPose(false)
+   {}
 
    //Copy Constructor
    Frame::Frame(const Frame & frame)
@@ -41,15 +110,15 @@ namespace ORB_SLAM2_TEAM
       , N(frame.N)
       , mvKeys(frame.mvKeys)
       , mvKeysRight(frame.mvKeysRight)
-      , mvKeysUn(frame.mvKeysUn)
       , mvuRight(frame.mvuRight)
       , mvDepth(frame.mvDepth)
       , mBowVec(frame.mBowVec)
       , mFeatVec(frame.mFeatVec)
-      , mDescriptors(frame.mDescriptors.clone())
       , mDescriptorsRight(frame.mDescriptorsRight.clone())
+      , mFeatures(frame.mFeatures)
       , mvpMapPoints(frame.mvpMapPoints)
       , mvbOutlier(frame.mvbOutlier)
+      , mGrid(frame.mGrid)
       , mnId(frame.mnId)
       , mpReferenceKF(frame.mpReferenceKF)
       , mnScaleLevels(frame.mnScaleLevels)
@@ -59,13 +128,11 @@ namespace ORB_SLAM2_TEAM
       , mvInvScaleFactors(frame.mvInvScaleFactors)
       , mvLevelSigma2(frame.mvLevelSigma2)
       , mvInvLevelSigma2(frame.mvInvLevelSigma2)
+      , mTcw(frame.mTcw)
+      , mTwc(frame.mTwc)
+      , mOw(frame.mOw)
+      , mbHasPose(frame.mbHasPose)
    {
-      for (int i = 0;i < FRAME_GRID_COLS;i++)
-         for (int j = 0; j < FRAME_GRID_ROWS; j++)
-            mGrid[i][j] = frame.mGrid[i][j];
-
-      if (!frame.mTcw.empty())
-         SetPose(frame.mTcw);
    }
 
 
@@ -75,6 +142,7 @@ namespace ORB_SLAM2_TEAM
       , mTimeStamp(timeStamp)
       , mFC(FC)
       , mpReferenceKF(static_cast<KeyFrame*>(NULL))
+      , mbHasPose(false)
    {
       // Frame ID
       mnId = nNextId++;
@@ -88,17 +156,25 @@ namespace ORB_SLAM2_TEAM
       mvLevelSigma2 = mpORBextractorLeft->GetScaleSigmaSquares();
       mvInvLevelSigma2 = mpORBextractorLeft->GetInverseScaleSigmaSquares();
 
-      // ORB extraction
-      thread threadLeft(&Frame::ExtractORBLeft, this, imLeft);
-      ExtractORBRight(imRight);
-      threadLeft.join();
+      // ORB extraction, left and right images are extracted at the same time by the worker pool
+      cv::Mat descriptors;
+      mpORBextractorLeft->GetWorkerPool().ParallelFor(2, [this, &imLeft, &imRight, &descriptors](size_t i)
+      {
+         if (i == 0)
+            ExtractORBLeft(imLeft, descriptors);
+         else
+            ExtractORBRight(imRight);
+      });
 
       N = mvKeys.size();
 
       if (mvKeys.empty())
          return;
 
-      UndistortKeyPoints();
+      vector<cv::KeyPoint> keysUn;
+      UndistortKeyPoints(keysUn);
+
+      mFeatures.Assign(keysUn, descriptors);
 
       ComputeStereoMatches();
 
@@ -113,6 +189,7 @@ namespace ORB_SLAM2_TEAM
       , mpORBextractorRight(static_cast<ORBextractor*>(NULL))
       , mTimeStamp(timeStamp)
       , mFC(FC)
+      , mbHasPose(false)
    {
       // Frame ID
       mnId = nNextId++;
@@ -127,16 +204,18 @@ namespace ORB_SLAM2_TEAM
       mvInvLevelSigma2 = mpORBextractorLeft->GetInverseScaleSigmaSquares();
 
       // ORB extraction
-      ExtractORBLeft(imGray);
+      cv::Mat descriptors;
+      ExtractORBLeft(imGray, descriptors);
 
       N = mvKeys.size();
 
       if (mvKeys.empty())
          return;
 
-      UndistortKeyPoints();
+      vector<cv::KeyPoint> keysUn;
+      UndistortKeyPointsRGBD(imDepth, keysUn);
 
-      ComputeStereoFromRGBD(imDepth);
+      mFeatures.Assign(keysUn, descriptors);
 
       mvpMapPoints = vector<MapPoint*>(N, static_cast<MapPoint*>(NULL));
       mvbOutlier = vector<bool>(N, false);
@@ -150,6 +229,7 @@ namespace ORB_SLAM2_TEAM
       , mpORBextractorRight(static_cast<ORBextractor*>(NULL))
       , mTimeStamp(timeStamp)
       , mFC(FC)
+      , mbHasPose(false)
    {
       // Frame ID
       mnId = nNextId++;
@@ -164,14 +244,18 @@ namespace ORB_SLAM2_TEAM
       mvInvLevelSigma2 = mpORBextractorLeft->GetInverseScaleSigmaSquares();
 
       // ORB extraction
-      ExtractORBLeft(imGray);
+      cv::Mat descriptors;
+      ExtractORBLeft(imGray, descriptors);
 
       N = mvKeys.size();
 
       if (mvKeys.empty())
          return;
 
-      UndistortKeyPoints();
+      vector<cv::KeyPoint> keysUn;
+      UndistortKeyPoints(keysUn);
+
+      mFeatures.Assign(keysUn, descriptors);
 
       // Set no stereo information
       mvuRight = vector<float>(N, -1.0f);
@@ -185,24 +269,12 @@ namespace ORB_SLAM2_TEAM
 
    void Frame::AssignFeaturesToGrid()
    {
-      size_t nReserve = 0.5f*N / (size_t)(FRAME_GRID_COLS*FRAME_GRID_ROWS);
-      for (unsigned int i = 0; i < FRAME_GRID_COLS;i++)
-         for (unsigned int j = 0; j < FRAME_GRID_ROWS;j++)
-            mGrid[i][j].reserve(nReserve);
-
-      for (size_t i = 0;i < N; i++)
-      {
-         const cv::KeyPoint &kp = mvKeysUn[i];
-
-         int nGridPosX, nGridPosY;
-         if (PosInGrid(kp, nGridPosX, nGridPosY))
-            mGrid[nGridPosX][nGridPosY].push_back(i);
-      }
+      mGrid.Assign(mFeatures, *mFC);
    }
 
-   void Frame::ExtractORBLeft(const cv::Mat &im)
+   void Frame::ExtractORBLeft(const cv::Mat &im, cv::Mat &descriptors)
    {
-      mpORBextractorLeft->Extract(im, cv::Mat(), mvKeys, mDescriptors);
+      mpORBextractorLeft->Extract(im, cv::Mat(), mvKeys, descriptors);
    }
 
    void Frame::ExtractORBRight(const cv::Mat &im)
@@ -210,32 +282,41 @@ namespace ORB_SLAM2_TEAM
       mpORBextractorRight->Extract(im, cv::Mat(), mvKeysRight, mDescriptorsRight);
    }
 
-   void Frame::SetPose(cv::Mat Tcw)
+   void Frame::SetPose(const cv::Mat &Tcw)
    {
-      mTcw = Tcw.clone();
-      UpdatePoseMatrices();
+      SetPose(cv::Matx44f(Tcw));
    }
 
-   void Frame::UpdatePoseMatrices()
+   void Frame::SetPose(const cv::Matx44f &Tcw)
    {
-      mRcw = mTcw.rowRange(0, 3).colRange(0, 3);
-      mRwc = mRcw.t();
-      mtcw = mTcw.rowRange(0, 3).col(3);
-      mOw = -mRcw.t()*mtcw;
+      mTcw = Tcw;
+      const cv::Matx33f Rwc = mTcw.get_minor<3, 3>(0, 0).t();
+      const cv::Vec3f tcw(mTcw(0, 3), mTcw(1, 3), mTcw(2, 3));
+      mOw = -(Rwc * tcw);
+
+      mTwc = cv::Matx44f::eye();
+      for (int r = 0; r < 3; r++)
+      {
+         for (int c = 0; c < 3; c++)
+            mTwc(r, c) = Rwc(r, c);
+         mTwc(r, 3) = mOw[r];
+      }
+      mbHasPose = true;
    }
 
    bool Frame::isInFrustum(MapPoint *pMP, float viewingCosLimit)
    {
       pMP->mbTrackInView = false;
 
-      // 3D in absolute coordinates
-      cv::Mat P = pMP->GetWorldPos();
+      // 3D in absolute coordinates, read without locking or allocating
+      const MapPoint::Position pos = pMP->GetPosition();
+      const cv::Vec3f & P = pos.worldPos;
 
       // 3D in camera coordinates
-      const cv::Mat Pc = mRcw * P + mtcw;
-      const float &PcX = Pc.at<float>(0);
-      const float &PcY = Pc.at<float>(1);
-      const float &PcZ = Pc.at<float>(2);
+      const cv::Vec3f Pc = GetRotationMatx() * P + GetTranslationVec();
+      const float &PcX = Pc[0];
+      const float &PcY = Pc[1];
+      const float &PcZ = Pc[2];
 
       // Check positive depth
       if (PcZ < 0.0f)
@@ -254,16 +335,14 @@ namespace ORB_SLAM2_TEAM
       // Check distance is in the scale invariance region of the MapPoint
       const float maxDistance = pMP->GetMaxDistanceInvariance();
       const float minDistance = pMP->GetMinDistanceInvariance();
-      const cv::Mat PO = P - mOw;
+      const cv::Vec3f PO = P - mOw;
       const float dist = cv::norm(PO);
 
       if (dist<minDistance || dist>maxDistance)
          return false;
 
       // Check viewing angle
-      cv::Mat Pn = pMP->GetNormal();
-
-      const float viewCos = PO.dot(Pn) / dist;
+      const float viewCos = PO.dot(pos.normal) / dist;
 
       if (viewCos < viewingCosLimit)
          return false;
@@ -285,109 +364,64 @@ namespace ORB_SLAM2_TEAM
    vector<size_t> Frame::GetFeaturesInArea(const float &x, const float  &y, const float  &r, const int minLevel, const int maxLevel) const
    {
       vector<size_t> vIndices;
-      vIndices.reserve(N);
-
-      const int nMinCellX = max(0, (int)floor((x - mFC->minX - r) * mFC->gridElementWidthInv));
-      if (nMinCellX >= FRAME_GRID_COLS)
-         return vIndices;
-
-      const int nMaxCellX = min((int)FRAME_GRID_COLS - 1, (int)ceil((x - mFC->minX + r) * mFC->gridElementWidthInv));
-      if (nMaxCellX < 0)
-         return vIndices;
-
-      const int nMinCellY = max(0, (int)floor((y - mFC->minY - r) * mFC->gridElementHeightInv));
-      if (nMinCellY >= FRAME_GRID_ROWS)
-         return vIndices;
-
-      const int nMaxCellY = min((int)FRAME_GRID_ROWS - 1, (int)ceil((y - mFC->minY + r) * mFC->gridElementHeightInv));
-      if (nMaxCellY < 0)
-         return vIndices;
-
-      const bool bCheckLevels = (minLevel > 0) || (maxLevel >= 0);
-
-      for (int ix = nMinCellX; ix <= nMaxCellX; ix++)
-      {
-         for (int iy = nMinCellY; iy <= nMaxCellY; iy++)
-         {
-            const vector<size_t> vCell = mGrid[ix][iy];
-            if (vCell.empty())
-               continue;
-
-            for (size_t j = 0, jend = vCell.size(); j < jend; j++)
-            {
-               const cv::KeyPoint &kpUn = mvKeysUn[vCell[j]];
-               if (bCheckLevels)
-               {
-                  if (kpUn.octave < minLevel)
-                     continue;
-                  if (maxLevel >= 0)
-                     if (kpUn.octave > maxLevel)
-                        continue;
-               }
-
-               const float distx = kpUn.pt.x - x;
-               const float disty = kpUn.pt.y - y;
-
-               if (fabs(distx) < r && fabs(disty) < r)
-                  vIndices.push_back(vCell[j]);
-            }
-         }
-      }
-
+      GetFeaturesInArea(x, y, r, minLevel, maxLevel, vIndices);
       return vIndices;
    }
 
-   bool Frame::PosInGrid(const cv::KeyPoint &kp, int &posX, int &posY)
+   void Frame::GetFeaturesInArea(const float &x, const float  &y, const float  &r, const int minLevel, const int maxLevel, vector<size_t> & vIndices) const
    {
-      posX = round((kp.pt.x - mFC->minX) * mFC->gridElementWidthInv);
-      posY = round((kp.pt.y - mFC->minY) * mFC->gridElementHeightInv);
-
-      //Keypoint's coordinates are undistorted, which could cause to go out of the image
-      if (posX < 0 || posX >= FRAME_GRID_COLS || posY < 0 || posY >= FRAME_GRID_ROWS)
-         return false;
-
-      return true;
+      mGrid.GetFeaturesInArea(mFeatures, x, y, r, minLevel, maxLevel, vIndices);
    }
 
-
    void Frame::ComputeBoW(ORBVocabulary & vocab)
    {
       if (mBowVec.empty())
       {
-         vector<cv::Mat> vCurrentDesc = Converter::toDescriptorVector(mDescriptors);
+         vector<cv::Mat> vCurrentDesc = Converter::toDescriptorVector(mFeatures.Descriptors());
          vocab.transform(vCurrentDesc, mBowVec, mFeatVec, 4);
       }
    }
 
-   void Frame::UndistortKeyPoints()
+   void Frame::UndistortKeyPoints(vector<cv::KeyPoint> &keysUn)
    {
-      if (mFC->distCoef.at<float>(0) == 0.0)
-      {
-         mvKeysUn = mvKeys;
+      keysUn = mvKeys;
+      if (!mFC->HasUndistortMap())
          return;
-      }
 
-      // Fill matrix with points
-      cv::Mat mat(N, 2, CV_32F);
+      // the undistortion is precomputed for every pixel by FrameCalibration
       for (size_t i = 0; i < N; i++)
       {
-         mat.at<float>(i, 0) = mvKeys[i].pt.x;
-         mat.at<float>(i, 1) = mvKeys[i].pt.y;
+         cv::KeyPoint &kp = keysUn[i];
+         mFC->UndistortPoint(kp.pt.x, kp.pt.y, kp.pt.x, kp.pt.y);
       }
+   }
+
+   void Frame::UndistortKeyPointsRGBD(const cv::Mat &imDepth, vector<cv::KeyPoint> &keysUn)
+   {
+      keysUn = mvKeys;
+      mvuRight = vector<float>(N, -1);
+      mvDepth = vector<float>(N, -1);
 
-      // Undistort points
-      mat = mat.reshape(2);
-      cv::undistortPoints(mat, mat, mFC->K, mFC->distCoef, cv::Mat(), mFC->K);
-      mat = mat.reshape(1);
+      const bool bUndistort = mFC->HasUndistortMap();
+      const float blfx = mFC->blfx;
 
-      // Fill undistorted keypoint vector
-      mvKeysUn.resize(N);
       for (size_t i = 0; i < N; i++)
       {
-         cv::KeyPoint kp = mvKeys[i];
-         kp.pt.x = mat.at<float>(i, 0);
-         kp.pt.y = mat.at<float>(i, 1);
-         mvKeysUn[i] = kp;
+         cv::KeyPoint &kpU = keysUn[i];
+
+         // the depth is read at the distorted position, where the keypoint was detected
+         const float u = kpU.pt.x;
+         const float v = kpU.pt.y;
+         const float d = imDepth.ptr<float>((int)v)[(int)u];
+
+         if (bUndistort)
+            mFC->UndistortPoint(u, v, kpU.pt.x, kpU.pt.y);
+
+         if (d > 0)
+         {
+            mvDepth[i] = d;
+            mvuRight[i] = kpU.pt.x - blfx / d;
+         }
       }
    }
 
@@ -400,155 +434,160 @@ namespace ORB_SLAM2_TEAM
 
       const int nRows = mpORBextractorLeft->mvImagePyramid[0].rows;
 
-      //Assign keypoints to row table
-      vector<vector<size_t> > vRowIndices(nRows, vector<size_t>());
-
-      for (int i = 0; i < nRows; i++)
-         vRowIndices[i].reserve(200);
-
+      //Assign keypoints to row table, stored as one array of indices with an offset for each row
       const int Nr = mvKeysRight.size();
+      vector<int> vMinRow(Nr), vMaxRow(Nr);
+      vector<size_t> vRowStart(nRows + 1, 0);
 
       for (int iR = 0; iR < Nr; iR++)
       {
          const cv::KeyPoint &kp = mvKeysRight[iR];
          const float &kpY = kp.pt.y;
          const float r = 2.0f*mvScaleFactors[mvKeysRight[iR].octave];
-         const int maxr = ceil(kpY + r);
-         const int minr = floor(kpY - r);
+         vMinRow[iR] = max(0, (int)floor(kpY - r));
+         vMaxRow[iR] = min(nRows - 1, (int)ceil(kpY + r));
 
-         for (int yi = minr;yi <= maxr;yi++)
-            vRowIndices[yi].push_back(iR);
+         for (int yi = vMinRow[iR]; yi <= vMaxRow[iR]; yi++)
+            vRowStart[yi + 1]++;
       }
 
+      for (int yi = 0; yi < nRows; yi++)
+         vRowStart[yi + 1] += vRowStart[yi];
+
+      // the right keypoints of each row stay in ascending order, so ties are resolved as before
+      vector<size_t> vRowIndices(vRowStart[nRows]);
+      vector<size_t> vRowFill(vRowStart.begin(), vRowStart.end() - 1);
+      for (int iR = 0; iR < Nr; iR++)
+         for (int yi = vMinRow[iR]; yi <= vMaxRow[iR]; yi++)
+            vRowIndices[vRowFill[yi]++] = iR;
+
+      FeatureStore featuresRight;
+      featuresRight.Assign(mvKeysRight, mDescriptorsRight);
+
       // Set limits for search
       const float minZ = mFC->bl;
       const float minD = 0;
       const float maxD = mFC->blfx / minZ;
 
-      // For each left keypoint search a match in the right image
-      vector<pair<int, int> > vDistIdx;
-      vDistIdx.reserve(N);
+      // SAD distance of the match of each left keypoint, -1 if there is no match
+      vector<int> vMatchDist(N, -1);
 
-      for (size_t iL = 0; iL < N; iL++)
+      // For each left keypoint search a match in the right image, the left keypoints are split into chunks for the worker pool
+      WorkerPool & pool = mpORBextractorLeft->GetWorkerPool();
+      const size_t nChunks = min(N, (size_t)pool.QuantityThreads() * 4);
+      pool.ParallelFor(nChunks, [&](size_t iChunk)
       {
-         const cv::KeyPoint &kpL = mvKeys[iL];
-         const int &levelL = kpL.octave;
-         const float &vL = kpL.pt.y;
-         const float &uL = kpL.pt.x;
-
-         const vector<size_t> &vCandidates = vRowIndices[vL];
-
-         if (vCandidates.empty())
-            continue;
-
-         const float minU = uL - maxD;
-         const float maxU = uL - minD;
-
-         if (maxU < 0)
-            continue;
-
-         int bestDist = ORBmatcher::TH_HIGH;
-         size_t bestIdxR = 0;
-
-         const cv::Mat &dL = mDescriptors.row(iL);
+         vector<size_t> vCandidates;
+         float vDists[2 * STEREO_SAD_RANGE + 1];
 
-         // Compare descriptor to right keypoints
-         for (size_t iC = 0; iC < vCandidates.size(); iC++)
+         for (size_t iL = iChunk * N / nChunks, iendL = (iChunk + 1) * N / nChunks; iL < iendL; iL++)
          {
-            const size_t iR = vCandidates[iC];
-            const cv::KeyPoint &kpR = mvKeysRight[iR];
+            const cv::KeyPoint &kpL = mvKeys[iL];
+            const int &levelL = kpL.octave;
+            const float &vL = kpL.pt.y;
+            const float &uL = kpL.pt.x;
 
-            if (kpR.octave<levelL - 1 || kpR.octave>levelL + 1)
+            const int row = (int)vL;
+            if (row < 0 || row >= nRows || vRowStart[row] == vRowStart[row + 1])
                continue;
 
-            const float &uR = kpR.pt.x;
+            const float minU = uL - maxD;
+            const float maxU = uL - minD;
 
-            if (uR >= minU && uR <= maxU)
+            if (maxU < 0)
+               continue;
+
+            vCandidates.clear();
+            for (size_t iC = vRowStart[row], iendC = vRowStart[row + 1]; iC < iendC; iC++)
             {
-               const cv::Mat &dR = mDescriptorsRight.row(iR);
-               const int dist = ORBmatcher::DescriptorDistance(dL, dR);
+               const size_t iR = vRowIndices[iC];
+               const cv::KeyPoint &kpR = mvKeysRight[iR];
 
-               if (dist < bestDist)
-               {
-                  bestDist = dist;
-                  bestIdxR = iR;
-               }
+               if (kpR.octave<levelL - 1 || kpR.octave>levelL + 1)
+                  continue;
+
+               const float &uR = kpR.pt.x;
+
+               if (uR >= minU && uR <= maxU)
+                  vCandidates.push_back(iR);
             }
-         }
 
-         // Subpixel match by correlation
-         if (bestDist < thOrbDist)
-         {
-            // coordinates in image pyramid at keypoint scale
-            const float uR0 = mvKeysRight[bestIdxR].pt.x;
-            const float scaleFactor = mvInvScaleFactors[kpL.octave];
-            const float scaleduL = round(kpL.pt.x*scaleFactor);
-            const float scaledvL = round(kpL.pt.y*scaleFactor);
-            const float scaleduR0 = round(uR0*scaleFactor);
-
-            // sliding window search
-            const int w = 5;
-            cv::Mat IL = mpORBextractorLeft->mvImagePyramid[kpL.octave].rowRange(scaledvL - w, scaledvL + w + 1).colRange(scaleduL - w, scaleduL + w + 1);
-            IL.convertTo(IL, CV_32F);
-            IL = IL - IL.at<float>(w, w) *cv::Mat::ones(IL.rows, IL.cols, CV_32F);
-
-            int bestDist = INT_MAX;
-            int bestincR = 0;
-            const int L = 5;
-            vector<float> vDists;
-            vDists.resize(2 * L + 1);
-
-            const float iniu = scaleduR0 + L - w;
-            const float endu = scaleduR0 + L + w + 1;
-            if (iniu < 0 || endu >= mpORBextractorRight->mvImagePyramid[kpL.octave].cols)
-               continue;
+            // Compare descriptor to right keypoints
+            const HammingDistance::Result best = HammingDistance::FindBest(mFeatures.Descriptor(iL), featuresRight, vCandidates.data(), vCandidates.size());
 
-            for (int incR = -L; incR <= +L; incR++)
+            // Subpixel match by correlation
+            if (best.bestDist < thOrbDist)
             {
-               cv::Mat IR = mpORBextractorRight->mvImagePyramid[kpL.octave].rowRange(scaledvL - w, scaledvL + w + 1).colRange(scaleduR0 + incR - w, scaleduR0 + incR + w + 1);
-               IR.convertTo(IR, CV_32F);
-               IR = IR - IR.at<float>(w, w) *cv::Mat::ones(IR.rows, IR.cols, CV_32F);
-
-               float dist = cv::norm(IL, IR, cv::NORM_L1);
-               if (dist < bestDist)
+               // coordinates in image pyramid at keypoint scale
+               const float uR0 = mvKeysRight[best.bestIdx].pt.x;
+               const float scaleFactor = mvInvScaleFactors[kpL.octave];
+               const int scaleduL = round(kpL.pt.x*scaleFactor);
+               const int scaledvL = round(kpL.pt.y*scaleFactor);
+               const int scaleduR0 = round(uR0*scaleFactor);
+
+               // sliding window search
+               const int w = STEREO_SAD_WINDOW;
+               const int L = STEREO_SAD_RANGE;
+
+               const cv::Mat &imL = mpORBextractorLeft->mvImagePyramid[kpL.octave];
+               const cv::Mat &imR = mpORBextractorRight->mvImagePyramid[kpL.octave];
+               const int iniu = scaleduR0 + L - w;
+               const int endu = scaleduR0 + L + w + 1;
+               if (iniu < 0 || endu >= imR.cols || scaleduR0 - L - w < 0)
+                  continue;
+
+               StereoSAD(imL.ptr<uchar>(scaledvL) + scaleduL, imL.step, imR.ptr<uchar>(scaledvL) + scaleduR0, imR.step, vDists);
+
+               float bestDist = FLT_MAX;
+               int bestincR = 0;
+               for (int incR = -L; incR <= +L; incR++)
                {
-                  bestDist = dist;
-                  bestincR = incR;
+                  if (vDists[L + incR] < bestDist)
+                  {
+                     bestDist = vDists[L + incR];
+                     bestincR = incR;
+                  }
                }
 
-               vDists[L + incR] = dist;
-            }
-
-            if (bestincR == -L || bestincR == L)
-               continue;
+               if (bestincR == -L || bestincR == L)
+                  continue;
 
-            // Sub-pixel match (Parabola fitting)
-            const float dist1 = vDists[L + bestincR - 1];
-            const float dist2 = vDists[L + bestincR];
-            const float dist3 = vDists[L + bestincR + 1];
+               // Sub-pixel match (Parabola fitting)
+               const float dist1 = vDists[L + bestincR - 1];
+               const float dist2 = vDists[L + bestincR];
+               const float dist3 = vDists[L + bestincR + 1];
 
-            const float deltaR = (dist1 - dist3) / (2.0f*(dist1 + dist3 - 2.0f*dist2));
+               const float deltaR = (dist1 - dist3) / (2.0f*(dist1 + dist3 - 2.0f*dist2));
 
-            if (deltaR < -1 || deltaR>1)
-               continue;
+               if (deltaR < -1 || deltaR>1)
+                  continue;
 
-            // Re-scaled coordinate
-            float bestuR = mvScaleFactors[kpL.octave] * ((float)scaleduR0 + (float)bestincR + deltaR);
+               // Re-scaled coordinate
+               float bestuR = mvScaleFactors[kpL.octave] * ((float)scaleduR0 + (float)bestincR + deltaR);
 
-            float disparity = (uL - bestuR);
+               float disparity = (uL - bestuR);
 
-            if (disparity >= minD && disparity < maxD)
-            {
-               if (disparity <= 0)
+               if (disparity >= minD && disparity < maxD)
                {
-                  disparity = 0.01;
-                  bestuR = uL - 0.01;
+                  if (disparity <= 0)
+                  {
+                     disparity = 0.01;
+                     bestuR = uL - 0.01;
+                  }
+                  mvDepth[iL] = mFC->blfx / disparity;
+                  mvuRight[iL] = bestuR;
+                  vMatchDist[iL] = (int)bestDist;
                }
-               mvDepth[iL] = mFC->blfx / disparity;
-               mvuRight[iL] = bestuR;
-               vDistIdx.push_back(pair<int, int>(bestDist, iL));
             }
          }
+      });
+
+      vector<pair<int, int> > vDistIdx;
+      vDistIdx.reserve(N);
+      for (size_t iL = 0; iL < N; iL++)
+      {
+         if (vMatchDist[iL] >= 0)
+            vDistIdx.push_back(pair<int, int>(vMatchDist[iL], iL));
       }
 
       if (vDistIdx.size() <= 0)
@@ -570,41 +609,17 @@ namespace ORB_SLAM2_TEAM
       }
    }
 
-
-   void Frame::ComputeStereoFromRGBD(const cv::Mat &imDepth)
-   {
-      mvuRight = vector<float>(N, -1);
-      mvDepth = vector<float>(N, -1);
-
-      for (size_t i = 0; i < N; i++)
-      {
-         const cv::KeyPoint &kp = mvKeys[i];
-         const cv::KeyPoint &kpU = mvKeysUn[i];
-
-         const float &v = kp.pt.y;
-         const float &u = kp.pt.x;
-
-         const float d = imDepth.at<float>(v, u);
-
-         if (d > 0)
-         {
-            mvDepth[i] = d;
-            mvuRight[i] = kpU.pt.x - mFC->blfx / d;
-         }
-      }
-   }
-
    cv::Mat Frame::UnprojectStereo(const int &i)
    {
       const float z = mvDepth[i];
       if (z > 0)
       {
-         const float u = mvKeysUn[i].pt.x;
-         const float v = mvKeysUn[i].pt.y;
+         const float u = mFeatures.X(i);
+         const float v = mFeatures.Y(i);
          const float x = (u - mFC->cx) * z * mFC->invfx;
          const float y = (v - mFC->cy) * z * mFC->invfy;
-         cv::Mat x3Dc = (cv::Mat_<float>(3, 1) << x, y, z);
-         return mRwc * x3Dc + mOw;
+         const cv::Vec3f x3Dw = GetRotationInverseMatx() * cv::Vec3f(x, y, z) + mOw;
+         return cv::Mat(x3Dw);
       }
       else
          return cv::Mat();
@@ -51,7 +51,8 @@ namespace ORB_SLAM2_TEAM
 
    FrameCalibration::FrameCalibration(const FrameCalibration & FC) : FrameCalibration()
    {
-      Initialize(FC.mK, FC.mDistCoef, FC.mWidth, FC.mHeight, FC.mBlfx, FC.mThDepth);
+      InitializeCamera(FC.mK, FC.mDistCoef, FC.mWidth, FC.mHeight, FC.mBlfx, FC.mThDepth);
+      mUndistortMap = FC.mUndistortMap;
    }
 
    FrameCalibration::FrameCalibration(
@@ -66,6 +67,18 @@ namespace ORB_SLAM2_TEAM
    }
 
    void FrameCalibration::Initialize(
+      const cv::Mat & K,
+      const cv::Mat & distCoef,
+      const int & width,
+      const int & height,
+      const float & blfx,
+      const float & thDepth)
+   {
+      InitializeCamera(K, distCoef, width, height, blfx, thDepth);
+      InitializeUndistortMap();
+   }
+
+   void FrameCalibration::InitializeCamera(
       const cv::Mat & K, 
       const cv::Mat & distCoef, 
       const int & width, 
@@ -116,6 +129,26 @@ namespace ORB_SLAM2_TEAM
       mThDepth = thDepth;
    }
 
+   void FrameCalibration::InitializeUndistortMap()
+   {
+      if (mDistCoef.at<float>(0) == 0.0 || mWidth <= 0 || mHeight <= 0)
+      {
+         mUndistortMap.release();
+         return;
+      }
+
+      // the iterative undistortion is solved once here for every pixel corner,
+      // so each frame only samples the map
+      cv::Mat mat((mWidth + 1) * (mHeight + 1), 1, CV_32FC2);
+      cv::Vec2f * pPoint = mat.ptr<cv::Vec2f>();
+      for (int y = 0; y <= mHeight; y++)
+         for (int x = 0; x <= mWidth; x++, pPoint++)
+            *pPoint = cv::Vec2f((float)x, (float)y);
+
+      cv::undistortPoints(mat, mat, mK, mDistCoef, cv::Mat(), mK);
+      mUndistortMap = mat.reshape(2, mHeight + 1);
+   }
+
    size_t FrameCalibration::GetBufferSize() const
    {
       size_t size = sizeof(FrameCalibration::Header);
@@ -138,7 +171,8 @@ namespace ORB_SLAM2_TEAM
       pData = Serializer::ReadMatrix(pData, K);
       pData = Serializer::ReadMatrix(pData, distCoef);
 
-      Initialize(K, distCoef, width, height, bl, thDepth);
+      // received calibrations only describe KeyFrames, they do not undistort new keypoints
+      InitializeCamera(K, distCoef, width, height, bl, thDepth);
 
       return pData;
    }
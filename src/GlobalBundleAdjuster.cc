@@ -0,0 +1,528 @@
+/**
+* This file is part of ORB-SLAM2-TEAM.
+*
+* Copyright (C) 2018 Joe Bedard <mr dot joe dot bedard at gmail dot com>
+* For more information see <https://github.com/joebedard/ORB_SLAM2_TEAM>
+*
+* ORB-SLAM2-TEAM is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2-TEAM is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2-TEAM. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "GlobalBundleAdjuster.h"
+#include "Converter.h"
+
+#include "g2o/core/block_solver.h"
+#include "g2o/core/optimization_algorithm_levenberg.h"
+#include "g2o/solvers/linear_solver_eigen.h"
+
+#include <algorithm>
+#include <list>
+#include <unordered_set>
+
+namespace ORB_SLAM2_TEAM
+{
+
+   // iterations between checks for new KeyFrames and MapPoints
+   static const int ROUND_ITERATIONS = 2;
+
+   // KeyFrames and MapPoints corrected for each lock of the map by Publish
+   static const size_t PUBLISH_KEYFRAMES = 50;
+   static const size_t PUBLISH_MAPPOINTS = 2000;
+
+   GlobalBundleAdjuster::GlobalBundleAdjuster(int numThreads)
+      : SyncPrint("GlobalBundleAdjuster: ")
+      , mPass(0)
+   {
+      g2o::BlockSolver_6_3::LinearSolverType * linearSolver = new g2o::LinearSolverEigen<g2o::BlockSolver_6_3::PoseMatrixType>();
+      g2o::BlockSolver_6_3 * solver_ptr = new g2o::BlockSolver_6_3(linearSolver);
+      g2o::OptimizationAlgorithmLevenberg * solver = new g2o::OptimizationAlgorithmLevenberg(solver_ptr);
+      mOptimizer.setAlgorithm(solver);
+      mOptimizer.setNumThreads(numThreads);
+   }
+
+   bool GlobalBundleAdjuster::Optimize(Map & theMap, int nIterations, bool * pbStopFlag)
+   {
+      Print("begin Optimize");
+
+      {
+         Print("waiting to lock map");
+         unique_lock<mutex> lock(theMap.mutexMapUpdate);
+         Print("map is locked");
+         Sync(theMap, true);
+      }
+
+      mOptimizer.setForceStopFlag(pbStopFlag);
+
+      if (!mOptimizer.initializeOptimization())
+         throw exception("GlobalBundleAdjuster::Optimize initializeOptimization() failed");
+
+      int nDone = 0;
+      while (true)
+      {
+         const int n = min(ROUND_ITERATIONS, nIterations - nDone);
+         mOptimizer.optimize(n);
+         nDone += n;
+
+         if (pbStopFlag)
+            if (*pbStopFlag)
+            {
+               Print("end Optimize 1");
+               return false;
+            }
+
+         if (nDone >= nIterations)
+            break;
+
+         // KeyFrames created by the trackers during the round join the next one
+         bool bChanged;
+         {
+            Print("waiting to lock map");
+            unique_lock<mutex> lock(theMap.mutexMapUpdate);
+            Print("map is locked");
+            bChanged = Sync(theMap, false);
+         }
+
+         if (bChanged && !mOptimizer.initializeOptimization())
+            throw exception("GlobalBundleAdjuster::Optimize initializeOptimization() failed");
+      }
+
+      Print("end Optimize 2");
+      return true;
+   }
+
+   void GlobalBundleAdjuster::Publish(Map & theMap, id_type loopKeyFrameId)
+   {
+      Print("begin Publish");
+
+      // Correct KeyFrames starting at the map's first KeyFrames, each parent is corrected before its children
+      // mnBAGlobalForKF may already equal loopKeyFrameId from a stopped run with the same loop, so the KeyFrames
+      // corrected by this call are tracked here
+      list<KeyFrame *> lpKFtoCheck;
+      unordered_set<KeyFrame *> sCorrected;
+      {
+         Print("waiting to lock map");
+         unique_lock<mutex> lock(theMap.mutexMapUpdate);
+         Print("map is locked");
+
+         lpKFtoCheck.assign(theMap.mvpKeyFrameOrigins.begin(), theMap.mvpKeyFrameOrigins.end());
+         for (KeyFrame * pKF : lpKFtoCheck)
+         {
+            KeyFrameRecord * pRecord = FindKeyFrame(pKF);
+            pKF->mTcwGBA = pRecord ? Converter::toCvMat(pRecord->pVertex->estimate()) : pKF->GetPose();
+            pKF->mnBAGlobalForKF = loopKeyFrameId;
+            sCorrected.insert(pKF);
+         }
+      }
+
+      while (!lpKFtoCheck.empty())
+      {
+         unique_lock<mutex> lock(theMap.mutexMapUpdate);
+
+         for (size_t n = 0; n < PUBLISH_KEYFRAMES && !lpKFtoCheck.empty(); n++)
+         {
+            KeyFrame * pKF = lpKFtoCheck.front();
+            const set<KeyFrame *> sChilds = pKF->GetChilds();
+            cv::Mat Twc = pKF->GetPoseInverse();
+            for (KeyFrame * pChild : sChilds)
+            {
+               if (!sCorrected.insert(pChild).second)
+                  continue;
+
+               // a KeyFrame in the graph always takes its optimized pose, the others follow their parent
+               KeyFrameRecord * pRecord = FindKeyFrame(pChild);
+               if (pRecord)
+               {
+                  pChild->mTcwGBA = Converter::toCvMat(pRecord->pVertex->estimate());
+               }
+               else
+               {
+                  cv::Mat Tchildc = pChild->GetPose() * Twc;
+                  pChild->mTcwGBA = Tchildc * pKF->mTcwGBA;
+               }
+               pChild->mnBAGlobalForKF = loopKeyFrameId;
+               lpKFtoCheck.push_back(pChild);
+            }
+
+            pKF->mTcwBefGBA = pKF->GetPose();
+            pKF->SetPose(pKF->mTcwGBA);
+            lpKFtoCheck.pop_front();
+         }
+      }
+
+      // Correct MapPoints
+      Map::MapPointSnapshot pMPs = theMap.GetMapPointSnapshot();
+      const vector<MapPoint *> & vpMPs = *pMPs;
+
+      for (size_t i = 0; i < vpMPs.size(); )
+      {
+         unique_lock<mutex> lock(theMap.mutexMapUpdate);
+
+         for (const size_t iend = min(i + PUBLISH_MAPPOINTS, vpMPs.size()); i < iend; i++)
+         {
+            MapPoint * pMP = vpMPs[i];
+
+            if (pMP->IsBad())
+               continue;
+
+            auto it = mMapPoints.find(pMP->id);
+            if (it != mMapPoints.end())
+            {
+               // If optimized by Global BA, just update
+               pMP->SetWorldPos(Converter::toCvMat(it->second.pVertex->estimate()));
+            }
+            else
+            {
+               // Update according to the correction of its reference keyframe
+               KeyFrame * pRefKF = pMP->GetReferenceKeyFrame();
+               if (pRefKF == NULL)
+                  throw exception("GlobalBundleAdjuster::Publish detected a MapPoint without a reference KeyFrame");
+
+               // mTcwBefGBA is only current for the KeyFrames corrected above
+               if (!sCorrected.count(pRefKF))
+                  continue;
+
+               // Map to non-corrected camera
+               cv::Mat Rcw = pRefKF->mTcwBefGBA.rowRange(0, 3).colRange(0, 3);
+               cv::Mat tcw = pRefKF->mTcwBefGBA.rowRange(0, 3).col(3);
+               cv::Mat Xc = Rcw * pMP->GetWorldPos() + tcw;
+
+               // Backproject using corrected camera
+               cv::Mat Twc = pRefKF->GetPoseInverse();
+               cv::Mat Rwc = Twc.rowRange(0, 3).colRange(0, 3);
+               cv::Mat twc = Twc.rowRange(0, 3).col(3);
+
+               pMP->SetWorldPos(Rwc * Xc + twc);
+            }
+         }
+      }
+
+      Print("end Publish");
+   }
+
+   void GlobalBundleAdjuster::Clear()
+   {
+      mOptimizer.clear();
+      mKeyFrames.clear();
+      mMapPoints.clear();
+      mNewKeyFrames.clear();
+   }
+
+   bool GlobalBundleAdjuster::Sync(Map & theMap, bool bReadEstimates)
+   {
+      mPass++;
+      bool bChanged = false;
+
+      Map::KeyFrameSnapshot pKFs = theMap.GetKeyFrameSnapshot();
+      Map::MapPointSnapshot pMPs = theMap.GetMapPointSnapshot();
+
+      // Set KeyFrame vertices
+      mNewKeyFrames.clear();
+      for (KeyFrame * pKF : *pKFs)
+      {
+         if (pKF->IsBad())
+            continue;
+
+         auto it = mKeyFrames.find(pKF->id);
+         if (it == mKeyFrames.end())
+         {
+            mNewKeyFrames.push_back(pKF);
+            continue;
+         }
+
+         if (bReadEstimates)
+            it->second.pVertex->setEstimate(Converter::toSE3Quat(pKF->GetPoseMatx()));
+         it->second.pass = mPass;
+      }
+
+      // A new KeyFrame keeps its pose relative to its parent, so it starts from the parent's solution.
+      // Its parent may be new too, so the KeyFrames whose parent is not in the graph wait for the next pass,
+      // and they start from the map if a pass adds nothing.
+      vector<KeyFrame *> vPending(mNewKeyFrames);
+      bool bForce = bReadEstimates;
+      while (!vPending.empty())
+      {
+         size_t nWaiting = 0;
+         for (size_t i = 0; i < vPending.size(); i++)
+         {
+            KeyFrame * pKF = vPending[i];
+            g2o::SE3Quat Tcw = Converter::toSE3Quat(pKF->GetPoseMatx());
+            if (!bReadEstimates)
+            {
+               KeyFrame * pParent = pKF->GetParent();
+               KeyFrameRecord * pParentRecord = FindKeyFrame(pParent);
+               if (pParentRecord)
+                  Tcw = Tcw * Converter::toSE3Quat(pParent->GetPoseMatx()).inverse() * pParentRecord->pVertex->estimate();
+               else if (!bForce)
+               {
+                  vPending[nWaiting++] = pKF;
+                  continue;
+               }
+            }
+            AddKeyFrameVertex(pKF, Tcw);
+            bChanged = true;
+         }
+         bForce = nWaiting == vPending.size();
+         vPending.resize(nWaiting);
+      }
+
+      if (bReadEstimates)
+      {
+         // Set MapPoint vertices and edges, and remove the observations that were unlinked
+         for (MapPoint * pMP : *pMPs)
+         {
+            if (pMP->IsBad())
+               continue;
+
+            const Eigen::Vector3d x3Dw = Converter::toVector3d(pMP->GetPosition().worldPos);
+            auto it = mMapPoints.find(pMP->id);
+            if (it == mMapPoints.end())
+            {
+               AddMapPointVertex(pMP, x3Dw);
+            }
+            else
+            {
+               it->second.pVertex->setEstimate(x3Dw);
+               it->second.pass = mPass;
+               SyncEdges(pMP, it->second);
+            }
+         }
+
+         // Remove the MapPoints that are bad or lost all their edges, removing a vertex also deletes its edges
+         for (auto it = mMapPoints.begin(); it != mMapPoints.end(); )
+         {
+            if (it->second.pass != mPass || it->second.edges.empty())
+            {
+               mOptimizer.removeVertex(it->second.pVertex);
+               it = mMapPoints.erase(it);
+            }
+            else
+               it++;
+         }
+
+         // Remove the bad KeyFrames, their edges were removed with their observations
+         for (auto it = mKeyFrames.begin(); it != mKeyFrames.end(); )
+         {
+            if (it->second.pass != mPass)
+            {
+               mOptimizer.removeVertex(it->second.pVertex);
+               it = mKeyFrames.erase(it);
+            }
+            else
+               it++;
+         }
+
+         // the graph is initialized after the first Sync of a run
+         return true;
+      }
+
+      // Add the observations of the new KeyFrames to the MapPoints in the graph
+      for (KeyFrame * pKF : mNewKeyFrames)
+      {
+         g2o::VertexSE3Expmap * pKeyFrameVertex = mKeyFrames.at(pKF->id).pVertex;
+         const vector<MapPoint *> vpMPs = pKF->GetMapPointMatches();
+         for (size_t idx = 0; idx < vpMPs.size(); idx++)
+         {
+            MapPoint * pMP = vpMPs[idx];
+            if (!pMP)
+               continue;
+            auto it = mMapPoints.find(pMP->id);
+            if (it == mMapPoints.end() || pMP->IsBad())
+               continue;
+
+            it->second.edges.push_back(EdgeRecord());
+            EdgeRecord & edge = it->second.edges.back();
+            edge.keyFrameId = pKF->id;
+            edge.pEdge = NULL;
+            AddEdge(it->second.pVertex, pKeyFrameVertex, pKF, idx, edge);
+         }
+      }
+
+      // Add the new MapPoints, each keeps its position relative to its reference KeyFrame
+      for (MapPoint * pMP : *pMPs)
+      {
+         if (pMP->IsBad() || mMapPoints.count(pMP->id))
+            continue;
+
+         Eigen::Vector3d x3Dw = Converter::toVector3d(pMP->GetPosition().worldPos);
+         KeyFrame * pRefKF = pMP->GetReferenceKeyFrame();
+         KeyFrameRecord * pRefRecord = FindKeyFrame(pRefKF);
+         if (pRefRecord)
+            x3Dw = pRefRecord->pVertex->estimate().inverse().map(Converter::toSE3Quat(pRefKF->GetPoseMatx()).map(x3Dw));
+
+         if (AddMapPointVertex(pMP, x3Dw))
+            bChanged = true;
+      }
+
+      return bChanged;
+   }
+
+   GlobalBundleAdjuster::KeyFrameRecord * GlobalBundleAdjuster::FindKeyFrame(KeyFrame * pKF)
+   {
+      if (pKF == NULL)
+         return NULL;
+      auto it = mKeyFrames.find(pKF->id);
+      if (it == mKeyFrames.end() || it->second.pass != mPass)
+         return NULL;
+      return &it->second;
+   }
+
+   void GlobalBundleAdjuster::AddKeyFrameVertex(KeyFrame * pKF, const g2o::SE3Quat & Tcw)
+   {
+      KeyFrameRecord & record = mKeyFrames[pKF->id];
+      record.pVertex = new g2o::VertexSE3Expmap();
+      record.pVertex->setEstimate(Tcw);
+      record.pVertex->setId(VertexId(pKF->id));
+      record.pVertex->setFixed(pKF->id == 0);
+      record.pass = mPass;
+      if (!mOptimizer.addVertex(record.pVertex))
+         Print("mOptimizer.addVertex(vSE3) failed");
+   }
+
+   bool GlobalBundleAdjuster::AddMapPointVertex(MapPoint * pMP, const Eigen::Vector3d & x3Dw)
+   {
+      PointRecord record;
+      record.pVertex = new g2o::VertexSBAPointXYZ();
+      record.pVertex->setEstimate(x3Dw);
+      record.pVertex->setId(VertexId(pMP));
+      record.pVertex->setMarginalized(true);
+      record.pass = mPass;
+      if (!mOptimizer.addVertex(record.pVertex))
+         Print("mOptimizer.addVertex(vPoint) failed");
+
+      SyncEdges(pMP, record);
+
+      if (record.edges.empty())
+      {
+         mOptimizer.removeVertex(record.pVertex);
+         return false;
+      }
+
+      mMapPoints[pMP->id] = std::move(record);
+      return true;
+   }
+
+   void GlobalBundleAdjuster::SyncEdges(MapPoint * pMP, PointRecord & record)
+   {
+      const ObservationMap observations = pMP->GetObservations();
+      for (const ObservationMap::value_type & obs : observations)
+      {
+         KeyFrame * pKFi = obs.first;
+         if (pKFi->IsBad())
+            continue;
+
+         KeyFrameRecord * pKeyFrameRecord = FindKeyFrame(pKFi);
+         if (pKeyFrameRecord == NULL)
+            continue;
+
+         EdgeRecord * pEdge = NULL;
+         for (EdgeRecord & edge : record.edges)
+         {
+            if (edge.keyFrameId == pKFi->id)
+            {
+               pEdge = &edge;
+               break;
+            }
+         }
+
+         if (pEdge == NULL)
+         {
+            record.edges.push_back(EdgeRecord());
+            pEdge = &record.edges.back();
+            pEdge->keyFrameId = pKFi->id;
+            pEdge->pEdge = NULL;
+         }
+
+         AddEdge(record.pVertex, pKeyFrameRecord->pVertex, pKFi, obs.second, *pEdge);
+      }
+
+      // Remove the edges of observations that were unlinked
+      vector<EdgeRecord> & edges = record.edges;
+      for (size_t i = 0; i < edges.size(); )
+      {
+         if (edges[i].pass != mPass)
+         {
+            mOptimizer.removeEdge(edges[i].pEdge);
+            edges[i] = edges.back();
+            edges.pop_back();
+         }
+         else
+            i++;
+      }
+   }
+
+   void GlobalBundleAdjuster::AddEdge(
+      g2o::VertexSBAPointXYZ * pPointVertex,
+      g2o::VertexSE3Expmap * pKeyFrameVertex,
+      KeyFrame * pKF,
+      size_t idx,
+      EdgeRecord & record)
+   {
+      const bool stereo = pKF->right[idx] >= 0;
+      record.pass = mPass;
+
+      if (record.pEdge)
+      {
+         if (record.idx == idx && record.stereo == stereo)
+            return;
+         mOptimizer.removeEdge(record.pEdge);
+      }
+
+      const float kpUnX = pKF->features.X(idx);
+      const float kpUnY = pKF->features.Y(idx);
+      const int kpUnOctave = pKF->features.Octave(idx);
+      const float & invSigma2 = pKF->invLevelSigma2[kpUnOctave];
+
+      if (!stereo)
+      {
+         Eigen::Matrix<double, 2, 1> obs;
+         obs << kpUnX, kpUnY;
+
+         g2o::EdgeSE3ProjectXYZ * e = new g2o::EdgeSE3ProjectXYZ();
+         e->setVertex(0, pPointVertex);
+         e->setVertex(1, pKeyFrameVertex);
+         e->setMeasurement(obs);
+         e->setInformation(Eigen::Matrix2d::Identity()*invSigma2);
+
+         e->fx = pKF->mFC.fx;
+         e->fy = pKF->mFC.fy;
+         e->cx = pKF->mFC.cx;
+         e->cy = pKF->mFC.cy;
+         record.pEdge = e;
+      }
+      else
+      {
+         Eigen::Matrix<double, 3, 1> obs;
+         const float kp_ur = pKF->right[idx];
+         obs << kpUnX, kpUnY, kp_ur;
+
+         g2o::EdgeStereoSE3ProjectXYZ * e = new g2o::EdgeStereoSE3ProjectXYZ();
+         e->setVertex(0, pPointVertex);
+         e->setVertex(1, pKeyFrameVertex);
+         e->setMeasurement(obs);
+         e->setInformation(Eigen::Matrix3d::Identity()*invSigma2);
+
+         e->fx = pKF->mFC.fx;
+         e->fy = pKF->mFC.fy;
+         e->cx = pKF->mFC.cx;
+         e->cy = pKF->mFC.cy;
+         e->bf = pKF->mFC.blfx;
+         record.pEdge = e;
+      }
+
+      record.idx = idx;
+      record.stereo = stereo;
+      if (!mOptimizer.addEdge(record.pEdge))
+         Print("mOptimizer.addEdge(e) failed");
+   }
+
+}
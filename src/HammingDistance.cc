@@ -0,0 +1,276 @@
+/**
+* This file is part of ORB-SLAM2-TEAM.
+*
+* Copyright (C) 2018 Joe Bedard <mr dot joe dot bedard at gmail dot com>
+* For more information see <https://github.com/joebedard/ORB_SLAM2_TEAM>
+*
+* ORB-SLAM2-TEAM is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2-TEAM is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2-TEAM. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "HammingDistance.h"
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define HAMMING_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// GCC and Clang only emit AVX instructions inside functions compiled for that target
+#if defined(__GNUC__)
+#define HAMMING_TARGET(t) __attribute__((target(t)))
+#else
+#define HAMMING_TARGET(t)
+#endif
+
+namespace ORB_SLAM2_TEAM
+{
+
+   static const int DESCRIPTOR_SIZE = FeatureStore::DESCRIPTOR_SIZE;
+
+   typedef void (*BatchKernel)(const unsigned char * query, const unsigned char * base, const size_t * indices, size_t n, int * distances);
+
+   // Bit set counting: http://graphics.stanford.edu/~seander/bithacks.html#CountBitsSetParallel
+   static int distanceScalar(const unsigned char * a, const unsigned char * b)
+   {
+      int dist = 0;
+      for (int i = 0; i < DESCRIPTOR_SIZE; i += 4)
+      {
+         uint32_t va, vb;
+         memcpy(&va, a + i, 4);
+         memcpy(&vb, b + i, 4);
+         uint32_t v = va ^ vb;
+         v = v - ((v >> 1) & 0x55555555);
+         v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
+         dist += (((v + (v >> 4)) & 0xF0F0F0F) * 0x1010101) >> 24;
+      }
+      return dist;
+   }
+
+   static void batchScalar(const unsigned char * query, const unsigned char * base, const size_t * indices, size_t n, int * distances)
+   {
+      for (size_t i = 0; i < n; i++)
+         distances[i] = distanceScalar(query, base + indices[i] * DESCRIPTOR_SIZE);
+   }
+
+#if defined(HAMMING_X86)
+
+   HAMMING_TARGET("avx2")
+   static inline __m256i popcountBytesAvx2(__m256i x)
+   {
+      const __m256i lut = _mm256_setr_epi8(
+         0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+         0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+      const __m256i lowMask = _mm256_set1_epi8(0x0f);
+      const __m256i lo = _mm256_shuffle_epi8(lut, _mm256_and_si256(x, lowMask));
+      const __m256i hi = _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(x, 4), lowMask));
+      return _mm256_add_epi8(lo, hi);
+   }
+
+   // sum of the four 64-bit lanes
+   HAMMING_TARGET("avx2")
+   static inline int sumEpi64Avx2(__m256i v)
+   {
+      __m128i s = _mm_add_epi64(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+      s = _mm_add_epi64(s, _mm_unpackhi_epi64(s, s));
+      return _mm_cvtsi128_si32(s);
+   }
+
+   HAMMING_TARGET("avx2")
+   static inline int horizontalSumAvx2(__m256i bytes)
+   {
+      return sumEpi64Avx2(_mm256_sad_epu8(bytes, _mm256_setzero_si256()));
+   }
+
+   HAMMING_TARGET("avx2")
+   static void batchAvx2(const unsigned char * query, const unsigned char * base, const size_t * indices, size_t n, int * distances)
+   {
+      const __m256i q = _mm256_loadu_si256((const __m256i *)query);
+      size_t i = 0;
+
+      // two candidates per iteration to hide the shuffle latency
+      for (; i + 1 < n; i += 2)
+      {
+         const __m256i c0 = _mm256_loadu_si256((const __m256i *)(base + indices[i] * DESCRIPTOR_SIZE));
+         const __m256i c1 = _mm256_loadu_si256((const __m256i *)(base + indices[i + 1] * DESCRIPTOR_SIZE));
+         distances[i] = horizontalSumAvx2(popcountBytesAvx2(_mm256_xor_si256(q, c0)));
+         distances[i + 1] = horizontalSumAvx2(popcountBytesAvx2(_mm256_xor_si256(q, c1)));
+      }
+
+      if (i < n)
+      {
+         const __m256i c = _mm256_loadu_si256((const __m256i *)(base + indices[i] * DESCRIPTOR_SIZE));
+         distances[i] = horizontalSumAvx2(popcountBytesAvx2(_mm256_xor_si256(q, c)));
+      }
+   }
+
+   // GCC 12 reports the intentionally undefined upper lanes of the 256/512-bit casts as uninitialized
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+   HAMMING_TARGET("avx2,avx512f,avx512vpopcntdq")
+   static void batchAvx512(const unsigned char * query, const unsigned char * base, const size_t * indices, size_t n, int * distances)
+   {
+      // the query is repeated in both halves, so each 512-bit register compares two candidates
+      const __m512i q = _mm512_broadcast_i64x4(_mm256_loadu_si256((const __m256i *)query));
+      size_t i = 0;
+
+      for (; i + 1 < n; i += 2)
+      {
+         const __m256i c0 = _mm256_loadu_si256((const __m256i *)(base + indices[i] * DESCRIPTOR_SIZE));
+         const __m256i c1 = _mm256_loadu_si256((const __m256i *)(base + indices[i + 1] * DESCRIPTOR_SIZE));
+         const __m512i c = _mm512_inserti64x4(_mm512_castsi256_si512(c0), c1, 1);
+         const __m512i counts = _mm512_popcnt_epi64(_mm512_xor_si512(q, c));
+         distances[i] = sumEpi64Avx2(_mm512_castsi512_si256(counts));
+         distances[i + 1] = sumEpi64Avx2(_mm512_extracti64x4_epi64(counts, 1));
+      }
+
+      if (i < n)
+      {
+         const __m256i c0 = _mm256_loadu_si256((const __m256i *)(base + indices[i] * DESCRIPTOR_SIZE));
+         const __m512i counts = _mm512_popcnt_epi64(_mm512_xor_si512(q, _mm512_castsi256_si512(c0)));
+         distances[i] = sumEpi64Avx2(_mm512_castsi512_si256(counts));
+      }
+   }
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+#if defined(_MSC_VER)
+   static bool cpuSupports(bool & avx2, bool & avx512)
+   {
+      int info[4];
+      __cpuid(info, 0);
+      const int maxLeaf = info[0];
+
+      __cpuid(info, 1);
+      const bool osxsave = (info[2] & (1 << 27)) != 0;
+      if (maxLeaf < 7 || !osxsave)
+         return false;
+
+      // the OS must save the YMM (and for AVX-512 the ZMM and opmask) registers
+      const unsigned long long xcr0 = _xgetbv(0);
+      __cpuidex(info, 7, 0);
+      avx2 = (xcr0 & 0x06) == 0x06 && (info[1] & (1 << 5)) != 0;
+      avx512 = (xcr0 & 0xE6) == 0xE6 && (info[1] & (1 << 16)) != 0 && (info[2] & (1 << 14)) != 0;
+      return true;
+   }
+#endif
+
+#endif // HAMMING_X86
+
+   static BatchKernel selectKernel(const char * & name)
+   {
+#if defined(HAMMING_X86)
+      bool avx2 = false;
+      bool avx512 = false;
+#if defined(__GNUC__)
+      __builtin_cpu_init();
+      avx2 = __builtin_cpu_supports("avx2");
+      avx512 = __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vpopcntdq");
+#elif defined(_MSC_VER)
+      cpuSupports(avx2, avx512);
+#endif
+      if (avx512)
+      {
+         name = "AVX-512 VPOPCNTDQ";
+         return batchAvx512;
+      }
+      if (avx2)
+      {
+         name = "AVX2";
+         return batchAvx2;
+      }
+#endif
+      name = "scalar";
+      return batchScalar;
+   }
+
+   struct Dispatch
+   {
+      BatchKernel kernel;
+      const char * name;
+
+      Dispatch()
+      {
+         kernel = selectKernel(name);
+      }
+   };
+
+   // function-local static, so the CPU is queried once and in a thread-safe way
+   static const Dispatch & GetDispatch()
+   {
+      static const Dispatch dispatch;
+      return dispatch;
+   }
+
+   int HammingDistance::Distance(const unsigned char * a, const unsigned char * b)
+   {
+      return distanceScalar(a, b);
+   }
+
+   void HammingDistance::Compute(const unsigned char * query, const FeatureStore & store, const size_t * indices, size_t n, int * distances)
+   {
+      if (n == 0)
+         return;
+      GetDispatch().kernel(query, store.Descriptor(0), indices, n, distances);
+   }
+
+   HammingDistance::Result HammingDistance::FindBest(const unsigned char * query, const FeatureStore & store, const size_t * indices, size_t n)
+   {
+      Result r;
+      r.bestDist = 256;
+      r.secondDist = 256;
+      r.bestIdx = -1;
+
+      // process in chunks so that no memory is allocated
+      const size_t CHUNK = 64;
+      int distances[CHUNK];
+      const BatchKernel kernel = GetDispatch().kernel;
+      for (size_t begin = 0; begin < n; begin += CHUNK)
+      {
+         const size_t count = n - begin < CHUNK ? n - begin : CHUNK;
+         kernel(query, store.Descriptor(0), indices + begin, count, distances);
+         for (size_t i = 0; i < count; i++)
+         {
+            const int dist = distances[i];
+            if (dist < r.bestDist)
+            {
+               r.secondDist = r.bestDist;
+               r.bestDist = dist;
+               r.bestIdx = (int)indices[begin + i];
+            }
+            else if (dist < r.secondDist)
+            {
+               r.secondDist = dist;
+            }
+         }
+      }
+      return r;
+   }
+
+   const char * HammingDistance::InstructionSet()
+   {
+      return GetDispatch().name;
+   }
+
+}
@@ -32,7 +32,7 @@ namespace ORB_SLAM2_TEAM
    Initializer::Initializer(const Frame &ReferenceFrame, float sigma, int iterations)
       : mK(ReferenceFrame.mFC->K)
    {
-      mvKeys1 = ReferenceFrame.mvKeysUn;
+      ReferenceFrame.mFeatures.GetKeyPoints(mvKeys1);
 
       mSigma = sigma;
       mSigma2 = sigma * sigma;
@@ -44,7 +44,7 @@ namespace ORB_SLAM2_TEAM
    {
       // Fill structures with current keypoints and matches with reference frame
       // Reference Frame: 1, Current Frame: 2
-      mvKeys2 = CurrentFrame.mvKeysUn;
+      CurrentFrame.mFeatures.GetKeyPoints(mvKeys2);
 
       mvMatches12.clear();
       mvMatches12.reserve(mvKeys2.size());
@@ -23,27 +23,47 @@
 #include "KeyFrame.h"
 #include "Converter.h"
 #include "Serializer.h"
+#include "SlabAllocator.h"
 
 #include <mutex>
 
 namespace ORB_SLAM2_TEAM
 {
+   // never destroyed, so a KeyFrame can be deleted during static destruction
+   static SlabAllocator<KeyFrame, 256> & KeyFrameAllocator()
+   {
+      static SlabAllocator<KeyFrame, 256> * pAllocator = new SlabAllocator<KeyFrame, 256>();
+      return *pAllocator;
+   }
+
+   void * KeyFrame::operator new(size_t size)
+   {
+      // a derived class is larger than a slot
+      if (size != sizeof(KeyFrame))
+         return ::operator new(size);
+      return KeyFrameAllocator().Allocate();
+   }
+
+   void KeyFrame::operator delete(void * p, size_t size)
+   {
+      if (size != sizeof(KeyFrame))
+         return ::operator delete(p);
+      KeyFrameAllocator().Deallocate(p);
+   }
+
    KeyFrame::KeyFrame(id_type id)
       : SyncPrint("KeyFrame: ")
       , mnId(id)
-
-      // constants
-      , mnGridCols(FRAME_GRID_COLS)
-      , mnGridRows(FRAME_GRID_ROWS)
+      , mModified(false)
+      , mpMap(NULL)
 
       // public read-only access to private variables
       , id(mnId)
       , timestamp(mTimestamp)
       , N(mN)
-      , keysUn(mvKeysUn)
+      , features(mFeatures)
       , right(mvuRight)
       , depth(mvDepth)
-      , descriptors(mDescriptors)
       , Tcp(mTcp)
       , scaleLevels(mnScaleLevels)
       , scaleFactor(mfScaleFactor)
@@ -64,10 +84,9 @@ namespace ORB_SLAM2_TEAM
       , mFC(*frame.mFC)
       , mN(frame.N)
       , mvKeys(frame.mvKeys)
-      , mvKeysUn(frame.mvKeysUn)
+      , mFeatures(frame.mFeatures)
       , mvuRight(frame.mvuRight)
       , mvDepth(frame.mvDepth)
-      , mDescriptors(frame.mDescriptors.clone())
       , mBowVec(frame.mBowVec)
       , mFeatVec(frame.mFeatVec)
       , mnScaleLevels(frame.mnScaleLevels)
@@ -92,19 +111,16 @@ namespace ORB_SLAM2_TEAM
       , mbToBeErased(false)
       , mbBad(false)
       , mTcp(cv::Mat::eye(4, 4, CV_32F))
-
-      // public constants
-      , mnGridCols(FRAME_GRID_COLS)
-      , mnGridRows(FRAME_GRID_ROWS)
+      , mModified(false)
+      , mpMap(NULL)
 
       // public read-only access to private variables
       , id(mnId)
       , timestamp(mTimestamp)
       , N(mN)
-      , keysUn(mvKeysUn)
+      , features(mFeatures)
       , right(mvuRight)
       , depth(mvDepth)
-      , descriptors(mDescriptors)
       , Tcp(mTcp)
       , scaleLevels(mnScaleLevels)
       , scaleFactor(mfScaleFactor)
@@ -113,14 +129,12 @@ namespace ORB_SLAM2_TEAM
       , levelSigma2(mvLevelSigma2)
       , invLevelSigma2(mvInvLevelSigma2)
    {
-      for (int i = 0;i < FRAME_GRID_COLS;i++)
-         for (int j = 0; j < FRAME_GRID_ROWS; j++)
-            mGrid[i][j] = frame.mGrid[i][j];
+      mGrid = frame.mGrid;
       
-      if (frame.mTcw.empty())
-         throw exception("KeyFrame::KeyFrame(id_type id, Frame & frame) : frame.mTcw is empty");
+      if (!frame.HasPose())
+         throw exception("KeyFrame::KeyFrame(id_type id, Frame & frame) : frame has no pose");
 
-      SetPose(frame.mTcw);
+      SetPose(frame.GetPose());
    }
 
    KeyFrame * KeyFrame::Find(id_type id, const Map & rMap, unordered_map<id_type, KeyFrame *> & newKeyFrames)
@@ -287,40 +301,16 @@ namespace ORB_SLAM2_TEAM
       return pData;
    }
 
-   bool KeyFrame::PosInGrid(const cv::KeyPoint &kp, int &posX, int &posY)
-   {
-      posX = round((kp.pt.x - mFC.minX) * mFC.gridElementWidthInv);
-      posY = round((kp.pt.y - mFC.minY) * mFC.gridElementHeightInv);
-
-      //Keypoint's coordinates are undistorted, which could cause to go out of the image
-      if (posX < 0 || posX >= FRAME_GRID_COLS || posY < 0 || posY >= FRAME_GRID_ROWS)
-         return false;
-
-      return true;
-   }
-
    void KeyFrame::AssignFeaturesToGrid()
    {
-      int nReserve = 0.5f*N / (FRAME_GRID_COLS*FRAME_GRID_ROWS);
-      for (unsigned int i = 0; i < FRAME_GRID_COLS;i++)
-         for (unsigned int j = 0; j < FRAME_GRID_ROWS;j++)
-            mGrid[i][j].reserve(nReserve);
-
-      for (int i = 0;i < N;i++)
-      {
-         const cv::KeyPoint &kp = mvKeysUn[i];
-
-         int nGridPosX, nGridPosY;
-         if (PosInGrid(kp, nGridPosX, nGridPosY))
-            mGrid[nGridPosX][nGridPosY].push_back(i);
-      }
+      mGrid.Assign(mFeatures, mFC);
    }
 
    void KeyFrame::ComputeBoW(ORBVocabulary & vocab)
    {
       if (mBowVec.empty() || mFeatVec.empty())
       {
-         vector<cv::Mat> vCurrentDesc = Converter::toDescriptorVector(mDescriptors);
+         vector<cv::Mat> vCurrentDesc = Converter::toDescriptorVector(mFeatures.Descriptors());
          // Feature vector associate features with nodes in the 4th level (from leaves up)
          // We assume the vocabulary tree has 6 levels, change the 4 otherwise
          vocab.transform(vCurrentDesc, mBowVec, mFeatVec, 4);
@@ -330,46 +320,74 @@ namespace ORB_SLAM2_TEAM
    void KeyFrame::SetPose(const cv::Mat &Tcw_)
    {
       unique_lock<mutex> lock(mMutexPose);
-      Tcw_.copyTo(Tcw);
-      cv::Mat Rcw = Tcw.rowRange(0, 3).colRange(0, 3);
-      cv::Mat tcw = Tcw.rowRange(0, 3).col(3);
-      cv::Mat Rwc = Rcw.t();
-      Ow = -Rwc * tcw;
+      Tcw = Tcw_;
+      const cv::Matx33f Rwc = Tcw.get_minor<3, 3>(0, 0).t();
+      const cv::Vec3f tcw(Tcw(0, 3), Tcw(1, 3), Tcw(2, 3));
+      Ow = -(Rwc * tcw);
 
-      Twc = cv::Mat::eye(4, 4, Tcw.type());
-      Rwc.copyTo(Twc.rowRange(0, 3).colRange(0, 3));
-      Ow.copyTo(Twc.rowRange(0, 3).col(3));
-      mModified = true;
+      Twc = cv::Matx44f::eye();
+      for (int r = 0; r < 3; r++)
+      {
+         for (int c = 0; c < 3; c++)
+            Twc(r, c) = Rwc(r, c);
+         Twc(r, 3) = Ow[r];
+      }
+      SetModified(true);
    }
 
    cv::Mat KeyFrame::GetPose()
    {
-      unique_lock<mutex> lock(mMutexPose);
-      return Tcw.clone();
+      return cv::Mat(GetPoseMatx());
    }
 
    cv::Mat KeyFrame::GetPoseInverse()
    {
-      unique_lock<mutex> lock(mMutexPose);
-      return Twc.clone();
+      return cv::Mat(GetPoseInverseMatx());
    }
 
    cv::Mat KeyFrame::GetCameraCenter()
    {
-      unique_lock<mutex> lock(mMutexPose);
-      return Ow.clone();
+      return cv::Mat(GetCameraCenterVec());
    }
 
    cv::Mat KeyFrame::GetRotation()
    {
-      unique_lock<mutex> lock(mMutexPose);
-      return Tcw.rowRange(0, 3).colRange(0, 3).clone();
+      return cv::Mat(GetRotationMatx());
    }
 
    cv::Mat KeyFrame::GetTranslation()
+   {
+      return cv::Mat(GetTranslationVec());
+   }
+
+   cv::Matx44f KeyFrame::GetPoseMatx()
+   {
+      unique_lock<mutex> lock(mMutexPose);
+      return Tcw;
+   }
+
+   cv::Matx44f KeyFrame::GetPoseInverseMatx()
+   {
+      unique_lock<mutex> lock(mMutexPose);
+      return Twc;
+   }
+
+   cv::Vec3f KeyFrame::GetCameraCenterVec()
+   {
+      unique_lock<mutex> lock(mMutexPose);
+      return Ow;
+   }
+
+   cv::Matx33f KeyFrame::GetRotationMatx()
    {
       unique_lock<mutex> lock(mMutexPose);
-      return Tcw.rowRange(0, 3).col(3).clone();
+      return Tcw.get_minor<3, 3>(0, 0);
+   }
+
+   cv::Vec3f KeyFrame::GetTranslationVec()
+   {
+      unique_lock<mutex> lock(mMutexPose);
+      return cv::Vec3f(Tcw(0, 3), Tcw(1, 3), Tcw(2, 3));
    }
 
    void KeyFrame::AddConnection(KeyFrame *pKF, const int &weight)
@@ -543,14 +561,10 @@ namespace ORB_SLAM2_TEAM
          if (pMP->IsBad())
             continue;
 
-         map<KeyFrame *, size_t> observations = pMP->GetObservations();
-
-         for (map<KeyFrame *, size_t>::iterator mit = observations.begin(), mend = observations.end(); mit != mend; mit++)
-         {
-            if (mit->first->mnId == mnId)
-               continue;
-            KFcounter[mit->first]++;
-         }
+         pMP->ForEachObservation([this, &KFcounter](KeyFrame * pKF, size_t idx) {
+            if (pKF->mnId != mnId)
+               KFcounter[pKF]++;
+         });
       }
 
       // this is for the first stereo KeyFrame added to the map
@@ -610,7 +624,7 @@ namespace ORB_SLAM2_TEAM
             mpParent = mvpOrderedConnectedKeyFrames.front();
             mpParent->AddChild(this);
             mbFirstConnection = false;
-            mModified = true; // not sure if this is necessary, this function is usually only called after MapPoint changes
+            SetModified(true); // not sure if this is necessary, this function is usually only called after MapPoint changes
          }
 
       }
@@ -634,7 +648,7 @@ namespace ORB_SLAM2_TEAM
       unique_lock<mutex> lockCon(mMutexConnections);
       mpParent = pKF;
       pKF->AddChild(this);
-      mModified = true;
+      SetModified(true);
    }
 
    set<KeyFrame *> KeyFrame::GetChilds()
@@ -660,7 +674,7 @@ namespace ORB_SLAM2_TEAM
       unique_lock<mutex> lockCon(mMutexConnections);
       mbNotErase = true;
       mspLoopEdges.insert(pKF);
-      mModified = true;
+      SetModified(true);
    }
 
    set<KeyFrame *> KeyFrame::GetLoopEdges()
@@ -796,9 +810,9 @@ namespace ORB_SLAM2_TEAM
 
          mpParent->EraseChild(this);
          unique_lock<mutex> lock3(mMutexPose);
-         mTcp = Tcw * mpParent->GetPoseInverse();
+         mTcp = cv::Mat(Tcw * mpParent->GetPoseInverseMatx());
          mbBad = true;
-         mModified = true;
+         SetModified(true);
       }
 
 
@@ -833,44 +847,15 @@ namespace ORB_SLAM2_TEAM
    vector<size_t> KeyFrame::GetFeaturesInArea(const float &x, const float &y, const float &r) const
    {
       vector<size_t> vIndices;
-      vIndices.reserve(N);
-
-      const int nMinCellX = max(0, (int)floor((x - mFC.minX - r) * mFC.gridElementWidthInv));
-      if (nMinCellX >= mnGridCols)
-         return vIndices;
-
-      const int nMaxCellX = min((int)mnGridCols - 1, (int)ceil((x - mFC.minX + r) * mFC.gridElementWidthInv));
-      if (nMaxCellX < 0)
-         return vIndices;
-
-      const int nMinCellY = max(0, (int)floor((y - mFC.minY - r) * mFC.gridElementHeightInv));
-      if (nMinCellY >= mnGridRows)
-         return vIndices;
-
-      const int nMaxCellY = min((int)mnGridRows - 1, (int)ceil((y - mFC.minY + r) * mFC.gridElementHeightInv));
-      if (nMaxCellY < 0)
-         return vIndices;
-
-      for (int ix = nMinCellX; ix <= nMaxCellX; ix++)
-      {
-         for (int iy = nMinCellY; iy <= nMaxCellY; iy++)
-         {
-            const vector<size_t> vCell = mGrid[ix][iy];
-            for (size_t j = 0, jend = vCell.size(); j < jend; j++)
-            {
-               const cv::KeyPoint &kpUn = mvKeysUn[vCell[j]];
-               const float distx = kpUn.pt.x - x;
-               const float disty = kpUn.pt.y - y;
-
-               if (fabs(distx) < r && fabs(disty) < r)
-                  vIndices.push_back(vCell[j]);
-            }
-         }
-      }
-
+      GetFeaturesInArea(x, y, r, vIndices);
       return vIndices;
    }
 
+   void KeyFrame::GetFeaturesInArea(const float &x, const float &y, const float &r, vector<size_t> & vIndices) const
+   {
+      mGrid.GetFeaturesInArea(mFeatures, x, y, r, -1, -1, vIndices);
+   }
+
    bool KeyFrame::IsInImage(const float &x, const float &y) const
    {
       return (x >= mFC.minX && x < mFC.maxX && y >= mFC.minY && y < mFC.maxY);
@@ -885,10 +870,10 @@ namespace ORB_SLAM2_TEAM
          const float v = mvKeys[i].pt.y;
          const float x = (u - mFC.cx) * z * mFC.invfx;
          const float y = (v - mFC.cy) * z * mFC.invfy;
-         cv::Mat x3Dc = (cv::Mat_<float>(3, 1) << x, y, z);
+         const cv::Vec3f x3Dc(x, y, z);
 
          unique_lock<mutex> lock(mMutexPose);
-         return Twc.rowRange(0, 3).colRange(0, 3)*x3Dc + Twc.rowRange(0, 3).col(3);
+         return cv::Mat(Twc.get_minor<3, 3>(0, 0) * x3Dc + Ow);
       }
       else
          return cv::Mat();
@@ -897,26 +882,24 @@ namespace ORB_SLAM2_TEAM
    float KeyFrame::ComputeSceneMedianDepth(const int q)
    {
       vector<MapPoint *> vpMapPoints;
-      cv::Mat Tcw_;
+      cv::Matx44f Tcw_;
       {
          unique_lock<mutex> lock1(mMutexFeatures);
          vpMapPoints = mvpMapPoints;
          unique_lock<mutex> lock2(mMutexPose);
-         Tcw_ = Tcw.clone();
+         Tcw_ = Tcw;
       }
 
       vector<float> vDepths;
       vDepths.reserve(N);
-      cv::Mat Rcw2 = Tcw_.row(2).colRange(0, 3);
-      Rcw2 = Rcw2.t();
-      float zcw = Tcw_.at<float>(2, 3);
+      const cv::Vec3f Rcw2(Tcw_(2, 0), Tcw_(2, 1), Tcw_(2, 2));
+      const float zcw = Tcw_(2, 3);
       for (int i = 0; i < N; i++)
       {
          if (mvpMapPoints.at(i))
          {
             MapPoint * pMP = mvpMapPoints.at(i);
-            cv::Mat x3Dw = pMP->GetWorldPos();
-            float z = Rcw2.dot(x3Dw) + zcw;
+            const float z = Rcw2.dot(pMP->GetPosition().worldPos) + zcw;
             vDepths.push_back(z);
          }
       }
@@ -933,7 +916,15 @@ namespace ORB_SLAM2_TEAM
 
    void KeyFrame::SetModified(bool b)
    {
-      mModified = b;
+      // only the first modification since the Map last took its changes is recorded
+      if (!b)
+         mModified = false;
+      else if (!mModified.exchange(true))
+      {
+         Map * pMap = mpMap;
+         if (pMap)
+            pMap->AddModified(this);
+      }
    }
 
    id_type KeyFrame::PeekId(const void * data)
@@ -1048,19 +1039,18 @@ namespace ORB_SLAM2_TEAM
 
       unsigned int size = sizeof(KeyFrame::Header);
       size += Serializer::GetKeyPointVectorBufferSize(mvKeys);
-      size += Serializer::GetKeyPointVectorBufferSize(mvKeysUn);
+      size += mFeatures.GetBufferSize();
       size += Serializer::GetVectorBufferSize<float>(mvuRight.size());
       size += Serializer::GetVectorBufferSize<float>(mvDepth.size());
-      size += Serializer::GetMatBufferSize(mDescriptors);
       //mBowVec // will be re-created by LocalMapping::ProcessNewKeyFrame->KeyFrame::ComputeBow
       //mFeatVec // will be re-created by LocalMapping::ProcessNewKeyFrame->KeyFrame::ComputeBow
       size += Serializer::GetMatBufferSize(mTcp);
       size += Serializer::GetVectorBufferSize<float>(mvScaleFactors.size());
       size += Serializer::GetVectorBufferSize<float>(mvLevelSigma2.size());
       size += Serializer::GetVectorBufferSize<float>(mvInvLevelSigma2.size());
-      size += Serializer::GetMatBufferSize(Tcw);
-      size += Serializer::GetMatBufferSize(Twc);
-      size += Serializer::GetMatBufferSize(Ow);
+      size += Serializer::GetMatBufferSize(cv::Mat(Tcw));
+      size += Serializer::GetMatBufferSize(cv::Mat(Twc));
+      size += Serializer::GetMatBufferSize(cv::Mat(Ow));
       size += Serializer::GetVectorBufferSize<id_type>(mvpMapPoints.size());
       size += Serializer::GetVectorBufferSize<KeyFrameWeight>(mConnectedKeyFrameWeights.size());
       size += Serializer::GetVectorBufferSize<id_type>(mvpOrderedConnectedKeyFrames.size());
@@ -1109,17 +1099,20 @@ namespace ORB_SLAM2_TEAM
          // read variable-length data
          pData = pHeader + 1;
          pData = Serializer::ReadKeyPointVector(pData, mvKeys);
-         pData = Serializer::ReadKeyPointVector(pData, mvKeysUn);
+         pData = mFeatures.ReadBytes(pData);
          pData = Serializer::ReadVector<float>(pData, mvuRight);
          pData = Serializer::ReadVector<float>(pData, mvDepth);
-         pData = Serializer::ReadMatrix(pData, mDescriptors);
          pData = Serializer::ReadMatrix(pData, mTcp);
          pData = Serializer::ReadVector<float>(pData, mvScaleFactors);
          pData = Serializer::ReadVector<float>(pData, mvLevelSigma2);
          pData = Serializer::ReadVector<float>(pData, mvInvLevelSigma2);
-         pData = Serializer::ReadMatrix(pData, Tcw);
-         pData = Serializer::ReadMatrix(pData, Twc);
-         pData = Serializer::ReadMatrix(pData, Ow);
+         cv::Mat tcw, twc, ow;
+         pData = Serializer::ReadMatrix(pData, tcw);
+         pData = Serializer::ReadMatrix(pData, twc);
+         pData = Serializer::ReadMatrix(pData, ow);
+         Tcw = tcw;
+         Twc = twc;
+         Ow = ow;
          pData = ReadMapPointIds(pData, rMap, newMapPoints, mvpMapPoints);
          pData = ReadKeyFrameWeights(pData, rMap, newKeyFrames, mConnectedKeyFrameWeights);
          pData = ReadKeyFrameIds(pData, rMap, newKeyFrames, mvpOrderedConnectedKeyFrames);
@@ -1159,17 +1152,16 @@ namespace ORB_SLAM2_TEAM
       // write variable-length data
       void * pData = pHeader + 1;
       pData = Serializer::WriteKeyPointVector(pData, mvKeys);
-      pData = Serializer::WriteKeyPointVector(pData, mvKeysUn);
+      pData = mFeatures.WriteBytes(pData);
       pData = Serializer::WriteVector<float>(pData, mvuRight);
       pData = Serializer::WriteVector<float>(pData, mvDepth);
-      pData = Serializer::WriteMatrix(pData, mDescriptors);
       pData = Serializer::WriteMatrix(pData, mTcp);
       pData = Serializer::WriteVector<float>(pData, mvScaleFactors);
       pData = Serializer::WriteVector<float>(pData, mvLevelSigma2);
       pData = Serializer::WriteVector<float>(pData, mvInvLevelSigma2);
-      pData = Serializer::WriteMatrix(pData, Tcw);
-      pData = Serializer::WriteMatrix(pData, Twc);
-      pData = Serializer::WriteMatrix(pData, Ow);
+      pData = Serializer::WriteMatrix(pData, cv::Mat(Tcw));
+      pData = Serializer::WriteMatrix(pData, cv::Mat(Twc));
+      pData = Serializer::WriteMatrix(pData, cv::Mat(Ow));
       pData = WriteMapPointIds(pData, mvpMapPoints);
       pData = WriteKeyFrameWeights(pData, mConnectedKeyFrameWeights);
       pData = WriteKeyFrameIds(pData, mvpOrderedConnectedKeyFrames);
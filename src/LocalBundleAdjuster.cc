@@ -0,0 +1,515 @@
+/**
+* This file is part of ORB-SLAM2-TEAM.
+*
+* Copyright (C) 2018 Joe Bedard <mr dot joe dot bedard at gmail dot com>
+* For more information see <https://github.com/joebedard/ORB_SLAM2_TEAM>
+*
+* ORB-SLAM2-TEAM is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2-TEAM is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2-TEAM. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "LocalBundleAdjuster.h"
+#include "Converter.h"
+
+#include "g2o/core/block_solver.h"
+#include "g2o/core/optimization_algorithm_levenberg.h"
+#include "g2o/solvers/linear_solver_eigen.h"
+
+#include <limits>
+
+namespace ORB_SLAM2_TEAM
+{
+
+   static const double TH_HUBER_MONO = sqrt(5.991);
+   static const double TH_HUBER_STEREO = sqrt(7.815);
+
+   LocalBundleAdjuster::LocalBundleAdjuster(int numThreads)
+      : SyncPrint("LocalBundleAdjuster: ")
+      , mPass(0)
+   {
+      g2o::BlockSolver_6_3::LinearSolverType * linearSolver = new g2o::LinearSolverEigen<g2o::BlockSolver_6_3::PoseMatrixType>();
+      g2o::BlockSolver_6_3 * solver_ptr = new g2o::BlockSolver_6_3(linearSolver);
+      g2o::OptimizationAlgorithmLevenberg * solver = new g2o::OptimizationAlgorithmLevenberg(solver_ptr);
+      mOptimizer.setAlgorithm(solver);
+      mOptimizer.setNumThreads(numThreads);
+   }
+
+   void LocalBundleAdjuster::Adjust(KeyFrame * pKF, bool * pbStopFlag, Map & theMap)
+   {
+      Print("begin Adjust");
+
+      {
+         Print("waiting to lock map");
+         unique_lock<mutex> lock(theMap.mutexMapUpdate);
+         Print("map is locked");
+         BuildGraph(pKF);
+      }
+
+      mOptimizer.setForceStopFlag(pbStopFlag);
+
+      if (pbStopFlag)
+         if (*pbStopFlag)
+         {
+            Print("end Adjust 1");
+            return;
+         }
+
+      if (mOptimizer.initializeOptimization())
+         mOptimizer.optimize(5);
+      else
+         throw exception("LocalBundleAdjuster::Adjust initializeOptimization() failed");
+
+      bool bDoMore = true;
+
+      if (pbStopFlag)
+         if (*pbStopFlag)
+            bDoMore = false;
+
+      if (bDoMore)
+      {
+         size_t nOutliers;
+         {
+            Print("waiting to lock map");
+            unique_lock<mutex> lock(theMap.mutexMapUpdate);
+            Print("map is locked");
+            nOutliers = CheckEdges();
+         }
+
+         // Optimize again without the outliers
+         // if none were found, the graph is unchanged and the online pass reuses the CCS structure
+         // and the symbolic factorization of the first pass
+         if (nOutliers > 0)
+         {
+            if (!mOptimizer.initializeOptimization())
+               throw exception("LocalBundleAdjuster::Adjust initializeOptimization() failed");
+            mOptimizer.optimize(10);
+         }
+         else
+            mOptimizer.optimize(10, true);
+      }
+
+      Recover(theMap);
+
+      Print("end Adjust 2");
+   }
+
+   void LocalBundleAdjuster::ReleaseBad()
+   {
+      for (auto it = mMapPoints.begin(); it != mMapPoints.end(); )
+      {
+         if (it->first->IsBad())
+         {
+            // removing a vertex also deletes its edges
+            mOptimizer.removeVertex(it->second.pVertex);
+            it = mMapPoints.erase(it);
+         }
+         else
+            it++;
+      }
+
+      for (auto it = mKeyFrames.begin(); it != mKeyFrames.end(); )
+      {
+         if (it->first->IsBad())
+         {
+            // the edges of the KeyFrame are also in the records of the MapPoints
+            for (auto & p : mMapPoints)
+            {
+               vector<EdgeRecord> & edges = p.second.edges;
+               for (size_t i = 0; i < edges.size(); )
+               {
+                  if (edges[i].pKF == it->first)
+                  {
+                     edges[i] = edges.back();
+                     edges.pop_back();
+                  }
+                  else
+                     i++;
+               }
+            }
+            mOptimizer.removeVertex(it->second.pVertex);
+            it = mKeyFrames.erase(it);
+         }
+         else
+            it++;
+      }
+
+      mEdges.clear();
+      mEdgeMapPoints.clear();
+      mLocalKeyFrames.clear();
+      mFixedKeyFrames.clear();
+      mLocalMapPoints.clear();
+   }
+
+   void LocalBundleAdjuster::Clear()
+   {
+      mOptimizer.clear();
+      mKeyFrames.clear();
+      mMapPoints.clear();
+      mEdges.clear();
+      mEdgeMapPoints.clear();
+      mLocalKeyFrames.clear();
+      mFixedKeyFrames.clear();
+      mLocalMapPoints.clear();
+   }
+
+   void LocalBundleAdjuster::BuildGraph(KeyFrame * pKF)
+   {
+      mPass++;
+      mLocalKeyFrames.clear();
+      mFixedKeyFrames.clear();
+      mLocalMapPoints.clear();
+
+      mLocalKeyFrames.push_back(pKF);
+      pKF->mnBALocalForKF = pKF->id;
+
+      // Local KeyFrames: First Breath Search from Current Keyframe
+      const vector<KeyFrame *> vNeighKFs = pKF->GetVectorCovisibleKeyFrames();
+      for (KeyFrame * pKFi : vNeighKFs)
+      {
+         pKFi->mnBALocalForKF = pKF->id;
+         if (!pKFi->IsBad())
+            mLocalKeyFrames.push_back(pKFi);
+      }
+
+      // Local MapPoints seen in Local KeyFrames
+      for (KeyFrame * pKFi : mLocalKeyFrames)
+      {
+         const vector<MapPoint *> vpMPs = pKFi->GetMapPointMatches();
+         for (MapPoint * pMP : vpMPs)
+         {
+            if (pMP)
+               if (!pMP->IsBad())
+                  if (pMP->mnBALocalForKF != pKF->id)
+                  {
+                     mLocalMapPoints.push_back(pMP);
+                     pMP->mnBALocalForKF = pKF->id;
+                  }
+         }
+      }
+
+      // Fixed Keyframes. Keyframes that see Local MapPoints but that are not Local Keyframes
+      for (MapPoint * pMP : mLocalMapPoints)
+      {
+         pMP->ForEachObservation([this, pKF](KeyFrame * pKFi, size_t idx) {
+            if (pKFi->mnBALocalForKF != pKF->id && pKFi->mnBAFixedForKF != pKF->id)
+            {
+               pKFi->mnBAFixedForKF = pKF->id;
+               mFixedKeyFrames.push_back(pKFi);
+            }
+         });
+      }
+
+      // Set KeyFrame vertices
+      for (KeyFrame * pKFi : mLocalKeyFrames)
+         AddKeyFrameVertex(pKFi, pKFi->id == 0);
+
+      for (KeyFrame * pKFi : mFixedKeyFrames)
+      {
+         if (!pKFi->IsBad())
+            AddKeyFrameVertex(pKFi, true);
+      }
+
+      // Set MapPoint vertices and edges
+      for (MapPoint * pMP : mLocalMapPoints)
+         AddMapPointVertex(pMP);
+
+      // Remove the MapPoints that left the window, removing a vertex also deletes its edges
+      for (auto it = mMapPoints.begin(); it != mMapPoints.end(); )
+      {
+         if (it->second.pass != mPass)
+         {
+            mOptimizer.removeVertex(it->second.pVertex);
+            it = mMapPoints.erase(it);
+         }
+         else
+            it++;
+      }
+
+      // Remove the KeyFrames that left the window, their edges were removed with their MapPoints
+      for (auto it = mKeyFrames.begin(); it != mKeyFrames.end(); )
+      {
+         if (it->second.pass != mPass)
+         {
+            mOptimizer.removeVertex(it->second.pVertex);
+            it = mKeyFrames.erase(it);
+         }
+         else
+            it++;
+      }
+
+      // the records do not move until the next call
+      mEdges.clear();
+      mEdgeMapPoints.clear();
+      for (MapPoint * pMP : mLocalMapPoints)
+      {
+         for (EdgeRecord & edge : mMapPoints.at(pMP).edges)
+         {
+            mEdges.push_back(&edge);
+            mEdgeMapPoints.push_back(pMP);
+         }
+      }
+   }
+
+   void LocalBundleAdjuster::AddKeyFrameVertex(KeyFrame * pKF, bool fixed)
+   {
+      KeyFrameRecord & record = mKeyFrames[pKF];
+      if (!record.pVertex)
+      {
+         record.pVertex = new g2o::VertexSE3Expmap();
+         record.pVertex->setId(VertexId(pKF));
+         if (!mOptimizer.addVertex(record.pVertex))
+            Print("mOptimizer.addVertex(vSE3) failed");
+      }
+      record.pVertex->setEstimate(Converter::toSE3Quat(pKF->GetPoseMatx()));
+      record.pVertex->setFixed(fixed);
+      record.pass = mPass;
+   }
+
+   void LocalBundleAdjuster::AddMapPointVertex(MapPoint * pMP)
+   {
+      PointRecord & record = mMapPoints[pMP];
+      if (!record.pVertex)
+      {
+         record.pVertex = new g2o::VertexSBAPointXYZ();
+         record.pVertex->setId(VertexId(pMP));
+         record.pVertex->setMarginalized(true);
+         if (!mOptimizer.addVertex(record.pVertex))
+            Print("mOptimizer.addVertex(vPoint) failed");
+      }
+      record.pVertex->setEstimate(Converter::toVector3d(pMP->GetPosition().worldPos));
+      record.pass = mPass;
+
+      const ObservationMap observations = pMP->GetObservations();
+      for (const ObservationMap::value_type & obs : observations)
+      {
+         KeyFrame * pKFi = obs.first;
+         if (pKFi->IsBad())
+            continue;
+
+         auto itKF = mKeyFrames.find(pKFi);
+         if (itKF == mKeyFrames.end() || itKF->second.pass != mPass)
+            continue;
+
+         EdgeRecord * pEdge = NULL;
+         for (EdgeRecord & edge : record.edges)
+         {
+            if (edge.pKF == pKFi)
+            {
+               pEdge = &edge;
+               break;
+            }
+         }
+
+         if (pEdge == NULL)
+         {
+            record.edges.push_back(EdgeRecord());
+            pEdge = &record.edges.back();
+            pEdge->pKF = pKFi;
+            pEdge->pEdge = NULL;
+         }
+
+         AddEdge(record.pVertex, itKF->second.pVertex, pKFi, obs.second, *pEdge);
+      }
+
+      // Remove the edges of observations that were unlinked
+      vector<EdgeRecord> & edges = record.edges;
+      for (size_t i = 0; i < edges.size(); )
+      {
+         if (edges[i].pass != mPass)
+         {
+            mOptimizer.removeEdge(edges[i].pEdge);
+            edges[i] = edges.back();
+            edges.pop_back();
+         }
+         else
+            i++;
+      }
+   }
+
+   void LocalBundleAdjuster::AddEdge(
+      g2o::VertexSBAPointXYZ * pPointVertex,
+      g2o::VertexSE3Expmap * pKeyFrameVertex,
+      KeyFrame * pKF,
+      size_t idx,
+      EdgeRecord & record)
+   {
+      const bool stereo = pKF->right[idx] >= 0;
+      record.pass = mPass;
+
+      if (record.pEdge)
+      {
+         if (record.idx == idx && record.stereo == stereo)
+         {
+            // reuse the edge, an outlier of the previous call is tried again
+            record.pEdge->setLevel(0);
+            record.pKernel->setDelta(stereo ? TH_HUBER_STEREO : TH_HUBER_MONO);
+            return;
+         }
+         mOptimizer.removeEdge(record.pEdge);
+      }
+
+      const float kpUnX = pKF->features.X(idx);
+      const float kpUnY = pKF->features.Y(idx);
+      const int kpUnOctave = pKF->features.Octave(idx);
+      const float & invSigma2 = pKF->invLevelSigma2[kpUnOctave];
+
+      g2o::RobustKernelHuber * rk = new g2o::RobustKernelHuber;
+
+      if (!stereo)
+      {
+         Eigen::Matrix<double, 2, 1> obs;
+         obs << kpUnX, kpUnY;
+
+         g2o::EdgeSE3ProjectXYZ * e = new g2o::EdgeSE3ProjectXYZ();
+         e->setVertex(0, pPointVertex);
+         e->setVertex(1, pKeyFrameVertex);
+         e->setMeasurement(obs);
+         e->setInformation(Eigen::Matrix2d::Identity()*invSigma2);
+         e->setRobustKernel(rk);
+         rk->setDelta(TH_HUBER_MONO);
+
+         e->fx = pKF->mFC.fx;
+         e->fy = pKF->mFC.fy;
+         e->cx = pKF->mFC.cx;
+         e->cy = pKF->mFC.cy;
+         record.pEdge = e;
+      }
+      else
+      {
+         Eigen::Matrix<double, 3, 1> obs;
+         const float kp_ur = pKF->right[idx];
+         obs << kpUnX, kpUnY, kp_ur;
+
+         g2o::EdgeStereoSE3ProjectXYZ * e = new g2o::EdgeStereoSE3ProjectXYZ();
+         e->setVertex(0, pPointVertex);
+         e->setVertex(1, pKeyFrameVertex);
+         e->setMeasurement(obs);
+         e->setInformation(Eigen::Matrix3d::Identity()*invSigma2);
+         e->setRobustKernel(rk);
+         rk->setDelta(TH_HUBER_STEREO);
+
+         e->fx = pKF->mFC.fx;
+         e->fy = pKF->mFC.fy;
+         e->cx = pKF->mFC.cx;
+         e->cy = pKF->mFC.cy;
+         e->bf = pKF->mFC.blfx;
+         record.pEdge = e;
+      }
+
+      record.pKernel = rk;
+      record.idx = idx;
+      record.stereo = stereo;
+      if (!mOptimizer.addEdge(record.pEdge))
+         Print("mOptimizer.addEdge(e) failed");
+   }
+
+   size_t LocalBundleAdjuster::CheckEdges()
+   {
+      size_t nOutliers = 0;
+
+      // Check inlier observations
+      for (size_t i = 0, iend = mEdges.size(); i < iend; i++)
+      {
+         EdgeRecord & edge = *mEdges[i];
+         MapPoint * pMP = mEdgeMapPoints[i];
+
+         if (pMP->IsBad())
+            continue;
+
+         bool outlier;
+         if (edge.stereo)
+         {
+            g2o::EdgeStereoSE3ProjectXYZ * e = static_cast<g2o::EdgeStereoSE3ProjectXYZ *>(edge.pEdge);
+            outlier = e->chi2() > 7.815 || !e->isDepthPositive();
+         }
+         else
+         {
+            g2o::EdgeSE3ProjectXYZ * e = static_cast<g2o::EdgeSE3ProjectXYZ *>(edge.pEdge);
+            outlier = e->chi2() > 5.991 || !e->isDepthPositive();
+         }
+
+         if (outlier)
+         {
+            edge.pEdge->setLevel(1);
+            nOutliers++;
+         }
+
+         // an infinite delta disables the kernel, which is kept for the next call
+         edge.pKernel->setDelta(std::numeric_limits<double>::infinity());
+      }
+
+      return nOutliers;
+   }
+
+   void LocalBundleAdjuster::Recover(Map & theMap)
+   {
+      vector<pair<KeyFrame *, MapPoint *>> vToErase;
+
+      // Check inlier observations, an outlier of CheckEdges keeps the error it had before it was excluded
+      for (size_t i = 0, iend = mEdges.size(); i < iend; i++)
+      {
+         const EdgeRecord & edge = *mEdges[i];
+         MapPoint * pMP = mEdgeMapPoints[i];
+
+         if (pMP->IsBad())
+            continue;
+
+         bool outlier;
+         if (edge.stereo)
+         {
+            g2o::EdgeStereoSE3ProjectXYZ * e = static_cast<g2o::EdgeStereoSE3ProjectXYZ *>(edge.pEdge);
+            outlier = e->chi2() > 7.815 || !e->isDepthPositive();
+         }
+         else
+         {
+            g2o::EdgeSE3ProjectXYZ * e = static_cast<g2o::EdgeSE3ProjectXYZ *>(edge.pEdge);
+            outlier = e->chi2() > 5.991 || !e->isDepthPositive();
+         }
+
+         if (outlier)
+            vToErase.push_back(make_pair(edge.pKF, pMP));
+      }
+
+      // Get Map Mutex
+      Print("waiting to lock map");
+      unique_lock<mutex> lock(theMap.mutexMapUpdate);
+      Print("map is locked");
+
+      for (size_t i = 0; i < vToErase.size(); i++)
+      {
+         KeyFrame * pKFi = vToErase[i].first;
+         MapPoint * pMPi = vToErase[i].second;
+         theMap.Unlink(*pMPi, *pKFi);
+         if (pMPi->Observations() <= 2)
+            theMap.EraseMapPoint(pMPi);
+      }
+
+      // Recover optimized data
+
+      //Keyframes
+      for (KeyFrame * pKFi : mLocalKeyFrames)
+      {
+         g2o::SE3Quat SE3quat = mKeyFrames.at(pKFi).pVertex->estimate();
+         pKFi->SetPose(Converter::toCvMat(SE3quat));
+      }
+
+      //Points
+      for (MapPoint * pMP : mLocalMapPoints)
+      {
+         g2o::VertexSBAPointXYZ * vPoint = mMapPoints.at(pMP).pVertex;
+         pMP->SetWorldPos(Converter::toCvMat(vPoint->estimate()));
+         pMP->UpdateNormalAndDepth();
+      }
+   }
+
+}
@@ -23,7 +23,6 @@
 #include "LocalMapping.h"
 #include "ORBmatcher.h"
 #include "Optimizer.h"
-#include "Sleep.h"
 #include "Duration.h"
 
 #include<mutex>
@@ -39,7 +38,8 @@ namespace ORB_SLAM2_TEAM
       size_t quantityTrackers,
       unsigned int keyFrameIdSpan,
       unsigned long firstMapPointId,
-      unsigned int mapPointIdSpan
+      unsigned int mapPointIdSpan,
+      unsigned int quantityThreads
    ) :
       SyncPrint("LocalMapping: "),
       mMap(map),
@@ -58,8 +58,11 @@ namespace ORB_SLAM2_TEAM
       mbPaused(false),
       mbPauseRequested(false),
       mbNotPause(false),
-      mbIdle(true)
+      mbIdle(true),
+      mWorkerPool(max(quantityThreads, 1u)),
+      mLocalBundleAdjuster(mWorkerPool.QuantityThreads())
    {
+      mMapReader = mMap.RegisterReader();
    }
 
 
@@ -76,7 +79,8 @@ namespace ORB_SLAM2_TEAM
 
       do
       {
-         sleep(3000);
+         ReclaimMapPoints();
+         mWakeUp.Wait();
 
          do 
          {
@@ -118,7 +122,7 @@ namespace ORB_SLAM2_TEAM
                   if (mMap.KeyFramesInMap() > 2)
                   {
                      // deletes points, updates keyframes, updates points
-                     Optimizer::LocalBundleAdjustment(mpCurrentKeyFrame, &mbAbortBA, mMap);
+                     mLocalBundleAdjuster.Adjust(mpCurrentKeyFrame, &mbAbortBA, mMap);
 
                      // Check for redundant local Keyframes, and delete them
                      KeyFrameCulling();
@@ -143,7 +147,7 @@ namespace ORB_SLAM2_TEAM
 
                while (IsPaused() && !CheckFinish())
                {
-                  sleep(3000);
+                  mWakeUp.Wait();
                }
 
                // LocalMapping::Resume clears the keyframe queue
@@ -162,6 +166,7 @@ namespace ORB_SLAM2_TEAM
 
       } while (!CheckFinish());
 
+      mMap.Idle(mMapReader);
       SetFinish();
       Print("end Run");
    }
@@ -210,9 +215,12 @@ namespace ORB_SLAM2_TEAM
          pKF1->ComputeBoW(mVocab);
          pKF2->ComputeBoW(mVocab);
 
-         unique_lock<mutex> lock(mMutexNewKFs);
-         pair<KeyFrame *, unsigned int> p = make_pair(pKF2, trackerId);
-         mNewKeyFrames.push_back(p);
+         {
+            unique_lock<mutex> lock(mMutexNewKFs);
+            pair<KeyFrame *, unsigned int> p = make_pair(pKF2, trackerId);
+            mNewKeyFrames.push_back(p);
+         }
+         mWakeUp.Set();
 
          success = true;
          SetNotPause(false);
@@ -301,9 +309,12 @@ namespace ORB_SLAM2_TEAM
             // Update links in the Covisibility Graph
             pKF->UpdateConnections();
 
-            unique_lock<mutex> lock(mMutexNewKFs);
-            pair<KeyFrame *, unsigned int> p = make_pair(pKF, trackerId);
-            mNewKeyFrames.push_back(p);
+            {
+               unique_lock<mutex> lock(mMutexNewKFs);
+               pair<KeyFrame *, unsigned int> p = make_pair(pKF, trackerId);
+               mNewKeyFrames.push_back(p);
+            }
+            mWakeUp.Set();
 
             success = true;
          }
@@ -341,6 +352,17 @@ namespace ORB_SLAM2_TEAM
    }
 
 
+   void LocalMapping::ReclaimMapPoints()
+   {
+      unique_lock<mutex> lock(mMutexMapUpdate);
+      const unsigned long epoch = mMap.GetEpoch();
+      for (list<MapPoint *> & recentAddedMapPoints : mRecentAddedMapPoints)
+         recentAddedMapPoints.remove_if([](MapPoint * pMP) { return pMP->IsBad(); });
+      mLocalBundleAdjuster.ReleaseBad();
+      mMap.Quiescent(mMapReader, epoch);
+      mMap.ReclaimMapPoints();
+   }
+
    void LocalMapping::MapPointCulling()
    {
       Print("begin MapPointCulling");
@@ -491,17 +513,21 @@ namespace ORB_SLAM2_TEAM
             const int &idx1 = vMatchedIndices[ikp].first;
             const int &idx2 = vMatchedIndices[ikp].second;
 
-            const cv::KeyPoint &kp1 = mpCurrentKeyFrame->keysUn[idx1];
+            const float kp1X = mpCurrentKeyFrame->features.X(idx1);
+            const float kp1Y = mpCurrentKeyFrame->features.Y(idx1);
+            const int kp1Octave = mpCurrentKeyFrame->features.Octave(idx1);
             const float kp1_ur = mpCurrentKeyFrame->right[idx1];
             bool bStereo1 = kp1_ur >= 0;
 
-            const cv::KeyPoint &kp2 = pKF2->keysUn[idx2];
+            const float kp2X = pKF2->features.X(idx2);
+            const float kp2Y = pKF2->features.Y(idx2);
+            const int kp2Octave = pKF2->features.Octave(idx2);
             const float kp2_ur = pKF2->right[idx2];
             bool bStereo2 = kp2_ur >= 0;
 
             // Check parallax between rays
-            cv::Mat xn1 = (cv::Mat_<float>(3, 1) << (kp1.pt.x - cx1)*invfx1, (kp1.pt.y - cy1)*invfy1, 1.0);
-            cv::Mat xn2 = (cv::Mat_<float>(3, 1) << (kp2.pt.x - cx2)*invfx2, (kp2.pt.y - cy2)*invfy2, 1.0);
+            cv::Mat xn1 = (cv::Mat_<float>(3, 1) << (kp1X - cx1)*invfx1, (kp1Y - cy1)*invfy1, 1.0);
+            cv::Mat xn2 = (cv::Mat_<float>(3, 1) << (kp2X - cx2)*invfx2, (kp2Y - cy2)*invfy2, 1.0);
 
             cv::Mat ray1 = Rwc1 * xn1;
             cv::Mat ray2 = Rwc2 * xn2;
@@ -563,7 +589,7 @@ namespace ORB_SLAM2_TEAM
                continue;
 
             //Check reprojection error in first keyframe
-            const float &sigmaSquare1 = mpCurrentKeyFrame->levelSigma2[kp1.octave];
+            const float &sigmaSquare1 = mpCurrentKeyFrame->levelSigma2[kp1Octave];
             const float x1 = Rcw1.row(0).dot(x3Dt) + tcw1.at<float>(0);
             const float y1 = Rcw1.row(1).dot(x3Dt) + tcw1.at<float>(1);
             const float invz1 = 1.0 / z1;
@@ -572,8 +598,8 @@ namespace ORB_SLAM2_TEAM
             {
                float u1 = fx1 * x1*invz1 + cx1;
                float v1 = fy1 * y1*invz1 + cy1;
-               float errX1 = u1 - kp1.pt.x;
-               float errY1 = v1 - kp1.pt.y;
+               float errX1 = u1 - kp1X;
+               float errY1 = v1 - kp1Y;
                if ((errX1*errX1 + errY1 * errY1) > 5.991*sigmaSquare1)
                   continue;
             }
@@ -582,15 +608,15 @@ namespace ORB_SLAM2_TEAM
                float u1 = fx1 * x1*invz1 + cx1;
                float u1_r = u1 - mpCurrentKeyFrame->mFC.blfx * invz1;
                float v1 = fy1 * y1*invz1 + cy1;
-               float errX1 = u1 - kp1.pt.x;
-               float errY1 = v1 - kp1.pt.y;
+               float errX1 = u1 - kp1X;
+               float errY1 = v1 - kp1Y;
                float errX1_r = u1_r - kp1_ur;
                if ((errX1*errX1 + errY1 * errY1 + errX1_r * errX1_r) > 7.8*sigmaSquare1)
                   continue;
             }
 
             //Check reprojection error in second keyframe
-            const float sigmaSquare2 = pKF2->levelSigma2[kp2.octave];
+            const float sigmaSquare2 = pKF2->levelSigma2[kp2Octave];
             const float x2 = Rcw2.row(0).dot(x3Dt) + tcw2.at<float>(0);
             const float y2 = Rcw2.row(1).dot(x3Dt) + tcw2.at<float>(1);
             const float invz2 = 1.0 / z2;
@@ -598,8 +624,8 @@ namespace ORB_SLAM2_TEAM
             {
                float u2 = fx2 * x2*invz2 + cx2;
                float v2 = fy2 * y2*invz2 + cy2;
-               float errX2 = u2 - kp2.pt.x;
-               float errY2 = v2 - kp2.pt.y;
+               float errX2 = u2 - kp2X;
+               float errY2 = v2 - kp2Y;
                if ((errX2*errX2 + errY2 * errY2) > 5.991*sigmaSquare2)
                   continue;
             }
@@ -608,8 +634,8 @@ namespace ORB_SLAM2_TEAM
                float u2 = fx2 * x2*invz2 + cx2;
                float u2_r = u2 - mpCurrentKeyFrame->mFC.blfx * invz2;
                float v2 = fy2 * y2*invz2 + cy2;
-               float errX2 = u2 - kp2.pt.x;
-               float errY2 = v2 - kp2.pt.y;
+               float errX2 = u2 - kp2X;
+               float errY2 = v2 - kp2Y;
                float errX2_r = u2_r - kp2_ur;
                if ((errX2*errX2 + errY2 * errY2 + errX2_r * errX2_r) > 7.8*sigmaSquare2)
                   continue;
@@ -626,7 +652,7 @@ namespace ORB_SLAM2_TEAM
                continue;
 
             const float ratioDist = dist2 / dist1;
-            const float ratioOctave = mpCurrentKeyFrame->scaleFactors[kp1.octave] / pKF2->scaleFactors[kp2.octave];
+            const float ratioOctave = mpCurrentKeyFrame->scaleFactors[kp1Octave] / pKF2->scaleFactors[kp2Octave];
 
             /*if(fabs(ratioDist-ratioOctave)>ratioFactor)
                 continue;*/
@@ -689,12 +715,20 @@ namespace ORB_SLAM2_TEAM
       }
 
       // Search matches by projection from current KF in target KFs
+      // the searches run in parallel against the map before this fuse, then the matches are fused in the order of the targets
       ORBmatcher matcher;
       vector<MapPoint *> vpMapPointMatches = mpCurrentKeyFrame->GetMapPointMatches();
-      for (vector<KeyFrame *>::iterator vit = vpTargetKFs.begin(), vend = vpTargetKFs.end(); vit != vend; vit++)
+      vector<vector<ORBmatcher::FuseMatch>> vTargetMatches(vpTargetKFs.size());
+      mWorkerPool.ParallelFor(vpTargetKFs.size(), [&vpTargetKFs, &vpMapPointMatches, &vTargetMatches](size_t i)
       {
-         KeyFrame * pKFi = *vit;
-         matcher.Fuse(mMap, *pKFi, vpMapPointMatches);
+         ORBmatcher targetMatcher;
+         targetMatcher.FindFuseMatches(*vpTargetKFs[i], vpMapPointMatches, vTargetMatches[i]);
+      });
+
+      {
+         unique_lock<mutex> lock(mMutexMapUpdate);
+         for (const vector<ORBmatcher::FuseMatch> & matches : vTargetMatches)
+            matcher.ApplyFuseMatches(mMap, matches);
       }
 
       // Search matches by projection from target KFs in current KF
@@ -717,11 +751,28 @@ namespace ORB_SLAM2_TEAM
          }
       }
 
-      matcher.Fuse(mMap, *mpCurrentKeyFrame, vpFuseCandidates);
+      // the candidates are split into one part per thread, then the matches are fused in the order of the candidates
+      // (see ApplyFuseMatches for how this differs from a serial Fuse)
+      const size_t nParts = min<size_t>(mWorkerPool.QuantityThreads(), vpFuseCandidates.size());
+      vector<vector<ORBmatcher::FuseMatch>> vPartMatches(nParts);
+      mWorkerPool.ParallelFor(nParts, [&vpFuseCandidates, &vPartMatches, nParts, this](size_t i)
+      {
+         const size_t begin = vpFuseCandidates.size() * i / nParts;
+         const size_t end = vpFuseCandidates.size() * (i + 1) / nParts;
+         const vector<MapPoint *> vpPart(vpFuseCandidates.begin() + begin, vpFuseCandidates.begin() + end);
+         ORBmatcher partMatcher;
+         partMatcher.FindFuseMatches(*mpCurrentKeyFrame, vpPart, vPartMatches[i]);
+      });
+
+      {
+         unique_lock<mutex> lock(mMutexMapUpdate);
+         for (const vector<ORBmatcher::FuseMatch> & matches : vPartMatches)
+            matcher.ApplyFuseMatches(mMap, matches);
+      }
 
-      // Update points
+      // Update points, each MapPoint is updated by one thread
       vpMapPointMatches = mpCurrentKeyFrame->GetMapPointMatches();
-      for (size_t i = 0, iend = vpMapPointMatches.size(); i < iend; i++)
+      mWorkerPool.ParallelFor(vpMapPointMatches.size(), [&vpMapPointMatches](size_t i)
       {
          MapPoint * pMP = vpMapPointMatches[i];
          if (pMP)
@@ -732,7 +783,7 @@ namespace ORB_SLAM2_TEAM
                pMP->UpdateNormalAndDepth();
             }
          }
-      }
+      });
 
       // Update connections in covisibility graph
       mpCurrentKeyFrame->UpdateConnections();
@@ -768,6 +819,7 @@ namespace ORB_SLAM2_TEAM
       NotifyPauseRequested(mbPauseRequested);
       unique_lock<mutex> lock2(mMutexNewKFs);
       mbAbortBA = true;
+      mWakeUp.Set();
       Print("end RequestPause");
    }
 
@@ -778,6 +830,7 @@ namespace ORB_SLAM2_TEAM
       if (mbPauseRequested && !mbNotPause)
       {
          mbPaused = true;
+         mCondPaused.notify_all();
          return true;
       }
 
@@ -792,6 +845,14 @@ namespace ORB_SLAM2_TEAM
    }
 
 
+   void LocalMapping::WaitUntilPaused()
+   {
+      // SetFinish also sets mbPaused, so this returns if Run has finished
+      unique_lock<mutex> lock(mMutexPause);
+      mCondPaused.wait(lock, [this] { return mbPaused; });
+   }
+
+
    bool LocalMapping::PauseRequested()
    {
       unique_lock<mutex> lock(mMutexPause);
@@ -826,6 +887,7 @@ namespace ORB_SLAM2_TEAM
          mbPauseRequested = false;
          NotifyPauseRequested(mbPauseRequested);
       }
+      mWakeUp.Set();
 
       Print("RESUME");
    }
@@ -858,6 +920,10 @@ namespace ORB_SLAM2_TEAM
 
       mbNotPause = flag;
 
+      // a pause may have been requested while pausing was not allowed
+      if (!flag)
+         mWakeUp.Set();
+
       return true;
    }
 
@@ -904,15 +970,15 @@ namespace ORB_SLAM2_TEAM
                   nMPs++;
                   if (pMP->Observations() > thObs)
                   {
-                     const int &scaleLevel = pKF->keysUn[i].octave;
-                     const map<KeyFrame *, size_t> observations = pMP->GetObservations();
+                     const int scaleLevel = pKF->features.Octave(i);
+                     const ObservationMap observations = pMP->GetObservations();
                      int nObs = 0;
-                     for (map<KeyFrame *, size_t>::const_iterator mit = observations.begin(), mend = observations.end(); mit != mend; mit++)
+                     for (ObservationMap::const_iterator mit = observations.begin(), mend = observations.end(); mit != mend; mit++)
                      {
                         KeyFrame * pKFi = mit->first;
                         if (pKFi == pKF)
                            continue;
-                        const int &scaleLeveli = pKFi->keysUn[mit->second].octave;
+                        const int scaleLeveli = pKFi->features.Octave(mit->second);
 
                         if (scaleLeveli <= scaleLevel + 1)
                         {
@@ -949,20 +1015,10 @@ namespace ORB_SLAM2_TEAM
 
    void LocalMapping::RequestReset()
    {
-      {
-         unique_lock<mutex> lock(mMutexReset);
-         mbResetRequested = true;
-      }
-
-      while (1)
-      {
-         {
-            unique_lock<mutex> lock2(mMutexReset);
-            if (!mbResetRequested)
-               break;
-         }
-         sleep(3000);
-      }
+      unique_lock<mutex> lock(mMutexReset);
+      mbResetRequested = true;
+      mWakeUp.Set();
+      mCondReset.wait(lock, [this] { return !mbResetRequested; });
    }
 
 
@@ -978,9 +1034,11 @@ namespace ORB_SLAM2_TEAM
             list<MapPoint *> & recentAddedMapPoints = mRecentAddedMapPoints[i];
             recentAddedMapPoints.clear();
          }
+         mLocalBundleAdjuster.Clear();
          unique_lock<mutex> lock2(mMutexNewKFs);
          mNewKeyFrames.clear();
          mbResetRequested = false;
+         mCondReset.notify_all();
       }
       //Print("end ResetIfRequested");
    }
@@ -988,8 +1046,11 @@ namespace ORB_SLAM2_TEAM
 
    void LocalMapping::RequestFinish()
    {
-      unique_lock<mutex> lock(mMutexFinish);
-      mbFinishRequested = true;
+      {
+         unique_lock<mutex> lock(mMutexFinish);
+         mbFinishRequested = true;
+      }
+      mWakeUp.Set();
    }
 
 
@@ -1006,6 +1067,7 @@ namespace ORB_SLAM2_TEAM
       mbFinished = true;
       unique_lock<mutex> lock2(mMutexPause);
       mbPaused = true;
+      mCondPaused.notify_all();
    }
 
 
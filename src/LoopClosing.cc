@@ -25,8 +25,9 @@
 #include "Converter.h"
 #include "Optimizer.h"
 #include "ORBmatcher.h"
-#include "Sleep.h"
 #include "Duration.h"
+#include <algorithm>
+#include <atomic>
 #include <mutex>
 #include <thread>
 
@@ -37,13 +38,17 @@ namespace ORB_SLAM2_TEAM
       Map & map,
       KeyFrameDatabase & keyFrameDB, 
       ORBVocabulary & vocab,
-      const bool bFixScale
+      const bool bFixScale,
+      const unsigned int quantityThreads
    ) :
       SyncPrint("LoopClosing: "),
       mMap(map),
       mKeyFrameDB(keyFrameDB),
       mVocab(vocab),
       mbFixScale(bFixScale),
+      mQuantityThreads(max(quantityThreads, 1u)),
+      mGlobalBundleAdjuster(mQuantityThreads),
+      mWorkerPool(mQuantityThreads),
       mMutexMapUpdate(map.mutexMapUpdate),
       mbResetRequested(false),
       mbFinishRequested(false),
@@ -53,22 +58,24 @@ namespace ORB_SLAM2_TEAM
       mbRunningGBA(false),
       mbFinishedGBA(true),
       mbStopGBA(false),
+      mbPublishStoppedGBA(false),
+      mbInterruptedGBA(false),
+      mGBALoopKeyFrameId(0),
       mpThreadGBA(NULL),
-      mnFullBAIdx(0),
       mnCovisibilityConsistencyTh(3),
       mQuantityLoops(0),
       quantityLoops(mQuantityLoops)
    {
+      mMapReader = mMap.RegisterReader();
    }
 
    LoopClosing::~LoopClosing()
    {
-      if (mpThreadGBA)
-      {
-         mpThreadGBA->detach();
-         delete mpThreadGBA;
-         mpThreadGBA = NULL;
-      }
+      // the thread uses mGlobalBundleAdjuster
+      StopGBA(false);
+
+      for (Sim3Solver * pSolver : mvpSim3Solvers)
+         delete pSolver;
    }
 
    void LoopClosing::SetLocalMapper(LocalMapping *pLocalMapper)
@@ -84,7 +91,11 @@ namespace ORB_SLAM2_TEAM
 
       while (!CheckFinish())
       {
-         sleep(5000);
+         mvpCurrentMatchedPoints.clear();
+         mvpLoopMapPoints.clear();
+         mMap.Idle(mMapReader);
+         mWakeUp.Wait();
+         mMap.Quiescent(mMapReader, mMap.GetEpoch());
 
          //Print("ResetIfRequested();");
          ResetIfRequested();
@@ -100,6 +111,10 @@ namespace ORB_SLAM2_TEAM
                mMetricsLoopDetectionDuration.push_back(Duration(GetNow(), startTime1));
                if (detected)
                {
+                  // A running Global BA is stopped and its solution so far is written to the map first,
+                  // so the Sim3 and the loop matches are computed from the poses that CorrectLoop corrects
+                  const bool bStoppedGBA = StopGBA(true);
+
                   // Compute similarity transformation [sR|t]
                   // In the stereo/RGBD case s=1
                   if (ComputeSim3())
@@ -112,11 +127,17 @@ namespace ORB_SLAM2_TEAM
                      mMetricsLoopCorrectionDuration.push_back(Duration(GetNow(), startTime2));
                      mQuantityLoops++;
                   }
+                  else if (bStoppedGBA)
+                  {
+                     // no loop was closed, the Global BA continues from its written solution
+                     StartGBA(mGBALoopKeyFrameId);
+                  }
                }
             }
          }
       }
 
+      mMap.Idle(mMapReader);
       SetFinish();
       Print("end Run");
    }
@@ -141,9 +162,12 @@ namespace ORB_SLAM2_TEAM
    void LoopClosing::InsertKeyFrame(KeyFrame *pKF)
    {
       Print("begin InsertKeyFrame");
-      unique_lock<mutex> lock(mMutexLoopQueue);
       if (pKF->id != 0)
+      {
+         unique_lock<mutex> lock(mMutexLoopQueue);
          mlpLoopKeyFrameQueue.push_back(pKF);
+      }
+      mWakeUp.Set();
       Print("end InsertKeyFrame");
    }
 
@@ -306,30 +330,32 @@ namespace ORB_SLAM2_TEAM
 
       // We compute first ORB matches for each candidate
       // If enough matches are found, we setup a Sim3Solver
+      // The candidates are independent, so they are matched on the worker pool
       ORBmatcher matcher(0.75, true);
 
-      vector<Sim3Solver*> vpSim3Solvers;
-      vpSim3Solvers.resize(nInitialCandidates);
+      while (mvpSim3Solvers.size() < (size_t)nInitialCandidates)
+         mvpSim3Solvers.push_back(new Sim3Solver());
 
       vector<vector<MapPoint*> > vvpMapPointMatches;
       vvpMapPointMatches.resize(nInitialCandidates);
 
-      vector<bool> vbDiscarded;
-      vbDiscarded.resize(nInitialCandidates);
-
-      int nCandidates = 0; //candidates with enough matches
+      // char instead of bool, the elements are written by different threads
+      vector<char> vbDiscarded(nInitialCandidates, false);
 
       for (int i = 0; i < nInitialCandidates; i++)
       {
-         KeyFrame* pKF = mvpEnoughConsistentCandidates[i];
-
          // avoid that local mapping erase it while it is being processed in this thread
-         pKF->SetNotErase();
+         mvpEnoughConsistentCandidates[i]->SetNotErase();
+      }
+
+      mWorkerPool.ParallelFor(nInitialCandidates, [&](size_t i)
+      {
+         KeyFrame* pKF = mvpEnoughConsistentCandidates[i];
 
          if (pKF->IsBad())
          {
             vbDiscarded[i] = true;
-            continue;
+            return;
          }
 
          int nmatches = matcher.SearchByBoW(mpCurrentKF, pKF, vvpMapPointMatches[i]);
@@ -337,28 +363,39 @@ namespace ORB_SLAM2_TEAM
          if (nmatches < 20)
          {
             vbDiscarded[i] = true;
-            continue;
-         }
-         else
-         {
-            Sim3Solver* pSolver = new Sim3Solver(mpCurrentKF, pKF, vvpMapPointMatches[i], mbFixScale);
-            pSolver->SetRansacParameters(0.99, 20, 300);
-            vpSim3Solvers[i] = pSolver;
+            return;
          }
 
-         nCandidates++;
-      }
+         Sim3Solver* pSolver = mvpSim3Solvers[i];
+         pSolver->Initialize(mpCurrentKF, pKF, vvpMapPointMatches[i], mbFixScale);
+         pSolver->SetRansacParameters(0.99, 20, 300);
+         pSolver->SetSeed((unsigned int)(mpCurrentKF->id ^ pKF->id));
+      });
+
+      int nCandidates = 0; //candidates with enough matches
+      for (int i = 0; i < nInitialCandidates; i++)
+         if (!vbDiscarded[i])
+            nCandidates++;
 
       bool bMatch = false;
 
       // Perform alternatively RANSAC iterations for each candidate
       // until one is succesful or all fail
+      // Each round runs the RANSAC iterations, guided matching and optimization of all candidates on the worker pool.
+      // The first candidate in order that succeeds is taken, as in a serial round, so once one succeeds
+      // the candidates after it are skipped.
+      vector<vector<MapPoint*> > vvpSim3Matches(nInitialCandidates);
+      vector<g2o::Sim3, Eigen::aligned_allocator<g2o::Sim3> > vgScm(nInitialCandidates);
+      vector<char> vbNoMore(nInitialCandidates);
+
       while (nCandidates > 0 && !bMatch)
       {
-         for (int i = 0; i < nInitialCandidates; i++)
+         atomic<int> nFirstMatch(nInitialCandidates);
+
+         mWorkerPool.ParallelFor(nInitialCandidates, [&](size_t i)
          {
-            if (vbDiscarded[i])
-               continue;
+            if (vbDiscarded[i] || (int)i > nFirstMatch.load())
+               return;
 
             KeyFrame* pKF = mvpEnoughConsistentCandidates[i];
 
@@ -367,20 +404,15 @@ namespace ORB_SLAM2_TEAM
             int nInliers;
             bool bNoMore;
 
-            Sim3Solver* pSolver = vpSim3Solvers[i];
+            Sim3Solver* pSolver = mvpSim3Solvers[i];
             cv::Mat Scm = pSolver->iterate(5, bNoMore, vbInliers, nInliers);
-
-            // If Ransac reachs max. iterations discard keyframe
-            if (bNoMore)
-            {
-               vbDiscarded[i] = true;
-               nCandidates--;
-            }
+            vbNoMore[i] = bNoMore;
 
             // If RANSAC returns a Sim3, perform a guided matching and optimize with all correspondences
             if (!Scm.empty())
             {
-               vector<MapPoint*> vpMapPointMatches(vvpMapPointMatches[i].size(), static_cast<MapPoint*>(NULL));
+               vector<MapPoint*> & vpMapPointMatches = vvpSim3Matches[i];
+               vpMapPointMatches.assign(vvpMapPointMatches[i].size(), static_cast<MapPoint*>(NULL));
                for (size_t j = 0, jend = vbInliers.size(); j < jend; j++)
                {
                   if (vbInliers[j])
@@ -395,19 +427,41 @@ namespace ORB_SLAM2_TEAM
                g2o::Sim3 gScm(Converter::toMatrix3d(R), Converter::toVector3d(t), s);
                const int nInliers = Optimizer::OptimizeSim3(mpCurrentKF, pKF, vpMapPointMatches, gScm, 10, mbFixScale);
 
-               // If optimization is succesful stop ransacs and continue
+               // If optimization is succesful stop the ransacs of the candidates after this one
                if (nInliers >= 20)
                {
-                  bMatch = true;
-                  mpMatchedKF = pKF;
-                  g2o::Sim3 gSmw(Converter::toMatrix3d(pKF->GetRotation()), Converter::toVector3d(pKF->GetTranslation()), 1.0);
-                  mg2oScw = gScm * gSmw;
-                  mScw = Converter::toCvMat(mg2oScw);
-
-                  mvpCurrentMatchedPoints = vpMapPointMatches;
-                  break;
+                  vgScm[i] = gScm;
+                  int nFirst = nFirstMatch.load();
+                  while ((int)i < nFirst && !nFirstMatch.compare_exchange_weak(nFirst, (int)i))
+                     ;
                }
             }
+         });
+
+         const int nMatch = nFirstMatch.load();
+         for (int i = 0; i < nInitialCandidates && i <= nMatch; i++)
+         {
+            if (vbDiscarded[i])
+               continue;
+
+            // If Ransac reachs max. iterations discard keyframe
+            if (vbNoMore[i])
+            {
+               vbDiscarded[i] = true;
+               nCandidates--;
+            }
+         }
+
+         if (nMatch < nInitialCandidates)
+         {
+            bMatch = true;
+            KeyFrame* pKF = mvpEnoughConsistentCandidates[nMatch];
+            mpMatchedKF = pKF;
+            g2o::Sim3 gSmw(Converter::toMatrix3d(pKF->GetRotationMatx()), Converter::toVector3d(pKF->GetTranslationVec()), 1.0);
+            mg2oScw = vgScm[nMatch] * gSmw;
+            mScw = Converter::toCvMat(mg2oScw);
+
+            mvpCurrentMatchedPoints = vvpSim3Matches[nMatch];
          }
       }
 
@@ -486,34 +540,15 @@ namespace ORB_SLAM2_TEAM
       Print("begin CorrectLoop");
       Print("Loop detected!");
 
+      // A running Global BA was stopped and written before ComputeSim3, this only joins a finished one
+      StopGBA(false);
+
       // Send a stop signal to Local Mapping
       // Avoid new keyframes are inserted while correcting the loop
       mpLocalMapper->RequestPause();
 
-      // If a Global Bundle Adjustment is running, abort it
-      Print("if (IsRunningGBA())");
-      if (IsRunningGBA())
-      {
-         unique_lock<mutex> lock(mMutexGBA);
-         mbStopGBA = true;
-
-         mnFullBAIdx++;
-
-         if (mpThreadGBA)
-         {
-            Print("mpThreadGBA->detach();");
-            // TODO - refactor so that each thread has one mbStopGBA variable
-            mpThreadGBA->detach();
-            delete mpThreadGBA;
-            mpThreadGBA = NULL;
-         }
-      }
-
       // Wait until Local Mapping has effectively stopped
-      while (!mpLocalMapper->IsPaused())
-      {
-         sleep(1000);
-      }
+      mpLocalMapper->WaitUntilPaused();
 
       // Ensure current keyframe is updated
       mpCurrentKF->UpdateConnections();
@@ -653,7 +688,7 @@ namespace ORB_SLAM2_TEAM
       }
 
       // Optimize graph
-      Optimizer::OptimizeEssentialGraph(mMap, mpMatchedKF, mpCurrentKF, NonCorrectedSim3, CorrectedSim3, LoopConnections, mbFixScale);
+      Optimizer::OptimizeEssentialGraph(mMap, mpMatchedKF, mpCurrentKF, NonCorrectedSim3, CorrectedSim3, LoopConnections, mbFixScale, mQuantityThreads);
       // TODO OK - detect map changes in Optimizer
 
       mMap.InformNewBigChange();
@@ -666,10 +701,7 @@ namespace ORB_SLAM2_TEAM
       NotifyMapChanged(mMap);
 
       // Launch a new thread to perform Global Bundle Adjustment
-      mbRunningGBA = true;
-      mbFinishedGBA = false;
-      mbStopGBA = false;
-      mpThreadGBA = new thread(&LoopClosing::RunGlobalBundleAdjustment, this, mpCurrentKF->id);
+      StartGBA(mpCurrentKF->id);
 
       // Loop closed. Release Local Mapping.
       mpLocalMapper->Resume();
@@ -710,22 +742,44 @@ namespace ORB_SLAM2_TEAM
    }
 
 
-   void LoopClosing::RequestReset()
+   void LoopClosing::StartGBA(unsigned long loopKeyFrameId)
    {
-      {
-         unique_lock<mutex> lock(mMutexReset);
-         mbResetRequested = true;
-      }
+      mbRunningGBA = true;
+      mbFinishedGBA = false;
+      mbStopGBA = false;
+      mbPublishStoppedGBA = false;
+      mbInterruptedGBA = false;
+      mGBALoopKeyFrameId = loopKeyFrameId;
+      mpThreadGBA = new thread(&LoopClosing::RunGlobalBundleAdjustment, this, loopKeyFrameId);
+   }
 
-      while (1)
+   bool LoopClosing::StopGBA(bool bPublish)
+   {
       {
-         {
-            unique_lock<mutex> lock2(mMutexReset);
-            if (!mbResetRequested)
-               break;
-         }
-         sleep(5000);
+         unique_lock<mutex> lock(mMutexGBA);
+         mbStopGBA = true;
+         mbPublishStoppedGBA = bPublish;
       }
+
+      // mMutexGBA is not locked while waiting, the thread locks it before it ends
+      if (!mpThreadGBA)
+         return false;
+
+      Print("mpThreadGBA->join();");
+      mpThreadGBA->join();
+      delete mpThreadGBA;
+      mpThreadGBA = NULL;
+
+      unique_lock<mutex> lock(mMutexGBA);
+      return mbInterruptedGBA;
+   }
+
+   void LoopClosing::RequestReset()
+   {
+      unique_lock<mutex> lock(mMutexReset);
+      mbResetRequested = true;
+      mWakeUp.Set();
+      mCondReset.wait(lock, [this] { return !mbResetRequested; });
    }
 
    void LoopClosing::ResetIfRequested()
@@ -734,9 +788,12 @@ namespace ORB_SLAM2_TEAM
       if (mbResetRequested)
       {
          Print("resetting LoopClosing");
+         StopGBA(false);
+         mGlobalBundleAdjuster.Clear();
          mlpLoopKeyFrameQueue.clear();
          mLastLoopKFid = 0;
          mbResetRequested = false;
+         mCondReset.notify_all();
       }
    }
 
@@ -745,119 +802,49 @@ namespace ORB_SLAM2_TEAM
       Print("begin RunGlobalBundleAdjustment");
       Print("Starting Global Bundle Adjustment");
 
+      // erased MapPoints are not deleted while Publish holds the MapPoint snapshot between its locks of the map
+      Map::ReaderScope readerScope(mMap);
+
       mMetricsBundleAdjustmentKeyFramesInMap.push_back(mMap.KeyFramesInMap());
       mMetricsBundleAdjustmentMapPointsInMap.push_back(mMap.MapPointsInMap());
       time_type startTime = GetNow();
-      int idx = mnFullBAIdx;
-      Optimizer::GlobalBundleAdjustment(mMap, 10, &mbStopGBA, loopKeyFrameId, false);
+      const bool bConverged = mGlobalBundleAdjuster.Optimize(mMap, 10, &mbStopGBA);
 
+      bool bPublish;
+      {
+         unique_lock<mutex> lock(mMutexGBA);
+         bPublish = bConverged || mbPublishStoppedGBA;
+      }
 
       // Update all MapPoints and KeyFrames
       // Local Mapping was active during BA, that means that there might be new keyframes
       // not included in the Global BA and they are not consistent with the updated map.
       // We need to propagate the correction through the spanning tree
+      if (bPublish)
       {
-         unique_lock<mutex> lock(mMutexGBA);
-         if (idx != mnFullBAIdx)
-         {
-            mMetricsBundleAdjustmentDuration.push_back(Duration(GetNow(), startTime));
-            NotifyMapChanged(mMap);
-            return;
-         }
-
-         if (!mbStopGBA)
-         {
-            Print("Global Bundle Adjustment finished");
-            Print("Updating map ...");
-
-            mpLocalMapper->RequestPause();
-            // Wait until Local Mapping has effectively stopped
-            while (!mpLocalMapper->IsPaused() && !mpLocalMapper->IsFinished())
-            {
-               sleep(1000);
-            }
+         Print(bConverged ? "Global Bundle Adjustment finished" : "Global Bundle Adjustment stopped");
+         Print("Updating map ...");
 
-            Print("waiting to lock map");
-            unique_lock<mutex> lock(mMutexMapUpdate);
-            Print("map is locked");
+         mpLocalMapper->RequestPause();
+         // Wait until Local Mapping has effectively stopped
+         mpLocalMapper->WaitUntilPaused();
 
-            // Correct keyframes starting at map first keyframe
-            list<KeyFrame*> lpKFtoCheck(mMap.mvpKeyFrameOrigins.begin(), mMap.mvpKeyFrameOrigins.end());
-                 
-            while (!lpKFtoCheck.empty())
-            {
-               KeyFrame* pKF = lpKFtoCheck.front();
-               const set<KeyFrame*> sChilds = pKF->GetChilds();
-               cv::Mat Twc = pKF->GetPoseInverse();
-               for (set<KeyFrame*>::const_iterator sit = sChilds.begin();sit != sChilds.end();sit++)
-               {
-                  KeyFrame* pChild = *sit;
-                  if (pChild->mnBAGlobalForKF != loopKeyFrameId)
-                  {
-                     cv::Mat Tchildc = pChild->GetPose()*Twc;
-                     pChild->mTcwGBA = Tchildc * pKF->mTcwGBA;//*Tcorc*pKF->mTcwGBA;
-                     pChild->mnBAGlobalForKF = loopKeyFrameId;
-
-                  }
-                  lpKFtoCheck.push_back(pChild);
-               }
-
-               pKF->mTcwBefGBA = pKF->GetPose();
-               pKF->SetPose(pKF->mTcwGBA);
-               lpKFtoCheck.pop_front();
-            }
-
-            // Correct MapPoints
-            const vector<MapPoint*> vpMPs = mMap.GetAllMapPoints();
-
-            for (size_t i = 0; i < vpMPs.size(); i++)
-            {
-               MapPoint* pMP = vpMPs[i];
-
-               if (pMP->IsBad())
-                  continue;
-
-               if (pMP->mnBAGlobalForKF == loopKeyFrameId)
-               {
-                  // If optimized by Global BA, just update
-                  pMP->SetWorldPos(pMP->mPosGBA);
-               }
-               else
-               {
-                  // Update according to the correction of its reference keyframe
-                  KeyFrame * pRefKF = pMP->GetReferenceKeyFrame();
-                  if (pRefKF == NULL)
-                     throw exception("LoopClosing::RunGlobalBundleAdjustment detected a MapPoint without a reference KeyFrame");
-
-                  if (pRefKF->mnBAGlobalForKF != loopKeyFrameId)
-                     continue;
-
-                  // Map to non-corrected camera
-                  cv::Mat Rcw = pRefKF->mTcwBefGBA.rowRange(0, 3).colRange(0, 3);
-                  cv::Mat tcw = pRefKF->mTcwBefGBA.rowRange(0, 3).col(3);
-                  cv::Mat Xc = Rcw * pMP->GetWorldPos() + tcw;
+         mGlobalBundleAdjuster.Publish(mMap, loopKeyFrameId);
 
-                  // Backproject using corrected camera
-                  cv::Mat Twc = pRefKF->GetPoseInverse();
-                  cv::Mat Rwc = Twc.rowRange(0, 3).colRange(0, 3);
-                  cv::Mat twc = Twc.rowRange(0, 3).col(3);
-
-                  pMP->SetWorldPos(Rwc*Xc + twc);
-               }
-            }
-
-            Print("NotifyMapChanged(mapChanges);");
-            NotifyMapChanged(mMap);
-            mMap.InformNewBigChange();
+         Print("NotifyMapChanged(mapChanges);");
+         NotifyMapChanged(mMap);
+         mMap.InformNewBigChange();
 
-            mpLocalMapper->Resume();
-
-            Print("Map updated!");
-         }
+         mpLocalMapper->Resume();
 
+         Print("Map updated!");
+      }
 
+      {
+         unique_lock<mutex> lock(mMutexGBA);
          mbFinishedGBA = true;
          mbRunningGBA = false;
+         mbInterruptedGBA = !bConverged;
       }
 
       mMetricsBundleAdjustmentDuration.push_back(Duration(GetNow(), startTime));
@@ -883,9 +870,12 @@ namespace ORB_SLAM2_TEAM
 
    void LoopClosing::RequestFinish()
    {
-      unique_lock<mutex> lock(mMutexFinish);
-      mbFinishRequested = true;
-      mbStopGBA = true;
+      {
+         unique_lock<mutex> lock(mMutexFinish);
+         mbFinishRequested = true;
+         mbStopGBA = true;
+      }
+      mWakeUp.Set();
    }
 
    bool LoopClosing::CheckFinish()
@@ -23,12 +23,86 @@
 #include "Map.h"
 
 #include<mutex>
+#include <atomic>
+#include <climits>
+#include <algorithm>
 
 namespace ORB_SLAM2_TEAM
 {
 
+   // returns the vector of a snapshot, copied first if a reader still holds it
+   template<class T>
+   static vector<T *> & WritableSnapshot(shared_ptr<vector<T *>> & pSnapshot)
+   {
+      if (pSnapshot.use_count() != 1)
+         pSnapshot = make_shared<vector<T *>>(*pSnapshot);
+
+      // the reads of the last reader happen before the vector is modified
+      atomic_thread_fence(memory_order_acquire);
+      return *pSnapshot;
+   }
+
+   // returns the object with the id from a table indexed by id, or NULL
+   template<class T>
+   static T * FindInTable(const vector<T *> & table, id_type id)
+   {
+      return (id < table.size()) ? table[id] : NULL;
+   }
+
+   // stores the object in the table, and adds it to the snapshot or replaces the object with the same id
+   template<class T>
+   static void AddToTable(vector<T *> & table, vector<size_t> & index, shared_ptr<vector<T *>> & pSnapshot, T * p)
+   {
+      const id_type id = p->id;
+      if (id >= table.size())
+      {
+         table.resize(id + 1, NULL);
+         index.resize(id + 1, 0);
+      }
+
+      vector<T *> & v = WritableSnapshot(pSnapshot);
+      if (table[id])
+      {
+         v[index[id]] = p;
+      }
+      else
+      {
+         index[id] = v.size();
+         v.push_back(p);
+      }
+      table[id] = p;
+   }
+
+   // removes the object with the id from the table and the snapshot, returns the object or NULL
+   template<class T>
+   static T * EraseFromTable(vector<T *> & table, vector<size_t> & index, shared_ptr<vector<T *>> & pSnapshot, id_type id)
+   {
+      T * p = FindInTable(table, id);
+      if (!p)
+         return NULL;
+
+      // move the last element into the hole
+      vector<T *> & v = WritableSnapshot(pSnapshot);
+      const size_t i = index[id];
+      if (i + 1 < v.size())
+      {
+         v[i] = v.back();
+         index[v[i]->id] = i;
+      }
+      v.pop_back();
+      table[id] = NULL;
+      return p;
+   }
+
+   // the epoch of a reader that holds no MapPoint pointers
+   static const unsigned long READER_IDLE = ULONG_MAX;
+
    Map::Map()
       : mnMaxKFid(0), mnBigChangeIdx(0), mFirstKeyFrame(NULL), SyncPrint("Map: ", false)
+      , mpKeyFrameSnapshot(make_shared<vector<KeyFrame *>>())
+      , mpMapPointSnapshot(make_shared<vector<MapPoint *>>())
+      , mTakingModified(0)
+      , mEpoch(0)
    {
 
    }
@@ -43,11 +117,16 @@ namespace ORB_SLAM2_TEAM
       if (NULL == mFirstKeyFrame)
          mFirstKeyFrame = pKF;
 
-      mKeyFrames[pKF->id] = pKF;
+      PublishKeyFrame(pKF);
 
       if (pKF->id > mnMaxKFid)
          mnMaxKFid = pKF->id;
 
+      // a new KeyFrame is a change, even if it was modified before it was added
+      pKF->mpMap = this;
+      pKF->mModified = true;
+      AddModified(pKF);
+
       //Print("end AddKeyFrame");
    }
 
@@ -62,14 +141,19 @@ namespace ORB_SLAM2_TEAM
          throw exception("Map::AddMapPoint: can not add a NULL MapPoint *");
 
       unique_lock<mutex> lock(mMutexMap);
-      mMapPoints[pMP->id] = pMP;
+      PublishMapPoint(pMP);
+
+      // a new MapPoint is a change, even if it was modified before it was added
+      pMP->mpMap = this;
+      pMP->mModified = true;
+      AddModified(pMP);
    }
 
    void Map::EraseMapPoint(MapPoint * pMP)
    {
       Print("begin EraseMapPoint");
 
-      map<KeyFrame *, size_t> obs;
+      ObservationMap obs;
       {
          unique_lock<mutex> lockMP(pMP->mMutexFeatures);
          pMP->mbBad = true;
@@ -83,50 +167,50 @@ namespace ORB_SLAM2_TEAM
       }
       
       if (pMP->IsBad()) {
-         unique_lock<mutex> lock(mMutexMap);
-         mMapPoints.erase(pMP->id);
+         bool erased = false;
+         {
+            unique_lock<mutex> lock(mMutexMap);
+            if (FindInTable(mMapPoints, pMP->id) == pMP)
+               erased = (UnpublishMapPoint(pMP->id) != NULL);
+         }
+
+         // erased only once, even if two threads erase the same MapPoint
+         if (erased)
+            RetireMapPoint(pMP);
       }
       else {
          Print("a new KeyFrame was linked to the MapPoint by another thread");
       }
 
-      // TODO: This only erase the pointer.
-      // Delete the MapPoint
       Print("end EraseMapPoint");
    }
 
    void Map::EraseMapPoint(id_type mapPointId)
    {
-      unique_lock<mutex> lock(mMutexMap);
-      if (mMapPoints.count(mapPointId) > 0)
-      {
-         EraseMapPoint(mMapPoints[mapPointId]);
-      }
-
-      // TODO: This only erase the pointer.
-      // Delete the MapPoint
+      // EraseMapPoint locks the map again
+      MapPoint * pMP = GetMapPoint(mapPointId);
+      if (pMP)
+         EraseMapPoint(pMP);
    }
 
    void Map::EraseKeyFrame(KeyFrame *pKF)
    {
       unique_lock<mutex> lock(mMutexMap);
-      mKeyFrames.erase(pKF->id);
-      if (mFirstKeyFrame->id == pKF->id)
+      UnpublishKeyFrame(pKF->id);
+      if (mFirstKeyFrame && mFirstKeyFrame->id == pKF->id)
          mFirstKeyFrame = NULL;
 
-      // TODO: This only erase the pointer.
-      // Delete the KeyFrame
+      // the KeyFrame is not deleted, bad KeyFrames are still followed by their children and the saved trajectory
    }
 
    void Map::EraseKeyFrame(id_type keyFrameId)
    {
       unique_lock<mutex> lock(mMutexMap);
-      mKeyFrames.erase(keyFrameId);
-      if (mFirstKeyFrame->id == keyFrameId)
+      UnpublishKeyFrame(keyFrameId);
+      if (mFirstKeyFrame && mFirstKeyFrame->id == keyFrameId)
          mFirstKeyFrame = NULL;
 
-      // TODO: This only erase the pointer.
-      // Delete the KeyFrame
+      // the KeyFrame is not deleted, bad KeyFrames are still followed by their children and the saved trajectory
    }
 
    void Map::InformNewBigChange()
@@ -141,84 +225,50 @@ namespace ORB_SLAM2_TEAM
       return mnBigChangeIdx;
    }
 
-   vector<KeyFrame *> Map::GetAllKeyFrames()
+   Map::KeyFrameSnapshot Map::GetKeyFrameSnapshot()
    {
-      //Print("begin GetAllKeyFrames");
-      unique_lock<mutex> lock(mMutexMap);
-      vector<KeyFrame *> allKeyFrames;
-      for (unordered_map<id_type, KeyFrame *>::iterator it = mKeyFrames.begin(); it != mKeyFrames.end(); ++it)
-      {
-         if (it->second == NULL) Print("it->second == NULL");
-         allKeyFrames.push_back(it->second);
-      }
-      //Print("end GetAllKeyFrames");
-      return allKeyFrames;
+      unique_lock<mutex> lock(mMutexSnapshot);
+      return mpKeyFrameSnapshot;
    }
 
-   set<KeyFrame *> Map::GetKeyFrameSet()
+   vector<KeyFrame *> Map::GetAllKeyFrames()
    {
-      //Print("begin GetKeyFrameSet");
-      unique_lock<mutex> lock(mMutexMap);
-      set<KeyFrame *> allKeyFrames;
-      for (unordered_map<id_type, KeyFrame *>::iterator it = mKeyFrames.begin(); it != mKeyFrames.end(); ++it)
-      {
-         if (it->second == NULL) Print("it->second == NULL");
-         allKeyFrames.insert(it->second);
-      }
-      //Print("end GetKeyFrameSet");
-      return allKeyFrames;
+      return *GetKeyFrameSnapshot();
    }
 
    KeyFrame * Map::GetKeyFrame(const id_type keyFrameId) const
    {
-      //unique_lock<mutex> lock(mMutexMap);
-      return (mKeyFrames.count(keyFrameId) == 1) ? mKeyFrames.at(keyFrameId) : NULL;
+      unique_lock<mutex> lock(mMutexMap);
+      return FindInTable(mKeyFrames, keyFrameId);
    }
 
-   vector<MapPoint *> Map::GetAllMapPoints()
+   Map::MapPointSnapshot Map::GetMapPointSnapshot()
    {
-      //Print("begin GetAllMapPoints");
-      unique_lock<mutex> lock(mMutexMap);
-      vector<MapPoint *> allMapPoints;
-      for (unordered_map<id_type, MapPoint *>::iterator it = mMapPoints.begin(); it != mMapPoints.end(); ++it)
-      {
-         if (it->second == NULL) Print("it->second == NULL");
-         allMapPoints.push_back(it->second);
-      }
-      //Print("end GetAllMapPoints");
-      return allMapPoints;
+      unique_lock<mutex> lock(mMutexSnapshot);
+      return mpMapPointSnapshot;
    }
 
-   set<MapPoint *> Map::GetMapPointSet()
+   vector<MapPoint *> Map::GetAllMapPoints()
    {
-      //Print("begin GetMapPointSet");
-      unique_lock<mutex> lock(mMutexMap);
-      set<MapPoint *> allMapPoints;
-      for (unordered_map<id_type, MapPoint *>::iterator it = mMapPoints.begin(); it != mMapPoints.end(); ++it)
-      {
-         if (it->second == NULL) Print("it->second == NULL");
-         allMapPoints.insert(it->second);
-      }
-      //Print("end GetMapPointSet");
-      return allMapPoints;
+      return *GetMapPointSnapshot();
    }
 
    MapPoint * Map::GetMapPoint(id_type mapPointId) const
    {
-      //unique_lock<mutex> lock(mMutexMap);
-      return (mMapPoints.count(mapPointId) == 1) ? mMapPoints.at(mapPointId) : NULL;
+      unique_lock<mutex> lock(mMutexMap);
+      return FindInTable(mMapPoints, mapPointId);
    }
 
    size_t Map::MapPointsInMap()
    {
       unique_lock<mutex> lock(mMutexMap);
-      return mMapPoints.size();
+      return mpMapPointSnapshot->size();
    }
 
    size_t Map::KeyFramesInMap()
    {
       unique_lock<mutex> lock(mMutexMap);
-      return mKeyFrames.size();
+      return mpKeyFrameSnapshot->size();
    }
 
    id_type Map::GetMaxKFid()
@@ -231,17 +281,191 @@ namespace ORB_SLAM2_TEAM
    {
       unique_lock<mutex> lock(mMutexMap);
 
-      for (pair<id_type, MapPoint *> p : mMapPoints)
-         delete p.second;
+      for (MapPoint * pMP : *mpMapPointSnapshot)
+         delete pMP;
 
-      for (pair<id_type, KeyFrame *> p : mKeyFrames)
-         delete p.second;
+      for (KeyFrame * pKF : *mpKeyFrameSnapshot)
+         delete pKF;
+
+      {
+         unique_lock<mutex> lock4(mMutexReclaim);
+         for (pair<unsigned long, MapPoint *> p : mRetiredMapPoints)
+            delete p.second;
+         mRetiredMapPoints.clear();
+      }
 
       mMapPoints.clear();
       mKeyFrames.clear();
       mnMaxKFid = 0;
       mFirstKeyFrame = NULL;
       mvpKeyFrameOrigins.clear();
+
+      {
+         // readers may still hold the old snapshots
+         unique_lock<mutex> lock3(mMutexSnapshot);
+         mpKeyFrameSnapshot = make_shared<vector<KeyFrame *>>();
+         mpMapPointSnapshot = make_shared<vector<MapPoint *>>();
+         mKeyFrameSnapshotIndex.clear();
+         mMapPointSnapshotIndex.clear();
+      }
+
+      unique_lock<mutex> lock2(mMutexModified);
+      mModifiedKeyFrames.clear();
+      mModifiedMapPoints.clear();
+   }
+
+   void Map::PublishKeyFrame(KeyFrame * pKF)
+   {
+      unique_lock<mutex> lock(mMutexSnapshot);
+      AddToTable(mKeyFrames, mKeyFrameSnapshotIndex, mpKeyFrameSnapshot, pKF);
+   }
+
+   KeyFrame * Map::UnpublishKeyFrame(id_type keyFrameId)
+   {
+      unique_lock<mutex> lock(mMutexSnapshot);
+      return EraseFromTable(mKeyFrames, mKeyFrameSnapshotIndex, mpKeyFrameSnapshot, keyFrameId);
+   }
+
+   void Map::PublishMapPoint(MapPoint * pMP)
+   {
+      unique_lock<mutex> lock(mMutexSnapshot);
+      AddToTable(mMapPoints, mMapPointSnapshotIndex, mpMapPointSnapshot, pMP);
+   }
+
+   MapPoint * Map::UnpublishMapPoint(id_type mapPointId)
+   {
+      unique_lock<mutex> lock(mMutexSnapshot);
+      return EraseFromTable(mMapPoints, mMapPointSnapshotIndex, mpMapPointSnapshot, mapPointId);
+   }
+
+   void Map::RetireMapPoint(MapPoint * pMP)
+   {
+      unique_lock<mutex> lock(mMutexReclaim);
+      mRetiredMapPoints.push_back(make_pair(mEpoch++, pMP));
+   }
+
+   Map::reader_id Map::RegisterReader()
+   {
+      unique_lock<mutex> lock(mMutexReclaim);
+      for (reader_id i = 0; i < mReaderRegistered.size(); i++)
+      {
+         if (!mReaderRegistered[i])
+         {
+            mReaderRegistered[i] = true;
+            mReaderEpochs[i] = mEpoch;
+            return i;
+         }
+      }
+      mReaderRegistered.push_back(true);
+      mReaderEpochs.push_back(mEpoch);
+      return mReaderEpochs.size() - 1;
+   }
+
+   void Map::UnregisterReader(reader_id reader)
+   {
+      unique_lock<mutex> lock(mMutexReclaim);
+      mReaderRegistered.at(reader) = false;
+      mReaderEpochs.at(reader) = READER_IDLE;
+   }
+
+   unsigned long Map::GetEpoch()
+   {
+      unique_lock<mutex> lock(mMutexReclaim);
+      return mEpoch;
+   }
+
+   void Map::Quiescent(reader_id reader, unsigned long epoch)
+   {
+      unique_lock<mutex> lock(mMutexReclaim);
+      mReaderEpochs.at(reader) = epoch;
+   }
+
+   void Map::Idle(reader_id reader)
+   {
+      unique_lock<mutex> lock(mMutexReclaim);
+      mReaderEpochs.at(reader) = READER_IDLE;
+   }
+
+   void Map::ReclaimMapPoints()
+   {
+      vector<MapPoint *> reclaimed;
+      {
+         unique_lock<mutex> lock(mMutexReclaim);
+         unsigned long minEpoch = mEpoch;
+         for (unsigned long epoch : mReaderEpochs)
+            minEpoch = min(minEpoch, epoch);
+
+         // TakeModified may still read a MapPoint whose flag it cleared
+         unique_lock<mutex> lock2(mMutexModified);
+         if (mTakingModified > 0)
+            return;
+
+         // the list is ordered by epoch
+         auto it = mRetiredMapPoints.begin();
+         while (it != mRetiredMapPoints.end() && it->first < minEpoch)
+         {
+            // a MapPoint in the modified list is still read by TakeModified, it is deleted by a later call
+            if (it->second->GetModified())
+            {
+               ++it;
+            }
+            else
+            {
+               reclaimed.push_back(it->second);
+               it = mRetiredMapPoints.erase(it);
+            }
+         }
+      }
+
+      for (MapPoint * pMP : reclaimed)
+         delete pMP;
+   }
+
+   void Map::AddModified(KeyFrame * pKF)
+   {
+      unique_lock<mutex> lock(mMutexModified);
+      mModifiedKeyFrames.push_back(pKF);
+   }
+
+   void Map::AddModified(MapPoint * pMP)
+   {
+      unique_lock<mutex> lock(mMutexModified);
+      mModifiedMapPoints.push_back(pMP);
+   }
+
+   void Map::TakeModified(vector<KeyFrame *> & keyFrames, vector<MapPoint *> & mapPoints, vector<id_type> & badMapPoints)
+   {
+      keyFrames.clear();
+      badMapPoints.clear();
+      vector<MapPoint *> modifiedMPs;
+      {
+         unique_lock<mutex> lock(mMutexModified);
+         keyFrames.swap(mModifiedKeyFrames);
+         modifiedMPs.swap(mModifiedMapPoints);
+
+         // the flags are cleared with the lists swapped, so a modification after this
+         // waits in AddModified and is recorded in the new lists
+         for (KeyFrame * pKF : keyFrames)
+            pKF->SetModified(false);
+
+         for (MapPoint * pMP : modifiedMPs)
+            pMP->SetModified(false);
+
+         // retired MapPoints are not reclaimed until they have been read
+         mTakingModified++;
+      }
+
+      mapPoints.clear();
+      for (MapPoint * pMP : modifiedMPs)
+      {
+         if (pMP->IsBad())
+            badMapPoints.push_back(pMP->id);
+         else
+            mapPoints.push_back(pMP);
+      }
+
+      unique_lock<mutex> lock(mMutexModified);
+      mTakingModified--;
    }
 
    void Map::Link(KeyFrame & rKF, vector<MapPoint *> & mapPoints)
@@ -303,8 +527,9 @@ namespace ORB_SLAM2_TEAM
 
       unique_lock<mutex> lockMP(rMP.mMutexFeatures);
 
-      if (rMP.mObservations.count(&rKF) > 0) {
-         size_t prevIdx = rMP.mObservations[&rKF];
+      ObservationMap::const_iterator itObs = rMP.mObservations.find(&rKF);
+      if (itObs != rMP.mObservations.end()) {
+         size_t prevIdx = itObs->second;
          if (prevIdx != idx) {
             // rMP is already linked to rKF with a different index, so unlink them
             rKF.mvpMapPoints.at(prevIdx) = NULL;
@@ -315,7 +540,7 @@ namespace ORB_SLAM2_TEAM
 
       // link rMP to rKF at the desired index
       rKF.mvpMapPoints.at(idx) = &rMP;
-      rMP.mObservations[&rKF] = idx;
+      rMP.mObservations.set(&rKF, idx);
       rMP.CompleteLink(idx, rKF);
       rKF.SetModified(true);
       //Print("end LinkWithoutLock 2");
@@ -328,8 +553,9 @@ namespace ORB_SLAM2_TEAM
       unique_lock<mutex> lockKF(rKF.mMutexFeatures);
       unique_lock<mutex> lockMP(rMP.mMutexFeatures);
 
-      if (rMP.mObservations.count(&rKF) > 0) {
-         size_t prevIdx = rMP.mObservations[&rKF];
+      ObservationMap::const_iterator itObs = rMP.mObservations.find(&rKF);
+      if (itObs != rMP.mObservations.end()) {
+         size_t prevIdx = itObs->second;
          rKF.mvpMapPoints.at(prevIdx) = NULL;
          rMP.mObservations.erase(&rKF);
 
@@ -354,7 +580,7 @@ namespace ORB_SLAM2_TEAM
       Print(ss);
 
       int nvisible, nfound;
-      map<KeyFrame *, size_t> obs;
+      ObservationMap obs;
       {
          unique_lock<mutex> lock(oldMP.mMutexFeatures);
          oldMP.mbBad = true;
@@ -364,7 +590,7 @@ namespace ORB_SLAM2_TEAM
          oldMP.mpReplaced = &newMP;
       }
 
-      for (pair<KeyFrame *, size_t> p : obs) {
+      for (const ObservationMap::value_type & p : obs) {
          KeyFrame & rKF = *p.first;
          if (!newMP.IsObserving(&rKF)) {
             Link(newMP, p.second, rKF);
@@ -372,8 +598,16 @@ namespace ORB_SLAM2_TEAM
       }
 
       if (oldMP.IsBad()) {
-         unique_lock<mutex> lock(mMutexMap);
-         mMapPoints.erase(oldMP.id);
+         bool erased = false;
+         {
+            unique_lock<mutex> lock(mMutexMap);
+            if (FindInTable(mMapPoints, oldMP.id) == &oldMP)
+               erased = (UnpublishMapPoint(oldMP.id) != NULL);
+         }
+
+         // erased only once, even if two threads replace the same MapPoint
+         if (erased)
+            RetireMapPoint(&oldMP);
       }
       else {
          Print("a new KeyFrame was linked to the old MapPoint by another thread");
@@ -391,9 +625,9 @@ namespace ORB_SLAM2_TEAM
       unique_lock<mutex> lock(mMutexMap);
       
       // for each KeyFrame
-      for (auto itKF = mKeyFrames.begin(); itKF != mKeyFrames.end(); itKF++)
+      for (KeyFrame * pKF : *mpKeyFrameSnapshot)
       {
-         KeyFrame & rKF = *itKF->second;
+         KeyFrame & rKF = *pKF;
          set<MapPoint *> mapPoints;
          unique_lock<mutex> lockKF(rKF.mMutexFeatures);
          for (size_t i = 0; i < rKF.mvpMapPoints.size(); i++)
@@ -408,7 +642,7 @@ namespace ORB_SLAM2_TEAM
                   mapPoints.insert(pMP);
                if (pMP->mObservations.count(&rKF) < 1)
                   throw exception("Map::ValidateAllLinks detected a missing link from a MapPoint to a KeyFrame");
-               else if (pMP->mObservations[&rKF] != i)
+               else if (pMP->mObservations.at(&rKF) != i)
                {
                   Print(rKF.IsBad() ? "rKF is bad" : "rKF is good");
                   Print(pMP->IsBad() ? "pMP is bad" : "pMP is good");
@@ -420,9 +654,9 @@ namespace ORB_SLAM2_TEAM
             throw exception("Map::ValidateAllLinks detected a bad KeyFrame with MapPoints");
       }
 
-      for (auto itMP = mMapPoints.begin(); itMP != mMapPoints.end(); ++itMP)
+      for (MapPoint * pMP : *mpMapPointSnapshot)
       {
-         MapPoint & rMP = *itMP->second;
+         MapPoint & rMP = *pMP;
          unique_lock<mutex> lockMP(rMP.mMutexFeatures);
          for (auto itKF = rMP.mObservations.begin(); itKF != rMP.mObservations.end(); itKF++)
          {
@@ -453,6 +687,15 @@ namespace ORB_SLAM2_TEAM
          this->mKeyFrames = map.mKeyFrames;
          this->mnMaxKFid = map.mnMaxKFid;
          this->mnBigChangeIdx = map.mnBigChangeIdx;
+
+         // both snapshots are locked, the source may be republished while it is copied
+         unique_lock<mutex> lock2(mMutexSnapshot, defer_lock);
+         unique_lock<mutex> lock3(map.mMutexSnapshot, defer_lock);
+         std::lock(lock2, lock3);
+         this->mpKeyFrameSnapshot = make_shared<vector<KeyFrame *>>(*map.mpKeyFrameSnapshot);
+         this->mpMapPointSnapshot = make_shared<vector<MapPoint *>>(*map.mpMapPointSnapshot);
+         this->mKeyFrameSnapshotIndex = map.mKeyFrameSnapshotIndex;
+         this->mMapPointSnapshotIndex = map.mMapPointSnapshotIndex;
       }
       return (*this);
    }
@@ -43,12 +43,15 @@ namespace ORB_SLAM2_TEAM
       mViewpointY = settings["Viewer.ViewpointY"];
       mViewpointZ = settings["Viewer.ViewpointZ"];
       mViewpointF = settings["Viewer.ViewpointF"];
+
+      mMapReader = mMap.RegisterReader();
+      mMap.Idle(mMapReader);
    }
 
    void MapDrawer::Reset()
    {
       unique_lock<mutex> mutex(mMutexReferenceMapPoints);
-      mvpReferenceMapPoints.clear();
+      mReferenceMapPointIds.clear();
    }
 
    void MapDrawer::Follow(pangolin::OpenGlRenderState & pRenderState)
@@ -65,18 +68,22 @@ namespace ORB_SLAM2_TEAM
       float currentColor[4];
       glGetFloatv(GL_CURRENT_COLOR, currentColor);
 
-      const vector<MapPoint*> &vpMPs = mMap.GetAllMapPoints();
+      mMap.Quiescent(mMapReader, mMap.GetEpoch());
+      Map::MapPointSnapshot pMPs = mMap.GetMapPointSnapshot();
+      const vector<MapPoint*> &vpMPs = *pMPs;
       if (vpMPs.empty())
       {
+         mMap.Idle(mMapReader);
          Print("end DrawMapPoints 1");
          return;
       }
 
-      set<MapPoint*> spRefMPs;
+      set<id_type> refIds;
       {
          unique_lock<mutex> lock2(mMutexReferenceMapPoints);
-         spRefMPs.insert(mvpReferenceMapPoints.begin(), mvpReferenceMapPoints.end());
+         refIds.insert(mReferenceMapPointIds.begin(), mReferenceMapPointIds.end());
       }
+      vector<MapPoint *> vpRefMPs;
 
       glPointSize(mPointSize);
       glBegin(GL_POINTS);
@@ -84,8 +91,11 @@ namespace ORB_SLAM2_TEAM
 
       for (MapPoint * pMP : vpMPs)
       {
-         if (spRefMPs.count(pMP))
+         if (refIds.count(pMP->id))
+         {
+            vpRefMPs.push_back(pMP);
             continue;
+         }
          if (pMP->IsBad())
             continue;
          cv::Mat pos = pMP->GetWorldPos();
@@ -109,7 +119,7 @@ namespace ORB_SLAM2_TEAM
       glBegin(GL_POINTS);
       glColor3f(1.0, 0.0, 0.0);
 
-      for (MapPoint * pMP : spRefMPs)
+      for (MapPoint * pMP : vpRefMPs)
       {
          if (pMP->IsBad())
             continue;
@@ -127,6 +137,7 @@ namespace ORB_SLAM2_TEAM
 
       glEnd();
       glColor4fv(currentColor);
+      mMap.Idle(mMapReader);
       Print("end DrawMapPoints 2");
    }
 
@@ -140,7 +151,8 @@ namespace ORB_SLAM2_TEAM
       const float h = w * 0.75;
       const float z = w * 0.6;
 
-      const vector<KeyFrame*> vpKFs = mMap.GetAllKeyFrames();
+      Map::KeyFrameSnapshot pKFs = mMap.GetKeyFrameSnapshot();
+      const vector<KeyFrame*> & vpKFs = *pKFs;
 
       if (bDrawKF)
       {
@@ -367,7 +379,9 @@ namespace ORB_SLAM2_TEAM
    {
       //Print("begin SetReferenceMapPoints");
       unique_lock<mutex> lock(mMutexReferenceMapPoints);
-      mvpReferenceMapPoints = vpMPs;
+      mReferenceMapPointIds.clear();
+      for (MapPoint * pMP : vpMPs)
+         mReferenceMapPointIds.push_back(pMP->id);
       //Print("end SetReferenceMapPoints");
    }
 
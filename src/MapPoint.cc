@@ -23,13 +23,45 @@
 #include "MapPoint.h"
 #include "ORBmatcher.h"
 #include "Serializer.h"
+#include "SlabAllocator.h"
 
 #include<mutex>
 
 namespace ORB_SLAM2_TEAM
 {
 
-   mutex MapPoint::mGlobalMutex;
+   // never destroyed, so a MapPoint can be deleted during static destruction
+   static SlabAllocator<MapPoint> & MapPointAllocator()
+   {
+      static SlabAllocator<MapPoint> * pAllocator = new SlabAllocator<MapPoint>();
+      return *pAllocator;
+   }
+
+   void * MapPoint::operator new(size_t size)
+   {
+      // a derived class is larger than a slot
+      if (size != sizeof(MapPoint))
+         return ::operator new(size);
+      return MapPointAllocator().Allocate();
+   }
+
+   void MapPoint::operator delete(void * p, size_t size)
+   {
+      if (size != sizeof(MapPoint))
+         return ::operator delete(p);
+      MapPointAllocator().Deallocate(p);
+   }
+
+   static void StoreVector(atomic<float> * dst, const cv::Mat & src)
+   {
+      for (int i = 0; i < 3; i++)
+         dst[i].store(src.at<float>(i), memory_order_relaxed);
+   }
+
+   static cv::Vec3f LoadVector(const atomic<float> * src)
+   {
+      return cv::Vec3f(src[0].load(memory_order_relaxed), src[1].load(memory_order_relaxed), src[2].load(memory_order_relaxed));
+   }
 
    MapPoint::MapPoint(id_type id)
       : SyncPrint("MapPoint: ")
@@ -51,11 +83,18 @@ namespace ORB_SLAM2_TEAM
       , mpReplaced(static_cast<MapPoint*>(NULL))
       , mfMinDistance(0)
       , mfMaxDistance(0)
+      , mModified(false)
+      , mpMap(NULL)
 
       // public read-only access to private variables
       , id(mnId)
       , firstKFid(mnFirstKFid)
    {
+      for (int i = 0; i < 3; i++)
+      {
+         mWorldPos[i] = 0.0f;
+         mNormalVector[i] = 0.0f;
+      }
    }
 
    MapPoint::MapPoint(id_type id, const cv::Mat & worldPos, KeyFrame *pRefKF) 
@@ -78,8 +117,8 @@ namespace ORB_SLAM2_TEAM
       , mpReplaced(static_cast<MapPoint*>(NULL))
       , mfMinDistance(0)
       , mfMaxDistance(0)
-      , mNormalVector(cv::Mat::zeros(3, 1, CV_32F))
-      , mWorldPos(worldPos)
+      , mModified(false)
+      , mpMap(NULL)
    
       // public read-only access to private variables
       , id(mnId)
@@ -87,28 +126,47 @@ namespace ORB_SLAM2_TEAM
    {
       if (worldPos.empty())
          throw exception("MapPoint::SetWorldPos([])!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!");
+      StoreVector(mWorldPos, worldPos);
+      for (int i = 0; i < 3; i++)
+         mNormalVector[i] = 0.0f;
+   }
+
+   MapPoint::Position MapPoint::GetPosition()
+   {
+      Position p;
+      unsigned int seq;
+      do
+      {
+         seq = mPosSeqLock.ReadBegin();
+         p.worldPos = LoadVector(mWorldPos);
+         p.normal = LoadVector(mNormalVector);
+         p.minDistance = mfMinDistance.load(memory_order_relaxed);
+         p.maxDistance = mfMaxDistance.load(memory_order_relaxed);
+      } while (mPosSeqLock.ReadRetry(seq));
+      return p;
    }
 
    void MapPoint::SetWorldPos(const cv::Mat &Pos)
    {
-      unique_lock<mutex> lock2(mGlobalMutex);
-      unique_lock<mutex> lock(mMutexPos);
       if (Pos.empty())
          throw exception("MapPoint::SetWorldPos([])!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!");
-      Pos.copyTo(mWorldPos);
-      mModified = true;
+      {
+         unique_lock<mutex> lock(mMutexPos);
+         mPosSeqLock.WriteBegin();
+         StoreVector(mWorldPos, Pos);
+         mPosSeqLock.WriteEnd();
+      }
+      SetModified(true);
    }
 
    cv::Mat MapPoint::GetWorldPos()
    {
-      unique_lock<mutex> lock(mMutexPos);
-      return mWorldPos.clone();
+      return cv::Mat(GetPosition().worldPos);
    }
 
    cv::Mat MapPoint::GetNormal()
    {
-      unique_lock<mutex> lock(mMutexPos);
-      return mNormalVector.clone();
+      return cv::Mat(GetPosition().normal);
    }
 
    KeyFrame* MapPoint::GetReferenceKeyFrame()
@@ -117,7 +175,7 @@ namespace ORB_SLAM2_TEAM
       return mpRefKF;
    }
 
-   map<KeyFrame*, size_t> MapPoint::GetObservations()
+   ObservationMap MapPoint::GetObservations()
    {
       unique_lock<mutex> lock(mMutexFeatures);
       return mObservations;
@@ -170,14 +228,14 @@ namespace ORB_SLAM2_TEAM
    {
       unique_lock<mutex> lock(mMutexFeatures);
       mnVisible += n;
-      mModified = true;
+      SetModified(true);
    }
 
    void MapPoint::IncreaseFound(int n)
    {
       unique_lock<mutex> lock(mMutexFeatures);
       mnFound += n;
-      mModified = true;
+      SetModified(true);
    }
 
    float MapPoint::GetFoundRatio()
@@ -191,7 +249,7 @@ namespace ORB_SLAM2_TEAM
       // Retrieve all observed descriptors
       vector<cv::Mat> vDescriptors;
 
-      map<KeyFrame*, size_t> obs;
+      ObservationMap obs;
 
       {
          unique_lock<mutex> lock(mMutexFeatures);
@@ -202,12 +260,12 @@ namespace ORB_SLAM2_TEAM
 
       vDescriptors.reserve(obs.size());
 
-      for (map<KeyFrame*, size_t>::iterator mit = obs.begin(), mend = obs.end(); mit != mend; mit++)
+      for (ObservationMap::const_iterator mit = obs.begin(), mend = obs.end(); mit != mend; mit++)
       {
          KeyFrame* pKF = mit->first;
 
          if (!pKF->IsBad())
-            vDescriptors.push_back(pKF->descriptors.row(mit->second));
+            vDescriptors.push_back(pKF->features.DescriptorRow(mit->second));
       }
 
       if (vDescriptors.empty())
@@ -254,7 +312,7 @@ namespace ORB_SLAM2_TEAM
       {
          unique_lock<mutex> lock(mMutexFeatures);
          mDescriptor = vDescriptors[BestIdx].clone();
-         mModified = true;
+         SetModified(true);
       }
    }
 
@@ -267,8 +325,9 @@ namespace ORB_SLAM2_TEAM
    int MapPoint::GetIndexInKeyFrame(KeyFrame *pKF)
    {
       unique_lock<mutex> lock(mMutexFeatures);
-      if (mObservations.count(pKF))
-         return mObservations[pKF];
+      ObservationMap::const_iterator it = mObservations.find(pKF);
+      if (it != mObservations.end())
+         return it->second;
       else
          return -1;
    }
@@ -281,7 +340,7 @@ namespace ORB_SLAM2_TEAM
 
    void MapPoint::UpdateNormalAndDepth()
    {
-      map<KeyFrame*, size_t> obs;
+      ObservationMap obs;
       KeyFrame* pRefKF;
       cv::Mat Pos;
       {
@@ -291,8 +350,7 @@ namespace ORB_SLAM2_TEAM
             throw exception("MapPoint::UpdateNormalAndDepth mpRefKF is NULL");
          pRefKF = mpRefKF;
          obs = mObservations;
-         unique_lock<mutex> lock2(mMutexPos);
-         Pos = mWorldPos.clone();
+         Pos = GetWorldPos();
       }
 
       if (obs.empty())
@@ -300,7 +358,7 @@ namespace ORB_SLAM2_TEAM
 
       cv::Mat normal = cv::Mat::zeros(3, 1, CV_32F);
       int n = 0;
-      for (map<KeyFrame*, size_t>::iterator mit = obs.begin(), mend = obs.end(); mit != mend; mit++)
+      for (ObservationMap::const_iterator mit = obs.begin(), mend = obs.end(); mit != mend; mit++)
       {
          KeyFrame* pKF = mit->first;
          cv::Mat Owi = pKF->GetCameraCenter();
@@ -311,38 +369,35 @@ namespace ORB_SLAM2_TEAM
 
       cv::Mat PC = Pos - pRefKF->GetCameraCenter();
       const float dist = cv::norm(PC);
-      const int level = pRefKF->keysUn[obs[pRefKF]].octave;
+      const int level = pRefKF->features.Octave(obs.at(pRefKF));
       const float levelScaleFactor = pRefKF->scaleFactors[level];
       const int nLevels = pRefKF->scaleLevels;
 
       {
-         mModified = true;
+         SetModified(true);
+         const float maxDistance = dist * levelScaleFactor;
          unique_lock<mutex> lock3(mMutexPos);
-         mfMaxDistance = dist * levelScaleFactor;
-         mfMinDistance = mfMaxDistance / pRefKF->scaleFactors[nLevels - 1];
-         mNormalVector = normal / n;
+         mPosSeqLock.WriteBegin();
+         mfMaxDistance.store(maxDistance, memory_order_relaxed);
+         mfMinDistance.store(maxDistance / pRefKF->scaleFactors[nLevels - 1], memory_order_relaxed);
+         StoreVector(mNormalVector, normal / n);
+         mPosSeqLock.WriteEnd();
       }
    }
 
    float MapPoint::GetMinDistanceInvariance()
    {
-      unique_lock<mutex> lock(mMutexPos);
-      return 0.8f*mfMinDistance;
+      return 0.8f*mfMinDistance.load(memory_order_relaxed);
    }
 
    float MapPoint::GetMaxDistanceInvariance()
    {
-      unique_lock<mutex> lock(mMutexPos);
-      return 1.2f*mfMaxDistance;
+      return 1.2f*mfMaxDistance.load(memory_order_relaxed);
    }
 
    int MapPoint::PredictScale(const float &currentDist, KeyFrame* pKF)
    {
-      float ratio;
-      {
-         unique_lock<mutex> lock(mMutexPos);
-         ratio = mfMaxDistance / currentDist;
-      }
+      const float ratio = mfMaxDistance.load(memory_order_relaxed) / currentDist;
 
       int nScale = ceil(log(ratio) / pKF->logScaleFactor);
       if (nScale < 0)
@@ -355,11 +410,7 @@ namespace ORB_SLAM2_TEAM
 
    int MapPoint::PredictScale(const float &currentDist, Frame* pF)
    {
-      float ratio;
-      {
-         unique_lock<mutex> lock(mMutexPos);
-         ratio = mfMaxDistance / currentDist;
-      }
+      const float ratio = mfMaxDistance.load(memory_order_relaxed) / currentDist;
 
       int nScale = ceil(log(ratio) / pF->mfLogScaleFactor);
       if (nScale < 0)
@@ -377,7 +428,15 @@ namespace ORB_SLAM2_TEAM
 
    void MapPoint::SetModified(bool b)
    {
-      mModified = b;
+      // only the first modification since the Map last took its changes is recorded
+      if (!b)
+         mModified = false;
+      else if (!mModified.exchange(true))
+      {
+         Map * pMap = mpMap;
+         if (pMap)
+            pMap->AddModified(this);
+      }
    }
 
    void MapPoint::CompleteLink(size_t idx, KeyFrame & rKF) 
@@ -390,7 +449,7 @@ namespace ORB_SLAM2_TEAM
       else
          mnObs++;
 
-      mModified = true;
+      SetModified(true);
    }
 
    void MapPoint::CompleteUnlink(size_t idx, KeyFrame & rKF) 
@@ -410,7 +469,7 @@ namespace ORB_SLAM2_TEAM
       if (mnObs <= 2)
          mbBad = true;
 
-      mModified = true;
+      SetModified(true);
    }
 
    MapPoint * MapPoint::Find(const id_type id, const Map & rMap, std::unordered_map<id_type, MapPoint *> & newMapPoints)
@@ -554,8 +613,8 @@ namespace ORB_SLAM2_TEAM
       unique_lock<mutex> lock2(mMutexFeatures);
 
       size_t size = sizeof(MapPoint::Header);
-      size += Serializer::GetMatBufferSize(mWorldPos);
-      size += Serializer::GetMatBufferSize(mNormalVector);
+      size += Serializer::GetMatBufferSize(cv::Mat(LoadVector(mWorldPos)));
+      size += Serializer::GetMatBufferSize(cv::Mat(LoadVector(mNormalVector)));
       size += Serializer::GetMatBufferSize(mDescriptor);
       size += Serializer::GetVectorBufferSize<Observation>(mObservations.size());
       return size;
@@ -601,13 +660,20 @@ namespace ORB_SLAM2_TEAM
             newMapPoints[pHeader->mpReplacedId] = mpReplaced;
          }
       }
-      mfMinDistance = pHeader->mfMinDistance;
-      mfMaxDistance = pHeader->mfMaxDistance;
 
       // read variable-length data
+      cv::Mat worldPos, normal;
       void * pData = pHeader + 1;
-      pData = Serializer::ReadMatrix(pData, mWorldPos);
-      pData = Serializer::ReadMatrix(pData, mNormalVector);
+      pData = Serializer::ReadMatrix(pData, worldPos);
+      pData = Serializer::ReadMatrix(pData, normal);
+
+      mPosSeqLock.WriteBegin();
+      mfMinDistance.store(pHeader->mfMinDistance, memory_order_relaxed);
+      mfMaxDistance.store(pHeader->mfMaxDistance, memory_order_relaxed);
+      StoreVector(mWorldPos, worldPos);
+      StoreVector(mNormalVector, normal);
+      mPosSeqLock.WriteEnd();
+
       pData = Serializer::ReadMatrix(pData, mDescriptor);
       pData = ReadObservations(pData, rMap, newKeyFrames, mObservations);
       return pData;
@@ -635,8 +701,8 @@ namespace ORB_SLAM2_TEAM
 
       // write variable-length data
       void * pData = pHeader + 1;
-      pData = Serializer::WriteMatrix(pData, mWorldPos);
-      pData = Serializer::WriteMatrix(pData, mNormalVector);
+      pData = Serializer::WriteMatrix(pData, cv::Mat(LoadVector(mWorldPos)));
+      pData = Serializer::WriteMatrix(pData, cv::Mat(LoadVector(mNormalVector)));
       pData = Serializer::WriteMatrix(pData, mDescriptor);
       pData = WriteObservations(pData, mObservations);
       return pData;
@@ -646,7 +712,7 @@ namespace ORB_SLAM2_TEAM
       void * const buffer,
       const Map & rMap,
       std::unordered_map<id_type, KeyFrame *> & newKeyFrames,
-      std::map<KeyFrame *, size_t> & observations)
+      ObservationMap & observations)
    {
       observations.clear();
       size_t * pQuantity = (size_t *)buffer;
@@ -663,18 +729,18 @@ namespace ORB_SLAM2_TEAM
             //pKF = new KeyFrame(pData->keyFrameId);
             //newKeyFrames[pData->keyFrameId] = pKF;
          }
-         observations[pKF] = pData->index;
+         observations.set(pKF, pData->index);
          ++pData;
       }
       return pData;
    }
 
-   void * MapPoint::WriteObservations(void * const buffer, std::map<KeyFrame *, size_t> & observations)
+   void * MapPoint::WriteObservations(void * const buffer, const ObservationMap & observations)
    {
       size_t * pQuantity = (size_t *)buffer;
       *pQuantity = observations.size();
       Observation * pData = (Observation *)(pQuantity + 1);
-      for (std::pair<KeyFrame *, size_t> p : observations)
+      for (const ObservationMap::value_type & p : observations)
       {
          pData->keyFrameId = p.first->id;
          pData->index = p.second;
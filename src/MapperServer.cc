@@ -21,12 +21,19 @@
 #include "MapperServer.h"
 #include "Optimizer.h"
 #include "Sleep.h"
+#include <algorithm>
 #include <exception>
 
 namespace ORB_SLAM2_TEAM
 {
 
-   MapperServer::MapperServer(ORBVocabulary & vocab, const bool bMonocular, const unsigned int maxTrackers) :
+   // the setting is read as a signed int, so a negative value is not taken as a huge thread count
+   static unsigned int ResolveQuantityThreads(const int quantityThreads)
+   {
+      return quantityThreads <= 0 ? max(thread::hardware_concurrency(), 1u) : (unsigned int)quantityThreads;
+   }
+
+   MapperServer::MapperServer(ORBVocabulary & vocab, const bool bMonocular, const unsigned int maxTrackers, const int quantityThreads) :
       SyncPrint("MapperServer: ")
       , mVocab(vocab)
       , mbMonocular(bMonocular)
@@ -43,8 +50,9 @@ namespace ORB_SLAM2_TEAM
       , mPoseTcw(maxTrackers)
       , mInitialized(false)
       , mFinalized(false)
-      , mLocalMapper(mMap, mKeyFrameDB, mVocab, bMonocular, maxTrackers, mKeyFrameIdSpan, mFirstMapPointIdMapper, mMapPointIdSpan)
-      , mLoopCloser(mMap, mKeyFrameDB, mVocab, !bMonocular)
+      , mLocalMapper(mMap, mKeyFrameDB, mVocab, bMonocular, maxTrackers, mKeyFrameIdSpan, mFirstMapPointIdMapper, mMapPointIdSpan,
+         ResolveQuantityThreads(quantityThreads))
+      , mLoopCloser(mMap, mKeyFrameDB, mVocab, !bMonocular, ResolveQuantityThreads(quantityThreads))
       , mLocalMappingObserver(this)
       , mLoopClosingObserver(this)
    {
@@ -60,6 +60,12 @@
 #include <opencv2/imgproc/imgproc.hpp>
 #include <vector>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
 #include "ORBextractor.h"
 
 
@@ -105,22 +111,27 @@ namespace ORB_SLAM2_TEAM
 
 
    const float factorPI = (float)(CV_PI / 180.f);
+
+   // orientations are quantized into bins of 12 degrees, like the reference ORB implementation
+   const int ANGLE_BINS = 30;
+
+   static inline int angleBin(float angle)
+   {
+      int bin = cvRound(angle * (ANGLE_BINS / 360.f));
+      return bin >= ANGLE_BINS ? bin - ANGLE_BINS : bin;
+   }
+
+   // Computes the descriptor with the sampling pattern already rotated to the keypoint's angle bin.
+   // offsets holds the 512 pattern points of that bin as offsets from the center pixel.
    static void computeOrbDescriptor(const KeyPoint& kpt,
-      const Mat& img, const Point* pattern,
+      const Mat& img, const int* offsets,
       uchar* desc)
    {
-      float angle = (float)kpt.angle*factorPI;
-      float a = (float)cos(angle), b = (float)sin(angle);
-
       const uchar* center = &img.at<uchar>(cvRound(kpt.pt.y), cvRound(kpt.pt.x));
-      const int step = (int)img.step;
 
-#define GET_VALUE(idx) \
-        center[cvRound(pattern[idx].x*b + pattern[idx].y*a)*step + \
-               cvRound(pattern[idx].x*a - pattern[idx].y*b)]
+#define GET_VALUE(idx) center[offsets[idx]]
 
-
-      for (int i = 0; i < 32; ++i, pattern += 16)
+      for (int i = 0; i < 32; ++i, offsets += 16)
       {
          int t0, t1, val;
          t0 = GET_VALUE(0); t1 = GET_VALUE(1);
@@ -408,9 +419,9 @@ namespace ORB_SLAM2_TEAM
    };
 
    ORBextractor::ORBextractor(int _nfeatures, float _scaleFactor, int _nlevels,
-      int _iniThFAST, int _minThFAST) :
+      int _iniThFAST, int _minThFAST, int _nThreads) :
       nfeatures(_nfeatures), scaleFactor(_scaleFactor), nlevels(_nlevels),
-      iniThFAST(_iniThFAST), minThFAST(_minThFAST)
+      iniThFAST(_iniThFAST), minThFAST(_minThFAST), mWorkerPool(std::max(_nThreads, 1))
    {
       mvScaleFactor.resize(nlevels);
       mvLevelSigma2.resize(nlevels);
@@ -431,6 +442,9 @@ namespace ORB_SLAM2_TEAM
       }
 
       mvImagePyramid.resize(nlevels);
+      mvFastScore.resize(nlevels);
+      mvPyramidBuffer.resize(nlevels);
+      mvBlurBuffer.resize(nlevels);
 
       mnFeaturesPerLevel.resize(nlevels);
       float factor = 1.0f / scaleFactor;
@@ -449,6 +463,22 @@ namespace ORB_SLAM2_TEAM
       const Point* pattern0 = (const Point*)bit_pattern_31_;
       std::copy(pattern0, pattern0 + npoints, std::back_inserter(pattern));
 
+      // rotate the pattern once for each angle bin, with the same rounding as rotating it per keypoint
+      mvRotatedPattern.resize(ANGLE_BINS * npoints);
+      for (int bin = 0; bin < ANGLE_BINS; bin++)
+      {
+         float angle = (float)(bin * (360 / ANGLE_BINS))*factorPI;
+         float a = (float)cos(angle), b = (float)sin(angle);
+         for (int i = 0; i < npoints; i++)
+         {
+            Point & rotated = mvRotatedPattern[bin * npoints + i];
+            rotated.x = cvRound(pattern[i].x*a - pattern[i].y*b);
+            rotated.y = cvRound(pattern[i].x*b + pattern[i].y*a);
+         }
+      }
+      mvPatternOffsets.resize(nlevels);
+      mvPatternStep.resize(nlevels, 0);
+
       //This is for orientation
       // pre-compute the end of a row in a circular patch
       umax.resize(HALF_PATCH_SIZE + 1);
@@ -762,94 +792,366 @@ namespace ORB_SLAM2_TEAM
       return vResultKeys;
    }
 
-   void ORBextractor::ComputeKeyPointsOctTree(vector<vector<KeyPoint> >& allKeypoints)
+   // offsets of the 16 pixels on the Bresenham circle of radius 3, the first 9 are repeated at the end
+   // so that a contiguous arc can be tested without wrapping
+   static void makeFastOffsets(int pixel[25], int rowStride)
    {
-      allKeypoints.resize(nlevels);
+      static const int offsets[16][2] =
+      {
+         {0,  3}, { 1,  3}, { 2,  2}, { 3,  1}, { 3, 0}, { 3, -1}, { 2, -2}, { 1, -3},
+         {0, -3}, {-1, -3}, {-2, -2}, {-3, -1}, {-3, 0}, {-3,  1}, {-2,  2}, {-1,  3}
+      };
+
+      int k = 0;
+      for (; k < 16; k++)
+         pixel[k] = offsets[k][0] + offsets[k][1] * rowStride;
+      for (; k < 25; k++)
+         pixel[k] = pixel[k - 16];
+   }
 
-      const float W = 30;
+   // same score as cv::FAST, i.e. the largest threshold minus one for which the pixel is still a corner
+   static int fastCornerScore(const uchar* ptr, const int pixel[], int threshold)
+   {
+      const int K = 8, N = 16 + K + 1;
+      int k, v = ptr[0];
+      short d[N];
+      for (k = 0; k < N; k++)
+         d[k] = (short)(v - ptr[pixel[k]]);
+
+      int a0 = threshold;
+      for (k = 0; k < 16; k += 2)
+      {
+         int a = std::min((int)d[k + 1], (int)d[k + 2]);
+         a = std::min(a, (int)d[k + 3]);
+         if (a <= a0)
+            continue;
+         a = std::min(a, (int)d[k + 4]);
+         a = std::min(a, (int)d[k + 5]);
+         a = std::min(a, (int)d[k + 6]);
+         a = std::min(a, (int)d[k + 7]);
+         a = std::min(a, (int)d[k + 8]);
+         a0 = std::max(a0, std::min(a, (int)d[k]));
+         a0 = std::max(a0, std::min(a, (int)d[k + 9]));
+      }
 
-      for (int level = 0; level < nlevels; ++level)
+      int b0 = -a0;
+      for (k = 0; k < 16; k += 2)
       {
-         const int minBorderX = EDGE_THRESHOLD - 3;
-         const int minBorderY = minBorderX;
-         const int maxBorderX = mvImagePyramid[level].cols - EDGE_THRESHOLD + 3;
-         const int maxBorderY = mvImagePyramid[level].rows - EDGE_THRESHOLD + 3;
+         int b = std::max((int)d[k + 1], (int)d[k + 2]);
+         b = std::max(b, (int)d[k + 3]);
+         b = std::max(b, (int)d[k + 4]);
+         b = std::max(b, (int)d[k + 5]);
+         if (b >= b0)
+            continue;
+         b = std::max(b, (int)d[k + 6]);
+         b = std::max(b, (int)d[k + 7]);
+         b = std::max(b, (int)d[k + 8]);
+         b0 = std::min(b0, std::max(b, (int)d[k]));
+         b0 = std::min(b0, std::max(b, (int)d[k + 9]));
+      }
 
-         vector<cv::KeyPoint> vToDistributeKeys;
-         vToDistributeKeys.reserve(nfeatures * 10);
+      return -b0 - 1;
+   }
 
-         const float width = (maxBorderX - minBorderX);
-         const float height = (maxBorderY - minBorderY);
+   // FAST-9 segment test: 9 contiguous circle pixels all brighter or all darker than the center by threshold
+   static bool fastSegmentTest(const uchar* ptr, const int pixel[], int threshold)
+   {
+      const int v = ptr[0];
+      const int vt = v + threshold, v_t = v - threshold;
 
-         const int nCols = width / W;
-         const int nRows = height / W;
-         const int wCell = ceil(width / nCols);
-         const int hCell = ceil(height / nRows);
+      // an arc of 9 always contains pixel 0 or pixel 8
+      const int x0 = ptr[pixel[0]], x8 = ptr[pixel[8]];
+      if (x0 <= vt && x0 >= v_t && x8 <= vt && x8 >= v_t)
+         return false;
 
-         for (int i = 0; i < nRows; i++)
+      int countBright = 0, countDark = 0;
+      for (int k = 0; k < 25; k++)
+      {
+         const int x = ptr[pixel[k]];
+         if (x > vt)
+         {
+            countDark = 0;
+            if (++countBright >= 9)
+               return true;
+         }
+         else if (x < v_t)
          {
-            const float iniY = minBorderY + i * hCell;
-            float maxY = iniY + hCell + 6;
+            countBright = 0;
+            if (++countDark >= 9)
+               return true;
+         }
+         else
+         {
+            countBright = countDark = 0;
+         }
+      }
+      return false;
+   }
+
+   // Computes the FAST score of every pixel in [minX, maxX) x [minY, maxY) in one pass and writes it into score.
+   // Pixels that are not corners for the given threshold get a score of 0. The caller guarantees that the
+   // image has at least 3 valid pixels around the region.
+   static void computeFastScores(const Mat & image, Mat & score, int minX, int minY, int maxX, int maxY, int threshold)
+   {
+      threshold = std::min(std::max(threshold, 0), 255);
+
+      int pixel[25];
+      makeFastOffsets(pixel, (int)image.step);
 
-            if (iniY >= maxBorderY - 3)
+#if defined(__AVX2__)
+      const __m256i delta256 = _mm256_set1_epi8((char)-128), t256 = _mm256_set1_epi8((char)threshold), K256 = _mm256_set1_epi8(8);
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+      const __m128i delta128 = _mm_set1_epi8((char)-128), t128 = _mm_set1_epi8((char)threshold), K128 = _mm_set1_epi8(8);
+#endif
+
+      for (int y = minY; y < maxY; y++)
+      {
+         const uchar* ptr = image.ptr<uchar>(y) + minX;
+         uchar* pScore = score.ptr<uchar>(y) + minX;
+         int x = minX;
+
+#if defined(__AVX2__)
+         for (; x + 32 <= maxX; x += 32, ptr += 32, pScore += 32)
+         {
+            _mm256_storeu_si256((__m256i*)pScore, _mm256_setzero_si256());
+
+            __m256i v0 = _mm256_loadu_si256((const __m256i*)ptr);
+            __m256i v1 = _mm256_xor_si256(_mm256_subs_epu8(v0, t256), delta256);
+            v0 = _mm256_xor_si256(_mm256_adds_epu8(v0, t256), delta256);
+
+            // quick rejection with the 4 compass pixels, two neighbors among them must pass
+            __m256i x0 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(ptr + pixel[0])), delta256);
+            __m256i x1 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(ptr + pixel[4])), delta256);
+            __m256i x2 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(ptr + pixel[8])), delta256);
+            __m256i x3 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(ptr + pixel[12])), delta256);
+            __m256i m0 = _mm256_and_si256(_mm256_cmpgt_epi8(x0, v0), _mm256_cmpgt_epi8(x1, v0));
+            __m256i m1 = _mm256_and_si256(_mm256_cmpgt_epi8(v1, x0), _mm256_cmpgt_epi8(v1, x1));
+            m0 = _mm256_or_si256(m0, _mm256_and_si256(_mm256_cmpgt_epi8(x1, v0), _mm256_cmpgt_epi8(x2, v0)));
+            m1 = _mm256_or_si256(m1, _mm256_and_si256(_mm256_cmpgt_epi8(v1, x1), _mm256_cmpgt_epi8(v1, x2)));
+            m0 = _mm256_or_si256(m0, _mm256_and_si256(_mm256_cmpgt_epi8(x2, v0), _mm256_cmpgt_epi8(x3, v0)));
+            m1 = _mm256_or_si256(m1, _mm256_and_si256(_mm256_cmpgt_epi8(v1, x2), _mm256_cmpgt_epi8(v1, x3)));
+            m0 = _mm256_or_si256(m0, _mm256_and_si256(_mm256_cmpgt_epi8(x3, v0), _mm256_cmpgt_epi8(x0, v0)));
+            m1 = _mm256_or_si256(m1, _mm256_and_si256(_mm256_cmpgt_epi8(v1, x3), _mm256_cmpgt_epi8(v1, x0)));
+            if (_mm256_movemask_epi8(_mm256_or_si256(m0, m1)) == 0)
                continue;
-            if (maxY > maxBorderY)
-               maxY = maxBorderY;
 
-            for (int j = 0; j < nCols; j++)
+            // count the longest run of brighter and darker pixels on the circle
+            __m256i c0 = _mm256_setzero_si256(), c1 = c0, max0 = c0, max1 = c0;
+            for (int k = 0; k < 25; k++)
             {
-               const float iniX = minBorderX + j * wCell;
-               float maxX = iniX + wCell + 6;
-               if (iniX >= maxBorderX - 6)
-                  continue;
-               if (maxX > maxBorderX)
-                  maxX = maxBorderX;
+               __m256i xk = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(ptr + pixel[k])), delta256);
+               m0 = _mm256_cmpgt_epi8(xk, v0);
+               m1 = _mm256_cmpgt_epi8(v1, xk);
+               c0 = _mm256_and_si256(_mm256_sub_epi8(c0, m0), m0);
+               c1 = _mm256_and_si256(_mm256_sub_epi8(c1, m1), m1);
+               max0 = _mm256_max_epu8(max0, c0);
+               max1 = _mm256_max_epu8(max1, c1);
+            }
+            max0 = _mm256_max_epu8(max0, max1);
+            unsigned int m = (unsigned int)_mm256_movemask_epi8(_mm256_cmpgt_epi8(max0, K256));
+            for (int k = 0; m != 0; k++, m >>= 1)
+            {
+               if (m & 1)
+                  pScore[k] = (uchar)fastCornerScore(ptr + k, pixel, threshold);
+            }
+         }
+#endif
 
-               vector<cv::KeyPoint> vKeysCell;
-               FAST(mvImagePyramid[level].rowRange(iniY, maxY).colRange(iniX, maxX),
-                  vKeysCell, iniThFAST, true);
+#if defined(__SSE2__) || defined(_M_X64)
+         for (; x + 16 <= maxX; x += 16, ptr += 16, pScore += 16)
+         {
+            _mm_storeu_si128((__m128i*)pScore, _mm_setzero_si128());
+
+            __m128i v0 = _mm_loadu_si128((const __m128i*)ptr);
+            __m128i v1 = _mm_xor_si128(_mm_subs_epu8(v0, t128), delta128);
+            v0 = _mm_xor_si128(_mm_adds_epu8(v0, t128), delta128);
+
+            __m128i x0 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(ptr + pixel[0])), delta128);
+            __m128i x1 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(ptr + pixel[4])), delta128);
+            __m128i x2 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(ptr + pixel[8])), delta128);
+            __m128i x3 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(ptr + pixel[12])), delta128);
+            __m128i m0 = _mm_and_si128(_mm_cmpgt_epi8(x0, v0), _mm_cmpgt_epi8(x1, v0));
+            __m128i m1 = _mm_and_si128(_mm_cmpgt_epi8(v1, x0), _mm_cmpgt_epi8(v1, x1));
+            m0 = _mm_or_si128(m0, _mm_and_si128(_mm_cmpgt_epi8(x1, v0), _mm_cmpgt_epi8(x2, v0)));
+            m1 = _mm_or_si128(m1, _mm_and_si128(_mm_cmpgt_epi8(v1, x1), _mm_cmpgt_epi8(v1, x2)));
+            m0 = _mm_or_si128(m0, _mm_and_si128(_mm_cmpgt_epi8(x2, v0), _mm_cmpgt_epi8(x3, v0)));
+            m1 = _mm_or_si128(m1, _mm_and_si128(_mm_cmpgt_epi8(v1, x2), _mm_cmpgt_epi8(v1, x3)));
+            m0 = _mm_or_si128(m0, _mm_and_si128(_mm_cmpgt_epi8(x3, v0), _mm_cmpgt_epi8(x0, v0)));
+            m1 = _mm_or_si128(m1, _mm_and_si128(_mm_cmpgt_epi8(v1, x3), _mm_cmpgt_epi8(v1, x0)));
+            if (_mm_movemask_epi8(_mm_or_si128(m0, m1)) == 0)
+               continue;
 
-               if (vKeysCell.empty())
-               {
-                  FAST(mvImagePyramid[level].rowRange(iniY, maxY).colRange(iniX, maxX),
-                     vKeysCell, minThFAST, true);
-               }
+            __m128i c0 = _mm_setzero_si128(), c1 = c0, max0 = c0, max1 = c0;
+            for (int k = 0; k < 25; k++)
+            {
+               __m128i xk = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(ptr + pixel[k])), delta128);
+               m0 = _mm_cmpgt_epi8(xk, v0);
+               m1 = _mm_cmpgt_epi8(v1, xk);
+               c0 = _mm_and_si128(_mm_sub_epi8(c0, m0), m0);
+               c1 = _mm_and_si128(_mm_sub_epi8(c1, m1), m1);
+               max0 = _mm_max_epu8(max0, c0);
+               max1 = _mm_max_epu8(max1, c1);
+            }
+            max0 = _mm_max_epu8(max0, max1);
+            unsigned int m = (unsigned int)_mm_movemask_epi8(_mm_cmpgt_epi8(max0, K128));
+            for (int k = 0; m != 0; k++, m >>= 1)
+            {
+               if (m & 1)
+                  pScore[k] = (uchar)fastCornerScore(ptr + k, pixel, threshold);
+            }
+         }
+#endif
+
+         for (; x < maxX; x++, ptr++, pScore++)
+         {
+            *pScore = fastSegmentTest(ptr, pixel, threshold) ? (uchar)fastCornerScore(ptr, pixel, threshold) : 0;
+         }
+      }
+   }
+
+   // Collects the corners of one cell from a precomputed score map, with the same result as running
+   // cv::FAST with non-maximum suppression on the cell. Corners for a threshold are the pixels with a score
+   // of at least that threshold, and neighbors outside the cell do not take part in the suppression.
+   static void collectFastCell(const Mat & score, int iniX, int iniY, int maxX, int maxY, int threshold,
+      vector<KeyPoint> & vKeysCell)
+   {
+      const int x0 = iniX + 3, x1 = maxX - 3;
+      const int y0 = iniY + 3, y1 = maxY - 3;
+
+      for (int y = y0; y < y1; y++)
+      {
+         const uchar* pRow = score.ptr<uchar>(y);
+         for (int x = x0; x < x1; x++)
+         {
+            const int s = pRow[x];
+            if (s < threshold)
+               continue;
 
-               if (!vKeysCell.empty())
+            bool bMax = true;
+            for (int dy = -1; dy <= 1 && bMax; dy++)
+            {
+               const int ny = y + dy;
+               if (ny < y0 || ny >= y1)
+                  continue;
+               const uchar* pNeighbors = score.ptr<uchar>(ny);
+               for (int dx = -1; dx <= 1; dx++)
                {
-                  for (vector<cv::KeyPoint>::iterator vit = vKeysCell.begin(); vit != vKeysCell.end();vit++)
+                  const int nx = x + dx;
+                  if ((dx == 0 && dy == 0) || nx < x0 || nx >= x1)
+                     continue;
+                  const int n = pNeighbors[nx];
+                  if (n >= threshold && n >= s)
                   {
-                     (*vit).pt.x += j * wCell;
-                     (*vit).pt.y += i * hCell;
-                     vToDistributeKeys.push_back(*vit);
+                     bMax = false;
+                     break;
                   }
                }
-
             }
+
+            if (bMax)
+               vKeysCell.push_back(KeyPoint((float)(x - iniX), (float)(y - iniY), 7.f, -1, (float)s));
          }
+      }
+   }
 
-         vector<KeyPoint> & keypoints = allKeypoints[level];
-         keypoints.reserve(nfeatures);
+   void ORBextractor::ComputeKeyPointsOctTree(vector<vector<KeyPoint> >& allKeypoints)
+   {
+      allKeypoints.resize(nlevels);
 
-         keypoints = DistributeOctTree(vToDistributeKeys, minBorderX, maxBorderX,
-            minBorderY, maxBorderY, mnFeaturesPerLevel[level], level);
+      // levels are independent of each other, so they can be computed in any order
+      mWorkerPool.ParallelFor(nlevels, [this, &allKeypoints](size_t level)
+      {
+         ComputeKeyPointsOctTree((int)level, allKeypoints[level]);
+      });
+   }
 
-         const int scaledPatchSize = PATCH_SIZE * mvScaleFactor[level];
+   void ORBextractor::ComputeKeyPointsOctTree(int level, vector<KeyPoint> & keypoints)
+   {
+      const float W = 30;
+
+      const int minBorderX = EDGE_THRESHOLD - 3;
+      const int minBorderY = minBorderX;
+      const int maxBorderX = mvImagePyramid[level].cols - EDGE_THRESHOLD + 3;
+      const int maxBorderY = mvImagePyramid[level].rows - EDGE_THRESHOLD + 3;
 
-         // Add border to coordinates and scale information
-         const int nkps = keypoints.size();
-         for (int i = 0; i < nkps; i++)
+      // score the whole level once, using the lower threshold so that the fallback needs no second pass
+      Mat & score = mvFastScore[level];
+      score.create(mvImagePyramid[level].size(), CV_8UC1);
+      computeFastScores(mvImagePyramid[level], score, minBorderX + 3, minBorderY + 3,
+         maxBorderX - 3, maxBorderY - 3, std::min(iniThFAST, minThFAST));
+
+      vector<cv::KeyPoint> vToDistributeKeys;
+      vToDistributeKeys.reserve(nfeatures * 10);
+      vector<cv::KeyPoint> vKeysCell;
+
+      const float width = (maxBorderX - minBorderX);
+      const float height = (maxBorderY - minBorderY);
+
+      const int nCols = width / W;
+      const int nRows = height / W;
+      const int wCell = ceil(width / nCols);
+      const int hCell = ceil(height / nRows);
+
+      for (int i = 0; i < nRows; i++)
+      {
+         const float iniY = minBorderY + i * hCell;
+         float maxY = iniY + hCell + 6;
+
+         if (iniY >= maxBorderY - 3)
+            continue;
+         if (maxY > maxBorderY)
+            maxY = maxBorderY;
+
+         for (int j = 0; j < nCols; j++)
          {
-            keypoints[i].pt.x += minBorderX;
-            keypoints[i].pt.y += minBorderY;
-            keypoints[i].octave = level;
-            keypoints[i].size = scaledPatchSize;
+            const float iniX = minBorderX + j * wCell;
+            float maxX = iniX + wCell + 6;
+            if (iniX >= maxBorderX - 6)
+               continue;
+            if (maxX > maxBorderX)
+               maxX = maxBorderX;
+
+            vKeysCell.clear();
+            collectFastCell(score, iniX, iniY, maxX, maxY, iniThFAST, vKeysCell);
+
+            if (vKeysCell.empty())
+            {
+               collectFastCell(score, iniX, iniY, maxX, maxY, minThFAST, vKeysCell);
+            }
+
+            if (!vKeysCell.empty())
+            {
+               for (vector<cv::KeyPoint>::iterator vit = vKeysCell.begin(); vit != vKeysCell.end();vit++)
+               {
+                  (*vit).pt.x += j * wCell;
+                  (*vit).pt.y += i * hCell;
+                  vToDistributeKeys.push_back(*vit);
+               }
+            }
+
          }
       }
 
+      keypoints.reserve(nfeatures);
+
+      keypoints = DistributeOctTree(vToDistributeKeys, minBorderX, maxBorderX,
+         minBorderY, maxBorderY, mnFeaturesPerLevel[level], level);
+
+      const int scaledPatchSize = PATCH_SIZE * mvScaleFactor[level];
+
+      // Add border to coordinates and scale information
+      const int nkps = keypoints.size();
+      for (int i = 0; i < nkps; i++)
+      {
+         keypoints[i].pt.x += minBorderX;
+         keypoints[i].pt.y += minBorderY;
+         keypoints[i].octave = level;
+         keypoints[i].size = scaledPatchSize;
+      }
+
       // compute orientations
-      for (int level = 0; level < nlevels; ++level)
-         computeOrientation(mvImagePyramid[level], allKeypoints[level], umax);
+      computeOrientation(mvImagePyramid[level], keypoints, umax);
    }
 
    void ORBextractor::ComputeKeyPointsOld(std::vector<std::vector<KeyPoint> > &allKeypoints)
@@ -1032,12 +1334,26 @@ namespace ORB_SLAM2_TEAM
    }
 
    static void computeDescriptors(const Mat& image, vector<KeyPoint>& keypoints, Mat& descriptors,
-      const vector<Point>& pattern)
+      const vector<int>& offsets)
    {
       descriptors = Mat::zeros((int)keypoints.size(), 32, CV_8UC1);
 
       for (size_t i = 0; i < keypoints.size(); i++)
-         computeOrbDescriptor(keypoints[i], image, &pattern[0], descriptors.ptr((int)i));
+         computeOrbDescriptor(keypoints[i], image, &offsets[angleBin(keypoints[i].angle) * 512], descriptors.ptr((int)i));
+   }
+
+   const vector<int> & ORBextractor::GetPatternOffsets(int level, int step)
+   {
+      // the rotated pattern only has to be converted to memory offsets when the row step changes
+      vector<int> & offsets = mvPatternOffsets[level];
+      if (mvPatternStep[level] != step)
+      {
+         offsets.resize(mvRotatedPattern.size());
+         for (size_t i = 0; i < mvRotatedPattern.size(); i++)
+            offsets[i] = mvRotatedPattern[i].y * step + mvRotatedPattern[i].x;
+         mvPatternStep[level] = step;
+      }
+      return offsets;
    }
 
    void ORBextractor::Extract(const InputArray & _image, const InputArray & _mask, vector<KeyPoint> & _keypoints,
@@ -1072,24 +1388,26 @@ namespace ORB_SLAM2_TEAM
       _keypoints.clear();
       _keypoints.reserve(nkeypoints);
 
-      int offset = 0;
-      for (int level = 0; level < nlevels; ++level)
+      // each level writes its own block of descriptor rows, so the output does not depend on the order of the levels
+      vector<int> vOffsets(nlevels, 0);
+      for (int level = 1; level < nlevels; ++level)
+         vOffsets[level] = vOffsets[level - 1] + (int)allKeypoints[level - 1].size();
+
+      mWorkerPool.ParallelFor(nlevels, [this, &allKeypoints, &vOffsets, &descriptors](size_t level)
       {
          vector<KeyPoint>& keypoints = allKeypoints[level];
          int nkeypointsLevel = (int)keypoints.size();
 
          if (nkeypointsLevel == 0)
-            continue;
+            return;
 
-         // preprocess the resized image
-         Mat workingMat = mvImagePyramid[level].clone();
-         GaussianBlur(workingMat, workingMat, Size(7, 7), 2, 2, BORDER_REFLECT_101);
+         // preprocess the resized image into a scratch buffer that is reused between frames
+         Mat & workingMat = mvBlurBuffer[level];
+         GaussianBlur(mvImagePyramid[level], workingMat, Size(7, 7), 2, 2, BORDER_REFLECT_101 + BORDER_ISOLATED);
 
          // Compute the descriptors
-         Mat desc = descriptors.rowRange(offset, offset + nkeypointsLevel);
-         computeDescriptors(workingMat, keypoints, desc, pattern);
-
-         offset += nkeypointsLevel;
+         Mat desc = descriptors.rowRange(vOffsets[level], vOffsets[level] + nkeypointsLevel);
+         computeDescriptors(workingMat, keypoints, desc, GetPatternOffsets((int)level, (int)workingMat.step));
 
          // Scale keypoint coordinates
          if (level != 0)
@@ -1099,8 +1417,36 @@ namespace ORB_SLAM2_TEAM
                keypointEnd = keypoints.end(); keypoint != keypointEnd; ++keypoint)
                keypoint->pt *= scale;
          }
-         // And add the keypoints to the output
-         _keypoints.insert(_keypoints.end(), keypoints.begin(), keypoints.end());
+      });
+
+      // And add the keypoints to the output
+      for (int level = 0; level < nlevels; ++level)
+         _keypoints.insert(_keypoints.end(), allKeypoints[level].begin(), allKeypoints[level].end());
+   }
+
+   // Fills the border of a padded image by reflecting its interior (BORDER_REFLECT_101), in place.
+   static void fillBorderReflect101(Mat & padded, int border)
+   {
+      const int width = padded.cols - 2 * border;
+      const int height = padded.rows - 2 * border;
+
+      for (int y = border; y < border + height; y++)
+      {
+         uchar* row = padded.ptr<uchar>(y);
+         uchar* first = row + border;
+         uchar* last = first + width - 1;
+         for (int i = 1; i <= border; i++)
+         {
+            first[-i] = first[i];
+            last[i] = last[-i];
+         }
+      }
+
+      const size_t rowBytes = padded.cols;
+      for (int i = 1; i <= border; i++)
+      {
+         memcpy(padded.ptr<uchar>(border - i), padded.ptr<uchar>(border + i), rowBytes);
+         memcpy(padded.ptr<uchar>(border + height - 1 + i), padded.ptr<uchar>(border + height - 1 - i), rowBytes);
       }
    }
 
@@ -1111,22 +1457,23 @@ namespace ORB_SLAM2_TEAM
          float scale = mvInvScaleFactor[level];
          Size sz(cvRound((float)image.cols*scale), cvRound((float)image.rows*scale));
          Size wholeSize(sz.width + EDGE_THRESHOLD * 2, sz.height + EDGE_THRESHOLD * 2);
-         Mat temp(wholeSize, image.type()), masktemp;
+
+         // the padded buffer is only reallocated when the image size changes
+         Mat & temp = mvPyramidBuffer[level];
+         temp.create(wholeSize, image.type());
          mvImagePyramid[level] = temp(Rect(EDGE_THRESHOLD, EDGE_THRESHOLD, sz.width, sz.height));
 
-         // Compute the resized image
+         // Compute the resized image directly inside the padded buffer
          if (level != 0)
          {
             resize(mvImagePyramid[level - 1], mvImagePyramid[level], sz, 0, 0, INTER_LINEAR);
-
-            copyMakeBorder(mvImagePyramid[level], temp, EDGE_THRESHOLD, EDGE_THRESHOLD, EDGE_THRESHOLD, EDGE_THRESHOLD,
-               BORDER_REFLECT_101 + BORDER_ISOLATED);
          }
          else
          {
-            copyMakeBorder(image, temp, EDGE_THRESHOLD, EDGE_THRESHOLD, EDGE_THRESHOLD, EDGE_THRESHOLD,
-               BORDER_REFLECT_101);
+            image.copyTo(mvImagePyramid[level]);
          }
+
+         fillBorderReflect101(temp, EDGE_THRESHOLD);
       }
 
    }
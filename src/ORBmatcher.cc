@@ -23,12 +23,15 @@
 #include "ORBmatcher.h"
 
 #include<limits.h>
+#include<algorithm>
 
 #include<opencv2/core/core.hpp>
 #include<opencv2/features2d/features2d.hpp>
 
 #include "DBoW2/FeatureVector.h"
 
+#include "HammingDistance.h"
+
 #ifdef LINUX
 #include<stdint-gcc.h>
 #endif
@@ -57,87 +60,164 @@ namespace ORB_SLAM2_TEAM
       Print("begin SearchByProjection");
       int nmatches = 0;
 
-      const bool bFactor = th != 1.0;
+      // reused for each MapPoint
+      vector<size_t> vCandidates;
+      vector<int> vDistances;
 
       for (size_t iMP = 0; iMP < vpMapPoints.size(); iMP++)
       {
          MapPoint* pMP = vpMapPoints[iMP];
-         if (!pMP->mbTrackInView)
-            continue;
 
-         if (pMP->IsBad())
-            continue;
+         vCandidates.clear();
+         vDistances.clear();
+         LocalMapCandidates(F, pMP, th, vCandidates, vDistances);
 
-         const int &nPredictedLevel = pMP->mnTrackScaleLevel;
+         if (ClaimLocalMapMatch(F, pMP, vCandidates.data(), vDistances.data(), vCandidates.size()))
+            nmatches++;
+      }
 
-         // The size of the window will depend on the viewing direction
-         float r = RadiusByViewingCos(pMP->mTrackViewCos);
+      Print("end SearchByProjection");
+      return nmatches;
+   }
 
-         if (bFactor)
-            r *= th;
+   int ORBmatcher::SearchByProjection(Frame &F, const vector<MapPoint*> &vpMapPoints, WorkerPool &pool, const float th)
+   {
+      const size_t nMPs = vpMapPoints.size();
 
-         const vector<size_t> vIndices =
-            F.GetFeaturesInArea(pMP->mTrackProjX, pMP->mTrackProjY, r*F.mvScaleFactors[nPredictedLevel], nPredictedLevel - 1, nPredictedLevel);
+      // a few chunks per thread to balance the load, each chunk is a contiguous range of MapPoints
+      const size_t nChunks = min(nMPs, (size_t)pool.QuantityThreads() * 4);
+      if (nChunks < 2)
+         return SearchByProjection(F, vpMapPoints, th);
 
-         if (vIndices.empty())
-            continue;
+      Print("begin SearchByProjection parallel");
 
-         const cv::Mat MPdescriptor = pMP->GetDescriptor();
+      vector<vector<size_t> > vChunkCandidates(nChunks);
+      vector<vector<int> > vChunkDistances(nChunks);
 
-         int bestDist = 256;
-         int bestLevel = -1;
-         int bestDist2 = 256;
-         int bestLevel2 = -1;
-         int bestIdx = -1;
+      // end of the candidates of each MapPoint, within the buffers of its chunk
+      vector<size_t> vEnd(nMPs);
 
-         // Get best and second matches with near keypoints
-         for (vector<size_t>::const_iterator vit = vIndices.begin(), vend = vIndices.end(); vit != vend; vit++)
+      pool.ParallelFor(nChunks, [&](size_t iChunk)
+      {
+         vector<size_t> & vCandidates = vChunkCandidates[iChunk];
+         vector<int> & vDistances = vChunkDistances[iChunk];
+         for (size_t iMP = iChunk * nMPs / nChunks, iend = (iChunk + 1) * nMPs / nChunks; iMP < iend; iMP++)
          {
-            const size_t idx = *vit;
+            LocalMapCandidates(F, vpMapPoints[iMP], th, vCandidates, vDistances);
+            vEnd[iMP] = vCandidates.size();
+         }
+      });
 
-            if (F.mvpMapPoints[idx])
-               if (F.mvpMapPoints[idx]->Observations() > 0)
-                  continue;
+      // Claim the keypoints in the same order as the serial search, so a keypoint
+      // wanted by several MapPoints goes to the same one
+      int nmatches = 0;
+      for (size_t iChunk = 0; iChunk < nChunks; iChunk++)
+      {
+         const vector<size_t> & vCandidates = vChunkCandidates[iChunk];
+         const vector<int> & vDistances = vChunkDistances[iChunk];
+         size_t begin = 0;
+         for (size_t iMP = iChunk * nMPs / nChunks, iend = (iChunk + 1) * nMPs / nChunks; iMP < iend; iMP++)
+         {
+            const size_t n = vEnd[iMP] - begin;
+            if (n > 0 && ClaimLocalMapMatch(F, vpMapPoints[iMP], &vCandidates[begin], &vDistances[begin], n))
+               nmatches++;
+            begin = vEnd[iMP];
+         }
+      }
 
-            if (F.mvuRight[idx] > 0)
-            {
-               const float er = fabs(pMP->mTrackProjXR - F.mvuRight[idx]);
-               if (er > r*F.mvScaleFactors[nPredictedLevel])
-                  continue;
-            }
+      Print("end SearchByProjection parallel");
+      return nmatches;
+   }
 
-            const cv::Mat &d = F.mDescriptors.row(idx);
+   void ORBmatcher::LocalMapCandidates(const Frame &F, MapPoint * pMP, const float th, vector<size_t> &vCandidates, vector<int> &vDistances)
+   {
+      if (!pMP->mbTrackInView)
+         return;
 
-            const int dist = DescriptorDistance(MPdescriptor, d);
+      if (pMP->IsBad())
+         return;
 
-            if (dist < bestDist)
-            {
-               bestDist2 = bestDist;
-               bestDist = dist;
-               bestLevel2 = bestLevel;
-               bestLevel = F.mvKeysUn[idx].octave;
-               bestIdx = idx;
-            }
-            else if (dist < bestDist2)
-            {
-               bestLevel2 = F.mvKeysUn[idx].octave;
-               bestDist2 = dist;
-            }
-         }
+      const int &nPredictedLevel = pMP->mnTrackScaleLevel;
 
-         // Apply ratio to second match (only if best and second are in the same scale level)
-         if (bestDist <= TH_HIGH)
+      // The size of the window will depend on the viewing direction
+      float r = RadiusByViewingCos(pMP->mTrackViewCos);
+
+      if (th != 1.0)
+         r *= th;
+
+      const float radius = r*F.mvScaleFactors[nPredictedLevel];
+      const float projXR = pMP->mTrackProjXR;
+
+      // the grid visits the keypoints in place, so no temporary index vector is built
+      const size_t begin = vCandidates.size();
+      F.mGrid.ForEachInArea(F.mFeatures, pMP->mTrackProjX, pMP->mTrackProjY, radius, nPredictedLevel - 1, nPredictedLevel,
+         [&](size_t idx)
+      {
+         if (F.mvuRight[idx] > 0)
          {
-            if (bestLevel == bestLevel2 && bestDist > mfNNratio*bestDist2)
+            const float er = fabs(projXR - F.mvuRight[idx]);
+            if (er > radius)
+               return;
+         }
+
+         vCandidates.push_back(idx);
+      });
+
+      const size_t n = vCandidates.size() - begin;
+      if (n == 0)
+         return;
+
+      const cv::Mat MPdescriptor = pMP->GetDescriptor();
+
+      vDistances.resize(vCandidates.size());
+      HammingDistance::Compute(MPdescriptor.ptr(), F.mFeatures, &vCandidates[begin], n, &vDistances[begin]);
+   }
+
+   bool ORBmatcher::ClaimLocalMapMatch(Frame &F, MapPoint * pMP, const size_t * pCandidates, const int * pDistances, size_t n)
+   {
+      int bestDist = 256;
+      int bestLevel = -1;
+      int bestDist2 = 256;
+      int bestLevel2 = -1;
+      int bestIdx = -1;
+
+      // Get best and second matches with near keypoints
+      for (size_t i = 0; i < n; i++)
+      {
+         const size_t idx = pCandidates[i];
+
+         if (F.mvpMapPoints[idx])
+            if (F.mvpMapPoints[idx]->Observations() > 0)
                continue;
 
-            F.mvpMapPoints[bestIdx] = pMP;
-            nmatches++;
+         const int dist = pDistances[i];
+
+         if (dist < bestDist)
+         {
+            bestDist2 = bestDist;
+            bestDist = dist;
+            bestLevel2 = bestLevel;
+            bestLevel = F.mFeatures.Octave(idx);
+            bestIdx = idx;
+         }
+         else if (dist < bestDist2)
+         {
+            bestLevel2 = F.mFeatures.Octave(idx);
+            bestDist2 = dist;
          }
       }
 
-      Print("end SearchByProjection");
-      return nmatches;
+      // Apply ratio to second match (only if best and second are in the same scale level)
+      if (bestDist <= TH_HIGH)
+      {
+         if (bestLevel == bestLevel2 && bestDist > mfNNratio*bestDist2)
+            return false;
+
+         F.mvpMapPoints[bestIdx] = pMP;
+         return true;
+      }
+
+      return false;
    }
 
    float ORBmatcher::RadiusByViewingCos(const float &viewCos)
@@ -149,14 +229,14 @@ namespace ORB_SLAM2_TEAM
    }
 
 
-   bool ORBmatcher::CheckDistEpipolarLine(const cv::KeyPoint &kp1, const cv::KeyPoint &kp2, const cv::Mat &F12, const KeyFrame* pKF2)
+   bool ORBmatcher::CheckDistEpipolarLine(const float x1, const float y1, const float x2, const float y2, const int octave2, const cv::Mat &F12, const KeyFrame* pKF2)
    {
       // Epipolar line in second image l = x1'F12 = [a b c]
-      const float a = kp1.pt.x*F12.at<float>(0, 0) + kp1.pt.y*F12.at<float>(1, 0) + F12.at<float>(2, 0);
-      const float b = kp1.pt.x*F12.at<float>(0, 1) + kp1.pt.y*F12.at<float>(1, 1) + F12.at<float>(2, 1);
-      const float c = kp1.pt.x*F12.at<float>(0, 2) + kp1.pt.y*F12.at<float>(1, 2) + F12.at<float>(2, 2);
+      const float a = x1*F12.at<float>(0, 0) + y1*F12.at<float>(1, 0) + F12.at<float>(2, 0);
+      const float b = x1*F12.at<float>(0, 1) + y1*F12.at<float>(1, 1) + F12.at<float>(2, 1);
+      const float c = x1*F12.at<float>(0, 2) + y1*F12.at<float>(1, 2) + F12.at<float>(2, 2);
 
-      const float num = a * kp2.pt.x + b * kp2.pt.y + c;
+      const float num = a * x2 + b * y2 + c;
 
       const float den = a * a + b * b;
 
@@ -165,7 +245,7 @@ namespace ORB_SLAM2_TEAM
 
       const float dsqr = num * num / den;
 
-      return dsqr < 3.84*pKF2->levelSigma2[kp2.octave];
+      return dsqr < 3.84*pKF2->levelSigma2[octave2];
    }
 
    int ORBmatcher::SearchByBoW(KeyFrame* pKF, Frame &F, vector<MapPoint*> &vpMapPointMatches)
@@ -184,6 +264,8 @@ namespace ORB_SLAM2_TEAM
          rotHist[i].reserve(500);
       const float factor = 1.0f / HISTO_LENGTH;
 
+      vector<size_t> vCandidates;
+
       // We perform the matching over ORB that belong to the same vocabulary node (at a certain level)
       DBoW2::FeatureVector::const_iterator KFit = vFeatVecKF.begin();
       DBoW2::FeatureVector::const_iterator Fit = F.mFeatVec.begin();
@@ -197,6 +279,14 @@ namespace ORB_SLAM2_TEAM
             const vector<unsigned int> vIndicesKF = KFit->second;
             const vector<unsigned int> vIndicesF = Fit->second;
 
+            // the Frame keypoints of this node that are not matched yet
+            vCandidates.clear();
+            for (size_t iF = 0; iF < vIndicesF.size(); iF++)
+            {
+               if (!vpMapPointMatches[vIndicesF[iF]])
+                  vCandidates.push_back(vIndicesF[iF]);
+            }
+
             for (size_t iKF = 0; iKF < vIndicesKF.size(); iKF++)
             {
                const unsigned int realIdxKF = vIndicesKF[iKF];
@@ -209,46 +299,22 @@ namespace ORB_SLAM2_TEAM
                if (pMP->IsBad())
                   continue;
 
-               const cv::Mat &dKF = pKF->descriptors.row(realIdxKF);
-
-               int bestDist1 = 256;
-               int bestIdxF = -1;
-               int bestDist2 = 256;
-
-               for (size_t iF = 0; iF < vIndicesF.size(); iF++)
-               {
-                  const unsigned int realIdxF = vIndicesF[iF];
-
-                  if (vpMapPointMatches[realIdxF])
-                     continue;
-
-                  const cv::Mat &dF = F.mDescriptors.row(realIdxF);
-
-                  const int dist = DescriptorDistance(dKF, dF);
-
-                  if (dist < bestDist1)
-                  {
-                     bestDist2 = bestDist1;
-                     bestDist1 = dist;
-                     bestIdxF = realIdxF;
-                  }
-                  else if (dist < bestDist2)
-                  {
-                     bestDist2 = dist;
-                  }
-               }
+               const HammingDistance::Result best =
+                  HammingDistance::FindBest(pKF->features.Descriptor(realIdxKF), F.mFeatures, vCandidates.data(), vCandidates.size());
+               const int bestDist1 = best.bestDist;
+               const int bestIdxF = best.bestIdx;
+               const int bestDist2 = best.secondDist;
 
                if (bestDist1 <= TH_LOW)
                {
                   if (static_cast<float>(bestDist1) < mfNNratio*static_cast<float>(bestDist2))
                   {
                      vpMapPointMatches[bestIdxF] = pMP;
-
-                     const cv::KeyPoint &kp = pKF->keysUn[realIdxKF];
+                     vCandidates.erase(find(vCandidates.begin(), vCandidates.end(), (size_t)bestIdxF));
 
                      if (mbCheckOrientation)
                      {
-                        float rot = kp.angle - F.mvKeys[bestIdxF].angle;
+                        float rot = pKF->features.Angle(realIdxKF) - F.mFeatures.Angle(bestIdxF);
                         if (rot < 0.0)
                            rot += 360.0f;
                         int bin = round(rot*factor);
@@ -317,12 +383,19 @@ namespace ORB_SLAM2_TEAM
       cv::Mat tcw = Scw.rowRange(0, 3).col(3) / scw;
       cv::Mat Ow = -Rcw.t()*tcw;
 
+      // fixed-size copies, so projecting a MapPoint does not allocate
+      const cv::Matx33f Rcwf = Rcw;
+      const cv::Vec3f tcwf = tcw;
+      const cv::Vec3f Owf = Ow;
+
       // Set of MapPoints already found in the KeyFrame
       set<MapPoint*> spAlreadyFound(vpMatched.begin(), vpMatched.end());
       spAlreadyFound.erase(static_cast<MapPoint*>(NULL));
 
       int nmatches = 0;
 
+      vector<size_t> vIndices, vCandidates;
+
       // For each Candidate MapPoint Project and Match
       for (int iMP = 0, iendMP = vpPoints.size(); iMP < iendMP; iMP++)
       {
@@ -333,19 +406,20 @@ namespace ORB_SLAM2_TEAM
             continue;
 
          // Get 3D Coords.
-         cv::Mat p3Dw = pMP->GetWorldPos();
+         const MapPoint::Position pos = pMP->GetPosition();
+         const cv::Vec3f & p3Dw = pos.worldPos;
 
          // Transform into Camera Coords.
-         cv::Mat p3Dc = Rcw * p3Dw + tcw;
+         const cv::Vec3f p3Dc = Rcwf * p3Dw + tcwf;
 
          // Depth must be positive
-         if (p3Dc.at<float>(2) < 0.0)
+         if (p3Dc[2] < 0.0)
             continue;
 
          // Project into Image
-         const float invz = 1 / p3Dc.at<float>(2);
-         const float x = p3Dc.at<float>(0)*invz;
-         const float y = p3Dc.at<float>(1)*invz;
+         const float invz = 1 / p3Dc[2];
+         const float x = p3Dc[0]*invz;
+         const float y = p3Dc[1]*invz;
 
          const float u = fx * x + cx;
          const float v = fy * y + cy;
@@ -357,16 +431,14 @@ namespace ORB_SLAM2_TEAM
          // Depth must be inside the scale invariance region of the point
          const float maxDistance = pMP->GetMaxDistanceInvariance();
          const float minDistance = pMP->GetMinDistanceInvariance();
-         cv::Mat PO = p3Dw - Ow;
+         const cv::Vec3f PO = p3Dw - Owf;
          const float dist = cv::norm(PO);
 
          if (dist<minDistance || dist>maxDistance)
             continue;
 
          // Viewing angle must be less than 60 deg
-         cv::Mat Pn = pMP->GetNormal();
-
-         if (PO.dot(Pn) < 0.5*dist)
+         if (PO.dot(pos.normal) < 0.5*dist)
             continue;
 
          int nPredictedLevel = pMP->PredictScale(dist, pKF);
@@ -374,7 +446,7 @@ namespace ORB_SLAM2_TEAM
          // Search in a radius
          const float radius = th * pKF->scaleFactors[nPredictedLevel];
 
-         const vector<size_t> vIndices = pKF->GetFeaturesInArea(u, v, radius);
+         pKF->GetFeaturesInArea(u, v, radius, vIndices);
 
          if (vIndices.empty())
             continue;
@@ -382,30 +454,25 @@ namespace ORB_SLAM2_TEAM
          // Match to the most similar keypoint in the radius
          const cv::Mat dMP = pMP->GetDescriptor();
 
-         int bestDist = 256;
-         int bestIdx = -1;
+         vCandidates.clear();
          for (vector<size_t>::const_iterator vit = vIndices.begin(), vend = vIndices.end(); vit != vend; vit++)
          {
             const size_t idx = *vit;
             if (vpMatched[idx])
                continue;
 
-            const int &kpLevel = pKF->keysUn[idx].octave;
+            const int kpLevel = pKF->features.Octave(idx);
 
             if (kpLevel<nPredictedLevel - 1 || kpLevel>nPredictedLevel)
                continue;
 
-            const cv::Mat &dKF = pKF->descriptors.row(idx);
-
-            const int dist = DescriptorDistance(dMP, dKF);
-
-            if (dist < bestDist)
-            {
-               bestDist = dist;
-               bestIdx = idx;
-            }
+            vCandidates.push_back(idx);
          }
 
+         const HammingDistance::Result best = HammingDistance::FindBest(dMP.ptr(), pKF->features, vCandidates.data(), vCandidates.size());
+         const int bestDist = best.bestDist;
+         const int bestIdx = best.bestIdx;
+
          if (bestDist <= TH_LOW)
          {
             vpMatched[bestIdx] = pMP;
@@ -422,41 +489,42 @@ namespace ORB_SLAM2_TEAM
    {
       Print("begin SearchForInitialization");
       int nmatches = 0;
-      vnMatches12 = vector<int>(F1.mvKeysUn.size(), -1);
+      vnMatches12 = vector<int>(F1.mFeatures.Size(), -1);
 
       vector<int> rotHist[HISTO_LENGTH];
       for (int i = 0;i < HISTO_LENGTH;i++)
          rotHist[i].reserve(500);
       const float factor = 1.0f / HISTO_LENGTH;
 
-      vector<int> vMatchedDistance(F2.mvKeysUn.size(), INT_MAX);
-      vector<int> vnMatches21(F2.mvKeysUn.size(), -1);
+      vector<int> vMatchedDistance(F2.mFeatures.Size(), INT_MAX);
+      vector<int> vnMatches21(F2.mFeatures.Size(), -1);
 
-      for (size_t i1 = 0, iend1 = F1.mvKeysUn.size(); i1 < iend1; i1++)
+      vector<size_t> vIndices2;
+      vector<int> vDistances;
+
+      for (size_t i1 = 0, iend1 = F1.mFeatures.Size(); i1 < iend1; i1++)
       {
-         cv::KeyPoint kp1 = F1.mvKeysUn[i1];
-         int level1 = kp1.octave;
+         int level1 = F1.mFeatures.Octave(i1);
          if (level1 > 0)
             continue;
 
-         vector<size_t> vIndices2 = F2.GetFeaturesInArea(vbPrevMatched[i1].x, vbPrevMatched[i1].y, windowSize, level1, level1);
+         F2.GetFeaturesInArea(vbPrevMatched[i1].x, vbPrevMatched[i1].y, windowSize, level1, level1, vIndices2);
 
          if (vIndices2.empty())
             continue;
 
-         cv::Mat d1 = F1.mDescriptors.row(i1);
+         vDistances.resize(vIndices2.size());
+         HammingDistance::Compute(F1.mFeatures.Descriptor(i1), F2.mFeatures, vIndices2.data(), vIndices2.size(), vDistances.data());
 
          int bestDist = INT_MAX;
          int bestDist2 = INT_MAX;
          int bestIdx2 = -1;
 
-         for (vector<size_t>::iterator vit = vIndices2.begin(); vit != vIndices2.end(); vit++)
+         for (size_t iv = 0; iv < vIndices2.size(); iv++)
          {
-            size_t i2 = *vit;
-
-            cv::Mat d2 = F2.mDescriptors.row(i2);
+            size_t i2 = vIndices2[iv];
 
-            int dist = DescriptorDistance(d1, d2);
+            int dist = vDistances[iv];
 
             if (vMatchedDistance[i2] <= dist)
                continue;
@@ -489,7 +557,7 @@ namespace ORB_SLAM2_TEAM
 
                if (mbCheckOrientation)
                {
-                  float rot = F1.mvKeysUn[i1].angle - F2.mvKeysUn[bestIdx2].angle;
+                  float rot = F1.mFeatures.Angle(i1) - F2.mFeatures.Angle(bestIdx2);
                   if (rot < 0.0)
                      rot += 360.0f;
                   int bin = round(rot*factor);
@@ -531,7 +599,7 @@ namespace ORB_SLAM2_TEAM
       //Update prev matched
       for (size_t i1 = 0, iend1 = vnMatches12.size(); i1 < iend1; i1++)
          if (vnMatches12[i1] >= 0)
-            vbPrevMatched[i1] = F2.mvKeysUn[vnMatches12[i1]].pt;
+            vbPrevMatched[i1] = cv::Point2f(F2.mFeatures.X(vnMatches12[i1]), F2.mFeatures.Y(vnMatches12[i1]));
 
       Print("end SearchForInitialization");
       return nmatches;
@@ -540,19 +608,19 @@ namespace ORB_SLAM2_TEAM
    int ORBmatcher::SearchByBoW(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint *> &vpMatches12)
    {
       Print("begin SearchByBoW");
-      const vector<cv::KeyPoint> &vKeysUn1 = pKF1->keysUn;
+      const FeatureStore &features1 = pKF1->features;
       const DBoW2::FeatureVector &vFeatVec1 = pKF1->mFeatVec;
       const vector<MapPoint*> vpMapPoints1 = pKF1->GetMapPointMatches();
-      const cv::Mat &Descriptors1 = pKF1->descriptors;
 
-      const vector<cv::KeyPoint> &vKeysUn2 = pKF2->keysUn;
+      const FeatureStore &features2 = pKF2->features;
       const DBoW2::FeatureVector &vFeatVec2 = pKF2->mFeatVec;
       const vector<MapPoint*> vpMapPoints2 = pKF2->GetMapPointMatches();
-      const cv::Mat &Descriptors2 = pKF2->descriptors;
 
       vpMatches12 = vector<MapPoint*>(vpMapPoints1.size(), static_cast<MapPoint*>(NULL));
       vector<bool> vbMatched2(vpMapPoints2.size(), false);
 
+      vector<size_t> vCandidates;
+
       vector<int> rotHist[HISTO_LENGTH];
       for (int i = 0;i < HISTO_LENGTH;i++)
          rotHist[i].reserve(500);
@@ -570,6 +638,23 @@ namespace ORB_SLAM2_TEAM
       {
          if (f1it->first == f2it->first)
          {
+            // the keypoints of KF2 in this node with a good MapPoint that is not matched yet
+            vCandidates.clear();
+            for (size_t i2 = 0, iend2 = f2it->second.size(); i2 < iend2; i2++)
+            {
+               const size_t idx2 = f2it->second[i2];
+
+               MapPoint* pMP2 = vpMapPoints2[idx2];
+
+               if (vbMatched2[idx2] || !pMP2)
+                  continue;
+
+               if (pMP2->IsBad())
+                  continue;
+
+               vCandidates.push_back(idx2);
+            }
+
             for (size_t i1 = 0, iend1 = f1it->second.size(); i1 < iend1; i1++)
             {
                const size_t idx1 = f1it->second[i1];
@@ -580,39 +665,11 @@ namespace ORB_SLAM2_TEAM
                if (pMP1->IsBad())
                   continue;
 
-               const cv::Mat &d1 = Descriptors1.row(idx1);
-
-               int bestDist1 = 256;
-               int bestIdx2 = -1;
-               int bestDist2 = 256;
-
-               for (size_t i2 = 0, iend2 = f2it->second.size(); i2 < iend2; i2++)
-               {
-                  const size_t idx2 = f2it->second[i2];
-
-                  MapPoint* pMP2 = vpMapPoints2[idx2];
-
-                  if (vbMatched2[idx2] || !pMP2)
-                     continue;
-
-                  if (pMP2->IsBad())
-                     continue;
-
-                  const cv::Mat &d2 = Descriptors2.row(idx2);
-
-                  int dist = DescriptorDistance(d1, d2);
-
-                  if (dist < bestDist1)
-                  {
-                     bestDist2 = bestDist1;
-                     bestDist1 = dist;
-                     bestIdx2 = idx2;
-                  }
-                  else if (dist < bestDist2)
-                  {
-                     bestDist2 = dist;
-                  }
-               }
+               const HammingDistance::Result best =
+                  HammingDistance::FindBest(features1.Descriptor(idx1), features2, vCandidates.data(), vCandidates.size());
+               const int bestDist1 = best.bestDist;
+               const int bestIdx2 = best.bestIdx;
+               const int bestDist2 = best.secondDist;
 
                if (bestDist1 < TH_LOW)
                {
@@ -620,10 +677,11 @@ namespace ORB_SLAM2_TEAM
                   {
                      vpMatches12[idx1] = vpMapPoints2[bestIdx2];
                      vbMatched2[bestIdx2] = true;
+                     vCandidates.erase(find(vCandidates.begin(), vCandidates.end(), (size_t)bestIdx2));
 
                      if (mbCheckOrientation)
                      {
-                        float rot = vKeysUn1[idx1].angle - vKeysUn2[bestIdx2].angle;
+                        float rot = features1.Angle(idx1) - features2.Angle(bestIdx2);
                         if (rot < 0.0)
                            rot += 360.0f;
                         int bin = round(rot*factor);
@@ -698,6 +756,9 @@ namespace ORB_SLAM2_TEAM
       vector<bool> vbMatched2(pKF2->N, false);
       vector<int> vMatches12(pKF1->N, -1);
 
+      vector<size_t> vCandidates;
+      vector<int> vDistances;
+
       vector<int> rotHist[HISTO_LENGTH];
       for (int i = 0;i < HISTO_LENGTH;i++)
          rotHist[i].reserve(500);
@@ -713,6 +774,26 @@ namespace ORB_SLAM2_TEAM
       {
          if (f1it->first == f2it->first)
          {
+            // the keypoints of KF2 in this node without a MapPoint
+            vCandidates.clear();
+            for (size_t i2 = 0, iend2 = f2it->second.size(); i2 < iend2; i2++)
+            {
+               size_t idx2 = f2it->second[i2];
+
+               MapPoint* pMP2 = pKF2->GetMapPoint(idx2);
+
+               // If we have already matched or there is a MapPoint skip
+               if (vbMatched2[idx2] || pMP2)
+                  continue;
+
+               if (bOnlyStereo)
+                  if (pKF2->right[idx2] < 0)
+                     continue;
+
+               vCandidates.push_back(idx2);
+            }
+            vDistances.resize(vCandidates.size());
+
             for (size_t i1 = 0, iend1 = f1it->second.size(); i1 < iend1; i1++)
             {
                const size_t idx1 = f1it->second[i1];
@@ -729,47 +810,38 @@ namespace ORB_SLAM2_TEAM
                   if (!bStereo1)
                      continue;
 
-               const cv::KeyPoint &kp1 = pKF1->keysUn[idx1];
+               const float kp1x = pKF1->features.X(idx1);
+               const float kp1y = pKF1->features.Y(idx1);
 
-               const cv::Mat &d1 = pKF1->descriptors.row(idx1);
+               HammingDistance::Compute(pKF1->features.Descriptor(idx1), pKF2->features, vCandidates.data(), vCandidates.size(), vDistances.data());
 
                int bestDist = TH_LOW;
                int bestIdx2 = -1;
 
-               for (size_t i2 = 0, iend2 = f2it->second.size(); i2 < iend2; i2++)
+               for (size_t i2 = 0; i2 < vCandidates.size(); i2++)
                {
-                  size_t idx2 = f2it->second[i2];
-
-                  MapPoint* pMP2 = pKF2->GetMapPoint(idx2);
-
-                  // If we have already matched or there is a MapPoint skip
-                  if (vbMatched2[idx2] || pMP2)
-                     continue;
+                  const size_t idx2 = vCandidates[i2];
 
                   const bool bStereo2 = pKF2->right[idx2] >= 0;
 
-                  if (bOnlyStereo)
-                     if (!bStereo2)
-                        continue;
-
-                  const cv::Mat &d2 = pKF2->descriptors.row(idx2);
-
-                  const int dist = DescriptorDistance(d1, d2);
+                  const int dist = vDistances[i2];
 
                   if (dist > TH_LOW || dist > bestDist)
                      continue;
 
-                  const cv::KeyPoint &kp2 = pKF2->keysUn[idx2];
+                  const float kp2x = pKF2->features.X(idx2);
+                  const float kp2y = pKF2->features.Y(idx2);
+                  const int kp2octave = pKF2->features.Octave(idx2);
 
                   if (!bStereo1 && !bStereo2)
                   {
-                     const float distex = ex - kp2.pt.x;
-                     const float distey = ey - kp2.pt.y;
-                     if (distex*distex + distey * distey < 100 * pKF2->scaleFactors[kp2.octave])
+                     const float distex = ex - kp2x;
+                     const float distey = ey - kp2y;
+                     if (distex*distex + distey * distey < 100 * pKF2->scaleFactors[kp2octave])
                         continue;
                   }
 
-                  if (CheckDistEpipolarLine(kp1, kp2, F12, pKF2))
+                  if (CheckDistEpipolarLine(kp1x, kp1y, kp2x, kp2y, kp2octave, F12, pKF2))
                   {
                      bestIdx2 = idx2;
                      bestDist = dist;
@@ -778,13 +850,12 @@ namespace ORB_SLAM2_TEAM
 
                if (bestIdx2 >= 0)
                {
-                  const cv::KeyPoint &kp2 = pKF2->keysUn[bestIdx2];
                   vMatches12[idx1] = bestIdx2;
                   nmatches++;
 
                   if (mbCheckOrientation)
                   {
-                     float rot = kp1.angle - kp2.angle;
+                     float rot = pKF1->features.Angle(idx1) - pKF2->features.Angle(bestIdx2);
                      if (rot < 0.0)
                         rot += 360.0f;
                      int bin = round(rot*factor);
@@ -847,8 +918,18 @@ namespace ORB_SLAM2_TEAM
    int ORBmatcher::Fuse(Map & rMap, KeyFrame & rKF, const vector<MapPoint *> & vpMapPoints, const float th)
    {
       Print("begin Fuse 1");
-      cv::Mat Rcw = rKF.GetRotation();
-      cv::Mat tcw = rKF.GetTranslation();
+      vector<FuseMatch> matches;
+      FindFuseMatches(rKF, vpMapPoints, matches, th);
+      const int nFused = ApplyFuseMatches(rMap, matches);
+      Print("end Fuse 1");
+      return nFused;
+   }
+
+   void ORBmatcher::FindFuseMatches(KeyFrame & rKF, const vector<MapPoint *> & vpMapPoints, vector<FuseMatch> & matches, const float th)
+   {
+      // fixed-size copies, so projecting a MapPoint does not allocate
+      const cv::Matx33f Rcwf = rKF.GetRotationMatx();
+      const cv::Vec3f tcwf = rKF.GetTranslationVec();
 
       const float &fx = rKF.mFC.fx;
       const float &fy = rKF.mFC.fy;
@@ -856,12 +937,12 @@ namespace ORB_SLAM2_TEAM
       const float &cy = rKF.mFC.cy;
       const float &bf = rKF.mFC.blfx;
 
-      cv::Mat Ow = rKF.GetCameraCenter();
-
-      int nFused = 0;
+      const cv::Vec3f Owf = rKF.GetCameraCenterVec();
 
       const int nMPs = vpMapPoints.size();
 
+      vector<size_t> vIndices, vCandidates;
+
       for (int i = 0; i < nMPs; i++)
       {
          MapPoint* pMP = vpMapPoints[i];
@@ -872,16 +953,17 @@ namespace ORB_SLAM2_TEAM
          if (pMP->IsBad() || pMP->IsObserving(&rKF))
             continue;
 
-         cv::Mat p3Dw = pMP->GetWorldPos();
-         cv::Mat p3Dc = Rcw * p3Dw + tcw;
+         const MapPoint::Position pos = pMP->GetPosition();
+         const cv::Vec3f & p3Dw = pos.worldPos;
+         const cv::Vec3f p3Dc = Rcwf * p3Dw + tcwf;
 
          // Depth must be positive
-         if (p3Dc.at<float>(2) < 0.0f)
+         if (p3Dc[2] < 0.0f)
             continue;
 
-         const float invz = 1 / p3Dc.at<float>(2);
-         const float x = p3Dc.at<float>(0)*invz;
-         const float y = p3Dc.at<float>(1)*invz;
+         const float invz = 1 / p3Dc[2];
+         const float x = p3Dc[0]*invz;
+         const float y = p3Dc[1]*invz;
 
          const float u = fx * x + cx;
          const float v = fy * y + cy;
@@ -894,7 +976,7 @@ namespace ORB_SLAM2_TEAM
 
          const float maxDistance = pMP->GetMaxDistanceInvariance();
          const float minDistance = pMP->GetMinDistanceInvariance();
-         cv::Mat PO = p3Dw - Ow;
+         const cv::Vec3f PO = p3Dw - Owf;
          const float dist3D = cv::norm(PO);
 
          // Depth must be inside the scale pyramid of the image
@@ -902,9 +984,7 @@ namespace ORB_SLAM2_TEAM
             continue;
 
          // Viewing angle must be less than 60 deg
-         cv::Mat Pn = pMP->GetNormal();
-
-         if (PO.dot(Pn) < 0.5*dist3D)
+         if (PO.dot(pos.normal) < 0.5*dist3D)
             continue;
 
          int nPredictedLevel = pMP->PredictScale(dist3D, &rKF);
@@ -912,7 +992,7 @@ namespace ORB_SLAM2_TEAM
          // Search in a radius
          const float radius = th * rKF.scaleFactors[nPredictedLevel];
 
-         const vector<size_t> vIndices = rKF.GetFeaturesInArea(u, v, radius);
+         rKF.GetFeaturesInArea(u, v, radius, vIndices);
 
          if (vIndices.empty())
             continue;
@@ -921,15 +1001,12 @@ namespace ORB_SLAM2_TEAM
 
          const cv::Mat dMP = pMP->GetDescriptor();
 
-         int bestDist = 256;
-         int bestIdx = -1;
+         vCandidates.clear();
          for (vector<size_t>::const_iterator vit = vIndices.begin(), vend = vIndices.end(); vit != vend; vit++)
          {
             const size_t idx = *vit;
 
-            const cv::KeyPoint &kp = rKF.keysUn[idx];
-
-            const int &kpLevel = kp.octave;
+            const int kpLevel = rKF.features.Octave(idx);
 
             if (kpLevel<nPredictedLevel - 1 || kpLevel>nPredictedLevel)
                continue;
@@ -937,8 +1014,8 @@ namespace ORB_SLAM2_TEAM
             if (rKF.right[idx] >= 0)
             {
                // Check reprojection error in stereo
-               const float &kpx = kp.pt.x;
-               const float &kpy = kp.pt.y;
+               const float kpx = rKF.features.X(idx);
+               const float kpy = rKF.features.Y(idx);
                const float &kpr = rKF.right[idx];
                const float ex = u - kpx;
                const float ey = v - kpy;
@@ -950,8 +1027,8 @@ namespace ORB_SLAM2_TEAM
             }
             else
             {
-               const float &kpx = kp.pt.x;
-               const float &kpy = kp.pt.y;
+               const float kpx = rKF.features.X(idx);
+               const float kpy = rKF.features.Y(idx);
                const float ex = u - kpx;
                const float ey = v - kpy;
                const float e2 = ex * ex + ey * ey;
@@ -960,44 +1037,61 @@ namespace ORB_SLAM2_TEAM
                   continue;
             }
 
-            const cv::Mat &dKF = rKF.descriptors.row(idx);
+            vCandidates.push_back(idx);
+         }
 
-            const int dist = DescriptorDistance(dMP, dKF);
+         const HammingDistance::Result best = HammingDistance::FindBest(dMP.ptr(), rKF.features, vCandidates.data(), vCandidates.size());
+         const int bestDist = best.bestDist;
+         const int bestIdx = best.bestIdx;
 
-            if (dist < bestDist)
-            {
-               bestDist = dist;
-               bestIdx = idx;
-            }
+         if (bestDist <= TH_LOW)
+         {
+            FuseMatch match = { pMP, &rKF, (size_t)bestIdx };
+            matches.push_back(match);
+         }
+      }
+   }
+
+   int ORBmatcher::ApplyFuseMatches(Map & rMap, const vector<FuseMatch> & matches)
+   {
+      int nFused = 0;
+      for (const FuseMatch & match : matches)
+      {
+         KeyFrame & rKF = *match.pKF;
+
+         // a previous match may have replaced the MapPoint, or linked it to the KeyFrame
+         MapPoint * pMP = match.pMP;
+         if (pMP->IsBad())
+         {
+            pMP = MapPoint::FindFinalReplacement(pMP);
+            if (pMP->IsBad())
+               continue;
          }
+         if (rKF.IsBad() || pMP->IsObserving(&rKF))
+            continue;
 
          // If there is already a MapPoint replace otherwise add new measurement
-         if (bestDist <= TH_LOW)
+         MapPoint * pMPinKF = rKF.GetMapPoint(match.idx);
+         if (pMPinKF)
          {
-            MapPoint * pMPinKF = rKF.GetMapPoint(bestIdx);
-            if (pMPinKF)
+            if (!pMPinKF->IsBad())
             {
-               if (!pMPinKF->IsBad())
+               if (pMPinKF->Observations() > pMP->Observations())
                {
-                  if (pMPinKF->Observations() > pMP->Observations())
-                  {
-                     rMap.Replace(*pMP, *pMPinKF);
-                  }
-                  else
-                  {
-                     rMap.Replace(*pMPinKF, *pMP);
-                  }
+                  rMap.Replace(*pMP, *pMPinKF);
+               }
+               else
+               {
+                  rMap.Replace(*pMPinKF, *pMP);
                }
             }
-            else
-            {
-               rMap.Link(*pMP, bestIdx, rKF);
-            }
-            nFused++;
          }
+         else
+         {
+            rMap.Link(*pMP, match.idx, rKF);
+         }
+         nFused++;
       }
-
-      Print("end Fuse 1");
       return nFused;
    }
 
@@ -1017,6 +1111,11 @@ namespace ORB_SLAM2_TEAM
       cv::Mat tcw = Scw.rowRange(0, 3).col(3) / scw;
       cv::Mat Ow = -Rcw.t()*tcw;
 
+      // fixed-size copies, so projecting a MapPoint does not allocate
+      const cv::Matx33f Rcwf = Rcw;
+      const cv::Vec3f tcwf = tcw;
+      const cv::Vec3f Owf = Ow;
+
       // Set of MapPoints already found in the KeyFrame
       const set<MapPoint*> spAlreadyFound = rKF.GetMapPoints();
 
@@ -1024,6 +1123,8 @@ namespace ORB_SLAM2_TEAM
 
       const int nPoints = vpPoints.size();
 
+      vector<size_t> vIndices, vCandidates;
+
       // For each candidate MapPoint project and match
       for (int iMP = 0; iMP < nPoints; iMP++)
       {
@@ -1034,19 +1135,20 @@ namespace ORB_SLAM2_TEAM
             continue;
 
          // Get 3D Coords.
-         cv::Mat p3Dw = pMP->GetWorldPos();
+         const MapPoint::Position pos = pMP->GetPosition();
+         const cv::Vec3f & p3Dw = pos.worldPos;
 
          // Transform into Camera Coords.
-         cv::Mat p3Dc = Rcw * p3Dw + tcw;
+         const cv::Vec3f p3Dc = Rcwf * p3Dw + tcwf;
 
          // Depth must be positive
-         if (p3Dc.at<float>(2) < 0.0f)
+         if (p3Dc[2] < 0.0f)
             continue;
 
          // Project into Image
-         const float invz = 1.0 / p3Dc.at<float>(2);
-         const float x = p3Dc.at<float>(0)*invz;
-         const float y = p3Dc.at<float>(1)*invz;
+         const float invz = 1.0 / p3Dc[2];
+         const float x = p3Dc[0]*invz;
+         const float y = p3Dc[1]*invz;
 
          const float u = fx * x + cx;
          const float v = fy * y + cy;
@@ -1058,16 +1160,14 @@ namespace ORB_SLAM2_TEAM
          // Depth must be inside the scale pyramid of the image
          const float maxDistance = pMP->GetMaxDistanceInvariance();
          const float minDistance = pMP->GetMinDistanceInvariance();
-         cv::Mat PO = p3Dw - Ow;
+         const cv::Vec3f PO = p3Dw - Owf;
          const float dist3D = cv::norm(PO);
 
          if (dist3D<minDistance || dist3D>maxDistance)
             continue;
 
          // Viewing angle must be less than 60 deg
-         cv::Mat Pn = pMP->GetNormal();
-
-         if (PO.dot(Pn) < 0.5*dist3D)
+         if (PO.dot(pos.normal) < 0.5*dist3D)
             continue;
 
          // Compute predicted scale level
@@ -1076,7 +1176,7 @@ namespace ORB_SLAM2_TEAM
          // Search in a radius
          const float radius = th * rKF.scaleFactors[nPredictedLevel];
 
-         const vector<size_t> vIndices = rKF.GetFeaturesInArea(u, v, radius);
+         rKF.GetFeaturesInArea(u, v, radius, vIndices);
 
          if (vIndices.empty())
             continue;
@@ -1085,27 +1185,22 @@ namespace ORB_SLAM2_TEAM
 
          const cv::Mat dMP = pMP->GetDescriptor();
 
-         int bestDist = INT_MAX;
-         int bestIdx = -1;
+         vCandidates.clear();
          for (vector<size_t>::const_iterator vit = vIndices.begin(); vit != vIndices.end(); vit++)
          {
             const size_t idx = *vit;
-            const int &kpLevel = rKF.keysUn[idx].octave;
+            const int kpLevel = rKF.features.Octave(idx);
 
             if (kpLevel<nPredictedLevel - 1 || kpLevel>nPredictedLevel)
                continue;
 
-            const cv::Mat &dKF = rKF.descriptors.row(idx);
-
-            int dist = DescriptorDistance(dMP, dKF);
-
-            if (dist < bestDist)
-            {
-               bestDist = dist;
-               bestIdx = idx;
-            }
+            vCandidates.push_back(idx);
          }
 
+         const HammingDistance::Result best = HammingDistance::FindBest(dMP.ptr(), rKF.features, vCandidates.data(), vCandidates.size());
+         const int bestDist = best.bestDist;
+         const int bestIdx = best.bestIdx;
+
          // If there is already a MapPoint replace otherwise add new measurement
          if (bestDist <= TH_LOW)
          {
@@ -1173,6 +1268,8 @@ namespace ORB_SLAM2_TEAM
       vector<int> vnMatch1(N1, -1);
       vector<int> vnMatch2(N2, -1);
 
+      vector<size_t> vIndices, vCandidates;
+
       // Transform from KF1 to KF2 and search
       for (int i1 = 0; i1 < N1; i1++)
       {
@@ -1217,7 +1314,7 @@ namespace ORB_SLAM2_TEAM
          // Search in a radius
          const float radius = th * pKF2->scaleFactors[nPredictedLevel];
 
-         const vector<size_t> vIndices = pKF2->GetFeaturesInArea(u, v, radius);
+         pKF2->GetFeaturesInArea(u, v, radius, vIndices);
 
          if (vIndices.empty())
             continue;
@@ -1225,28 +1322,23 @@ namespace ORB_SLAM2_TEAM
          // Match to the most similar keypoint in the radius
          const cv::Mat dMP = pMP->GetDescriptor();
 
-         int bestDist = INT_MAX;
-         int bestIdx = -1;
+         vCandidates.clear();
          for (vector<size_t>::const_iterator vit = vIndices.begin(), vend = vIndices.end(); vit != vend; vit++)
          {
             const size_t idx = *vit;
 
-            const cv::KeyPoint &kp = pKF2->keysUn[idx];
+            const int kpLevel = pKF2->features.Octave(idx);
 
-            if (kp.octave<nPredictedLevel - 1 || kp.octave>nPredictedLevel)
+            if (kpLevel<nPredictedLevel - 1 || kpLevel>nPredictedLevel)
                continue;
 
-            const cv::Mat &dKF = pKF2->descriptors.row(idx);
-
-            const int dist = DescriptorDistance(dMP, dKF);
-
-            if (dist < bestDist)
-            {
-               bestDist = dist;
-               bestIdx = idx;
-            }
+            vCandidates.push_back(idx);
          }
 
+         const HammingDistance::Result best = HammingDistance::FindBest(dMP.ptr(), pKF2->features, vCandidates.data(), vCandidates.size());
+         const int bestDist = best.bestDist;
+         const int bestIdx = best.bestIdx;
+
          if (bestDist <= TH_HIGH)
          {
             vnMatch1[i1] = bestIdx;
@@ -1297,7 +1389,7 @@ namespace ORB_SLAM2_TEAM
          // Search in a radius of 2.5*sigma(ScaleLevel)
          const float radius = th * pKF1->scaleFactors[nPredictedLevel];
 
-         const vector<size_t> vIndices = pKF1->GetFeaturesInArea(u, v, radius);
+         pKF1->GetFeaturesInArea(u, v, radius, vIndices);
 
          if (vIndices.empty())
             continue;
@@ -1305,28 +1397,23 @@ namespace ORB_SLAM2_TEAM
          // Match to the most similar keypoint in the radius
          const cv::Mat dMP = pMP->GetDescriptor();
 
-         int bestDist = INT_MAX;
-         int bestIdx = -1;
+         vCandidates.clear();
          for (vector<size_t>::const_iterator vit = vIndices.begin(), vend = vIndices.end(); vit != vend; vit++)
          {
             const size_t idx = *vit;
 
-            const cv::KeyPoint &kp = pKF1->keysUn[idx];
+            const int kpLevel = pKF1->features.Octave(idx);
 
-            if (kp.octave<nPredictedLevel - 1 || kp.octave>nPredictedLevel)
+            if (kpLevel<nPredictedLevel - 1 || kpLevel>nPredictedLevel)
                continue;
 
-            const cv::Mat &dKF = pKF1->descriptors.row(idx);
-
-            const int dist = DescriptorDistance(dMP, dKF);
-
-            if (dist < bestDist)
-            {
-               bestDist = dist;
-               bestIdx = idx;
-            }
+            vCandidates.push_back(idx);
          }
 
+         const HammingDistance::Result best = HammingDistance::FindBest(dMP.ptr(), pKF1->features, vCandidates.data(), vCandidates.size());
+         const int bestDist = best.bestDist;
+         const int bestIdx = best.bestIdx;
+
          if (bestDist <= TH_HIGH)
          {
             vnMatch2[i2] = bestIdx;
@@ -1364,18 +1451,18 @@ namespace ORB_SLAM2_TEAM
          rotHist[i].reserve(500);
       const float factor = 1.0f / HISTO_LENGTH;
 
-      const cv::Mat Rcw = CurrentFrame.mTcw.rowRange(0, 3).colRange(0, 3);
-      const cv::Mat tcw = CurrentFrame.mTcw.rowRange(0, 3).col(3);
+      vector<size_t> vIndices2, vCandidates;
 
-      const cv::Mat twc = -Rcw.t()*tcw;
+      // fixed-size copies, so projecting a MapPoint does not allocate
+      const cv::Matx33f Rcwf = CurrentFrame.GetRotationMatx();
+      const cv::Vec3f tcwf = CurrentFrame.GetTranslationVec();
 
-      const cv::Mat Rlw = LastFrame.mTcw.rowRange(0, 3).colRange(0, 3);
-      const cv::Mat tlw = LastFrame.mTcw.rowRange(0, 3).col(3);
+      const cv::Vec3f twc = CurrentFrame.GetCameraCenterVec();
 
-      const cv::Mat tlc = Rlw * twc + tlw;
+      const cv::Vec3f tlc = LastFrame.GetRotationMatx() * twc + LastFrame.GetTranslationVec();
 
-      const bool bForward = tlc.at<float>(2) > CurrentFrame.mFC->bl && !bMono;
-      const bool bBackward = -tlc.at<float>(2) > CurrentFrame.mFC->bl && !bMono;
+      const bool bForward = tlc[2] > CurrentFrame.mFC->bl && !bMono;
+      const bool bBackward = -tlc[2] > CurrentFrame.mFC->bl && !bMono;
 
       for (size_t i = 0; i < LastFrame.N; i++)
       {
@@ -1386,12 +1473,11 @@ namespace ORB_SLAM2_TEAM
             if (!LastFrame.mvbOutlier[i])
             {
                // Project
-               cv::Mat x3Dw = pMP->GetWorldPos();
-               cv::Mat x3Dc = Rcw * x3Dw + tcw;
+               const cv::Vec3f x3Dc = Rcwf * pMP->GetPosition().worldPos + tcwf;
 
-               const float xc = x3Dc.at<float>(0);
-               const float yc = x3Dc.at<float>(1);
-               const float invzc = 1.0 / x3Dc.at<float>(2);
+               const float xc = x3Dc[0];
+               const float yc = x3Dc[1];
+               const float invzc = 1.0 / x3Dc[2];
 
                if (invzc < 0)
                   continue;
@@ -1404,28 +1490,24 @@ namespace ORB_SLAM2_TEAM
                if (v<CurrentFrame.mFC->minY || v>CurrentFrame.mFC->maxY)
                   continue;
 
-               int nLastOctave = LastFrame.mvKeys[i].octave;
+               int nLastOctave = LastFrame.mFeatures.Octave(i);
 
                // Search in a window. Size depends on scale
                float radius = th * CurrentFrame.mvScaleFactors[nLastOctave];
 
-               vector<size_t> vIndices2;
-
                if (bForward)
-                  vIndices2 = CurrentFrame.GetFeaturesInArea(u, v, radius, nLastOctave);
+                  CurrentFrame.GetFeaturesInArea(u, v, radius, nLastOctave, -1, vIndices2);
                else if (bBackward)
-                  vIndices2 = CurrentFrame.GetFeaturesInArea(u, v, radius, 0, nLastOctave);
+                  CurrentFrame.GetFeaturesInArea(u, v, radius, 0, nLastOctave, vIndices2);
                else
-                  vIndices2 = CurrentFrame.GetFeaturesInArea(u, v, radius, nLastOctave - 1, nLastOctave + 1);
+                  CurrentFrame.GetFeaturesInArea(u, v, radius, nLastOctave - 1, nLastOctave + 1, vIndices2);
 
                if (vIndices2.empty())
                   continue;
 
                const cv::Mat dMP = pMP->GetDescriptor();
 
-               int bestDist = 256;
-               int bestIdx2 = -1;
-
+               vCandidates.clear();
                for (vector<size_t>::const_iterator vit = vIndices2.begin(), vend = vIndices2.end(); vit != vend; vit++)
                {
                   const size_t i2 = *vit;
@@ -1441,17 +1523,14 @@ namespace ORB_SLAM2_TEAM
                         continue;
                   }
 
-                  const cv::Mat &d = CurrentFrame.mDescriptors.row(i2);
-
-                  const int dist = DescriptorDistance(dMP, d);
-
-                  if (dist < bestDist)
-                  {
-                     bestDist = dist;
-                     bestIdx2 = i2;
-                  }
+                  vCandidates.push_back(i2);
                }
 
+               const HammingDistance::Result best =
+                  HammingDistance::FindBest(dMP.ptr(), CurrentFrame.mFeatures, vCandidates.data(), vCandidates.size());
+               const int bestDist = best.bestDist;
+               const int bestIdx2 = best.bestIdx;
+
                if (bestDist <= TH_HIGH)
                {
                   CurrentFrame.mvpMapPoints[bestIdx2] = pMP;
@@ -1459,7 +1538,7 @@ namespace ORB_SLAM2_TEAM
 
                   if (mbCheckOrientation)
                   {
-                     float rot = LastFrame.mvKeysUn[i].angle - CurrentFrame.mvKeysUn[bestIdx2].angle;
+                     float rot = LastFrame.mFeatures.Angle(i) - CurrentFrame.mFeatures.Angle(bestIdx2);
                      if (rot < 0.0)
                         rot += 360.0f;
                      int bin = round(rot*factor);
@@ -1502,9 +1581,9 @@ namespace ORB_SLAM2_TEAM
    {
       int nmatches = 0;
 
-      const cv::Mat Rcw = CurrentFrame.mTcw.rowRange(0, 3).colRange(0, 3);
-      const cv::Mat tcw = CurrentFrame.mTcw.rowRange(0, 3).col(3);
-      const cv::Mat Ow = -Rcw.t()*tcw;
+      const cv::Matx33f Rcw = CurrentFrame.GetRotationMatx();
+      const cv::Vec3f tcw = CurrentFrame.GetTranslationVec();
+      const cv::Vec3f Ow = CurrentFrame.GetCameraCenterVec();
 
       // Rotation Histogram (to check rotation consistency)
       vector<int> rotHist[HISTO_LENGTH];
@@ -1512,6 +1591,8 @@ namespace ORB_SLAM2_TEAM
          rotHist[i].reserve(500);
       const float factor = 1.0f / HISTO_LENGTH;
 
+      vector<size_t> vIndices2, vCandidates;
+
       const vector<MapPoint*> vpMPs = pKF->GetMapPointMatches();
 
       for (size_t i = 0, iend = vpMPs.size(); i < iend; i++)
@@ -1523,12 +1604,12 @@ namespace ORB_SLAM2_TEAM
             if (!pMP->IsBad() && !sAlreadyFound.count(pMP))
             {
                //Project
-               cv::Mat x3Dw = pMP->GetWorldPos();
-               cv::Mat x3Dc = Rcw * x3Dw + tcw;
+               const cv::Vec3f x3Dw = pMP->GetPosition().worldPos;
+               const cv::Vec3f x3Dc = Rcw * x3Dw + tcw;
 
-               const float xc = x3Dc.at<float>(0);
-               const float yc = x3Dc.at<float>(1);
-               const float invzc = 1.0 / x3Dc.at<float>(2);
+               const float xc = x3Dc[0];
+               const float yc = x3Dc[1];
+               const float invzc = 1.0 / x3Dc[2];
 
                const float u = CurrentFrame.mFC->fx * xc * invzc + CurrentFrame.mFC->cx;
                const float v = CurrentFrame.mFC->fy * yc * invzc + CurrentFrame.mFC->cy;
@@ -1539,7 +1620,7 @@ namespace ORB_SLAM2_TEAM
                   continue;
 
                // Compute predicted scale level
-               cv::Mat PO = x3Dw - Ow;
+               const cv::Vec3f PO = x3Dw - Ow;
                float dist3D = cv::norm(PO);
 
                const float maxDistance = pMP->GetMaxDistanceInvariance();
@@ -1554,33 +1635,26 @@ namespace ORB_SLAM2_TEAM
                // Search in a window
                const float radius = th * CurrentFrame.mvScaleFactors[nPredictedLevel];
 
-               const vector<size_t> vIndices2 = CurrentFrame.GetFeaturesInArea(u, v, radius, nPredictedLevel - 1, nPredictedLevel + 1);
+               CurrentFrame.GetFeaturesInArea(u, v, radius, nPredictedLevel - 1, nPredictedLevel + 1, vIndices2);
 
                if (vIndices2.empty())
                   continue;
 
                const cv::Mat dMP = pMP->GetDescriptor();
 
-               int bestDist = 256;
-               int bestIdx2 = -1;
-
+               vCandidates.clear();
                for (vector<size_t>::const_iterator vit = vIndices2.begin(); vit != vIndices2.end(); vit++)
                {
                   const size_t i2 = *vit;
-                  if (CurrentFrame.mvpMapPoints[i2])
-                     continue;
-
-                  const cv::Mat &d = CurrentFrame.mDescriptors.row(i2);
-
-                  const int dist = DescriptorDistance(dMP, d);
-
-                  if (dist < bestDist)
-                  {
-                     bestDist = dist;
-                     bestIdx2 = i2;
-                  }
+                  if (!CurrentFrame.mvpMapPoints[i2])
+                     vCandidates.push_back(i2);
                }
 
+               const HammingDistance::Result best =
+                  HammingDistance::FindBest(dMP.ptr(), CurrentFrame.mFeatures, vCandidates.data(), vCandidates.size());
+               const int bestDist = best.bestDist;
+               const int bestIdx2 = best.bestIdx;
+
                if (bestDist <= ORBdist)
                {
                   CurrentFrame.mvpMapPoints[bestIdx2] = pMP;
@@ -1588,7 +1662,7 @@ namespace ORB_SLAM2_TEAM
 
                   if (mbCheckOrientation)
                   {
-                     float rot = pKF->keysUn[i].angle - CurrentFrame.mvKeysUn[bestIdx2].angle;
+                     float rot = pKF->features.Angle(i) - CurrentFrame.mFeatures.Angle(bestIdx2);
                      if (rot < 0.0)
                         rot += 360.0f;
                      int bin = round(rot*factor);
@@ -1671,24 +1745,14 @@ namespace ORB_SLAM2_TEAM
    }
 
 
-   // Bit set count operation from
-   // http://graphics.stanford.edu/~seander/bithacks.html#CountBitsSetParallel
    int ORBmatcher::DescriptorDistance(const cv::Mat &a, const cv::Mat &b)
    {
-      const int *pa = a.ptr<int32_t>();
-      const int *pb = b.ptr<int32_t>();
-
-      int dist = 0;
-
-      for (int i = 0; i < 8; i++, pa++, pb++)
-      {
-         unsigned  int v = *pa ^ *pb;
-         v = v - ((v >> 1) & 0x55555555);
-         v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
-         dist += (((v + (v >> 4)) & 0xF0F0F0F) * 0x1010101) >> 24;
-      }
+      return DescriptorDistance(a.ptr(), b.ptr());
+   }
 
-      return dist;
+   int ORBmatcher::DescriptorDistance(const unsigned char * a, const unsigned char * b)
+   {
+      return HammingDistance::Distance(a, b);
    }
 
 } //namespace ORB_SLAM
@@ -0,0 +1,133 @@
+/**
+* This file is part of ORB-SLAM2-TEAM.
+*
+* Copyright (C) 2018 Joe Bedard <mr dot joe dot bedard at gmail dot com>
+* For more information see <https://github.com/joebedard/ORB_SLAM2_TEAM>
+*
+* ORB-SLAM2-TEAM is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2-TEAM is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2-TEAM. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ObservationMap.h"
+#include "KeyFrame.h"
+
+#include <algorithm>
+
+namespace ORB_SLAM2_TEAM
+{
+
+   ObservationMap::ObservationMap()
+      : mpData(mInline)
+      , mSize(0)
+      , mCapacity(INLINE_CAPACITY)
+   {
+   }
+
+   ObservationMap::ObservationMap(const ObservationMap & other)
+      : mpData(mInline)
+      , mSize(0)
+      , mCapacity(INLINE_CAPACITY)
+   {
+      *this = other;
+   }
+
+   ObservationMap::~ObservationMap()
+   {
+      if (mpData != mInline)
+         delete[] mpData;
+   }
+
+   ObservationMap & ObservationMap::operator=(const ObservationMap & other)
+   {
+      if (this != &other)
+      {
+         Reserve(other.mSize);
+         copy(other.begin(), other.end(), mpData);
+         mSize = other.mSize;
+      }
+      return *this;
+   }
+
+   ObservationMap::const_iterator ObservationMap::find(KeyFrame * pKF) const
+   {
+      value_type * pEnd = mpData + mSize;
+      for (value_type * p = LowerBound(pKF); p != pEnd && p->first->id == pKF->id; ++p)
+      {
+         if (p->first == pKF)
+            return p;
+      }
+      return pEnd;
+   }
+
+   size_t ObservationMap::at(KeyFrame * pKF) const
+   {
+      const_iterator it = find(pKF);
+      if (it == end())
+         throw exception("ObservationMap::at the KeyFrame is not in the map");
+      return it->second;
+   }
+
+   void ObservationMap::set(KeyFrame * pKF, size_t idx)
+   {
+      const_iterator it = find(pKF);
+      if (it != end())
+      {
+         mpData[it - mpData].second = idx;
+         return;
+      }
+
+      if (mSize == mCapacity)
+         Reserve(mCapacity * 2);
+
+      value_type * p = LowerBound(pKF);
+      copy_backward(p, mpData + mSize, mpData + mSize + 1);
+      *p = value_type(pKF, idx);
+      ++mSize;
+   }
+
+   void ObservationMap::erase(KeyFrame * pKF)
+   {
+      const_iterator it = find(pKF);
+      if (it == end())
+         return;
+
+      value_type * p = mpData + (it - mpData);
+      copy(p + 1, mpData + mSize, p);
+      --mSize;
+   }
+
+   void ObservationMap::clear()
+   {
+      mSize = 0;
+   }
+
+   ObservationMap::value_type * ObservationMap::LowerBound(KeyFrame * pKF) const
+   {
+      return lower_bound(mpData, mpData + mSize, pKF->id,
+         [](const value_type & v, id_type id) { return v.first->id < id; });
+   }
+
+   void ObservationMap::Reserve(size_t capacity)
+   {
+      if (capacity <= mCapacity)
+         return;
+
+      value_type * pData = new value_type[capacity];
+      copy(mpData, mpData + mSize, pData);
+      if (mpData != mInline)
+         delete[] mpData;
+      mpData = pData;
+      mCapacity = capacity;
+   }
+
+}
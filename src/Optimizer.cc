@@ -32,6 +32,7 @@
 #include<Eigen/StdVector>
 
 #include "Converter.h"
+#include "PoseSolver.h"
 #include "SyncPrint.h"
 
 #include<mutex>
@@ -66,7 +67,7 @@ namespace ORB_SLAM2_TEAM
          if (pKF->IsBad())
             continue;
          g2o::VertexSE3Expmap * vSE3 = new g2o::VertexSE3Expmap();
-         vSE3->setEstimate(Converter::toSE3Quat(pKF->GetPose()));
+         vSE3->setEstimate(Converter::toSE3Quat(pKF->GetPoseMatx()));
          vSE3->setId(pKF->id);
          vSE3->setFixed(pKF->id == 0);
          if (!optimizer.addVertex(vSE3))
@@ -85,7 +86,7 @@ namespace ORB_SLAM2_TEAM
          if (pMP->IsBad())
             continue;
          g2o::VertexSBAPointXYZ* vPoint = new g2o::VertexSBAPointXYZ();
-         vPoint->setEstimate(Converter::toVector3d(pMP->GetWorldPos()));
+         vPoint->setEstimate(Converter::toVector3d(pMP->GetPosition().worldPos));
          const id_type id = pMP->id + maxKFid + 1;
          if (id <= maxKFid)
             throw exception("Optimizer::GlobalBundleAdjustment: maximum id exceeded");
@@ -94,11 +95,11 @@ namespace ORB_SLAM2_TEAM
          if (!optimizer.addVertex(vPoint))
             Print("optimizer.addVertex(vPoint) failed");
 
-         const map<KeyFrame*, size_t> observations = pMP->GetObservations();
+         const ObservationMap observations = pMP->GetObservations();
 
          int nEdges = 0;
          //SET EDGES
-         for (map<KeyFrame*, size_t>::const_iterator mit = observations.begin(); mit != observations.end(); mit++)
+         for (ObservationMap::const_iterator mit = observations.begin(); mit != observations.end(); mit++)
          {
 
             KeyFrame* pKF = mit->first;
@@ -107,19 +108,21 @@ namespace ORB_SLAM2_TEAM
 
             nEdges++;
 
-            const cv::KeyPoint &kpUn = pKF->keysUn[mit->second];
+            const float kpUnX = pKF->features.X(mit->second);
+            const float kpUnY = pKF->features.Y(mit->second);
+            const int kpUnOctave = pKF->features.Octave(mit->second);
 
             if (pKF->right[mit->second] < 0)
             {
                Eigen::Matrix<double, 2, 1> obs;
-               obs << kpUn.pt.x, kpUn.pt.y;
+               obs << kpUnX, kpUnY;
 
                g2o::EdgeSE3ProjectXYZ* e = new g2o::EdgeSE3ProjectXYZ();
 
                e->setVertex(0, dynamic_cast<g2o::OptimizableGraph::Vertex*>(optimizer.vertex(id)));
                e->setVertex(1, dynamic_cast<g2o::OptimizableGraph::Vertex*>(optimizer.vertex(pKF->id)));
                e->setMeasurement(obs);
-               Eigen::Matrix2d info = Eigen::Matrix2d::Identity() * pKF->invLevelSigma2[kpUn.octave];
+               Eigen::Matrix2d info = Eigen::Matrix2d::Identity() * pKF->invLevelSigma2[kpUnOctave];
                e->setInformation(info);
 
                if (bRobust)
@@ -141,14 +144,14 @@ namespace ORB_SLAM2_TEAM
             {
                Eigen::Matrix<double, 3, 1> obs;
                const float kp_ur = pKF->right[mit->second];
-               obs << kpUn.pt.x, kpUn.pt.y, kp_ur;
+               obs << kpUnX, kpUnY, kp_ur;
 
                g2o::EdgeStereoSE3ProjectXYZ* e = new g2o::EdgeStereoSE3ProjectXYZ();
 
                e->setVertex(0, dynamic_cast<g2o::OptimizableGraph::Vertex*>(optimizer.vertex(id)));
                e->setVertex(1, dynamic_cast<g2o::OptimizableGraph::Vertex*>(optimizer.vertex(pKF->id)));
                e->setMeasurement(obs);
-               Eigen::Matrix3d info = Eigen::Matrix3d::Identity() * pKF->invLevelSigma2[kpUn.octave];
+               Eigen::Matrix3d info = Eigen::Matrix3d::Identity() * pKF->invLevelSigma2[kpUnOctave];
                e->setInformation(info);
 
                if (bRobust)
@@ -250,7 +253,8 @@ namespace ORB_SLAM2_TEAM
       int nIterations, 
       bool * pbStopFlag, 
       const id_type loopKeyFrameId, 
-      const bool bRobust)
+      const bool bRobust,
+      const int nThreads)
    {
       Print("begin GlobalBundleAdjustment");
 
@@ -263,6 +267,7 @@ namespace ORB_SLAM2_TEAM
 
       g2o::OptimizationAlgorithmLevenberg* solver = new g2o::OptimizationAlgorithmLevenberg(solver_ptr);
       optimizer.setAlgorithm(solver);
+      optimizer.setNumThreads(nThreads);
 
       if (pbStopFlag)
          optimizer.setForceStopFlag(pbStopFlag);
@@ -302,122 +307,50 @@ namespace ORB_SLAM2_TEAM
    {
       Print("begin PoseOptimization");
 
-      g2o::SparseOptimizer optimizer;
-      g2o::BlockSolver_6_3::LinearSolverType * linearSolver;
-
-      linearSolver = new g2o::LinearSolverDense<g2o::BlockSolver_6_3::PoseMatrixType>();
-
-      g2o::BlockSolver_6_3 * solver_ptr = new g2o::BlockSolver_6_3(linearSolver);
-
-      g2o::OptimizationAlgorithmLevenberg* solver = new g2o::OptimizationAlgorithmLevenberg(solver_ptr);
-      optimizer.setAlgorithm(solver);
-
       int nInitialCorrespondences = 0;
 
-      // Set Frame vertex
-      g2o::VertexSE3Expmap * vSE3 = new g2o::VertexSE3Expmap();
-      vSE3->setEstimate(Converter::toSE3Quat(pFrame->mTcw));
-      vSE3->setId(0);
-      vSE3->setFixed(false);
-      if (!optimizer.addVertex(vSE3))
-         Print("optimizer.addVertex(vSE3) failed");
+      const float deltaMono = sqrt(5.991);
+      const float deltaStereo = sqrt(7.815);
 
-      // Set MapPoint vertices
+      PoseSolver solver(pFrame->mFC->fx, pFrame->mFC->fy, pFrame->mFC->cx, pFrame->mFC->cy, pFrame->mFC->blfx, deltaMono, deltaStereo);
+
+      // Set MapPoint observations
       const size_t N = pFrame->N;
 
-      vector<g2o::EdgeSE3ProjectXYZOnlyPose*> vpEdgesMono;
+      solver.Reserve(N);
+
       vector<size_t> vnIndexEdgeMono;
-      vpEdgesMono.reserve(N);
       vnIndexEdgeMono.reserve(N);
 
-      vector<g2o::EdgeStereoSE3ProjectXYZOnlyPose*> vpEdgesStereo;
       vector<size_t> vnIndexEdgeStereo;
-      vpEdgesStereo.reserve(N);
       vnIndexEdgeStereo.reserve(N);
 
-      const float deltaMono = sqrt(5.991);
-      const float deltaStereo = sqrt(7.815);
-
-
       {
-         unique_lock<mutex> lock(MapPoint::mGlobalMutex);
-
+         // each position is read consistently without a lock, a writer that moves many MapPoints holds the map update mutex
          for (int i = 0; i < N; i++)
          {
             MapPoint* pMP = pFrame->mvpMapPoints[i];
             if (pMP)
             {
+               nInitialCorrespondences++;
+               pFrame->mvbOutlier[i] = false;
+
+               const float kpUnX = pFrame->mFeatures.X(i);
+               const float kpUnY = pFrame->mFeatures.Y(i);
+               const int kpUnOctave = pFrame->mFeatures.Octave(i);
+               const float invSigma2 = pFrame->mvInvLevelSigma2[kpUnOctave];
+               const cv::Vec3f Xw = pMP->GetPosition().worldPos;
+
                // Monocular observation
                if (pFrame->mvuRight[i] < 0)
                {
-                  nInitialCorrespondences++;
-                  pFrame->mvbOutlier[i] = false;
-
-                  Eigen::Matrix<double, 2, 1> obs;
-                  const cv::KeyPoint &kpUn = pFrame->mvKeysUn[i];
-                  obs << kpUn.pt.x, kpUn.pt.y;
-
-                  g2o::EdgeSE3ProjectXYZOnlyPose* e = new g2o::EdgeSE3ProjectXYZOnlyPose();
-
-                  e->setVertex(0, dynamic_cast<g2o::OptimizableGraph::Vertex*>(optimizer.vertex(0)));
-                  e->setMeasurement(obs);
-                  const float invSigma2 = pFrame->mvInvLevelSigma2[kpUn.octave];
-                  e->setInformation(Eigen::Matrix2d::Identity()*invSigma2);
-
-                  g2o::RobustKernelHuber* rk = new g2o::RobustKernelHuber;
-                  e->setRobustKernel(rk);
-                  rk->setDelta(deltaMono);
-
-                  e->fx = pFrame->mFC->fx;
-                  e->fy = pFrame->mFC->fy;
-                  e->cx = pFrame->mFC->cx;
-                  e->cy = pFrame->mFC->cy;
-                  cv::Mat Xw = pMP->GetWorldPos();
-                  e->Xw[0] = Xw.at<float>(0);
-                  e->Xw[1] = Xw.at<float>(1);
-                  e->Xw[2] = Xw.at<float>(2);
-
-                  optimizer.addEdge(e);
-
-                  vpEdgesMono.push_back(e);
+                  solver.AddMono(Xw.val, kpUnX, kpUnY, invSigma2);
                   vnIndexEdgeMono.push_back(i);
                }
                else  // Stereo observation
                {
-                  nInitialCorrespondences++;
-                  pFrame->mvbOutlier[i] = false;
-
-                  //SET EDGE
-                  Eigen::Matrix<double, 3, 1> obs;
-                  const cv::KeyPoint &kpUn = pFrame->mvKeysUn[i];
                   const float &kp_ur = pFrame->mvuRight[i];
-                  obs << kpUn.pt.x, kpUn.pt.y, kp_ur;
-
-                  g2o::EdgeStereoSE3ProjectXYZOnlyPose* e = new g2o::EdgeStereoSE3ProjectXYZOnlyPose();
-
-                  e->setVertex(0, dynamic_cast<g2o::OptimizableGraph::Vertex*>(optimizer.vertex(0)));
-                  e->setMeasurement(obs);
-                  const float invSigma2 = pFrame->mvInvLevelSigma2[kpUn.octave];
-                  Eigen::Matrix3d Info = Eigen::Matrix3d::Identity()*invSigma2;
-                  e->setInformation(Info);
-
-                  g2o::RobustKernelHuber* rk = new g2o::RobustKernelHuber;
-                  e->setRobustKernel(rk);
-                  rk->setDelta(deltaStereo);
-
-                  e->fx = pFrame->mFC->fx;
-                  e->fy = pFrame->mFC->fy;
-                  e->cx = pFrame->mFC->cx;
-                  e->cy = pFrame->mFC->cy;
-                  e->bf = pFrame->mFC->blfx;
-                  cv::Mat Xw = pMP->GetWorldPos();
-                  e->Xw[0] = Xw.at<float>(0);
-                  e->Xw[1] = Xw.at<float>(1);
-                  e->Xw[2] = Xw.at<float>(2);
-
-                  optimizer.addEdge(e);
-
-                  vpEdgesStereo.push_back(e);
+                  solver.AddStereo(Xw.val, kpUnX, kpUnY, kp_ur, invSigma2);
                   vnIndexEdgeStereo.push_back(i);
                }
             }
@@ -438,483 +371,73 @@ namespace ORB_SLAM2_TEAM
       const float chi2Stereo[4] = { 7.815f, 7.815f, 7.815f, 7.815f };
       const int its[4] = { 10,10,10,10 };
 
+      const Eigen::Matrix3d Rcw = Converter::toMatrix3d(pFrame->GetRotationMatx());
+      const Eigen::Vector3d tcw = Converter::toVector3d(pFrame->GetTranslationVec());
+
+      vector<double> vChi2Mono, vChi2Stereo;
+
       int nBad = 0;
       for (size_t it = 0; it < 4; it++)
       {
 
-         vSE3->setEstimate(Converter::toSE3Quat(pFrame->mTcw));
-         optimizer.initializeOptimization(0);
-         optimizer.optimize(its[it]);
+         solver.SetPose(Rcw, tcw);
+         solver.Optimize(its[it]);
+         solver.ComputeChi2(vChi2Mono, vChi2Stereo);
 
          nBad = 0;
-         for (size_t i = 0, iend = vpEdgesMono.size(); i < iend; i++)
+         for (size_t i = 0, iend = vnIndexEdgeMono.size(); i < iend; i++)
          {
-            g2o::EdgeSE3ProjectXYZOnlyPose* e = vpEdgesMono[i];
-
             const size_t idx = vnIndexEdgeMono[i];
 
-            if (pFrame->mvbOutlier[idx])
-            {
-               e->computeError();
-            }
-
-            const float chi2 = e->chi2();
+            const float chi2 = vChi2Mono[i];
 
             if (chi2 > chi2Mono[it])
             {
                pFrame->mvbOutlier[idx] = true;
-               e->setLevel(1);
+               solver.SetActiveMono(i, false);
                nBad++;
             }
             else
             {
                pFrame->mvbOutlier[idx] = false;
-               e->setLevel(0);
+               solver.SetActiveMono(i, true);
             }
-
-            if (it == 2)
-               e->setRobustKernel(0);
          }
 
-         for (size_t i = 0, iend = vpEdgesStereo.size(); i < iend; i++)
+         for (size_t i = 0, iend = vnIndexEdgeStereo.size(); i < iend; i++)
          {
-            g2o::EdgeStereoSE3ProjectXYZOnlyPose* e = vpEdgesStereo[i];
-
             const size_t idx = vnIndexEdgeStereo[i];
 
-            if (pFrame->mvbOutlier[idx])
-            {
-               e->computeError();
-            }
-
-            const float chi2 = e->chi2();
+            const float chi2 = vChi2Stereo[i];
 
             if (chi2 > chi2Stereo[it])
             {
                pFrame->mvbOutlier[idx] = true;
-               e->setLevel(1);
+               solver.SetActiveStereo(i, false);
                nBad++;
             }
             else
             {
-               e->setLevel(0);
+               solver.SetActiveStereo(i, true);
                pFrame->mvbOutlier[idx] = false;
             }
-
-            if (it == 2)
-               e->setRobustKernel(0);
          }
 
-         if (optimizer.edges().size() < 10)
+         if (it == 2)
+            solver.SetRobust(false);
+
+         if (nInitialCorrespondences < 10)
             break;
       }
 
       // Recover optimized pose and return number of inliers
-      g2o::VertexSE3Expmap* vSE3_recov = static_cast<g2o::VertexSE3Expmap*>(optimizer.vertex(0));
-      g2o::SE3Quat SE3quat_recov = vSE3_recov->estimate();
-      cv::Mat pose = Converter::toCvMat(SE3quat_recov);
+      cv::Mat pose = Converter::toCvSE3(solver.GetRotation(), solver.GetTranslation());
       pFrame->SetPose(pose);
 
       Print("end PoseOptimization 2");
       return nInitialCorrespondences - nBad;
    }
 
-   void Optimizer::CreateGraphLocalBundleAdjustment(
-      std::mutex & mutexMapUpdate,
-      KeyFrame * pKF,
-      g2o::SparseOptimizer & optimizer,
-      id_type & maxKFid,
-      list<KeyFrame*> & lLocalKeyFrames,
-      list<MapPoint*> & lLocalMapPoints,
-      vector<g2o::EdgeSE3ProjectXYZ*> & vpEdgesMono,
-      vector<KeyFrame*> & vpEdgeKFMono,
-      vector<MapPoint*> & vpMapPointEdgeMono,
-      vector<g2o::EdgeStereoSE3ProjectXYZ*> & vpEdgesStereo,
-      vector<KeyFrame*> & vpEdgeKFStereo,
-      vector<MapPoint*> & vpMapPointEdgeStereo)
-   {
-      Print("waiting to lock map");
-      unique_lock<mutex> lock(mutexMapUpdate);
-      Print("map is locked");
-
-      lLocalKeyFrames.push_back(pKF);
-      pKF->mnBALocalForKF = pKF->id;
-
-      // Local KeyFrames: First Breath Search from Current Keyframe
-      const vector<KeyFrame*> vNeighKFs = pKF->GetVectorCovisibleKeyFrames();
-      for (int i = 0, iend = vNeighKFs.size(); i < iend; i++)
-      {
-         KeyFrame* pKFi = vNeighKFs[i];
-         pKFi->mnBALocalForKF = pKF->id;
-         if (!pKFi->IsBad())
-            lLocalKeyFrames.push_back(pKFi);
-      }
-
-      // Local MapPoints seen in Local KeyFrames
-      for (list<KeyFrame*>::iterator lit = lLocalKeyFrames.begin(), lend = lLocalKeyFrames.end(); lit != lend; lit++)
-      {
-         vector<MapPoint*> vpMPs = (*lit)->GetMapPointMatches();
-         for (vector<MapPoint*>::iterator vit = vpMPs.begin(), vend = vpMPs.end(); vit != vend; vit++)
-         {
-            MapPoint* pMP = *vit;
-            if (pMP)
-               if (!pMP->IsBad())
-                  if (pMP->mnBALocalForKF != pKF->id)
-                  {
-                     lLocalMapPoints.push_back(pMP);
-                     pMP->mnBALocalForKF = pKF->id;
-                  }
-         }
-      }
-
-      // Fixed Keyframes. Keyframes that see Local MapPoints but that are not Local Keyframes
-      list<KeyFrame*> lFixedCameras;
-      for (list<MapPoint*>::iterator lit = lLocalMapPoints.begin(), lend = lLocalMapPoints.end(); lit != lend; lit++)
-      {
-         std::map<KeyFrame *, size_t> observations = (*lit)->GetObservations();
-         for (std::map<KeyFrame *, size_t>::iterator mit = observations.begin(), mend = observations.end(); mit != mend; mit++)
-         {
-            KeyFrame* pKFi = mit->first;
-
-            if (pKFi->mnBALocalForKF != pKF->id && pKFi->mnBAFixedForKF != pKF->id)
-            {
-               pKFi->mnBAFixedForKF = pKF->id;
-               if (!pKFi->IsBad())
-                  lFixedCameras.push_back(pKFi);
-            }
-         }
-      }
-
-      // Set Local KeyFrame vertices
-      for (list<KeyFrame*>::iterator lit = lLocalKeyFrames.begin(), lend = lLocalKeyFrames.end(); lit != lend; lit++)
-      {
-         KeyFrame* pKFi = *lit;
-         g2o::VertexSE3Expmap * vSE3 = new g2o::VertexSE3Expmap();
-         vSE3->setEstimate(Converter::toSE3Quat(pKFi->GetPose()));
-         vSE3->setId(pKFi->id);
-         vSE3->setFixed(pKFi->id == 0);
-         if (!optimizer.addVertex(vSE3))
-            Print("optimizer.addVertex(vSE3)) failed");
-         if (pKFi->id > maxKFid)
-            maxKFid = pKFi->id;
-      }
-
-      // Set Fixed KeyFrame vertices
-      for (list<KeyFrame*>::iterator lit = lFixedCameras.begin(), lend = lFixedCameras.end(); lit != lend; lit++)
-      {
-         KeyFrame* pKFi = *lit;
-         g2o::VertexSE3Expmap * vSE3 = new g2o::VertexSE3Expmap();
-         vSE3->setEstimate(Converter::toSE3Quat(pKFi->GetPose()));
-         vSE3->setId(pKFi->id);
-         vSE3->setFixed(true);
-         if (!optimizer.addVertex(vSE3))
-            Print("optimizer.addVertex(vSE3) failed");
-         if (pKFi->id > maxKFid)
-            maxKFid = pKFi->id;
-      }
-
-      // Set MapPoint vertices
-      const int nExpectedSize = (lLocalKeyFrames.size() + lFixedCameras.size())*lLocalMapPoints.size();
-
-      vpEdgesMono.reserve(nExpectedSize);
-      vpEdgeKFMono.reserve(nExpectedSize);
-      vpMapPointEdgeMono.reserve(nExpectedSize);
-      vpEdgesStereo.reserve(nExpectedSize);
-      vpEdgeKFStereo.reserve(nExpectedSize);
-      vpMapPointEdgeStereo.reserve(nExpectedSize);
-
-      const float thHuberMono = sqrt(5.991);
-      const float thHuberStereo = sqrt(7.815);
-
-      for (list<MapPoint*>::iterator lit = lLocalMapPoints.begin(), lend = lLocalMapPoints.end(); lit != lend; lit++)
-      {
-         MapPoint* pMP = *lit;
-         g2o::VertexSBAPointXYZ* vPoint = new g2o::VertexSBAPointXYZ();
-         vPoint->setEstimate(Converter::toVector3d(pMP->GetWorldPos()));
-         id_type id = pMP->id + maxKFid + 1;
-         if (id < maxKFid)
-            throw exception("Optimizer::LocalBundleAdjustment: maximum id exceeded");
-         vPoint->setId(id);
-         vPoint->setMarginalized(true);
-         if (!optimizer.addVertex(vPoint))
-            Print("optimizer.addVertex(vPoint) failed");
-
-         const std::map<KeyFrame*, size_t> observations = pMP->GetObservations();
-
-         //Set edges
-         for (std::map<KeyFrame*, size_t>::const_iterator mit = observations.begin(), mend = observations.end(); mit != mend; mit++)
-         {
-            KeyFrame* pKFi = mit->first;
-
-            if (!pKFi->IsBad())
-            {
-               const cv::KeyPoint &kpUn = pKFi->keysUn[mit->second];
-
-               // Monocular observation
-               if (pKFi->right[mit->second] < 0)
-               {
-                  Eigen::Matrix<double, 2, 1> obs;
-                  obs << kpUn.pt.x, kpUn.pt.y;
-
-                  g2o::EdgeSE3ProjectXYZ* e = new g2o::EdgeSE3ProjectXYZ();
-
-                  e->setVertex(0, dynamic_cast<g2o::OptimizableGraph::Vertex*>(optimizer.vertex(id)));
-                  e->setVertex(1, dynamic_cast<g2o::OptimizableGraph::Vertex*>(optimizer.vertex(pKFi->id)));
-                  e->setMeasurement(obs);
-                  const float &invSigma2 = pKFi->invLevelSigma2[kpUn.octave];
-                  e->setInformation(Eigen::Matrix2d::Identity()*invSigma2);
-
-                  g2o::RobustKernelHuber* rk = new g2o::RobustKernelHuber;
-                  e->setRobustKernel(rk);
-                  rk->setDelta(thHuberMono);
-
-                  e->fx = pKFi->mFC.fx;
-                  e->fy = pKFi->mFC.fy;
-                  e->cx = pKFi->mFC.cx;
-                  e->cy = pKFi->mFC.cy;
-
-                  optimizer.addEdge(e);
-                  vpEdgesMono.push_back(e);
-                  vpEdgeKFMono.push_back(pKFi);
-                  vpMapPointEdgeMono.push_back(pMP);
-               }
-               else // Stereo observation
-               {
-                  Eigen::Matrix<double, 3, 1> obs;
-                  const float kp_ur = pKFi->right[mit->second];
-                  obs << kpUn.pt.x, kpUn.pt.y, kp_ur;
-
-                  g2o::EdgeStereoSE3ProjectXYZ* e = new g2o::EdgeStereoSE3ProjectXYZ();
-
-                  e->setVertex(0, dynamic_cast<g2o::OptimizableGraph::Vertex*>(optimizer.vertex(id)));
-                  e->setVertex(1, dynamic_cast<g2o::OptimizableGraph::Vertex*>(optimizer.vertex(pKFi->id)));
-                  e->setMeasurement(obs);
-                  const float &invSigma2 = pKFi->invLevelSigma2[kpUn.octave];
-                  Eigen::Matrix3d Info = Eigen::Matrix3d::Identity()*invSigma2;
-                  e->setInformation(Info);
-
-                  g2o::RobustKernelHuber* rk = new g2o::RobustKernelHuber;
-                  e->setRobustKernel(rk);
-                  rk->setDelta(thHuberStereo);
-
-                  e->fx = pKFi->mFC.fx;
-                  e->fy = pKFi->mFC.fy;
-                  e->cx = pKFi->mFC.cx;
-                  e->cy = pKFi->mFC.cy;
-                  e->bf = pKFi->mFC.blfx;
-
-                  optimizer.addEdge(e);
-                  vpEdgesStereo.push_back(e);
-                  vpEdgeKFStereo.push_back(pKFi);
-                  vpMapPointEdgeStereo.push_back(pMP);
-               }
-            }
-         }
-      }
-   }
-
-   void Optimizer::CheckGraphLocalBundleAdjustment(
-      std::mutex & mutexMapUpdate,
-      vector<g2o::EdgeSE3ProjectXYZ*> & vpEdgesMono,
-      vector<MapPoint*> & vpMapPointEdgeMono,
-      vector<g2o::EdgeStereoSE3ProjectXYZ*> & vpEdgesStereo,
-      vector<MapPoint*> & vpMapPointEdgeStereo)
-   {
-      Print("waiting to lock map");
-      unique_lock<mutex> lock(mutexMapUpdate);
-      Print("map is locked");
-
-      // Check inlier observations
-      for (size_t i = 0, iend = vpEdgesMono.size(); i < iend;i++)
-      {
-         g2o::EdgeSE3ProjectXYZ* e = vpEdgesMono[i];
-         MapPoint* pMP = vpMapPointEdgeMono[i];
-
-         if (pMP->IsBad())
-            continue;
-
-         if (e->chi2() > 5.991 || !e->isDepthPositive())
-         {
-            e->setLevel(1);
-         }
-
-         e->setRobustKernel(0);
-      }
-
-      for (size_t i = 0, iend = vpEdgesStereo.size(); i < iend;i++)
-      {
-         g2o::EdgeStereoSE3ProjectXYZ* e = vpEdgesStereo[i];
-         MapPoint* pMP = vpMapPointEdgeStereo[i];
-
-         if (pMP->IsBad())
-            continue;
-
-         if (e->chi2() > 7.815 || !e->isDepthPositive())
-         {
-            e->setLevel(1);
-         }
-
-         e->setRobustKernel(0);
-      }
-   }
-
-   void Optimizer::RecoverGraphLocalBundleAdjustment(
-      Map & theMap, 
-      g2o::SparseOptimizer & optimizer,
-      id_type & maxKFid,
-      list<KeyFrame*> & lLocalKeyFrames,
-      list<MapPoint*> & lLocalMapPoints,
-      vector<g2o::EdgeSE3ProjectXYZ*> & vpEdgesMono,
-      vector<KeyFrame*> & vpEdgeKFMono,
-      vector<MapPoint*> & vpMapPointEdgeMono,
-      vector<g2o::EdgeStereoSE3ProjectXYZ*> & vpEdgesStereo,
-      vector<KeyFrame*> & vpEdgeKFStereo,
-      vector<MapPoint*> & vpMapPointEdgeStereo)
-   {
-      vector<pair<KeyFrame*, MapPoint*> > vToErase;
-      vToErase.reserve(vpEdgesMono.size() + vpEdgesStereo.size());
-
-      // Check inlier observations       
-      for (size_t i = 0, iend = vpEdgesMono.size(); i < iend;i++)
-      {
-         g2o::EdgeSE3ProjectXYZ* e = vpEdgesMono[i];
-         MapPoint* pMP = vpMapPointEdgeMono[i];
-
-         if (pMP->IsBad())
-            continue;
-
-         if (e->chi2() > 5.991 || !e->isDepthPositive())
-         {
-            KeyFrame* pKFi = vpEdgeKFMono[i];
-            vToErase.push_back(make_pair(pKFi, pMP));
-         }
-      }
-
-      for (size_t i = 0, iend = vpEdgesStereo.size(); i < iend;i++)
-      {
-         g2o::EdgeStereoSE3ProjectXYZ* e = vpEdgesStereo[i];
-         MapPoint* pMP = vpMapPointEdgeStereo[i];
-
-         if (pMP->IsBad())
-            continue;
-
-         if (e->chi2() > 7.815 || !e->isDepthPositive())
-         {
-            KeyFrame* pKFi = vpEdgeKFStereo[i];
-            vToErase.push_back(make_pair(pKFi, pMP));
-         }
-      }
-
-      // Get Map Mutex
-      Print("waiting to lock map");
-      unique_lock<mutex> lock(theMap.mutexMapUpdate);
-      Print("map is locked");
-
-      if (!vToErase.empty())
-      {
-         for (size_t i = 0; i < vToErase.size(); i++)
-         {
-            KeyFrame* pKFi = vToErase[i].first;
-            MapPoint* pMPi = vToErase[i].second;
-            theMap.Unlink(*pMPi, *pKFi);
-            if (pMPi->Observations() <= 2)
-               theMap.EraseMapPoint(pMPi);
-         }
-      }
-
-      // Recover optimized data
-
-      //Keyframes
-      for (list<KeyFrame*>::iterator lit = lLocalKeyFrames.begin(), lend = lLocalKeyFrames.end(); lit != lend; lit++)
-      {
-         KeyFrame* pKF = *lit;
-         g2o::VertexSE3Expmap* vSE3 = static_cast<g2o::VertexSE3Expmap*>(optimizer.vertex(pKF->id));
-         g2o::SE3Quat SE3quat = vSE3->estimate();
-         pKF->SetPose(Converter::toCvMat(SE3quat));
-      }
-
-      //Points
-      for (list<MapPoint*>::iterator lit = lLocalMapPoints.begin(), lend = lLocalMapPoints.end(); lit != lend; lit++)
-      {
-         MapPoint* pMP = *lit;
-         g2o::VertexSBAPointXYZ* vPoint = static_cast<g2o::VertexSBAPointXYZ*>(optimizer.vertex(pMP->id + maxKFid + 1));
-         pMP->SetWorldPos(Converter::toCvMat(vPoint->estimate()));
-         pMP->UpdateNormalAndDepth();
-      }
-   }
-
-   void Optimizer::LocalBundleAdjustment(
-      KeyFrame * pKF,
-      bool * pbStopFlag,
-      Map & theMap)
-   {
-      Print("begin LocalBundleAdjustment");
-
-      // Setup optimizer
-      g2o::SparseOptimizer optimizer;
-      g2o::BlockSolver_6_3::LinearSolverType * linearSolver;
-
-      linearSolver = new g2o::LinearSolverEigen<g2o::BlockSolver_6_3::PoseMatrixType>();
-
-      g2o::BlockSolver_6_3 * solver_ptr = new g2o::BlockSolver_6_3(linearSolver);
-
-      g2o::OptimizationAlgorithmLevenberg* solver = new g2o::OptimizationAlgorithmLevenberg(solver_ptr);
-      optimizer.setAlgorithm(solver);
-
-      if (pbStopFlag)
-         optimizer.setForceStopFlag(pbStopFlag);
-
-      id_type maxKFid = 0;
-      list<KeyFrame*> lLocalKeyFrames;
-      list<MapPoint*> lLocalMapPoints;
-      vector<g2o::EdgeSE3ProjectXYZ*> vpEdgesMono;
-      vector<KeyFrame*> vpEdgeKFMono;
-      vector<MapPoint*> vpMapPointEdgeMono;
-      vector<g2o::EdgeStereoSE3ProjectXYZ*> vpEdgesStereo;
-      vector<KeyFrame*> vpEdgeKFStereo;
-      vector<MapPoint*> vpMapPointEdgeStereo;
-
-      CreateGraphLocalBundleAdjustment(theMap.mutexMapUpdate, pKF, optimizer, maxKFid, lLocalKeyFrames, lLocalMapPoints, 
-         vpEdgesMono, vpEdgeKFMono, vpMapPointEdgeMono, vpEdgesStereo, vpEdgeKFStereo, vpMapPointEdgeStereo);
-
-      if (pbStopFlag)
-         if (*pbStopFlag)
-         {
-            Print("end LocalBundleAdjustment 1");
-            return;
-         }
-
-      if (optimizer.initializeOptimization())
-         optimizer.optimize(5);
-      else
-         throw exception("optimizer.initializeOptimization() failed");
-
-      bool bDoMore = true;
-
-      if (pbStopFlag)
-         if (*pbStopFlag)
-            bDoMore = false;
-
-      if (bDoMore)
-      {
-         CheckGraphLocalBundleAdjustment(theMap.mutexMapUpdate, vpEdgesMono, vpMapPointEdgeMono, vpEdgesStereo, vpMapPointEdgeStereo);
-
-         // Optimize again without the outliers
-         if (optimizer.initializeOptimization())
-            optimizer.optimize(10);
-         else
-            throw exception("optimizer.initializeOptimization() failed");
-
-      }
-
-      RecoverGraphLocalBundleAdjustment(theMap, optimizer,
-         maxKFid, lLocalKeyFrames, lLocalMapPoints,
-         vpEdgesMono, vpEdgeKFMono, vpMapPointEdgeMono,
-         vpEdgesStereo, vpEdgeKFStereo, vpMapPointEdgeStereo);
-
-      Print("end LocalBundleAdjustment 2");
-   }
-
    void Optimizer::CreateGraphOptimize(
       KeyFrame * pCurKF,
       KeyFrame * pLoopKF, 
@@ -955,8 +478,8 @@ namespace ORB_SLAM2_TEAM
          }
          else
          {
-            Eigen::Matrix<double, 3, 3> Rcw = Converter::toMatrix3d(pKF->GetRotation());
-            Eigen::Matrix<double, 3, 1> tcw = Converter::toVector3d(pKF->GetTranslation());
+            Eigen::Matrix<double, 3, 3> Rcw = Converter::toMatrix3d(pKF->GetRotationMatx());
+            Eigen::Matrix<double, 3, 1> tcw = Converter::toVector3d(pKF->GetTranslationVec());
             g2o::Sim3 Siw(Rcw, tcw, 1.0);
             vScw[nIDi] = Siw;
             VSim3->setEstimate(Siw);
@@ -1190,7 +713,8 @@ namespace ORB_SLAM2_TEAM
       const LoopClosing::KeyFrameAndPose & NonCorrectedSim3,
       const LoopClosing::KeyFrameAndPose & CorrectedSim3,
       const std::map<KeyFrame *, set<KeyFrame *> > & LoopConnections, 
-      const bool & bFixScale)
+      const bool & bFixScale,
+      const int nThreads)
    {
       Print("begin OptimizeEssentialGraph");
 
@@ -1204,9 +728,12 @@ namespace ORB_SLAM2_TEAM
 
       solver->setUserLambdaInit(1e-16);
       optimizer.setAlgorithm(solver);
+      optimizer.setNumThreads(nThreads);
 
-      const vector<KeyFrame*> vpKFs = theMap.GetAllKeyFrames();
-      const vector<MapPoint*> vpMPs = theMap.GetAllMapPoints();
+      Map::KeyFrameSnapshot pKFs = theMap.GetKeyFrameSnapshot();
+      Map::MapPointSnapshot pMPs = theMap.GetMapPointSnapshot();
+      const vector<KeyFrame*> & vpKFs = *pKFs;
+      const vector<MapPoint*> & vpMPs = *pMPs;
 
       const unsigned int nMaxKFid = theMap.GetMaxKFid();
 
@@ -1353,14 +880,16 @@ namespace ORB_SLAM2_TEAM
 
          // Set edge x1 = S12*X2
          Eigen::Matrix<double, 2, 1> obs1;
-         const cv::KeyPoint &kpUn1 = pKF1->keysUn[i];
-         obs1 << kpUn1.pt.x, kpUn1.pt.y;
+         const float kpUn1X = pKF1->features.X(i);
+         const float kpUn1Y = pKF1->features.Y(i);
+         const int kpUn1Octave = pKF1->features.Octave(i);
+         obs1 << kpUn1X, kpUn1Y;
 
          g2o::EdgeSim3ProjectXYZ* e12 = new g2o::EdgeSim3ProjectXYZ();
          e12->setVertex(0, dynamic_cast<g2o::OptimizableGraph::Vertex*>(optimizer.vertex(id2)));
          e12->setVertex(1, dynamic_cast<g2o::OptimizableGraph::Vertex*>(optimizer.vertex(0)));
          e12->setMeasurement(obs1);
-         const float &invSigmaSquare1 = pKF1->invLevelSigma2[kpUn1.octave];
+         const float &invSigmaSquare1 = pKF1->invLevelSigma2[kpUn1Octave];
          e12->setInformation(Eigen::Matrix2d::Identity()*invSigmaSquare1);
 
          g2o::RobustKernelHuber* rk1 = new g2o::RobustKernelHuber;
@@ -1370,15 +899,17 @@ namespace ORB_SLAM2_TEAM
 
          // Set edge x2 = S21*X1
          Eigen::Matrix<double, 2, 1> obs2;
-         const cv::KeyPoint &kpUn2 = pKF2->keysUn[i2];
-         obs2 << kpUn2.pt.x, kpUn2.pt.y;
+         const float kpUn2X = pKF2->features.X(i2);
+         const float kpUn2Y = pKF2->features.Y(i2);
+         const int kpUn2Octave = pKF2->features.Octave(i2);
+         obs2 << kpUn2X, kpUn2Y;
 
          g2o::EdgeInverseSim3ProjectXYZ* e21 = new g2o::EdgeInverseSim3ProjectXYZ();
 
          e21->setVertex(0, dynamic_cast<g2o::OptimizableGraph::Vertex*>(optimizer.vertex(id1)));
          e21->setVertex(1, dynamic_cast<g2o::OptimizableGraph::Vertex*>(optimizer.vertex(0)));
          e21->setMeasurement(obs2);
-         float invSigmaSquare2 = pKF2->invLevelSigma2[kpUn2.octave];
+         float invSigmaSquare2 = pKF2->invLevelSigma2[kpUn2Octave];
          e21->setInformation(Eigen::Matrix2d::Identity()*invSigmaSquare2);
 
          g2o::RobustKernelHuber* rk2 = new g2o::RobustKernelHuber;
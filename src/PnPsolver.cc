@@ -56,7 +56,6 @@
 
 #include <vector>
 #include <cmath>
-#include "DUtils/Random.h"
 #include <algorithm>
 
 using namespace std;
@@ -65,10 +64,35 @@ namespace ORB_SLAM2_TEAM
 {
 
 
-   PnPsolver::PnPsolver(const Frame &F, const vector<MapPoint*> &vpMapPointMatches) :
+   PnPsolver::PnPsolver() :
       pws(0), us(0), alphas(0), pcs(0), maximum_number_of_correspondences(0), number_of_correspondences(0), mnInliersi(0),
       mnIterations(0), mnBestInliers(0), N(0)
    {
+   }
+
+   PnPsolver::PnPsolver(const Frame &F, const vector<MapPoint*> &vpMapPointMatches) : PnPsolver()
+   {
+      Initialize(F, vpMapPointMatches);
+   }
+
+   void PnPsolver::Initialize(const Frame &F, const vector<MapPoint*> &vpMapPointMatches)
+   {
+      number_of_correspondences = 0;
+      mnInliersi = 0;
+      mnIterations = 0;
+      mnBestInliers = 0;
+      mvbBestInliers.clear();
+      mBestTcw.release();
+      mRefinedTcw.release();
+      mvbRefinedInliers.clear();
+      mnRefinedInliers = 0;
+
+      mvP2D.clear();
+      mvSigma2.clear();
+      mvP3Dw.clear();
+      mvKeyPointIndices.clear();
+      mvAllIndices.clear();
+
       mvpMapPointMatches = vpMapPointMatches;
       mvP2D.reserve(F.mvpMapPoints.size());
       mvSigma2.reserve(F.mvpMapPoints.size());
@@ -85,10 +109,8 @@ namespace ORB_SLAM2_TEAM
          {
             if (!pMP->IsBad())
             {
-               const cv::KeyPoint &kp = F.mvKeysUn[i];
-
-               mvP2D.push_back(kp.pt);
-               mvSigma2.push_back(F.mvLevelSigma2[kp.octave]);
+               mvP2D.push_back(cv::Point2f(F.mFeatures.X(i), F.mFeatures.Y(i)));
+               mvSigma2.push_back(F.mvLevelSigma2[F.mFeatures.Octave(i)]);
 
                cv::Mat Pos = pMP->GetWorldPos();
                mvP3Dw.push_back(cv::Point3f(Pos.at<float>(0), Pos.at<float>(1), Pos.at<float>(2)));
@@ -110,6 +132,11 @@ namespace ORB_SLAM2_TEAM
       SetRansacParameters();
    }
 
+   void PnPsolver::SetSeed(unsigned int seed)
+   {
+      mRandom.seed(seed);
+   }
+
    PnPsolver::~PnPsolver()
    {
       delete[] pws;
@@ -177,8 +204,6 @@ namespace ORB_SLAM2_TEAM
          return cv::Mat();
       }
 
-      vector<size_t> vAvailableIndices;
-
       int nCurrentIterations = 0;
       while (mnIterations < mRansacMaxIts || nCurrentIterations < nIterations)
       {
@@ -186,19 +211,19 @@ namespace ORB_SLAM2_TEAM
          mnIterations++;
          reset_correspondences();
 
-         vAvailableIndices = mvAllIndices;
+         mvAvailableIndices = mvAllIndices;
 
          // Get min set of points
          for (short i = 0; i < mRansacMinSet; ++i)
          {
-            int randi = DUtils::Random::RandomInt(0, vAvailableIndices.size() - 1);
+            int randi = uniform_int_distribution<int>(0, mvAvailableIndices.size() - 1)(mRandom);
 
-            int idx = vAvailableIndices[randi];
+            int idx = mvAvailableIndices[randi];
 
             add_correspondence(mvP3Dw[idx].x, mvP3Dw[idx].y, mvP3Dw[idx].z, mvP2D[idx].x, mvP2D[idx].y);
 
-            vAvailableIndices[randi] = vAvailableIndices.back();
-            vAvailableIndices.pop_back();
+            mvAvailableIndices[randi] = mvAvailableIndices.back();
+            mvAvailableIndices.pop_back();
          }
 
          // Compute camera pose
@@ -0,0 +1,351 @@
+/**
+* This file is part of ORB-SLAM2-TEAM.
+*
+* Copyright (C) 2018 Joe Bedard <mr dot joe dot bedard at gmail dot com>
+* For more information see <https://github.com/joebedard/ORB_SLAM2_TEAM>
+*
+* ORB-SLAM2-TEAM is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2-TEAM is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2-TEAM. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "PoseSolver.h"
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#include <Eigen/Cholesky>
+
+namespace ORB_SLAM2_TEAM
+{
+
+   PoseSolver::PoseSolver(const double fx, const double fy, const double cx, const double cy, const double bf,
+      const double deltaMono, const double deltaStereo)
+      : mfx(fx)
+      , mfy(fy)
+      , mcx(cx)
+      , mcy(cy)
+      , mbf(bf)
+      , mDeltaMono(deltaMono)
+      , mDeltaStereo(deltaStereo)
+      , mbRobust(true)
+      , mRotation(Eigen::Quaterniond::Identity())
+      , mTranslation(Eigen::Vector3d::Zero())
+   {
+   }
+
+   void PoseSolver::Reserve(size_t n)
+   {
+      Observations * obs[2] = { &mMono, &mStereo };
+      for (Observations * o : obs)
+      {
+         o->X.reserve(n);
+         o->Y.reserve(n);
+         o->Z.reserve(n);
+         o->u.reserve(n);
+         o->v.reserve(n);
+         o->invSigma2.reserve(n);
+         o->active.reserve(n);
+      }
+      mStereo.ur.reserve(n);
+   }
+
+   size_t PoseSolver::AddMono(const float * Xw, const double u, const double v, const double invSigma2)
+   {
+      mMono.X.push_back(Xw[0]);
+      mMono.Y.push_back(Xw[1]);
+      mMono.Z.push_back(Xw[2]);
+      mMono.u.push_back(u);
+      mMono.v.push_back(v);
+      mMono.invSigma2.push_back(invSigma2);
+      mMono.active.push_back(true);
+      return mMono.u.size() - 1;
+   }
+
+   size_t PoseSolver::AddStereo(const float * Xw, const double u, const double v, const double ur, const double invSigma2)
+   {
+      mStereo.X.push_back(Xw[0]);
+      mStereo.Y.push_back(Xw[1]);
+      mStereo.Z.push_back(Xw[2]);
+      mStereo.u.push_back(u);
+      mStereo.v.push_back(v);
+      mStereo.ur.push_back(ur);
+      mStereo.invSigma2.push_back(invSigma2);
+      mStereo.active.push_back(true);
+      return mStereo.u.size() - 1;
+   }
+
+   void PoseSolver::SetPose(const Eigen::Matrix3d & Rcw, const Eigen::Vector3d & tcw)
+   {
+      mRotation = Eigen::Quaterniond(Rcw);
+      mRotation.normalize();
+      mTranslation = tcw;
+   }
+
+   Eigen::Matrix3d PoseSolver::GetRotation() const
+   {
+      return mRotation.toRotationMatrix();
+   }
+
+   Eigen::Vector3d PoseSolver::GetTranslation() const
+   {
+      return mTranslation;
+   }
+
+   double PoseSolver::Accumulate(Matrix6d * H, Vector6d * b) const
+   {
+      const Eigen::Matrix3d R = mRotation.toRotationMatrix();
+      const double r00 = R(0, 0), r01 = R(0, 1), r02 = R(0, 2);
+      const double r10 = R(1, 0), r11 = R(1, 1), r12 = R(1, 2);
+      const double r20 = R(2, 0), r21 = R(2, 1), r22 = R(2, 2);
+      const double t0 = mTranslation[0], t1 = mTranslation[1], t2 = mTranslation[2];
+
+      // only the upper triangle is accumulated
+      double h[21] = { 0 };
+      double g[6] = { 0 };
+      double chi2 = 0.0;
+
+      // adds w * J^T J to h and -w * J^T e to g for one row of the Jacobian
+      auto addRow = [&h, &g](const double * J, const double w, const double e)
+      {
+         for (int r = 0, k = 0; r < 6; r++)
+         {
+            const double wJr = w * J[r];
+            g[r] -= wJr * e;
+            for (int c = r; c < 6; c++, k++)
+               h[k] += wJr * J[c];
+         }
+      };
+
+      const double deltaMono2 = mDeltaMono * mDeltaMono;
+      for (size_t i = 0, n = mMono.u.size(); i < n; i++)
+      {
+         if (!mMono.active[i])
+            continue;
+
+         const double x = r00 * mMono.X[i] + r01 * mMono.Y[i] + r02 * mMono.Z[i] + t0;
+         const double y = r10 * mMono.X[i] + r11 * mMono.Y[i] + r12 * mMono.Z[i] + t1;
+         const double z = r20 * mMono.X[i] + r21 * mMono.Y[i] + r22 * mMono.Z[i] + t2;
+
+         const double ex = mMono.u[i] - (x / z * mfx + mcx);
+         const double ey = mMono.v[i] - (y / z * mfy + mcy);
+         const double invSigma2 = mMono.invSigma2[i];
+         const double e2 = invSigma2 * (ex * ex + ey * ey);
+
+         // Huber kernel, the weight is rho'(e2)
+         double w = 1.0;
+         if (mbRobust && e2 > deltaMono2)
+         {
+            const double sqrte = sqrt(e2);
+            chi2 += 2.0 * sqrte * mDeltaMono - deltaMono2;
+            w = mDeltaMono / sqrte;
+         }
+         else
+            chi2 += e2;
+
+         if (H == NULL)
+            continue;
+
+         const double invz = 1.0 / z;
+         const double invz_2 = invz * invz;
+         const double Jx[6] = { x * y * invz_2 * mfx, -(1 + (x * x * invz_2)) * mfx, y * invz * mfx, -invz * mfx, 0, x * invz_2 * mfx };
+         const double Jy[6] = { (1 + y * y * invz_2) * mfy, -x * y * invz_2 * mfy, -x * invz * mfy, 0, -invz * mfy, y * invz_2 * mfy };
+         addRow(Jx, w * invSigma2, ex);
+         addRow(Jy, w * invSigma2, ey);
+      }
+
+      const double deltaStereo2 = mDeltaStereo * mDeltaStereo;
+      for (size_t i = 0, n = mStereo.u.size(); i < n; i++)
+      {
+         if (!mStereo.active[i])
+            continue;
+
+         const double x = r00 * mStereo.X[i] + r01 * mStereo.Y[i] + r02 * mStereo.Z[i] + t0;
+         const double y = r10 * mStereo.X[i] + r11 * mStereo.Y[i] + r12 * mStereo.Z[i] + t1;
+         const double z = r20 * mStereo.X[i] + r21 * mStereo.Y[i] + r22 * mStereo.Z[i] + t2;
+
+         // the projection uses a float inverse depth, as EdgeStereoSE3ProjectXYZOnlyPose::cam_project
+         const float invzf = 1.0f / z;
+         const double pu = x * invzf * mfx + mcx;
+         const double ex = mStereo.u[i] - pu;
+         const double ey = mStereo.v[i] - (y * invzf * mfy + mcy);
+         const double er = mStereo.ur[i] - (pu - mbf * invzf);
+         const double invSigma2 = mStereo.invSigma2[i];
+         const double e2 = invSigma2 * (ex * ex + ey * ey + er * er);
+
+         double w = 1.0;
+         if (mbRobust && e2 > deltaStereo2)
+         {
+            const double sqrte = sqrt(e2);
+            chi2 += 2.0 * sqrte * mDeltaStereo - deltaStereo2;
+            w = mDeltaStereo / sqrte;
+         }
+         else
+            chi2 += e2;
+
+         if (H == NULL)
+            continue;
+
+         const double invz = 1.0 / z;
+         const double invz_2 = invz * invz;
+         const double Jx[6] = { x * y * invz_2 * mfx, -(1 + (x * x * invz_2)) * mfx, y * invz * mfx, -invz * mfx, 0, x * invz_2 * mfx };
+         const double Jy[6] = { (1 + y * y * invz_2) * mfy, -x * y * invz_2 * mfy, -x * invz * mfy, 0, -invz * mfy, y * invz_2 * mfy };
+         const double Jr[6] = { Jx[0] - mbf * y * invz_2, Jx[1] + mbf * x * invz_2, Jx[2], Jx[3], 0, Jx[5] - mbf * invz_2 };
+         addRow(Jx, w * invSigma2, ex);
+         addRow(Jy, w * invSigma2, ey);
+         addRow(Jr, w * invSigma2, er);
+      }
+
+      if (H != NULL)
+      {
+         for (int r = 0, k = 0; r < 6; r++)
+         {
+            (*b)[r] = g[r];
+            for (int c = r; c < 6; c++, k++)
+            {
+               (*H)(r, c) = h[k];
+               (*H)(c, r) = h[k];
+            }
+         }
+      }
+
+      return chi2;
+   }
+
+   void PoseSolver::ApplyUpdate(const Vector6d & update)
+   {
+      const Eigen::Vector3d omega = update.head<3>();
+      const Eigen::Vector3d upsilon = update.tail<3>();
+
+      const double theta = omega.norm();
+      Eigen::Matrix3d Omega;
+      Omega << 0, -omega[2], omega[1],
+         omega[2], 0, -omega[0],
+         -omega[1], omega[0], 0;
+
+      Eigen::Matrix3d R, V;
+      if (theta < 0.00001)
+      {
+         R = Eigen::Matrix3d::Identity() + Omega + Omega * Omega;
+         V = R;
+      }
+      else
+      {
+         const Eigen::Matrix3d Omega2 = Omega * Omega;
+         R = Eigen::Matrix3d::Identity() + sin(theta) / theta * Omega + (1 - cos(theta)) / (theta * theta) * Omega2;
+         V = Eigen::Matrix3d::Identity() + (1 - cos(theta)) / (theta * theta) * Omega + (theta - sin(theta)) / pow(theta, 3) * Omega2;
+      }
+
+      Eigen::Quaterniond q(R);
+      q.normalize();
+      mTranslation = q * mTranslation + V * upsilon;
+      mRotation = q * mRotation;
+      mRotation.normalize();
+   }
+
+   void PoseSolver::Optimize(int nIterations)
+   {
+      double lambda = 0.0;
+      double ni = 2.0;
+      int nBad = 0;
+
+      Matrix6d H;
+      Vector6d b;
+      for (int it = 0; it < nIterations; it++)
+      {
+         double currentChi = Accumulate(&H, &b);
+         const double iniChi = currentChi;
+
+         if (it == 0)
+            lambda = 1e-5 * H.diagonal().cwiseAbs().maxCoeff();
+
+         double rho = 0.0;
+         int nTrials = 0;
+         do
+         {
+            const Eigen::Quaterniond lastRotation = mRotation;
+            const Eigen::Vector3d lastTranslation = mTranslation;
+
+            Matrix6d Hl = H;
+            Hl.diagonal().array() += lambda;
+            Eigen::LDLT<Matrix6d> ldlt(Hl);
+            Vector6d dx = Vector6d::Zero();
+            const bool ok = ldlt.isPositive();
+            if (ok)
+               dx = ldlt.solve(b);
+
+            ApplyUpdate(dx);
+            double tempChi = Accumulate(NULL, NULL);
+            if (!ok)
+               tempChi = numeric_limits<double>::max();
+
+            rho = (currentChi - tempChi) / (dx.dot(lambda * dx + b) + 1e-3);
+            if (rho > 0 && std::isfinite(tempChi))
+            {
+               // good step
+               const double alpha = min(1.0 - pow(2 * rho - 1, 3), 2.0 / 3.0);
+               lambda *= max(1.0 / 3.0, alpha);
+               ni = 2.0;
+               currentChi = tempChi;
+            }
+            else
+            {
+               lambda *= ni;
+               ni *= 2.0;
+               mRotation = lastRotation;
+               mTranslation = lastTranslation;
+            }
+            nTrials++;
+         } while (rho < 0 && nTrials < 10);
+
+         if (nTrials == 10 || rho == 0)
+            break;
+
+         // stop when the error barely decreases three times in a row
+         if ((iniChi - currentChi) * 1e3 < iniChi)
+            nBad++;
+         else
+            nBad = 0;
+
+         if (nBad >= 3)
+            break;
+      }
+   }
+
+   void PoseSolver::ComputeChi2(vector<double> & vChi2Mono, vector<double> & vChi2Stereo) const
+   {
+      const Eigen::Matrix3d R = mRotation.toRotationMatrix();
+
+      vChi2Mono.resize(mMono.u.size());
+      for (size_t i = 0, n = mMono.u.size(); i < n; i++)
+      {
+         const Eigen::Vector3d Xc = R * Eigen::Vector3d(mMono.X[i], mMono.Y[i], mMono.Z[i]) + mTranslation;
+         const double ex = mMono.u[i] - (Xc[0] / Xc[2] * mfx + mcx);
+         const double ey = mMono.v[i] - (Xc[1] / Xc[2] * mfy + mcy);
+         vChi2Mono[i] = mMono.invSigma2[i] * (ex * ex + ey * ey);
+      }
+
+      vChi2Stereo.resize(mStereo.u.size());
+      for (size_t i = 0, n = mStereo.u.size(); i < n; i++)
+      {
+         const Eigen::Vector3d Xc = R * Eigen::Vector3d(mStereo.X[i], mStereo.Y[i], mStereo.Z[i]) + mTranslation;
+         const float invzf = 1.0f / Xc[2];
+         const double pu = Xc[0] * invzf * mfx + mcx;
+         const double ex = mStereo.u[i] - pu;
+         const double ey = mStereo.v[i] - (Xc[1] * invzf * mfy + mcy);
+         const double er = mStereo.ur[i] - (pu - mbf * invzf);
+         vChi2Stereo[i] = mStereo.invSigma2[i] * (ex * ex + ey * ey + er * er);
+      }
+   }
+
+}
@@ -26,15 +26,39 @@
 #include <vector>
 #include <cmath>
 
-#include "DUtils/Random.h"
-
 namespace ORB_SLAM2_TEAM
 {
 
 
-   Sim3Solver::Sim3Solver(KeyFrame *pKF1, KeyFrame *pKF2, const vector<MapPoint *> &vpMatched12, const bool bFixScale) :
-      mnIterations(0), mnBestInliers(0), mbFixScale(bFixScale)
+   Sim3Solver::Sim3Solver() :
+      mpKF1(NULL), mpKF2(NULL), N(0), mN1(0), mnInliersi(0), mnIterations(0), mnBestInliers(0), mbFixScale(true)
    {
+   }
+
+   Sim3Solver::Sim3Solver(KeyFrame *pKF1, KeyFrame *pKF2, const vector<MapPoint *> &vpMatched12, const bool bFixScale) : Sim3Solver()
+   {
+      Initialize(pKF1, pKF2, vpMatched12, bFixScale);
+   }
+
+   void Sim3Solver::Initialize(KeyFrame *pKF1, KeyFrame *pKF2, const vector<MapPoint *> &vpMatched12, const bool bFixScale)
+   {
+      mnIterations = 0;
+      mnBestInliers = 0;
+      mvbBestInliers.clear();
+      mBestT12.release();
+      mBestRotation.release();
+      mBestTranslation.release();
+      mbFixScale = bFixScale;
+
+      mvX3Dc1.clear();
+      mvX3Dc2.clear();
+      mvpMapPoints1.clear();
+      mvpMapPoints2.clear();
+      mvnIndices1.clear();
+      mvnMaxError1.clear();
+      mvnMaxError2.clear();
+      mvAllIndices.clear();
+
       mpKF1 = pKF1;
       mpKF2 = pKF2;
 
@@ -76,11 +100,8 @@ namespace ORB_SLAM2_TEAM
             if (indexKF1 < 0 || indexKF2 < 0)
                continue;
 
-            const cv::KeyPoint &kp1 = pKF1->keysUn[indexKF1];
-            const cv::KeyPoint &kp2 = pKF2->keysUn[indexKF2];
-
-            const float sigmaSquare1 = pKF1->levelSigma2[kp1.octave];
-            const float sigmaSquare2 = pKF2->levelSigma2[kp2.octave];
+            const float sigmaSquare1 = pKF1->levelSigma2[pKF1->features.Octave(indexKF1)];
+            const float sigmaSquare2 = pKF2->levelSigma2[pKF2->features.Octave(indexKF2)];
 
             mvnMaxError1.push_back(9.210*sigmaSquare1);
             mvnMaxError2.push_back(9.210*sigmaSquare2);
@@ -109,6 +130,11 @@ namespace ORB_SLAM2_TEAM
       SetRansacParameters();
    }
 
+   void Sim3Solver::SetSeed(unsigned int seed)
+   {
+      mRandom.seed(seed);
+   }
+
    void Sim3Solver::SetRansacParameters(double probability, int minInliers, int maxIterations)
    {
       mRansacProb = probability;
@@ -147,8 +173,6 @@ namespace ORB_SLAM2_TEAM
          return cv::Mat();
       }
 
-      vector<size_t> vAvailableIndices;
-
       cv::Mat P3Dc1i(3, 3, CV_32F);
       cv::Mat P3Dc2i(3, 3, CV_32F);
 
@@ -158,20 +182,20 @@ namespace ORB_SLAM2_TEAM
          nCurrentIterations++;
          mnIterations++;
 
-         vAvailableIndices = mvAllIndices;
+         mvAvailableIndices = mvAllIndices;
 
          // Get min set of points
          for (short i = 0; i < 3; ++i)
          {
-            int randi = DUtils::Random::RandomInt(0, vAvailableIndices.size() - 1);
+            int randi = uniform_int_distribution<int>(0, mvAvailableIndices.size() - 1)(mRandom);
 
-            int idx = vAvailableIndices[randi];
+            int idx = mvAvailableIndices[randi];
 
             mvX3Dc1[idx].copyTo(P3Dc1i.col(i));
             mvX3Dc2[idx].copyTo(P3Dc2i.col(i));
 
-            vAvailableIndices[randi] = vAvailableIndices.back();
-            vAvailableIndices.pop_back();
+            mvAvailableIndices[randi] = mvAvailableIndices.back();
+            mvAvailableIndices.pop_back();
          }
 
          ComputeSim3(P3Dc1i, P3Dc2i);
@@ -337,19 +361,25 @@ namespace ORB_SLAM2_TEAM
 
    void Sim3Solver::CheckInliers()
    {
-      vector<cv::Mat> vP1im2, vP2im1;
-      Project(mvX3Dc2, vP2im1, mT12i, mK1);
-      Project(mvX3Dc1, vP1im2, mT21i, mK2);
+      Project(mvX3Dc2, mvP2im1, mT12i, mK1);
+      Project(mvX3Dc1, mvP1im2, mT21i, mK2);
 
       mnInliersi = 0;
 
       for (size_t i = 0; i < mvP1im1.size(); i++)
       {
-         cv::Mat dist1 = mvP1im1[i] - vP2im1[i];
-         cv::Mat dist2 = vP1im2[i] - mvP2im2[i];
+         const float * p1im1 = mvP1im1[i].ptr<float>();
+         const float * p2im1 = mvP2im1[i].ptr<float>();
+         const float * p1im2 = mvP1im2[i].ptr<float>();
+         const float * p2im2 = mvP2im2[i].ptr<float>();
 
-         const float err1 = dist1.dot(dist1);
-         const float err2 = dist2.dot(dist2);
+         const float dx1 = p1im1[0] - p2im1[0];
+         const float dy1 = p1im1[1] - p2im1[1];
+         const float dx2 = p1im2[0] - p2im2[0];
+         const float dy2 = p1im2[1] - p2im2[1];
+
+         const float err1 = dx1 * dx1 + dy1 * dy1;
+         const float err2 = dx2 * dx2 + dy2 * dy2;
 
          if (err1 < mvnMaxError1[i] && err2 < mvnMaxError2[i])
          {
@@ -379,24 +409,27 @@ namespace ORB_SLAM2_TEAM
 
    void Sim3Solver::Project(const vector<cv::Mat> &vP3Dw, vector<cv::Mat> &vP2D, cv::Mat Tcw, cv::Mat K)
    {
-      cv::Mat Rcw = Tcw.rowRange(0, 3).colRange(0, 3);
-      cv::Mat tcw = Tcw.rowRange(0, 3).col(3);
+      const cv::Matx44f T(Tcw);
       const float &fx = K.at<float>(0, 0);
       const float &fy = K.at<float>(1, 1);
       const float &cx = K.at<float>(0, 2);
       const float &cy = K.at<float>(1, 2);
 
-      vP2D.clear();
-      vP2D.reserve(vP3Dw.size());
+      // the projections of the previous iteration are overwritten, so the vector keeps its matrices
+      vP2D.resize(vP3Dw.size());
 
       for (size_t i = 0, iend = vP3Dw.size(); i < iend; i++)
       {
-         cv::Mat P3Dc = Rcw * vP3Dw[i] + tcw;
-         const float invz = 1 / (P3Dc.at<float>(2));
-         const float x = P3Dc.at<float>(0)*invz;
-         const float y = P3Dc.at<float>(1)*invz;
-
-         vP2D.push_back((cv::Mat_<float>(2, 1) << fx * x + cx, fy*y + cy));
+         const float * Pw = vP3Dw[i].ptr<float>();
+         const float X = T(0, 0) * Pw[0] + T(0, 1) * Pw[1] + T(0, 2) * Pw[2] + T(0, 3);
+         const float Y = T(1, 0) * Pw[0] + T(1, 1) * Pw[1] + T(1, 2) * Pw[2] + T(1, 3);
+         const float Z = T(2, 0) * Pw[0] + T(2, 1) * Pw[1] + T(2, 2) * Pw[2] + T(2, 3);
+         const float invz = 1 / Z;
+
+         vP2D[i].create(2, 1, CV_32F);
+         float * p = vP2D[i].ptr<float>();
+         p[0] = fx * X * invz + cx;
+         p[1] = fy * Y * invz + cy;
       }
    }
 
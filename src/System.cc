@@ -125,14 +125,14 @@ namespace ORB_SLAM2_TEAM
          throw exception("ERROR: you called TrackStereo but input sensor was not set to STEREO.");
       }
 
-      Frame & f = mpTracker->GrabImageStereo(imLeft, imRight, timestamp);
+      Frame * pFrame = mpTracker->GrabImageStereo(imLeft, imRight, timestamp);
 
       // this is disabled until it is needed again
       //unique_lock<mutex> lock2(mMutexState);
       //mTrackingState = mpTracker->mState;
       //mTrackedMapPoints = mpTracker->mCurrentFrame.mvpMapPoints;
       //mTrackedKeyPointsUn = mpTracker->mCurrentFrame.mvKeysUn;
-      return f.mTcw.clone();
+      return pFrame && pFrame->HasPose() ? pFrame->GetPose() : cv::Mat();
    }
 
    cv::Mat System::TrackRGBD(const cv::Mat &im, const cv::Mat &depthmap, const double &timestamp)
@@ -142,14 +142,14 @@ namespace ORB_SLAM2_TEAM
          throw exception("ERROR: you called TrackRGBD but input sensor was not set to RGBD.");
       }
 
-      Frame & f = mpTracker->GrabImageRGBD(im, depthmap, timestamp);
+      Frame * pFrame = mpTracker->GrabImageRGBD(im, depthmap, timestamp);
 
       // this is disabled until it is needed again
       //unique_lock<mutex> lock2(mMutexState);
       //mTrackingState = mpTracker->mState;
       //mTrackedMapPoints = mpTracker->mCurrentFrame.mvpMapPoints;
       //mTrackedKeyPointsUn = mpTracker->mCurrentFrame.mvKeysUn;
-      return f.mTcw.clone();
+      return pFrame && pFrame->HasPose() ? pFrame->GetPose() : cv::Mat();
    }
 
    cv::Mat System::TrackMonocular(const cv::Mat &im, const double &timestamp)
@@ -160,14 +160,14 @@ namespace ORB_SLAM2_TEAM
          exit(-1);
       }
 
-      Frame & f = mpTracker->GrabImageMonocular(im, timestamp);
+      Frame * pFrame = mpTracker->GrabImageMonocular(im, timestamp);
 
       // this is disabled until it is needed again
       //unique_lock<mutex> lock2(mMutexState);
       //mTrackingState = mpTracker->mState;
       //mTrackedMapPoints = mpTracker->mCurrentFrame.mvpMapPoints;
       //mTrackedKeyPointsUn = mpTracker->mCurrentFrame.mvKeysUn;
-      return f.mTcw.clone();
+      return pFrame && pFrame->HasPose() ? pFrame->GetPose() : cv::Mat();
    }
 
    bool System::MapChanged()
@@ -185,6 +185,9 @@ namespace ORB_SLAM2_TEAM
 
    void System::Shutdown()
    {
+      // the last images are still in the pipeline
+      mpTracker->Flush();
+
       if (mptViewer)
       {
          //uncomment to force the viewer to close
@@ -27,6 +27,7 @@
 #include <opencv2/features2d/features2d.hpp>
 
 #include "ORBmatcher.h"
+#include "HammingDistance.h"
 #include "Converter.h"
 #include "Optimizer.h"
 #include "PnPsolver.h"
@@ -36,6 +37,7 @@
 #include <iostream>
 #include <mutex>
 #include <cmath>
+#include <algorithm>
 
 using namespace std;
 
@@ -69,6 +71,10 @@ namespace ORB_SLAM2_TEAM
       mKeyFrameIdSpan(0),
       mNextMapPointId(0),
       mMapPointIdSpan(0),
+      mPipelineGeneration(0),
+      mbFrontEndBusy(false),
+      mbFinishFrontEnd(false),
+      mQuantityFramesDropped(0),
       mMapperObserver(this),
       pivotCal(4, 4, CV_32F),
       mBaseline(cv::Mat::eye(4, 4, CV_32F)),
@@ -82,11 +88,29 @@ namespace ORB_SLAM2_TEAM
       LoadCameraParameters(fSettings, sensor);
       Login();
       mMapper.AddObserver(&mMapperObserver);
+      mMapReader = mMapper.GetMap().RegisterReader();
+
+      if (mbPipeline)
+         mFrontEndThread = thread(&Tracking::RunFrontEnd, this);
    }
 
    Tracking::~Tracking()
    {
+      if (mFrontEndThread.joinable())
+      {
+         {
+            unique_lock<mutex> lock(mMutexPipeline);
+            mbFinishFrontEnd = true;
+         }
+         mCondPipeline.notify_all();
+         mFrontEndThread.join();
+      }
+
+      mMapper.GetMap().UnregisterReader(mMapReader);
       mMapper.LogoutTracker(mId);
+
+      for (PnPsolver * pSolver : mvpPnPsolvers)
+         delete pSolver;
    }
 
    void Tracking::PrintPrefix(ostream & out)
@@ -256,13 +280,18 @@ namespace ORB_SLAM2_TEAM
       int fIniThFAST = fSettings["ORBextractor.iniThFAST"];
       int fMinThFAST = fSettings["ORBextractor.minThFAST"];
 
-      mpORBextractorLeft = new ORBextractor(nFeatures, fScaleFactor, nLevels, fIniThFAST, fMinThFAST);
+      // optional, the stereo images need at least 2 threads to be extracted at the same time
+      int nThreads = fSettings["ORBextractor.nThreads"];
+      if (nThreads < 1)
+         nThreads = sensor == STEREO ? 2 : 1;
+
+      mpORBextractorLeft = new ORBextractor(nFeatures, fScaleFactor, nLevels, fIniThFAST, fMinThFAST, nThreads);
 
       if (sensor == STEREO)
-         mpORBextractorRight = new ORBextractor(nFeatures, fScaleFactor, nLevels, fIniThFAST, fMinThFAST);
+         mpORBextractorRight = new ORBextractor(nFeatures, fScaleFactor, nLevels, fIniThFAST, fMinThFAST, nThreads);
 
       if (sensor == MONOCULAR)
-         mpIniORBextractor = new ORBextractor(2 * nFeatures, fScaleFactor, nLevels, fIniThFAST, fMinThFAST);
+         mpIniORBextractor = new ORBextractor(2 * nFeatures, fScaleFactor, nLevels, fIniThFAST, fMinThFAST, nThreads);
 
       ss << endl << "ORB Extractor Parameters: " << endl;
       ss << "- Number of Features: " << nFeatures << endl;
@@ -270,6 +299,24 @@ namespace ORB_SLAM2_TEAM
       ss << "- Scale Factor: " << fScaleFactor << endl;
       ss << "- Initial Fast Threshold: " << fIniThFAST << endl;
       ss << "- Minimum Fast Threshold: " << fMinThFAST << endl;
+      ss << "- Threads: " << nThreads << endl;
+      ss << "- Descriptor distance: " << HammingDistance::InstructionSet() << endl;
+
+      // optional, builds the Frame of the next image while the current Frame is tracked
+      int nPipeline = fSettings["Tracking.pipeline"];
+      mbPipeline = nPipeline != 0;
+      int nDropFrames = fSettings["Tracking.pipelineDropFrames"];
+      mbPipelineDropFrames = nDropFrames != 0;
+      int nQueueSize = fSettings["Tracking.pipelineQueueSize"];
+      mPipelineQueueSize = nQueueSize < 1 ? 2 : nQueueSize;
+
+      ss << endl << "Tracking Parameters: " << endl;
+      ss << "- Pipeline: " << (mbPipeline ? "ENABLED" : "DISABLED") << endl;
+      if (mbPipeline)
+      {
+         ss << "- Drop Frames: " << (mbPipelineDropFrames ? "ENABLED" : "DISABLED") << endl;
+         ss << "- Queue Size: " << mPipelineQueueSize << endl;
+      }
 
       if (sensor == RGBD)
       {
@@ -378,136 +425,251 @@ namespace ORB_SLAM2_TEAM
       mpViewer = pViewer;
    }
 
-   Frame & Tracking::GrabImageStereo(const cv::Mat & imRectLeft, const cv::Mat & imRectRight, const double & timestamp)
+   Frame * Tracking::GrabImageStereo(const cv::Mat & imRectLeft, const cv::Mat & imRectRight, const double & timestamp)
+   {
+      FrameRequest request;
+      request.imLeft = imRectLeft;
+      request.imRight = imRectRight;
+      request.timestamp = timestamp;
+      return GrabImage(request);
+   }
+
+
+   Frame * Tracking::GrabImageRGBD(const cv::Mat & imRGB, const cv::Mat & imD, const double & timestamp)
+   {
+      FrameRequest request;
+      request.imLeft = imRGB;
+      request.imRight = imD;
+      request.timestamp = timestamp;
+      return GrabImage(request);
+   }
+
+
+   Frame * Tracking::GrabImageMonocular(const cv::Mat & im, const double & timestamp)
+   {
+      FrameRequest request;
+      request.imLeft = im;
+      request.timestamp = timestamp;
+      return GrabImage(request);
+   }
+
+   Frame * Tracking::GrabImage(FrameRequest & request)
    {
       time_type startTrack = GetNow();
       CheckModeChange();
       CheckReset();
 
-      cv::Mat imGray = imRectLeft;
-      cv::Mat imGrayRight = imRectRight;
-
-      if (imGray.channels() == 3)
+      cv::Mat imGray;
+      if (mbPipeline)
       {
-         if (mbRGB)
-         {
-            cvtColor(imGray, imGray, CV_RGB2GRAY);
-            cvtColor(imGrayRight, imGrayRight, CV_RGB2GRAY);
-         }
-         else
-         {
-            cvtColor(imGray, imGray, CV_BGR2GRAY);
-            cvtColor(imGrayRight, imGrayRight, CV_BGR2GRAY);
-         }
+         if (!NextPipelinedFrame(request, mCurrentFrame, imGray))
+            return NULL;
       }
-      else if (imGray.channels() == 4)
+      else
       {
-         if (mbRGB)
-         {
-            cvtColor(imGray, imGray, CV_RGBA2GRAY);
-            cvtColor(imGrayRight, imGrayRight, CV_RGBA2GRAY);
-         }
-         else
-         {
-            cvtColor(imGray, imGray, CV_BGRA2GRAY);
-            cvtColor(imGrayRight, imGrayRight, CV_BGRA2GRAY);
-         }
+         BuildFrame(request, mCurrentFrame, imGray);
       }
 
-      if (mRectify)
-      {
-         cv::Mat imLeftRect, imRightRect;
-         cv::remap(imGray, imLeftRect, mRectMapLeft1, mRectMapLeft2, cv::INTER_LINEAR);
-         cv::remap(imGrayRight, imRightRect, mRectMapRight1, mRectMapRight2, cv::INTER_LINEAR);
-         mCurrentFrame = Frame(imLeftRect, imRightRect, timestamp, mpORBextractorLeft, mpORBextractorRight, &mFC);
-         Track(imLeftRect);
-      }
-      else
+      TrackCurrentFrame(imGray, startTrack);
+      return &mCurrentFrame;
+   }
+
+   void Tracking::Flush()
+   {
+      if (!mbPipeline)
+         return;
+
+      while (true)
       {
-         mCurrentFrame = Frame(imGray, imGrayRight, timestamp, mpORBextractorLeft, mpORBextractorRight, &mFC);
-         Track(imGray);
+         time_type startTrack = GetNow();
+         list<BuiltFrame> next;
+         {
+            unique_lock<mutex> lock(mMutexPipeline);
+            mCondPipeline.wait(lock, [this]
+            {
+               return !mBuiltFrames.empty() || (mPipelineRequests.empty() && !mbFrontEndBusy);
+            });
+
+            if (mBuiltFrames.empty())
+               return;
+
+            next.splice(next.begin(), mBuiltFrames, mBuiltFrames.begin());
+         }
+
+         cv::Mat imGray;
+         TakeBuiltFrame(next.front(), mCurrentFrame, imGray);
+         TrackCurrentFrame(imGray, startTrack);
       }
+   }
 
+   void Tracking::TrackCurrentFrame(cv::Mat & imGray, const time_type startTrack)
+   {
+      Track(imGray);
 
       mMetricsTrackDuration.push_back(Duration(GetNow(), startTrack));
       mMetricsTrackKeyFramesInMap.push_back(mMapper.GetMap().KeyFramesInMap());
       mMetricsTrackMapPointsInMap.push_back(mMapper.GetMap().MapPointsInMap());
-      return mCurrentFrame;
    }
 
-
-   Frame & Tracking::GrabImageRGBD(const cv::Mat & imRGB, const cv::Mat & imD, const double & timestamp)
+   void Tracking::ConvertToGray(cv::Mat & im)
    {
-      time_type startTrack = GetNow();
-      CheckModeChange();
-      CheckReset();
-
-      cv::Mat imGray = imRGB;
-      cv::Mat imDepth = imD;
-
-      if (imGray.channels() == 3)
+      if (im.channels() == 3)
       {
          if (mbRGB)
-            cvtColor(imGray, imGray, CV_RGB2GRAY);
+            cvtColor(im, im, CV_RGB2GRAY);
          else
-            cvtColor(imGray, imGray, CV_BGR2GRAY);
+            cvtColor(im, im, CV_BGR2GRAY);
       }
-      else if (imGray.channels() == 4)
+      else if (im.channels() == 4)
       {
          if (mbRGB)
-            cvtColor(imGray, imGray, CV_RGBA2GRAY);
+            cvtColor(im, im, CV_RGBA2GRAY);
          else
-            cvtColor(imGray, imGray, CV_BGRA2GRAY);
+            cvtColor(im, im, CV_BGRA2GRAY);
       }
+   }
 
-      if ((fabs(mDepthMapFactor - 1.0f) > 1e-5) || imDepth.type() != CV_32F)
-         imDepth.convertTo(imDepth, CV_32F, mDepthMapFactor);
+   void Tracking::BuildFrame(const FrameRequest & request, Frame & frame, cv::Mat & imGray)
+   {
+      imGray = request.imLeft;
+      ConvertToGray(imGray);
 
-      mCurrentFrame = Frame(imGray, imDepth, timestamp, mpORBextractorLeft, &mFC);
+      if (mSensor == STEREO)
+      {
+         cv::Mat imGrayRight = request.imRight;
+         ConvertToGray(imGrayRight);
 
-      Track(imGray);
+         if (mRectify)
+         {
+            cv::Mat imLeftRect, imRightRect;
+            cv::remap(imGray, imLeftRect, mRectMapLeft1, mRectMapLeft2, cv::INTER_LINEAR);
+            cv::remap(imGrayRight, imRightRect, mRectMapRight1, mRectMapRight2, cv::INTER_LINEAR);
+            imGray = imLeftRect;
+            imGrayRight = imRightRect;
+         }
 
-      mMetricsTrackDuration.push_back(Duration(GetNow(), startTrack));
-      mMetricsTrackKeyFramesInMap.push_back(mMapper.GetMap().KeyFramesInMap());
-      mMetricsTrackMapPointsInMap.push_back(mMapper.GetMap().MapPointsInMap());
-      return mCurrentFrame;
-   }
+         frame = Frame(imGray, imGrayRight, request.timestamp, mpORBextractorLeft, mpORBextractorRight, &mFC);
+      }
+      else if (mSensor == RGBD)
+      {
+         cv::Mat imDepth = request.imRight;
+         if ((fabs(mDepthMapFactor - 1.0f) > 1e-5) || imDepth.type() != CV_32F)
+            imDepth.convertTo(imDepth, CV_32F, mDepthMapFactor);
 
+         frame = Frame(imGray, imDepth, request.timestamp, mpORBextractorLeft, &mFC);
+      }
+      else if (!mMapper.GetInitialized())
+         frame = Frame(imGray, request.timestamp, mpIniORBextractor, &mFC);
+      else
+         frame = Frame(imGray, request.timestamp, mpORBextractorLeft, &mFC);
+   }
 
-   Frame & Tracking::GrabImageMonocular(const cv::Mat & im, const double & timestamp)
+   bool Tracking::NextPipelinedFrame(FrameRequest & request, Frame & frame, cv::Mat & imGray)
    {
-      time_type startTrack = GetNow();
-      CheckModeChange();
-      CheckReset();
+      // the caller may reuse its image buffers after this returns
+      request.imLeft = request.imLeft.clone();
+      request.imRight = request.imRight.clone();
 
-      cv::Mat imGray = im;
-
-      if (imGray.channels() == 3)
+      list<BuiltFrame> next;
       {
-         if (mbRGB)
-            cvtColor(imGray, imGray, CV_RGB2GRAY);
+         unique_lock<mutex> lock(mMutexPipeline);
+
+         if (mbPipelineDropFrames)
+         {
+            // never wait for the front-end, drop the oldest images instead
+            while (!mPipelineRequests.empty() && mPipelineRequests.size() >= mPipelineQueueSize)
+            {
+               mPipelineRequests.pop_front();
+               ++mQuantityFramesDropped;
+            }
+         }
+         mPipelineRequests.push_back(request);
+         mCondPipeline.notify_all();
+
+         if (mbPipelineDropFrames)
+         {
+            // track the newest Frame, older ones are out of date
+            while (mBuiltFrames.size() > 1)
+            {
+               mBuiltFrames.pop_front();
+               ++mQuantityFramesDropped;
+            }
+         }
          else
-            cvtColor(imGray, imGray, CV_BGR2GRAY);
+         {
+            // only the image of this call may still be in the front-end, so Frames are tracked one image behind
+            mCondPipeline.wait(lock, [this] 
+            { 
+               return !mBuiltFrames.empty() || mPipelineRequests.size() + (mbFrontEndBusy ? 1 : 0) <= 1;
+            });
+         }
+
+         if (mBuiltFrames.empty())
+            return false;
+
+         next.splice(next.begin(), mBuiltFrames, mBuiltFrames.begin());
       }
-      else if (imGray.channels() == 4)
+
+      TakeBuiltFrame(next.front(), frame, imGray);
+      return true;
+   }
+
+   void Tracking::TakeBuiltFrame(BuiltFrame & built, Frame & frame, cv::Mat & imGray)
+   {
+      if (built.error)
+         rethrow_exception(built.error);
+
+      // a monocular Frame built ahead of the map initialization has the extractor of the other state
+      if (mSensor == MONOCULAR && built.frame.mpORBextractorLeft != (mMapper.GetInitialized() ? mpORBextractorLeft : mpIniORBextractor))
       {
-         if (mbRGB)
-            cvtColor(imGray, imGray, CV_RGBA2GRAY);
-         else
-            cvtColor(imGray, imGray, CV_BGRA2GRAY);
+         BuildFrame(built.request, frame, imGray);
+         return;
       }
 
-      if (!mMapper.GetInitialized())
-         mCurrentFrame = Frame(imGray, timestamp, mpIniORBextractor, &mFC);
-      else
-         mCurrentFrame = Frame(imGray, timestamp, mpORBextractorLeft, &mFC);
+      frame = built.frame;
+      imGray = built.imGray;
+   }
 
-      Track(imGray);
+   void Tracking::RunFrontEnd()
+   {
+      unique_lock<mutex> lock(mMutexPipeline);
+      while (true)
+      {
+         mCondPipeline.wait(lock, [this] { return mbFinishFrontEnd || !mPipelineRequests.empty(); });
+         if (mbFinishFrontEnd)
+            return;
 
-      mMetricsTrackDuration.push_back(Duration(GetNow(), startTrack));
-      mMetricsTrackKeyFramesInMap.push_back(mMapper.GetMap().KeyFramesInMap());
-      mMetricsTrackMapPointsInMap.push_back(mMapper.GetMap().MapPointsInMap());
-      return mCurrentFrame;
+         FrameRequest request = mPipelineRequests.front();
+         mPipelineRequests.pop_front();
+         mbFrontEndBusy = true;
+
+         list<BuiltFrame> built(1);
+         built.front().request = request;
+         built.front().generation = mPipelineGeneration;
+         lock.unlock();
+
+         try
+         {
+            BuildFrame(request, built.front().frame, built.front().imGray);
+         }
+         catch (...)
+         {
+            built.front().error = current_exception();
+         }
+
+         lock.lock();
+         mbFrontEndBusy = false;
+         if (built.front().generation == mPipelineGeneration)
+         {
+            if (mbPipelineDropFrames && mBuiltFrames.size() >= mPipelineQueueSize)
+            {
+               mBuiltFrames.pop_front();
+               ++mQuantityFramesDropped;
+            }
+            mBuiltFrames.splice(mBuiltFrames.end(), built);
+         }
+         mCondPipeline.notify_all();
+      }
    }
 
    void Tracking::Track(cv::Mat & imGray)
@@ -521,6 +683,18 @@ namespace ORB_SLAM2_TEAM
       unique_lock<mutex> lock(mMapper.GetMutexMapUpdate());
       Print("map is locked");
 
+      // MapPoints erased before the epoch are not held by this tracker after the last frame is checked
+      Map & theMap = mMapper.GetMap();
+      const unsigned long epoch = theMap.GetEpoch();
+      if (mState == TRACKING_OK && mMapper.GetInitialized())
+      {
+         // Mapping might have changed some MapPoints tracked in last frame
+         CheckReplacedInLastFrame();
+      }
+      mvpLocalMapPoints.clear();
+      theMap.Quiescent(mMapReader, epoch);
+      theMap.ReclaimMapPoints();
+
       if (!mMapper.GetInitialized())
       {
          if (0 == mId)
@@ -555,9 +729,6 @@ namespace ORB_SLAM2_TEAM
          // Initial camera pose estimation using motion model or relocalization (if tracking is lost)
          if (mState == TRACKING_OK)
          {
-            // Mapping might have changed some MapPoints tracked in last frame
-            CheckReplacedInLastFrame();
-
             if (mVelocity.empty() || mQuantityFramesSinceReloc < 2)
             {
                bOK = TrackReferenceKeyFrame();
@@ -609,21 +780,18 @@ namespace ORB_SLAM2_TEAM
          if (bOK)
          {
             // Update motion model
-            if (!mLastFrame.mTcw.empty())
+            if (mLastFrame.HasPose())
             {
-               cv::Mat LastTwc = cv::Mat::eye(4, 4, CV_32F);
-               mLastFrame.GetRotationInverse().copyTo(LastTwc.rowRange(0, 3).colRange(0, 3));
-               mLastFrame.GetCameraCenter().copyTo(LastTwc.rowRange(0, 3).col(3));
-               mVelocity = mCurrentFrame.mTcw*LastTwc;
+               mVelocity = cv::Mat(mCurrentFrame.GetPoseMatx() * mLastFrame.GetPoseInverseMatx());
             }
             else
             {
                mVelocity = cv::Mat();
             }
 
-            mMapper.UpdatePose(mId, mCurrentFrame.mTcw);
+            mMapper.UpdatePose(mId, mCurrentFrame.GetPose());
             if (mpMapDrawer)
-               mpMapDrawer->SetCurrentCameraPose(mCurrentFrame.mTcw);
+               mpMapDrawer->SetCurrentCameraPose(mCurrentFrame.GetPose());
 
             // Check if we need to insert a new keyframe
             if (NeedNewKeyFrame())
@@ -662,9 +830,9 @@ namespace ORB_SLAM2_TEAM
       // Store frame pose information to retrieve the complete camera trajectory afterwards.
       if (mState == TRACKING_OK)
       {
-         cv::Mat Tcr = mCurrentFrame.mTcw*mCurrentFrame.mpReferenceKF->GetPoseInverse();
+         cv::Mat Tcr(mCurrentFrame.GetPoseMatx() * mCurrentFrame.mpReferenceKF->GetPoseInverseMatx());
          mlRelativeFramePoses.push_back(Tcr);
-         mlAbsoluteFramePoses.push_back(mCurrentFrame.mTcw.clone());
+         mlAbsoluteFramePoses.push_back(mCurrentFrame.GetPose());
          mlpReferenceKFs.push_back(mCurrentFrame.mpReferenceKF);
          mlFrameTimes.push_back(mCurrentFrame.mTimeStamp);
          mlbLost.push_back(mState == TRACKING_LOST);
@@ -730,7 +898,7 @@ namespace ORB_SLAM2_TEAM
 
          if (mpMapDrawer)
          {
-            mpMapDrawer->SetCurrentCameraPose(mCurrentFrame.mTcw);
+            mpMapDrawer->SetCurrentCameraPose(mCurrentFrame.GetPose());
             mpMapDrawer->SetReferenceMapPoints(mvpLocalMapPoints);
          }
       }
@@ -747,9 +915,9 @@ namespace ORB_SLAM2_TEAM
          {
             mInitialFrame = Frame(mCurrentFrame);
             mLastFrame = Frame(mCurrentFrame);
-            mvbPrevMatched.resize(mCurrentFrame.mvKeysUn.size());
-            for (size_t i = 0; i < mCurrentFrame.mvKeysUn.size(); i++)
-               mvbPrevMatched[i] = mCurrentFrame.mvKeysUn[i].pt;
+            mvbPrevMatched.resize(mCurrentFrame.mFeatures.Size());
+            for (size_t i = 0; i < mCurrentFrame.mFeatures.Size(); i++)
+               mvbPrevMatched[i] = cv::Point2f(mCurrentFrame.mFeatures.X(i), mCurrentFrame.mFeatures.Y(i));
 
             if (mpInitializer)
                delete mpInitializer;
@@ -983,7 +1151,7 @@ namespace ORB_SLAM2_TEAM
       }
 
       mCurrentFrame.mvpMapPoints = vpMapPointMatches;
-      mCurrentFrame.SetPose(mLastFrame.mTcw);
+      mCurrentFrame.SetPose(mLastFrame.GetPoseMatx());
 
       Optimizer::PoseOptimization(&mCurrentFrame);
 
@@ -1025,7 +1193,7 @@ namespace ORB_SLAM2_TEAM
       cv::Mat Tlr = mlRelativeFramePoses.back();
       mLastFrame.SetPose(Tlr*pRef->GetPose()); // rarely causes a cv::Exception in matmul, is pRef deleted? Was the pose changed by another thread?
 
-      mCurrentFrame.SetPose(mVelocity*mLastFrame.mTcw);
+      mCurrentFrame.SetPose(cv::Matx44f(mVelocity) * mLastFrame.GetPoseMatx());
 
       fill(mCurrentFrame.mvpMapPoints.begin(), mCurrentFrame.mvpMapPoints.end(), static_cast<MapPoint*>(NULL));
 
@@ -1236,23 +1404,34 @@ namespace ORB_SLAM2_TEAM
          }
       }
 
-      int nToMatch = 0;
+      WorkerPool & pool = mpORBextractorLeft->GetWorkerPool();
 
       // Project points in frame and check its visibility
-      for (vector<MapPoint*>::iterator vit = mvpLocalMapPoints.begin(), vend = mvpLocalMapPoints.end(); vit != vend; vit++)
+      // the local MapPoints are unique, so each chunk of them is projected independently
+      const size_t nLocal = mvpLocalMapPoints.size();
+      const size_t nChunks = min(nLocal, (size_t)pool.QuantityThreads() * 4);
+      vector<int> vnToMatch(nChunks, 0);
+      pool.ParallelFor(nChunks, [&](size_t iChunk)
       {
-         MapPoint* pMP = *vit;
-         if (pMP->mnLastFrameSeen == mCurrentFrame.mnId)
-            continue;
-         if (pMP->IsBad())
-            continue;
-         // Project (this fills MapPoint variables for matching)
-         if (mCurrentFrame.isInFrustum(pMP, 0.5))
+         for (size_t i = iChunk * nLocal / nChunks, iend = (iChunk + 1) * nLocal / nChunks; i < iend; i++)
          {
-            pMP->IncreaseVisible();
-            nToMatch++;
+            MapPoint* pMP = mvpLocalMapPoints[i];
+            if (pMP->mnLastFrameSeen == mCurrentFrame.mnId)
+               continue;
+            if (pMP->IsBad())
+               continue;
+            // Project (this fills MapPoint variables for matching)
+            if (mCurrentFrame.isInFrustum(pMP, 0.5))
+            {
+               pMP->IncreaseVisible();
+               vnToMatch[iChunk]++;
+            }
          }
-      }
+      });
+
+      int nToMatch = 0;
+      for (size_t i = 0; i < nChunks; i++)
+         nToMatch += vnToMatch[i];
 
       if (nToMatch > 0)
       {
@@ -1263,7 +1442,7 @@ namespace ORB_SLAM2_TEAM
          // If the camera has been relocalised recently, perform a coarser search
          if (mQuantityFramesSinceReloc < 2)
             th = 5;
-         matcher.SearchByProjection(mCurrentFrame, mvpLocalMapPoints, th);
+         matcher.SearchByProjection(mCurrentFrame, mvpLocalMapPoints, pool, th);
       }
       Print("end SearchLocalPoints");
    }
@@ -1321,9 +1500,9 @@ namespace ORB_SLAM2_TEAM
             }
             else
             {
-               const map<KeyFrame *, size_t> observations = pMP->GetObservations();
-               for (map<KeyFrame *, size_t>::const_iterator it = observations.begin(), itend = observations.end(); it != itend; it++)
-                  keyframeVotes[it->first]++;
+               pMP->ForEachObservation([&keyframeVotes](KeyFrame * pKF, size_t idx) {
+                  keyframeVotes[pKF]++;
+               });
             }
          }
       }
@@ -1436,64 +1615,81 @@ namespace ORB_SLAM2_TEAM
 
       // We perform first an ORB matching with each candidate
       // If enough matches are found we setup a PnP solver
+      // The candidates are independent, so they are matched on the worker pool
       ORBmatcher matcher(0.75, true);
+      WorkerPool & pool = mpORBextractorLeft->GetWorkerPool();
 
-      vector<PnPsolver*> vpPnPsolvers;
-      vpPnPsolvers.resize(nCandidateKFs);
+      while (mvpPnPsolvers.size() < (size_t)nCandidateKFs)
+         mvpPnPsolvers.push_back(new PnPsolver());
 
       vector<vector<MapPoint*> > vvpMapPointMatches;
       vvpMapPointMatches.resize(nCandidateKFs);
 
-      vector<bool> vbDiscarded;
-      vbDiscarded.resize(nCandidateKFs);
-
-      int nCandidates = 0;
+      // char instead of bool, the elements are written by different threads
+      vector<char> vbDiscarded(nCandidateKFs, false);
 
-      for (int i = 0; i < nCandidateKFs; i++)
+      pool.ParallelFor(nCandidateKFs, [&](size_t i)
       {
          KeyFrame * pKF = vpCandidateKFs[i];
          if (pKF->IsBad())
+         {
             vbDiscarded[i] = true;
-         else
+            return;
+         }
+
+         int nmatches = matcher.SearchByBoW(pKF, mCurrentFrame, vvpMapPointMatches[i]);
+         if (nmatches < 15)
          {
-            int nmatches = matcher.SearchByBoW(pKF, mCurrentFrame, vvpMapPointMatches[i]);
-            if (nmatches < 15)
-            {
-               vbDiscarded[i] = true;
-               continue;
-            }
-            else
-            {
-               PnPsolver* pSolver = new PnPsolver(mCurrentFrame, vvpMapPointMatches[i]);
-               pSolver->SetRansacParameters(0.99, 10, 300, 4, 0.5, 5.991);
-               vpPnPsolvers[i] = pSolver;
-               nCandidates++;
-            }
+            vbDiscarded[i] = true;
+            return;
          }
-      }
+
+         PnPsolver* pSolver = mvpPnPsolvers[i];
+         pSolver->Initialize(mCurrentFrame, vvpMapPointMatches[i]);
+         pSolver->SetRansacParameters(0.99, 10, 300, 4, 0.5, 5.991);
+         pSolver->SetSeed((unsigned int)(mCurrentFrame.mnId ^ pKF->id));
+      });
+
+      int nCandidates = 0;
+      for (int i = 0; i < nCandidateKFs; i++)
+         if (!vbDiscarded[i])
+            nCandidates++;
 
       // Alternatively perform some iterations of P4P RANSAC
       // Until we found a camera pose supported by enough inliers
+      // Each round runs the RANSAC iterations of all candidates on the worker pool,
+      // then the poses found are optimized in candidate order, because that changes mCurrentFrame
       bool bMatch = false;
       ORBmatcher matcher2(0.9, true);
 
+      vector<cv::Mat> vTcw(nCandidateKFs);
+      vector<vector<bool> > vvbInliers(nCandidateKFs);
+      vector<int> vnInliers(nCandidateKFs);
+      vector<char> vbNoMore(nCandidateKFs);
+
       while (nCandidates > 0 && !bMatch)
       {
-         for (int i = 0; i < nCandidateKFs; i++)
+         pool.ParallelFor(nCandidateKFs, [&](size_t i)
          {
             if (vbDiscarded[i])
-               continue;
+               return;
 
             // Perform 5 Ransac Iterations
-            vector<bool> vbInliers;
-            int nInliers;
             bool bNoMore;
+            vTcw[i] = mvpPnPsolvers[i]->iterate(5, bNoMore, vvbInliers[i], vnInliers[i]);
+            vbNoMore[i] = bNoMore;
+         });
+
+         for (int i = 0; i < nCandidateKFs; i++)
+         {
+            if (vbDiscarded[i])
+               continue;
 
-            PnPsolver* pSolver = vpPnPsolvers[i];
-            cv::Mat Tcw = pSolver->iterate(5, bNoMore, vbInliers, nInliers);
+            const vector<bool> & vbInliers = vvbInliers[i];
+            cv::Mat & Tcw = vTcw[i];
 
             // If Ransac reachs max. iterations discard keyframe
-            if (bNoMore)
+            if (vbNoMore[i])
             {
                vbDiscarded[i] = true;
                nCandidates--;
@@ -1502,7 +1698,7 @@ namespace ORB_SLAM2_TEAM
             // If a Camera Pose is computed, optimize
             if (!Tcw.empty())
             {
-               Tcw.copyTo(mCurrentFrame.mTcw);
+               mCurrentFrame.SetPose(Tcw);
 
                set<MapPoint*> sFound;
 
@@ -1636,6 +1832,16 @@ namespace ORB_SLAM2_TEAM
 
    void Tracking::CheckModeChange()
    {
+      bool bModeChange;
+      {
+         unique_lock<mutex> lock(mMutexMode);
+         bModeChange = mbActivateLocalizationMode || mbDeactivateLocalizationMode;
+      }
+
+      // images grabbed before the mode change are tracked in the previous mode
+      if (bModeChange)
+         Flush();
+
       unique_lock<mutex> lock(mMutexMode);
       if (mbActivateLocalizationMode)
       {
@@ -1678,7 +1884,6 @@ namespace ORB_SLAM2_TEAM
       if (sensorType != MONOCULAR)
       {
          vector<pair<float, int> > vDepthIdx;
-         currentFrame.UpdatePoseMatrices();
 
          vDepthIdx.reserve(currentFrame.N);
          for (size_t i = 0; i < currentFrame.N; i++)
@@ -1814,7 +2019,16 @@ namespace ORB_SLAM2_TEAM
       mlFrameTimes.clear();
       mlbLost.clear();
 
-      Frame::nNextId = 0;
+      {
+         // Frames in the pipeline were given ids before the reset
+         // the front-end reads the generation under the same lock, so a Frame with the new generation has a new id
+         unique_lock<mutex> lock(mMutexPipeline);
+         ++mPipelineGeneration;
+         mBuiltFrames.clear();
+         Frame::nNextId = 0;
+      }
+      mCondPipeline.notify_all();
+
       mState = NOT_INITIALIZED;
       mVelocity = cv::Mat(); //no velocity
 
@@ -1944,6 +2158,8 @@ namespace ORB_SLAM2_TEAM
       }
       stats["Frames Processed"] = mQuantityFramesProcessed;
       stats["Relocalizations"] = mQuantityRelocalizations;
+      if (mbPipeline)
+         stats["Frames Dropped"] = mQuantityFramesDropped;
       return stats;
    }
 
@@ -0,0 +1,126 @@
+/**
+* This file is part of ORB-SLAM2-TEAM.
+*
+* Copyright (C) 2018 Joe Bedard <mr dot joe dot bedard at gmail dot com>
+* For more information see <https://github.com/joebedard/ORB_SLAM2_TEAM>
+*
+* ORB-SLAM2-TEAM is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2-TEAM is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2-TEAM. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "WorkerPool.h"
+#include <algorithm>
+
+namespace ORB_SLAM2_TEAM
+{
+
+   WorkerPool::WorkerPool(unsigned int quantityThreads) :
+      mbFinish(false)
+   {
+      for (unsigned int i = 1; i < quantityThreads; i++)
+         mWorkers.push_back(thread(&WorkerPool::RunWorker, this));
+   }
+
+   WorkerPool::~WorkerPool()
+   {
+      {
+         unique_lock<mutex> lock(mMutexJobs);
+         mbFinish = true;
+      }
+      mCondJobs.notify_all();
+
+      for (thread & worker : mWorkers)
+         worker.join();
+   }
+
+   void WorkerPool::ParallelFor(size_t n, const function<void(size_t)> & task)
+   {
+      if (n == 0)
+         return;
+
+      if (mWorkers.empty() || n == 1)
+      {
+         for (size_t i = 0; i < n; i++)
+            task(i);
+         return;
+      }
+
+      Job job;
+      job.task = &task;
+      job.n = n;
+      job.next = 0;
+      job.active = 1;
+
+      unique_lock<mutex> lock(mMutexJobs);
+      mJobs.push_back(&job);
+      mCondJobs.notify_all();
+
+      RunJob(job, lock);
+
+      // workers can not pick up the job once it leaves the queue, wait for the ones still running it
+      list<Job *>::iterator it = find(mJobs.begin(), mJobs.end(), &job);
+      if (it != mJobs.end())
+         mJobs.erase(it);
+      job.active--;
+      mCondDone.wait(lock, [&job] { return job.active == 0; });
+
+      if (job.error)
+         rethrow_exception(job.error);
+   }
+
+   void WorkerPool::RunWorker()
+   {
+      unique_lock<mutex> lock(mMutexJobs);
+      while (true)
+      {
+         mCondJobs.wait(lock, [this] { return mbFinish || !mJobs.empty(); });
+         if (mbFinish)
+            return;
+
+         Job & job = *mJobs.front();
+         if (job.next >= job.n)
+         {
+            mJobs.pop_front();
+            continue;
+         }
+
+         job.active++;
+         RunJob(job, lock);
+         if (--job.active == 0)
+            mCondDone.notify_all();
+      }
+   }
+
+   void WorkerPool::RunJob(Job & job, unique_lock<mutex> & lock)
+   {
+      while (job.next < job.n)
+      {
+         size_t i = job.next++;
+         lock.unlock();
+         try
+         {
+            (*job.task)(i);
+         }
+         catch (...)
+         {
+            lock.lock();
+            if (!job.error)
+               job.error = current_exception();
+            job.next = job.n;
+            continue;
+         }
+         lock.lock();
+      }
+   }
+
+}